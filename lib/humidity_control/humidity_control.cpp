@@ -0,0 +1,949 @@
+#include "humidity_control.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+const char *automationReasonName(AutomationReason r) {
+  switch (r) {
+    case REASON_MQTT_DISCONNECTED: return "mqtt_disconnected";
+    case REASON_DISABLED: return "disabled";
+    case REASON_NO_HUMIDITY: return "no_humidity";
+    case REASON_WAITING_SAMPLES: return "waiting_samples";
+    case REASON_HUMIDIFYING: return "humidifying";
+    case REASON_BELOW_LOW: return "below_low";
+    case REASON_ABOVE_HIGH: return "above_high";
+    case REASON_WITHIN_BAND: return "within_band";
+    case REASON_MIN_ON_HOLD: return "min_on_hold";
+    case REASON_MIN_OFF_HOLD: return "min_off_hold";
+    case REASON_DUTY_LIMIT: return "duty_limit";
+    default: return "unknown";
+  }
+}
+
+static ControlDecision decision(ControlAction action, ControlCause cause) {
+  ControlDecision d;
+  d.action = action;
+  d.cause = cause;
+  return d;
+}
+
+void controlBand(const ControlInputs &in, float &low, float &high) {
+  low = in.target - in.hysteresis + in.earlyOn;
+  high = in.target + in.hysteresis - in.earlyOff;
+}
+
+ControlDecision controlDecide(const ControlInputs &in) {
+  const ControlAction off = in.relayOn ? CONTROL_TURN_OFF : CONTROL_KEEP;
+
+  // Without MQTT, we cannot receive external humidity reliably -> safe OFF
+  if (!in.linkUp) return decision(off, CAUSE_LINK_DOWN);
+  if (!in.enabled) return decision(off, CAUSE_DISABLED);
+  // No sensor yet -> safe OFF
+  if (isnan(in.humidity)) return decision(off, CAUSE_NO_HUMIDITY);
+  // Sensor went quiet while the link is up -> do not act on an old value
+  if (in.humiditySeen && in.humidityAgeMs > in.staleMs) return decision(off, CAUSE_STALE);
+
+  float low, high;
+  controlBand(in, low, high);
+
+  if (!in.relayOn && in.humidity < low) {
+    // Avoid turning ON based on a potentially stale retained value after reconnect.
+    if (in.samples < CONTROL_MIN_SAMPLES) return decision(CONTROL_KEEP, CAUSE_WAITING_SAMPLES);
+    return decision(CONTROL_TURN_ON, CAUSE_BELOW_LOW);
+  }
+  if (in.relayOn && in.humidity > high) return decision(CONTROL_TURN_OFF, CAUSE_ABOVE_HIGH);
+  return decision(CONTROL_KEEP, CAUSE_NONE);
+}
+
+AutomationReason controlReason(const ControlInputs &in) {
+  if (!in.linkUp) return REASON_MQTT_DISCONNECTED;
+  if (!in.enabled) return REASON_DISABLED;
+  if (isnan(in.humidity)) return REASON_NO_HUMIDITY;
+  if (in.samples < CONTROL_MIN_SAMPLES) return REASON_WAITING_SAMPLES;
+
+  float low, high;
+  controlBand(in, low, high);
+
+  if (in.relayOn) return REASON_HUMIDIFYING;
+  if (in.humidity < low) return REASON_BELOW_LOW;
+  if (in.humidity > high) return REASON_ABOVE_HIGH;
+  return REASON_WITHIN_BAND;
+}
+
+uint32_t controlNextWakeMs(const ControlInputs &in, uint32_t idleMs) {
+  if (!in.relayOn || !in.humiditySeen) return idleMs;
+  if (in.humidityAgeMs > in.staleMs) return 0;
+  const uint32_t left = in.staleMs - in.humidityAgeMs + 1U;
+  return left < idleMs ? left : idleMs;
+}
+
+bool humidityThrottled(uint32_t now, uint32_t lastAcceptMs, uint32_t minIntervalMs) {
+  return minIntervalMs > 0 && lastAcceptMs > 0 && (now - lastAcceptMs) < minIntervalMs;
+}
+
+const char *humidityFilterModeName(HumidityFilterMode m) {
+  switch (m) {
+    case FILTER_NONE: return "none";
+    case FILTER_MEDIAN: return "median";
+    case FILTER_EMA: return "ema";
+    case FILTER_TRIMMED_MEAN: return "trimmed_mean";
+    default: return "unknown";
+  }
+}
+
+void HumidityFilter::configure(const HumidityFilterConfig &cfg) {
+  cfg_ = cfg;
+  if (cfg_.window < 1) cfg_.window = 1;
+  if (cfg_.window > FILTER_WINDOW_MAX) cfg_.window = FILTER_WINDOW_MAX;
+  if (!(cfg_.emaAlpha > 0.0f) || cfg_.emaAlpha > 1.0f) cfg_.emaAlpha = 1.0f;
+  if (!(cfg_.maxRatePerMin > 0.0f)) cfg_.maxRatePerMin = 0.0f;
+  reset();
+}
+
+void HumidityFilter::reset() {
+  head_ = 0;
+  count_ = 0;
+  rejectedInRow_ = 0;
+  lastMs_ = 0;
+  value_ = NAN;
+}
+
+bool HumidityFilter::push(uint32_t now, float sample) {
+  if (isnan(sample)) return false;
+
+  if (count_ > 0 && cfg_.maxRatePerMin > 0.0f) {
+    // At least one second of slack so back-to-back duplicates never look infinitely fast.
+    const uint32_t dtMs = (now - lastMs_) < 1000U ? 1000U : (now - lastMs_);
+    const float allowed = cfg_.maxRatePerMin * (float)dtMs / 60000.0f;
+    if (fabsf(sample - last_) > allowed) {
+      if (++rejectedInRow_ < FILTER_REJECT_LIMIT) return false;
+      reset(); // persistent jump: follow it
+    }
+  }
+  rejectedInRow_ = 0;
+  last_ = sample;
+  lastMs_ = now;
+
+  ring_[head_] = sample;
+  head_ = (uint8_t)((head_ + 1) % cfg_.window);
+  if (count_ < cfg_.window) count_++;
+
+  if (cfg_.mode == FILTER_EMA) {
+    value_ = isnan(value_) ? sample : value_ + cfg_.emaAlpha * (sample - value_);
+    return true;
+  }
+  if (cfg_.mode != FILTER_MEDIAN && cfg_.mode != FILTER_TRIMMED_MEAN) {
+    value_ = sample;
+    return true;
+  }
+
+  float sorted[FILTER_WINDOW_MAX];
+  for (uint8_t i = 0; i < count_; i++) {
+    // insertion sort; the window is at most FILTER_WINDOW_MAX samples
+    const float v = ring_[i];
+    uint8_t j = i;
+    while (j > 0 && sorted[j - 1] > v) {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = v;
+  }
+
+  if (cfg_.mode == FILTER_MEDIAN) {
+    value_ = (count_ & 1) ? sorted[count_ / 2] : 0.5f * (sorted[count_ / 2 - 1] + sorted[count_ / 2]);
+  } else {
+    const uint8_t trim = count_ / 4;
+    float sum = 0.0f;
+    for (uint8_t i = trim; i < count_ - trim; i++) sum += sorted[i];
+    value_ = sum / (float)(count_ - 2 * trim);
+  }
+  return true;
+}
+
+const char *humidityFusionModeName(HumidityFusionMode m) {
+  switch (m) {
+    case FUSION_AVERAGE: return "average";
+    case FUSION_MIN: return "min";
+    case FUSION_MEDIAN: return "median";
+    default: return "unknown";
+  }
+}
+
+float fuseHumidity(const HumidityReading *readings, uint8_t count, uint32_t now, uint32_t staleMs,
+                   HumidityFusionMode mode, uint8_t *fresh) {
+  float values[HUMIDITY_SOURCES_MAX];
+  float weightSum = 0.0f;
+  float weighted = 0.0f;
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < count && i < HUMIDITY_SOURCES_MAX; i++) {
+    const HumidityReading &r = readings[i];
+    if (isnan(r.value) || !(r.weight > 0.0f) || (now - r.lastMs) > staleMs) continue;
+    // insertion sort, for min/median
+    uint8_t j = n++;
+    while (j > 0 && values[j - 1] > r.value) {
+      values[j] = values[j - 1];
+      j--;
+    }
+    values[j] = r.value;
+    weighted += r.value * r.weight;
+    weightSum += r.weight;
+  }
+  if (fresh) *fresh = n;
+  if (n == 0) return NAN;
+
+  switch (mode) {
+    case FUSION_MIN: return values[0];
+    case FUSION_MEDIAN: return (n & 1) ? values[n / 2] : 0.5f * (values[n / 2 - 1] + values[n / 2]);
+    case FUSION_AVERAGE:
+    default: return weighted / weightSum;
+  }
+}
+
+void RelayGuard::reset(uint32_t now, bool on) {
+  on_ = on;
+  changedMs_ = now; // a reboot does not cut the minimum off time short
+  lastMs_ = now;
+  bucketStartMs_ = now;
+  bucket_ = 0;
+  for (uint32_t &b : bucketOnMs_) b = 0;
+}
+
+void RelayGuard::restoreTotals(uint32_t switches, uint32_t onSeconds) {
+  switches_ = switches;
+  onMsTotal_ = (uint64_t)onSeconds * 1000U;
+}
+
+void RelayGuard::accrue(uint32_t ms) {
+  bucketOnMs_[bucket_] += ms;
+  onMsTotal_ += ms;
+}
+
+void RelayGuard::update(uint32_t now) {
+  uint32_t t = lastMs_;
+  lastMs_ = now;
+
+  if ((now - bucketStartMs_) >= DUTY_WINDOW_MS) {
+    // Not called for a whole window: the relay was in one state all along.
+    if (on_) onMsTotal_ += now - t;
+    for (uint32_t &b : bucketOnMs_) b = on_ ? DUTY_BUCKET_MS : 0;
+    bucketStartMs_ = now - (now - bucketStartMs_) % DUTY_BUCKET_MS;
+    bucketOnMs_[bucket_] = on_ ? now - bucketStartMs_ : 0;
+    return;
+  }
+  while ((now - bucketStartMs_) >= DUTY_BUCKET_MS) {
+    const uint32_t end = bucketStartMs_ + DUTY_BUCKET_MS;
+    if (on_) accrue(end - t);
+    t = end;
+    bucketStartMs_ = end;
+    bucket_ = (uint8_t)((bucket_ + 1) % DUTY_BUCKETS);
+    bucketOnMs_[bucket_] = 0;
+  }
+  if (on_) accrue(now - t);
+}
+
+void RelayGuard::switched(uint32_t now, bool on) {
+  if (on == on_) return;
+  update(now);
+  on_ = on;
+  changedMs_ = now;
+  switches_++;
+}
+
+uint32_t RelayGuard::onMsLastHour() const {
+  uint32_t sum = 0;
+  for (uint32_t b : bucketOnMs_) sum += b;
+  return sum;
+}
+
+RelayGate RelayGuard::gate(uint32_t now, bool want) const {
+  const uint32_t since = now - changedMs_;
+  if (want) {
+    if (dutyLimited() && onMsLastHour() >= dutyBudgetMs()) return GATE_DUTY;
+    if (!on_ && since < cfg_.minOffMs) return GATE_MIN_OFF;
+  } else if (on_ && since < cfg_.minOnMs) {
+    return GATE_MIN_ON;
+  }
+  return GATE_PASS;
+}
+
+uint32_t RelayGuard::nextWakeMs(uint32_t now, uint32_t idleMs) const {
+  const uint32_t since = now - changedMs_;
+  uint32_t wait = idleMs;
+  auto atMost = [&](uint32_t ms) {
+    if (ms < wait) wait = ms;
+  };
+
+  if (on_) {
+    if (since < cfg_.minOnMs) atMost(cfg_.minOnMs - since);
+    if (dutyLimited()) {
+      const uint32_t used = onMsLastHour();
+      // Budget spent: the relay goes OFF once the minimum run time allows it.
+      if (used < dutyBudgetMs()) atMost(dutyBudgetMs() - used);
+      else if (since >= cfg_.minOnMs) atMost(0);
+    }
+  } else {
+    if (since < cfg_.minOffMs) atMost(cfg_.minOffMs - since);
+    // The budget can only come back when the oldest bucket drops out.
+    if (dutyLimited() && onMsLastHour() >= dutyBudgetMs()) atMost(DUTY_BUCKET_MS - (now - bucketStartMs_));
+  }
+  return wait > 0 ? wait : 1; // never 0: the caller would spin
+}
+
+const char *controlModeName(ControlMode m) {
+  switch (m) {
+    case CONTROL_MODE_HYSTERESIS: return "hysteresis";
+    case CONTROL_MODE_PREDICTIVE: return "predictive";
+    default: return "unknown";
+  }
+}
+
+static float clampShift(float v, float hysteresis) {
+  if (isnan(v) || !(v > 0.0f) || !(hysteresis > 0.0f)) return 0.0f;
+  return v < hysteresis ? v : hysteresis;
+}
+
+void predictiveShift(const HumidityModel &m, float hysteresis, float &earlyOn, float &earlyOff) {
+  earlyOn = clampShift(m.undershoot, hysteresis);
+  earlyOff = clampShift(m.overshoot, hysteresis);
+}
+
+void HumidityPredictor::reset() {
+  model_ = {NAN, NAN, NAN, NAN};
+  phase_ = PHASE_NONE;
+  on_ = false;
+  switchHumidity_ = NAN;
+  extreme_ = NAN;
+  extremeMs_ = 0;
+}
+
+void HumidityPredictor::learn(float &value, float sample) {
+  value = isnan(value) ? sample : value + PREDICTOR_ALPHA * (sample - value);
+}
+
+// The extreme since the switch is now known: that is the overshoot (or undershoot).
+void HumidityPredictor::finishCoasting() {
+  if (isnan(switchHumidity_) || isnan(extreme_)) return;
+  const float coast = on_ ? switchHumidity_ - extreme_ : extreme_ - switchHumidity_;
+  learn(on_ ? model_.undershoot : model_.overshoot, coast > 0.0f ? coast : 0.0f);
+}
+
+void HumidityPredictor::switched(uint32_t now, bool on, float humidity) {
+  if (phase_ == PHASE_COASTING) finishCoasting();
+  if (phase_ != PHASE_NONE && !isnan(humidity) && !isnan(extreme_)) {
+    // Slope from the turn (or the switch) to now, at least a minute to be meaningful.
+    const uint32_t dtMs = now - extremeMs_;
+    if (dtMs >= 60000U) {
+      const float rate = (on_ ? humidity - extreme_ : extreme_ - humidity) * 60000.0f / (float)dtMs;
+      if (rate > 0.0f) learn(on_ ? model_.riseRate : model_.decayRate, rate);
+    }
+  }
+  on_ = on;
+  phase_ = isnan(humidity) ? PHASE_NONE : PHASE_COASTING;
+  switchHumidity_ = humidity;
+  extreme_ = humidity;
+  extremeMs_ = now;
+}
+
+void HumidityPredictor::observe(uint32_t now, float humidity) {
+  if (phase_ != PHASE_COASTING || isnan(humidity)) return;
+  // OFF: humidity still rising, track the peak. ON: still falling, track the trough.
+  if (on_ ? humidity < extreme_ : humidity > extreme_) {
+    extreme_ = humidity;
+    extremeMs_ = now;
+    return;
+  }
+  if (fabsf(humidity - extreme_) >= PREDICTOR_TURN_DELTA) {
+    finishCoasting();
+    phase_ = PHASE_SETTLED;
+  }
+}
+
+// History record: varint(zigzag(humidity delta) << 1 | ext). With ext set, a flags
+// byte and varint(zigzag(setpoint delta)) follow; ext is only needed when the relay,
+// enable, missing-reading flag or setpoint changed.
+static constexpr uint8_t HISTORY_RELAY = 0x01;
+static constexpr uint8_t HISTORY_ENABLED = 0x02;
+static constexpr uint8_t HISTORY_MISSING = 0x04;
+static constexpr uint8_t HISTORY_GAP = 0x08;
+
+static int16_t historyTenths(float v) {
+  const float t = roundf(v * 10.0f);
+  if (t > 32767.0f) return 32767;
+  if (t < -32768.0f) return -32768;
+  return (int16_t)t;
+}
+
+static size_t putVarint(uint8_t *p, uint32_t v) {
+  size_t n = 0;
+  while (v >= 0x80) {
+    p[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  p[n++] = (uint8_t)v;
+  return n;
+}
+
+static uint32_t zigzag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+void HistoryRing::begin(uint8_t *buf, size_t size) {
+  buf_ = buf;
+  size_ = size;
+  clear();
+}
+
+void HistoryRing::clear() {
+  tail_ = 0;
+  used_ = 0;
+  count_ = 0;
+  base_ = {0, 0, 0};
+  last_ = {0, 0, 0};
+}
+
+// Applies the record at pos to s; returns its length.
+size_t HistoryRing::decode(size_t pos, State &s) const {
+  size_t n = 0;
+  auto varint = [&]() {
+    uint32_t v = 0;
+    for (uint8_t shift = 0; shift < 32; shift += 7) {
+      const uint8_t b = byteAt(pos + n++);
+      v |= (uint32_t)(b & 0x7F) << shift;
+      if (!(b & 0x80)) break;
+    }
+    return v;
+  };
+  const uint32_t head = varint();
+  s.humidity = (int16_t)(s.humidity + unzigzag(head >> 1));
+  if (head & 1) {
+    s.flags = byteAt(pos + n++);
+    s.setpoint = (int16_t)(s.setpoint + unzigzag(varint()));
+  }
+  return n;
+}
+
+void HistoryRing::append(const HistorySample &sample) {
+  if (!buf_ || size_ < HISTORY_RECORD_MAX) return;
+
+  State s = last_;
+  const bool missing = sample.gap || isnan(sample.humidity);
+  if (!missing) s.humidity = historyTenths(sample.humidity);
+  if (!sample.gap && !isnan(sample.setpoint)) s.setpoint = historyTenths(sample.setpoint);
+  if (sample.gap) {
+    s.flags = HISTORY_MISSING | HISTORY_GAP;
+  } else {
+    s.flags = (sample.relay ? HISTORY_RELAY : 0) | (sample.enabled ? HISTORY_ENABLED : 0) | (missing ? HISTORY_MISSING : 0);
+  }
+
+  // The very first record is a full one, relative to the zero state.
+  const bool ext = count_ == 0 || s.flags != last_.flags || s.setpoint != last_.setpoint;
+  uint8_t rec[HISTORY_RECORD_MAX];
+  size_t n = putVarint(rec, (zigzag(s.humidity - last_.humidity) << 1) | (ext ? 1U : 0U));
+  if (ext) {
+    rec[n++] = s.flags;
+    n += putVarint(rec + n, zigzag(s.setpoint - last_.setpoint));
+  }
+
+  while (size_ - used_ < n) {
+    const size_t len = decode(tail_, base_);
+    tail_ = (tail_ + len) % size_;
+    used_ -= len;
+    count_--;
+  }
+  const size_t head = (tail_ + used_) % size_;
+  for (size_t i = 0; i < n; i++) buf_[(head + i) % size_] = rec[i];
+  used_ += n;
+  count_++;
+  last_ = s;
+}
+
+bool HistoryRing::Reader::next(HistorySample &out) {
+  if (left_ == 0) return false;
+  pos_ = (pos_ + ring_.decode(pos_, state_)) % ring_.size_;
+  left_--;
+  out.humidity = (state_.flags & HISTORY_MISSING) ? NAN : state_.humidity / 10.0f;
+  out.setpoint = state_.setpoint / 10.0f;
+  out.relay = (state_.flags & HISTORY_RELAY) != 0;
+  out.enabled = (state_.flags & HISTORY_ENABLED) != 0;
+  out.gap = (state_.flags & HISTORY_GAP) != 0;
+  return true;
+}
+
+const char *localSensorTypeName(LocalSensorType t) {
+  switch (t) {
+    case SENSOR_NONE: return "none";
+    case SENSOR_SHT3X: return "sht3x";
+    case SENSOR_BME280: return "bme280";
+    case SENSOR_DHT22: return "dht22";
+    case SENSOR_DHT11: return "dht11";
+    default: return "unknown";
+  }
+}
+
+uint8_t sht3xCrc8(const uint8_t *p, size_t len) {
+  uint8_t crc = 0xFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= p[i];
+    for (uint8_t b = 0; b < 8; b++) crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+  }
+  return crc;
+}
+
+bool sht3xDecode(const uint8_t *frame, float &humidity, float &temperature) {
+  if (sht3xCrc8(frame, 2) != frame[2] || sht3xCrc8(frame + 3, 2) != frame[5]) return false;
+  const uint16_t rawT = (uint16_t)((frame[0] << 8) | frame[1]);
+  const uint16_t rawH = (uint16_t)((frame[3] << 8) | frame[4]);
+  temperature = -45.0f + 175.0f * (float)rawT / 65535.0f;
+  humidity = 100.0f * (float)rawH / 65535.0f;
+  return true;
+}
+
+void bme280ParseCalib(const uint8_t *regs88, const uint8_t *regsE1, Bme280Calib &cal) {
+  auto u16 = [](const uint8_t *p) { return (uint16_t)(p[0] | (p[1] << 8)); };
+  cal.t1 = u16(regs88);
+  cal.t2 = (int16_t)u16(regs88 + 2);
+  cal.t3 = (int16_t)u16(regs88 + 4);
+  cal.h1 = regs88[25];
+  cal.h2 = (int16_t)u16(regsE1);
+  cal.h3 = regsE1[2];
+  cal.h4 = (int16_t)(((int16_t)(int8_t)regsE1[3] << 4) | (regsE1[4] & 0x0F));
+  cal.h5 = (int16_t)(((int16_t)(int8_t)regsE1[5] << 4) | (regsE1[4] >> 4));
+  cal.h6 = (int8_t)regsE1[6];
+}
+
+bool bme280Decode(const Bme280Calib &cal, const uint8_t *frame, float &humidity, float &temperature) {
+  const int32_t adcT = (int32_t)(((uint32_t)frame[3] << 12) | ((uint32_t)frame[4] << 4) | (frame[5] >> 4));
+  const int32_t adcH = (int32_t)(((uint32_t)frame[6] << 8) | frame[7]);
+  if (adcH == 0x8000) return false;
+
+  int32_t var1 = ((((adcT >> 3) - ((int32_t)cal.t1 << 1))) * (int32_t)cal.t2) >> 11;
+  int32_t var2 = (((((adcT >> 4) - (int32_t)cal.t1) * ((adcT >> 4) - (int32_t)cal.t1)) >> 12) * (int32_t)cal.t3) >> 14;
+  const int32_t tFine = var1 + var2;
+  temperature = (float)((tFine * 5 + 128) >> 8) / 100.0f;
+
+  int32_t v = tFine - 76800;
+  v = (((((adcH << 14) - ((int32_t)cal.h4 << 20) - ((int32_t)cal.h5 * v)) + 16384) >> 15) *
+       (((((((v * (int32_t)cal.h6) >> 10) * (((v * (int32_t)cal.h3) >> 11) + 32768)) >> 10) + 2097152) *
+             (int32_t)cal.h2 +
+         8192) >>
+        14));
+  v = v - (((((v >> 15) * (v >> 15)) >> 7) * (int32_t)cal.h1) >> 4);
+  if (v < 0) v = 0;
+  if (v > 419430400) v = 419430400;
+  humidity = (float)(v >> 12) / 1024.0f;
+  return true;
+}
+
+bool dhtDecode(const uint8_t *frame, bool dht11, float &humidity, float &temperature) {
+  if ((uint8_t)(frame[0] + frame[1] + frame[2] + frame[3]) != frame[4]) return false;
+  if (dht11) {
+    humidity = frame[0] + frame[1] / 10.0f;
+    temperature = frame[2] + (frame[3] & 0x7F) / 10.0f;
+    if (frame[3] & 0x80) temperature = -temperature;
+  } else {
+    humidity = (float)((frame[0] << 8) | frame[1]) / 10.0f;
+    temperature = (float)(((frame[2] & 0x7F) << 8) | frame[3]) / 10.0f;
+    if (frame[2] & 0x80) temperature = -temperature;
+  }
+  return humidity <= 100.0f;
+}
+
+bool dhtFrameFromPulses(const uint16_t *highUs, size_t count, uint8_t *frame) {
+  if (count < 40) return false;
+  const uint16_t *bits = highUs + count - 40;
+  for (uint8_t i = 0; i < 5; i++) frame[i] = 0;
+  for (uint8_t i = 0; i < 40; i++) {
+    if (bits[i] < 10 || bits[i] > 100) return false;
+    frame[i / 8] = (uint8_t)((frame[i / 8] << 1) | (bits[i] > 40 ? 1 : 0));
+  }
+  return true;
+}
+
+static void trimRaw(const uint8_t *&p, size_t &len) {
+  while (len > 0 && isspace(p[0])) {
+    p++;
+    len--;
+  }
+  while (len > 0 && isspace(p[len - 1])) len--;
+}
+
+bool parseBoolRaw(const uint8_t *p, size_t len, bool defaultValue) {
+  static const char *const TRUE_WORDS[] = {"1", "on", "true", "yes", "enable", "enabled"};
+  static const char *const FALSE_WORDS[] = {"0", "off", "false", "no", "disable", "disabled"};
+
+  trimRaw(p, len);
+  auto matches = [&](const char *word) {
+    return strlen(word) == len && strncasecmp((const char *)p, word, len) == 0;
+  };
+  for (const char *w : TRUE_WORDS) {
+    if (matches(w)) return true;
+  }
+  for (const char *w : FALSE_WORDS) {
+    if (matches(w)) return false;
+  }
+  return defaultValue;
+}
+
+bool parseFloatRaw(const uint8_t *p, size_t len, float &out) {
+  trimRaw(p, len);
+  char buf[32];
+  if (len >= sizeof(buf)) len = sizeof(buf) - 1;
+  for (size_t i = 0; i < len; i++) buf[i] = (p[i] == ',') ? '.' : (char)p[i];
+  buf[len] = '\0';
+
+  char *endptr = nullptr;
+  float f = strtof(buf, &endptr);
+  if (endptr == buf) return false;
+  out = f;
+  return true;
+}
+
+bool jsonStringFieldRaw(const uint8_t *p, size_t len, const char *key, char *out, size_t size) {
+  const size_t keyLen = strlen(key);
+  for (size_t i = 0; i + keyLen + 2 <= len; i++) {
+    if (p[i] != '"' || memcmp(p + i + 1, key, keyLen) != 0 || p[i + 1 + keyLen] != '"') continue;
+    size_t j = i + keyLen + 2;
+    while (j < len && isspace(p[j])) j++;
+    if (j >= len || p[j] != ':') continue; // a string value that happens to equal the key
+    j++;
+    while (j < len && isspace(p[j])) j++;
+    if (j >= len || p[j] != '"') return false;
+    j++;
+    size_t n = 0;
+    for (; j < len && p[j] != '"'; j++) {
+      char ch = (char)p[j];
+      if (ch == '\\') {
+        if (++j >= len) return false;
+        ch = (char)p[j];
+        if (ch != '"' && ch != '\\' && ch != '/') return false;
+      }
+      if (n + 1 >= size) return false;
+      out[n++] = ch;
+    }
+    if (j >= len) return false;
+    out[n] = '\0';
+    return true;
+  }
+  return false;
+}
+
+bool parseFleetAnnouncement(const uint8_t *p, size_t len, FleetAnnouncement &out) {
+  if (!jsonStringFieldRaw(p, len, "version", out.version, sizeof(out.version)) || out.version[0] == '\0') return false;
+  if (!jsonStringFieldRaw(p, len, "url", out.url, sizeof(out.url))) return false;
+  if (strncmp(out.url, "http://", 7) != 0 && strncmp(out.url, "https://", 8) != 0) return false;
+  if (!jsonStringFieldRaw(p, len, "sha256", out.sha256, sizeof(out.sha256)) || strlen(out.sha256) != 64) return false;
+  for (char *c = out.sha256; *c; c++) {
+    if (!isxdigit((unsigned char)*c)) return false;
+    *c = (char)tolower((unsigned char)*c);
+  }
+  return true;
+}
+
+size_t mqttEncodeConnect(const MqttConnectOptions &opt, uint8_t *out, size_t size) {
+  uint8_t flags = 0x02; // clean session
+  if (opt.willTopic) flags |= (uint8_t)(0x04 | (opt.willQos << 3) | (opt.willRetain ? 0x20 : 0));
+  if (opt.user) flags |= opt.pass ? 0xC0 : 0x80;
+
+  const char *strings[5] = {opt.clientId, nullptr, nullptr, nullptr, nullptr};
+  uint8_t n = 1;
+  if (opt.willTopic) {
+    strings[n++] = opt.willTopic;
+    strings[n++] = opt.willMessage ? opt.willMessage : "";
+  }
+  if (opt.user) {
+    strings[n++] = opt.user;
+    if (opt.pass) strings[n++] = opt.pass;
+  }
+
+  size_t body = 10; // protocol name and level, flags, keep-alive
+  for (uint8_t i = 0; i < n; i++) {
+    const size_t len = strlen(strings[i]);
+    if (len > 0xFFFF) return 0;
+    body += 2 + len;
+  }
+  uint8_t head[5];
+  size_t headLen = 1;
+  head[0] = 0x10;
+  for (size_t rest = body;;) {
+    head[headLen++] = (uint8_t)((rest & 0x7F) | (rest > 0x7F ? 0x80 : 0));
+    rest >>= 7;
+    if (rest == 0) break;
+    if (headLen == sizeof(head)) return 0;
+  }
+  if (headLen + body > size) return 0;
+
+  size_t pos = 0;
+  memcpy(out, head, headLen);
+  pos += headLen;
+  static const uint8_t VARIABLE[] = {0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04};
+  memcpy(out + pos, VARIABLE, sizeof(VARIABLE));
+  pos += sizeof(VARIABLE);
+  out[pos++] = flags;
+  out[pos++] = (uint8_t)(opt.keepAliveSec >> 8);
+  out[pos++] = (uint8_t)opt.keepAliveSec;
+  for (uint8_t i = 0; i < n; i++) {
+    const size_t len = strlen(strings[i]);
+    out[pos++] = (uint8_t)(len >> 8);
+    out[pos++] = (uint8_t)len;
+    memcpy(out + pos, strings[i], len);
+    pos += len;
+  }
+  return pos;
+}
+
+int mqttConnackCode(const uint8_t *p) {
+  if (p[0] != 0x20 || p[1] != 0x02) return -1;
+  return p[3];
+}
+
+bool httpParseRequestLine(char *line, HttpRequestLine &out) {
+  char *target = strchr(line, ' ');
+  if (!target) return false;
+  *target++ = '\0';
+  char *version = strchr(target, ' ');
+  if (!version) return false;
+  *version++ = '\0';
+  if (target[0] != '/' || strncmp(version, "HTTP/1.", 7) != 0) return false;
+
+  if (strcmp(line, "GET") == 0) {
+    out.method = HTTP_REQ_GET;
+  } else if (strcmp(line, "POST") == 0) {
+    out.method = HTTP_REQ_POST;
+  } else {
+    out.method = HTTP_REQ_OTHER;
+  }
+  out.http10 = strcmp(version, "HTTP/1.0") == 0;
+  char *query = strchr(target, '?');
+  if (query) {
+    *query++ = '\0';
+  } else {
+    query = target + strlen(target); // stays "" after the path is decoded
+  }
+  out.query = query;
+  out.path = httpUrlDecode(target);
+  return true;
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+char *httpUrlDecode(char *s) {
+  char *out = s;
+  for (const char *p = s; *p; p++) {
+    if (*p == '+') {
+      *out++ = ' ';
+    } else if (*p == '%' && hexValue(p[1]) >= 0 && hexValue(p[2]) >= 0) {
+      *out++ = (char)((hexValue(p[1]) << 4) | hexValue(p[2]));
+      p += 2;
+    } else {
+      *out++ = *p;
+    }
+  }
+  *out = '\0';
+  return s;
+}
+
+uint8_t httpParseArgs(char *s, HttpArg *args, uint8_t count, uint8_t max) {
+  while (s && *s) {
+    char *next = strchr(s, '&');
+    if (next) *next++ = '\0';
+    if (*s && count < max) {
+      char *value = strchr(s, '=');
+      if (value) *value++ = '\0';
+      args[count].name = httpUrlDecode(s);
+      args[count].value = value ? httpUrlDecode(value) : "";
+      count++;
+    }
+    s = next;
+  }
+  return count;
+}
+
+bool httpHeaderHasToken(const char *value, const char *token) {
+  const size_t len = strlen(token);
+  for (const char *p = value; *p;) {
+    while (*p == ' ' || *p == '\t' || *p == ',') p++;
+    const char *end = p;
+    while (*end && *end != ',') end++;
+    const char *last = end;
+    while (last > p && (last[-1] == ' ' || last[-1] == '\t')) last--;
+    if ((size_t)(last - p) == len && strncasecmp(p, token, len) == 0) return true;
+    p = end;
+  }
+  return false;
+}
+
+bool httpAcceptsEncoding(const char *value, const char *coding) {
+  const size_t len = strlen(coding);
+  int wildcard = -1; // q > 0 of "*", if listed
+  for (const char *p = value; *p;) {
+    while (*p == ' ' || *p == '\t' || *p == ',') p++;
+    const char *end = p;
+    while (*end && *end != ',') end++;
+    const char *last = p;
+    while (last < end && *last != ';' && *last != ' ' && *last != '\t') last++;
+
+    // "q=0", "q=0.0" ... refuse; any other weight accepts.
+    bool accepted = true;
+    for (const char *q = last; q < end; q++) {
+      if (*q != ';') continue;
+      q++;
+      while (q < end && (*q == ' ' || *q == '\t')) q++;
+      if (end - q < 2 || (q[0] != 'q' && q[0] != 'Q') || q[1] != '=') continue;
+      q += 2;
+      if (q < end && *q == '0') {
+        q++;
+        if (q < end && *q == '.') q++;
+        while (q < end && *q == '0') q++;
+        accepted = q < end && *q >= '1' && *q <= '9';
+      }
+      break;
+    }
+
+    if ((size_t)(last - p) == len && strncasecmp(p, coding, len) == 0) return accepted;
+    if (last - p == 1 && *p == '*') wildcard = accepted ? 1 : 0;
+    p = end;
+  }
+  return wildcard == 1;
+}
+
+bool httpHeaderParam(const char *value, const char *param, char *out, size_t size) {
+  const size_t paramLen = strlen(param);
+  const char *p = value;
+  for (;;) {
+    // To the next ';' outside a quoted string.
+    bool quoted = false;
+    for (; *p && (quoted || *p != ';'); p++) {
+      if (*p == '"') {
+        quoted = !quoted;
+      } else if (quoted && *p == '\\' && p[1]) {
+        p++;
+      }
+    }
+    if (!*p) return false;
+    p++;
+    while (*p == ' ' || *p == '\t') p++;
+    if (strncasecmp(p, param, paramLen) != 0 || p[paramLen] != '=') continue;
+
+    p += paramLen + 1;
+    quoted = *p == '"';
+    if (quoted) p++;
+    size_t n = 0;
+    for (; *p && (quoted ? *p != '"' : (*p != ';' && *p != ' ' && *p != '\t')); p++) {
+      if (quoted && *p == '\\' && p[1]) p++;
+      if (n + 1 >= size) return false;
+      out[n++] = *p;
+    }
+    out[n] = '\0';
+    return true;
+  }
+}
+
+bool MultipartParser::begin(const char *boundary, Callback cb, void *ctx) {
+  const size_t len = strlen(boundary);
+  state_ = MP_FAILED;
+  if (len == 0 || len > MULTIPART_BOUNDARY_MAX) return false;
+  memcpy(delim_, "\r\n--", 4);
+  memcpy(delim_ + 4, boundary, len);
+  delimLen_ = (uint8_t)(len + 4);
+  cb_ = cb;
+  ctx_ = ctx;
+  match_ = 2; // the first delimiter may open the body without the CRLF
+  state_ = MP_PREAMBLE;
+  return true;
+}
+
+void MultipartParser::partHeader() {
+  static const char DISPOSITION[] = "Content-Disposition:";
+  if (strncasecmp(line_, DISPOSITION, sizeof(DISPOSITION) - 1) != 0) return;
+  if (!httpHeaderParam(line_, "name", name_, sizeof(name_))) name_[0] = '\0';
+  if (!httpHeaderParam(line_, "filename", filename_, sizeof(filename_))) filename_[0] = '\0';
+}
+
+bool MultipartParser::feed(const uint8_t *p, size_t n) {
+  size_t i = 0;
+  while (i < n) {
+    switch (state_) {
+      case MP_PREAMBLE:
+      case MP_DATA: {
+        // Data runs up to a delimiter. Bytes matching the start of one stay in the run
+        // until the match fails or completes; only a partial match at the end of the
+        // input is held back, and passed on from delim_ if the next feed breaks it.
+        const bool data = state_ == MP_DATA;
+        const size_t start = i;
+        size_t held = match_; // matched in an earlier feed, not in p
+        while (i < n) {
+          if ((char)p[i] == delim_[match_]) {
+            i++;
+            if (++match_ == delimLen_) break;
+            continue;
+          }
+          if (match_ > 0) {
+            // CR only occurs at the start of the delimiter, so p[i] may begin a new match.
+            if (held > 0 && data) emit(MULTIPART_DATA, (const uint8_t *)delim_, held);
+            held = 0;
+            match_ = 0;
+            continue;
+          }
+          i++;
+        }
+        const size_t end = i - (match_ - held); // where the (partial) delimiter begins in p
+        if (data && end > start) emit(MULTIPART_DATA, p + start, end - start);
+        if (match_ == delimLen_) {
+          match_ = 0;
+          lineLen_ = 0;
+          if (data) emit(MULTIPART_PART_END, nullptr, 0);
+          state_ = MP_DELIMITER_END;
+        }
+        break;
+      }
+      case MP_DELIMITER_END: {
+        const char c = (char)p[i++];
+        if (c == '\n') {
+          lineLen_ = 0;
+          name_[0] = '\0';
+          filename_[0] = '\0';
+          state_ = MP_HEADERS;
+        } else if (c == '-') {
+          if (++lineLen_ == 2) state_ = MP_END;
+        } else if (c != '\r' && c != ' ' && c != '\t') {
+          state_ = MP_FAILED;
+        }
+        break;
+      }
+      case MP_HEADERS: {
+        const char c = (char)p[i++];
+        if (c != '\n') {
+          if (c != '\r' && lineLen_ + 1U < sizeof(line_)) line_[lineLen_++] = c;
+          break;
+        }
+        line_[lineLen_] = '\0';
+        if (lineLen_ == 0) {
+          emit(MULTIPART_PART_BEGIN, nullptr, 0);
+          state_ = MP_DATA;
+        } else {
+          partHeader();
+          lineLen_ = 0;
+        }
+        break;
+      }
+      case MP_END:
+        return true; // epilogue
+      case MP_FAILED:
+      default:
+        return false;
+    }
+  }
+  return state_ != MP_FAILED;
+}
@@ -0,0 +1,497 @@
+#pragma once
+
+// Hardware-independent humidifier control logic: payload parsers, the hysteresis
+// decision, the published automation reason and the humidity sample throttle.
+// No Arduino headers here, so the same code runs on the ESP32 and in the native
+// simulation (env:native, sim/humidity_sim.cpp).
+
+#include <stddef.h>
+#include <math.h>
+#include <stdint.h>
+
+// Relay ON is only allowed once this many samples arrived after an MQTT (re)connect,
+// so a stale retained value alone never switches the humidifier on.
+static constexpr uint8_t CONTROL_MIN_SAMPLES = 2;
+
+enum AutomationReason : uint8_t {
+  REASON_MQTT_DISCONNECTED = 0,
+  REASON_DISABLED,
+  REASON_NO_HUMIDITY,
+  REASON_WAITING_SAMPLES,
+  REASON_HUMIDIFYING,
+  REASON_BELOW_LOW,
+  REASON_ABOVE_HIGH,
+  REASON_WITHIN_BAND,
+  REASON_MIN_ON_HOLD,  // wants OFF, kept ON until the minimum run time is over
+  REASON_MIN_OFF_HOLD, // wants ON, kept OFF until the minimum off time is over
+  REASON_DUTY_LIMIT,   // wants ON, kept OFF: the hourly on-time budget is used up
+  REASON_NONE = 0xFF, // nothing published yet
+};
+
+const char *automationReasonName(AutomationReason r);
+
+// Everything the control decision depends on, sampled at one point in time.
+struct ControlInputs {
+  bool linkUp;            // MQTT session up (humidity can arrive)
+  bool enabled;           // automation enabled by the user
+  bool relayOn;           // current relay state
+  float humidity;         // last accepted sample, NaN if none
+  bool humiditySeen;      // a sample (accepted or throttled) has been seen
+  uint32_t humidityAgeMs; // time since that sample; only valid with humiditySeen
+  uint8_t samples;        // samples since the MQTT session started
+  float target;
+  float hysteresis;
+  float earlyOn;          // %RH the ON edge moves up (predictive mode), else 0
+  float earlyOff;         // %RH the OFF edge moves down
+  uint32_t staleMs;       // sample age at which the relay is forced off
+};
+
+// Band edges the decision uses: target -/+ hysteresis, moved inwards by earlyOn/earlyOff.
+void controlBand(const ControlInputs &in, float &low, float &high);
+
+enum ControlAction : uint8_t {
+  CONTROL_KEEP = 0,
+  CONTROL_TURN_ON,
+  CONTROL_TURN_OFF,
+};
+
+// Why the decision was taken; lets the caller pick the log line and whether to publish.
+enum ControlCause : uint8_t {
+  CAUSE_NONE = 0,
+  CAUSE_LINK_DOWN,
+  CAUSE_DISABLED,
+  CAUSE_NO_HUMIDITY,
+  CAUSE_STALE,
+  CAUSE_WAITING_SAMPLES, // would turn ON, but not enough fresh samples yet
+  CAUSE_BELOW_LOW,
+  CAUSE_ABOVE_HIGH,
+};
+
+struct ControlDecision {
+  ControlAction action;
+  ControlCause cause;
+};
+
+ControlDecision controlDecide(const ControlInputs &in);
+
+// Reason reported on state/reason; same inputs as the decision.
+AutomationReason controlReason(const ControlInputs &in);
+
+// How long the control loop may sleep before something can change on its own
+// (the stale timeout while the relay is on), capped at idleMs.
+uint32_t controlNextWakeMs(const ControlInputs &in, uint32_t idleMs);
+
+// True if a sample at now must be ignored because the previous accepted one
+// (lastAcceptMs, 0 = none) is closer than minIntervalMs.
+bool humidityThrottled(uint32_t now, uint32_t lastAcceptMs, uint32_t minIntervalMs);
+
+// Filters incoming humidity samples before the controller sees them. Fixed-size and
+// allocation-free: the last `window` accepted samples sit in a ring, and the output is
+// their median, trimmed mean (a quarter dropped at each end) or an EMA. A sample that
+// moves faster than maxRatePerMin from the last accepted one is rejected as an outlier,
+// unless FILTER_REJECT_LIMIT in a row were rejected: then it is a genuine step and the
+// filter restarts from it.
+static constexpr uint8_t FILTER_WINDOW_MAX = 15;
+static constexpr uint8_t FILTER_REJECT_LIMIT = 3;
+
+enum HumidityFilterMode : uint8_t {
+  FILTER_NONE = 0, // legacy: the min-interval throttle, raw values
+  FILTER_MEDIAN,
+  FILTER_EMA,
+  FILTER_TRIMMED_MEAN,
+};
+
+const char *humidityFilterModeName(HumidityFilterMode m);
+
+struct HumidityFilterConfig {
+  HumidityFilterMode mode;
+  uint8_t window;      // 1..FILTER_WINDOW_MAX (median / trimmed mean)
+  float emaAlpha;      // (0, 1], weight of the newest sample
+  float maxRatePerMin; // % RH per minute, 0 = no outlier rejection
+};
+
+class HumidityFilter {
+ public:
+  void configure(const HumidityFilterConfig &cfg);
+  void reset();
+
+  // Returns false if the sample was rejected as an outlier; value() is unchanged then.
+  bool push(uint32_t now, float sample);
+
+  float value() const { return value_; } // NaN until the first sample
+  uint8_t size() const { return count_; }
+
+ private:
+  HumidityFilterConfig cfg_ = {FILTER_MEDIAN, 5, 0.3f, 0.0f};
+  float ring_[FILTER_WINDOW_MAX];
+  uint8_t head_ = 0;
+  uint8_t count_ = 0;
+  uint8_t rejectedInRow_ = 0;
+  float last_ = 0.0f;
+  uint32_t lastMs_ = 0;
+  float value_ = NAN;
+};
+
+// Several humidity sources can feed one controller. Each reading carries the time it
+// was last updated; only readings younger than staleMs take part, so a dead sensor
+// drops out instead of freezing the room value. Weights apply to the average; a
+// weight of 0 keeps a source visible but excluded from control.
+static constexpr uint8_t HUMIDITY_SOURCES_MAX = 4;
+
+enum HumidityFusionMode : uint8_t {
+  FUSION_AVERAGE = 0, // weighted mean
+  FUSION_MIN,
+  FUSION_MEDIAN,
+};
+
+const char *humidityFusionModeName(HumidityFusionMode m);
+
+struct HumidityReading {
+  float value;     // NaN = nothing yet
+  uint32_t lastMs; // when value was last updated
+  float weight;
+};
+
+// Returns NaN if no source is fresh; *fresh (optional) gets the number used.
+float fuseHumidity(const HumidityReading *readings, uint8_t count, uint32_t now, uint32_t staleMs,
+                   HumidityFusionMode mode, uint8_t *fresh = nullptr);
+
+// Relay protection between the hysteresis decision and the GPIO: a minimum run time
+// and off time, and a cap on the relay's on-time within the last hour. On-time is
+// counted in DUTY_BUCKETS buckets of DUTY_BUCKET_MS, so "the last hour" moves in
+// five-minute steps. The guard also keeps the lifetime switch and on-time totals.
+// Safety OFFs (link down, disabled, stale humidity) bypass it: the caller only asks
+// for the controller's own decisions.
+static constexpr uint8_t DUTY_BUCKETS = 12;
+static constexpr uint32_t DUTY_BUCKET_MS = 300000;
+static constexpr uint32_t DUTY_WINDOW_MS = DUTY_BUCKETS * DUTY_BUCKET_MS;
+
+struct RelayGuardConfig {
+  uint32_t minOnMs;
+  uint32_t minOffMs;
+  uint8_t maxDutyPct; // of the last hour; 0 or 100 = no limit
+};
+
+enum RelayGate : uint8_t {
+  GATE_PASS = 0,
+  GATE_MIN_ON,  // stay ON
+  GATE_MIN_OFF, // stay OFF
+  GATE_DUTY,    // go or stay OFF
+};
+
+class RelayGuard {
+ public:
+  void configure(const RelayGuardConfig &cfg) { cfg_ = cfg; }
+  // Starts the hour window and the hold timer at now, e.g. at boot.
+  void reset(uint32_t now, bool on);
+  void restoreTotals(uint32_t switches, uint32_t onSeconds);
+
+  // Accounts relay on-time up to now; call before gate() and nextWakeMs().
+  void update(uint32_t now);
+  // Records an actual relay change (from any caller).
+  void switched(uint32_t now, bool on);
+
+  RelayGate gate(uint32_t now, bool want) const;
+  // Time until a hold ends or the duty budget runs out, capped at idleMs; at least 1 ms.
+  // With the budget spent during the minimum run time, that is the end of the run time.
+  uint32_t nextWakeMs(uint32_t now, uint32_t idleMs) const;
+
+  uint32_t onMsLastHour() const;
+  uint32_t switches() const { return switches_; }
+  uint32_t onSeconds() const { return (uint32_t)(onMsTotal_ / 1000U); }
+
+ private:
+  bool dutyLimited() const { return cfg_.maxDutyPct > 0 && cfg_.maxDutyPct < 100; }
+  uint32_t dutyBudgetMs() const { return (uint32_t)cfg_.maxDutyPct * (DUTY_WINDOW_MS / 100U); }
+  void accrue(uint32_t ms);
+
+  RelayGuardConfig cfg_ = {0, 0, 0};
+  bool on_ = false;
+  uint32_t changedMs_ = 0;
+  uint32_t lastMs_ = 0;
+  uint32_t bucketStartMs_ = 0;
+  uint32_t bucketOnMs_[DUTY_BUCKETS] = {0};
+  uint8_t bucket_ = 0;
+  uint32_t switches_ = 0;
+  uint64_t onMsTotal_ = 0;
+};
+
+// Control engines. Hysteresis switches at the band edges. Predictive switches early by
+// what the room did after previous switches: humidity keeps rising for a while after
+// the humidifier stops (overshoot) and keeps falling after it starts (undershoot).
+enum ControlMode : uint8_t {
+  CONTROL_MODE_HYSTERESIS = 0,
+  CONTROL_MODE_PREDICTIVE,
+};
+
+const char *controlModeName(ControlMode m);
+
+// What HumidityPredictor learned; every field is NaN until its first observation.
+struct HumidityModel {
+  float riseRate;   // %RH/min while humidifying
+  float decayRate;  // %RH/min while off
+  float overshoot;  // %RH rise after switching OFF
+  float undershoot; // %RH fall after switching ON
+};
+
+// A turn is only taken once humidity moved this far back from the extreme (sensor noise).
+static constexpr float PREDICTOR_TURN_DELTA = 0.3f;
+// Weight of each new cycle in the learned values.
+static constexpr float PREDICTOR_ALPHA = 0.3f;
+
+// earlyOn/earlyOff for the band: the learned undershoot/overshoot, at most hysteresis,
+// so the edges never cross the target.
+void predictiveShift(const HumidityModel &m, float hysteresis, float &earlyOn, float &earlyOff);
+
+// Learns a HumidityModel from the relay switches and the (filtered) control humidity.
+// Constant memory; one call per sample and per switch.
+class HumidityPredictor {
+ public:
+  HumidityPredictor() { reset(); }
+  void reset();
+  void restore(const HumidityModel &m) { model_ = m; }
+  const HumidityModel &model() const { return model_; }
+
+  void switched(uint32_t now, bool on, float humidity);
+  void observe(uint32_t now, float humidity);
+
+ private:
+  enum Phase : uint8_t {
+    PHASE_NONE = 0, // no switch seen yet
+    PHASE_COASTING, // after a switch, humidity still moving the old way
+    PHASE_SETTLED,  // turned: moving the way the relay pushes it
+  };
+
+  void learn(float &value, float sample);
+  void finishCoasting();
+
+  HumidityModel model_;
+  Phase phase_ = PHASE_NONE;
+  bool on_ = false;
+  float switchHumidity_ = NAN;
+  float extreme_ = NAN; // peak after OFF, trough after ON
+  uint32_t extremeMs_ = 0;
+};
+
+// Humidity history: one sample per fixed step, delta- and varint-coded into a
+// caller-provided byte ring, so a steady room costs one byte per sample. The oldest
+// samples are dropped as new ones need room. Values are kept in 0.1 units.
+struct HistorySample {
+  float humidity; // NaN = no reading
+  float setpoint;
+  bool relay;
+  bool enabled;
+  bool gap = false; // no sample was taken for this step: nothing but the setpoint is known
+};
+
+// Largest encoded sample: humidity delta, flags, setpoint delta.
+static constexpr uint8_t HISTORY_RECORD_MAX = 8;
+
+class HistoryRing {
+  struct State {
+    int16_t humidity; // last known value, also while missing
+    int16_t setpoint;
+    uint8_t flags;
+  };
+
+ public:
+  // size must be at least HISTORY_RECORD_MAX; clears the ring.
+  void begin(uint8_t *buf, size_t size);
+  void clear();
+  void append(const HistorySample &s);
+
+  uint32_t count() const { return count_; }
+  size_t bytesUsed() const { return used_; }
+  size_t capacity() const { return size_; }
+
+  // Walks the samples from the oldest; not valid across append().
+  class Reader {
+   public:
+    explicit Reader(const HistoryRing &ring) : ring_(ring), pos_(ring.tail_), left_(ring.count_), state_(ring.base_) {}
+    bool next(HistorySample &out);
+
+   private:
+    const HistoryRing &ring_;
+    size_t pos_;
+    uint32_t left_;
+    State state_;
+  };
+
+ private:
+  size_t decode(size_t pos, State &s) const;
+  uint8_t byteAt(size_t pos) const { return buf_[pos % size_]; }
+
+  uint8_t *buf_ = nullptr;
+  size_t size_ = 0;
+  size_t tail_ = 0; // oldest record
+  size_t used_ = 0;
+  uint32_t count_ = 0;
+  State base_ = {0, 0, 0}; // state before the record at tail_
+  State last_ = {0, 0, 0}; // state after the newest record
+};
+
+// Local sensors: decoding of the raw frames; the bus side lives in the firmware.
+enum LocalSensorType : uint8_t {
+  SENSOR_NONE = 0,
+  SENSOR_SHT3X,  // I2C, 0x44 (0x45)
+  SENSOR_BME280, // I2C, 0x76 (0x77)
+  SENSOR_DHT22,  // one-wire, also AM2302
+  SENSOR_DHT11,
+  SENSOR_TYPE_COUNT,
+};
+
+const char *localSensorTypeName(LocalSensorType t);
+
+// Sensirion CRC-8 (poly 0x31, init 0xFF) over one measurement word.
+uint8_t sht3xCrc8(const uint8_t *p, size_t len);
+// 6-byte SHT3x measurement: temperature word, CRC, humidity word, CRC.
+bool sht3xDecode(const uint8_t *frame, float &humidity, float &temperature);
+
+// Factory trimming from registers 0x88..0xA1 (26 bytes) and 0xE1..0xE7 (7 bytes).
+struct Bme280Calib {
+  uint16_t t1;
+  int16_t t2, t3;
+  uint8_t h1;
+  int16_t h2;
+  uint8_t h3;
+  int16_t h4, h5;
+  int8_t h6;
+};
+
+void bme280ParseCalib(const uint8_t *regs88, const uint8_t *regsE1, Bme280Calib &cal);
+// 8 bytes from 0xF7 (pressure, temperature, humidity); the datasheet's 32-bit
+// integer compensation. False if humidity was not measured.
+bool bme280Decode(const Bme280Calib &cal, const uint8_t *frame, float &humidity, float &temperature);
+
+// 5-byte DHT frame (humidity, temperature, checksum); false on a checksum mismatch.
+bool dhtDecode(const uint8_t *frame, bool dht11, float &humidity, float &temperature);
+// Builds the 5-byte frame from the captured high pulses of the line, in us and in order.
+// The data bits are the last 40 (26-28 us = 0, 70 us = 1); anything before them is the
+// sensor's response. False if fewer than 40 pulses or any of them is out of range.
+bool dhtFrameFromPulses(const uint16_t *highUs, size_t count, uint8_t *frame);
+
+// Payload parsers: surrounding whitespace is ignored; floats accept ',' as decimal
+// separator; bools accept 1/0, on/off, true/false, yes/no, enable(d)/disable(d).
+bool parseBoolRaw(const uint8_t *p, size_t len, bool defaultValue);
+bool parseFloatRaw(const uint8_t *p, size_t len, float &out);
+
+// String value of a key in a flat JSON object ("\"", "\\" and "\/" escapes; no
+// nesting). False if the key is missing, not a string, or does not fit in size.
+bool jsonStringFieldRaw(const uint8_t *p, size_t len, const char *key, char *out, size_t size);
+
+// Fleet firmware announcement: {"version":"1.4.0","url":"http://...","sha256":"<hex>"}.
+struct FleetAnnouncement {
+  char version[32];
+  char url[192];
+  char sha256[65];
+};
+
+// False unless all three fields are present, the URL is http(s) and the digest is
+// 64 hex digits (stored lowercase).
+bool parseFleetAnnouncement(const uint8_t *p, size_t len, FleetAnnouncement &out);
+
+// MQTT 3.1.1 CONNECT with a clean session, as PubSubClient sends it, so the firmware
+// can do the handshake on a non-blocking socket. user, pass and willTopic may be null.
+// Returns the packet length, or 0 if it does not fit in size.
+struct MqttConnectOptions {
+  const char *clientId;
+  const char *user;
+  const char *pass;
+  const char *willTopic;
+  const char *willMessage;
+  uint8_t willQos;
+  bool willRetain;
+  uint16_t keepAliveSec;
+};
+size_t mqttEncodeConnect(const MqttConnectOptions &opt, uint8_t *out, size_t size);
+// Return code of a 4-byte CONNACK (0 = accepted), or -1 if p is not a CONNACK.
+int mqttConnackCode(const uint8_t *p);
+
+// HTTP request parsing for the firmware's web server; everything is split and decoded
+// in place in the caller's buffers.
+enum HttpMethod : uint8_t {
+  HTTP_REQ_GET = 0,
+  HTTP_REQ_POST,
+  HTTP_REQ_OTHER,
+};
+
+struct HttpRequestLine {
+  HttpMethod method;
+  char *path;  // decoded
+  char *query; // still encoded, "" if none
+  bool http10; // HTTP/1.0 client: no chunked responses
+};
+
+// "GET /path?query HTTP/1.1"; false if it is not an origin-form HTTP/1.x request.
+bool httpParseRequestLine(char *line, HttpRequestLine &out);
+
+// Decodes %XX escapes and '+' in place; returns s.
+char *httpUrlDecode(char *s);
+
+struct HttpArg {
+  const char *name;
+  const char *value;
+};
+
+// Splits "a=1&b=2" (query string or urlencoded form) in place and appends the decoded
+// fields to args[count..max); returns the new count. Fields beyond max are dropped.
+uint8_t httpParseArgs(char *s, HttpArg *args, uint8_t count, uint8_t max);
+
+// Whether a comma-separated header value (Connection) lists token, ignoring case.
+bool httpHeaderHasToken(const char *value, const char *token);
+// Whether an Accept-Encoding value accepts coding: listed, or covered by "*", with a
+// q-value above 0. An explicit entry for coding wins over "*".
+bool httpAcceptsEncoding(const char *value, const char *coding);
+
+// Parameter of a header value, such as boundary in Content-Type or name/filename in
+// Content-Disposition; quotes removed. False if absent or it does not fit in size.
+bool httpHeaderParam(const char *value, const char *param, char *out, size_t size);
+
+// Streaming multipart/form-data parser: the body may arrive in pieces of any size,
+// and part data is passed through without being buffered.
+static constexpr uint8_t MULTIPART_BOUNDARY_MAX = 70; // RFC 2046
+
+enum MultipartEvent : uint8_t {
+  MULTIPART_PART_BEGIN, // name() and filename() are set
+  MULTIPART_DATA,
+  MULTIPART_PART_END,
+};
+
+class MultipartParser {
+ public:
+  typedef void (*Callback)(void *ctx, MultipartEvent event, const uint8_t *data, size_t len);
+
+  // boundary as given in Content-Type; false if empty or too long.
+  bool begin(const char *boundary, Callback cb, void *ctx);
+  // False once the body turned out malformed; later input is ignored.
+  bool feed(const uint8_t *p, size_t n);
+  // The closing delimiter was seen.
+  bool done() const { return state_ == MP_END; }
+
+  const char *name() const { return name_; }
+  const char *filename() const { return filename_; } // "" for a plain form field
+
+ private:
+  enum State : uint8_t {
+    MP_PREAMBLE,
+    MP_DELIMITER_END, // after a delimiter: CRLF, or "--" for the last one
+    MP_HEADERS,
+    MP_DATA,
+    MP_END,
+    MP_FAILED,
+  };
+
+  void emit(MultipartEvent event, const uint8_t *data, size_t len) { cb_(ctx_, event, data, len); }
+  void partHeader();
+
+  Callback cb_ = nullptr;
+  void *ctx_ = nullptr;
+  State state_ = MP_FAILED;
+  char delim_[MULTIPART_BOUNDARY_MAX + 5]; // "\r\n--" boundary
+  uint8_t delimLen_ = 0;
+  uint8_t match_ = 0; // delimiter bytes matched so far, possibly in an earlier feed
+  char line_[160];    // header line, truncated if longer
+  uint8_t lineLen_ = 0;
+  char name_[32];
+  char filename_[64];
+};
@@ -0,0 +1,37 @@
+"""Write firmware.bin.gz and firmware.bin.sha256 next to firmware.bin for /update.
+
+Runs as a PlatformIO post-build script (extra_scripts = post:...) after the
+image is linked, and can also be run by hand:
+python scripts/build_ota_image.py .pio/build/esp32dev/firmware.bin
+The digest is of the uncompressed image; the device checks it after inflating,
+so the same value is valid for both files.
+"""
+
+import gzip
+import hashlib
+import os
+import sys
+
+
+def build(path):
+    with open(path, "rb") as f:
+        raw = f.read()
+    gz = gzip.compress(raw, compresslevel=9, mtime=0)
+    with open(path + ".gz", "wb") as f:
+        f.write(gz)
+    digest = hashlib.sha256(raw).hexdigest()
+    with open(path + ".sha256", "w", newline="\n") as f:
+        f.write(digest + "\n")
+    print("ota image: %s.gz %d -> %d bytes, sha256 %s" % (os.path.basename(path), len(raw), len(gz), digest))
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+
+    def _post_bin(source, target, env):
+        build(target[0].get_abspath())
+
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.bin", _post_bin)  # noqa: F821
+except NameError:
+    for arg in sys.argv[1:]:
+        build(arg)
@@ -0,0 +1,56 @@
+"""Embed web/index.html into src/web_assets.h as a gzip-compressed byte array.
+
+Runs as a PlatformIO pre-build script (extra_scripts = pre:...) and can also be
+run by hand: python scripts/build_web_assets.py
+The output is deterministic (gzip mtime=0), so it only changes with the source.
+"""
+
+import gzip
+import hashlib
+import os
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+    PROJECT_DIR = env["PROJECT_DIR"]  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+SRC = os.path.join(PROJECT_DIR, "web", "index.html")
+DST = os.path.join(PROJECT_DIR, "src", "web_assets.h")
+
+
+def render(raw):
+    gz = gzip.compress(raw, compresslevel=9, mtime=0)
+    etag = hashlib.sha1(raw).hexdigest()[:16]
+
+    lines = [
+        "// Generated by scripts/build_web_assets.py from web/index.html - do not edit.",
+        "#pragma once",
+        "",
+        "#include <Arduino.h>",
+        "",
+        'static constexpr const char *INDEX_HTML_ETAG = "\\"%s\\"";' % etag,
+        "static constexpr size_t INDEX_HTML_GZ_LEN = %d;" % len(gz),
+        "static const uint8_t INDEX_HTML_GZ[] PROGMEM = {",
+    ]
+    for i in range(0, len(gz), 16):
+        lines.append("  " + ", ".join("0x%02x" % b for b in gz[i:i + 16]) + ",")
+    lines.append("};")
+    lines.append("")
+    return "\n".join(lines)
+
+
+def main():
+    with open(SRC, "rb") as f:
+        out = render(f.read())
+    old = None
+    if os.path.exists(DST):
+        with open(DST, "r", newline="\n") as f:
+            old = f.read()
+    if out != old:
+        with open(DST, "w", newline="\n") as f:
+            f.write(out)
+        print("web assets: regenerated %s" % os.path.relpath(DST, PROJECT_DIR))
+
+
+main()
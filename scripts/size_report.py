@@ -0,0 +1,107 @@
+"""Print where firmware.elf spends flash and static RAM, and write firmware.size.json.
+
+Runs as a PlatformIO post-build script (extra_scripts = post:...) after the
+ELF is linked, and can also be run by hand; with two or more files each one
+after the first is also shown as a difference to it:
+python scripts/size_report.py .pio/build/esp32dev/firmware.elf .pio/build/esp32lean/firmware.elf
+Sections are classified by the ESP32 address map, so no toolchain is needed.
+The HUM_FEATURE_* switches and buffer/worker sizes of the build are listed with the sizes.
+"""
+
+import json
+import os
+import struct
+import sys
+
+SHT_NOBITS = 8
+SHF_ALLOC = 0x2
+
+# (name, start, end) of the ESP32 regions a section can be linked into.
+REGIONS = (
+    ("flash_code", 0x400D0000, 0x40400000),
+    ("flash_rodata", 0x3F400000, 0x3F800000),
+    ("iram", 0x40070000, 0x400C0000),
+    ("dram", 0x3FFAE000, 0x40000000),
+    ("rtc", 0x50000000, 0x50002000),
+)
+
+
+def sections(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:4] != b"\x7fELF" or data[4] != 1:
+        raise ValueError("%s: not a 32-bit ELF file" % path)
+    shoff, = struct.unpack_from("<I", data, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from("<HHH", data, 0x2E)
+    headers = [struct.unpack_from("<IIIIIIIIII", data, shoff + i * shentsize) for i in range(shnum)]
+    strtab = headers[shstrndx][4]
+    for name, kind, flags, addr, _, size, _, _, _, _ in headers:
+        if not flags & SHF_ALLOC or size == 0:
+            continue
+        label = data[strtab + name:data.index(b"\0", strtab + name)].decode()
+        yield label, kind, addr, size
+
+
+def measure(path):
+    sizes = {"flash_code": 0, "flash_rodata": 0, "iram": 0, "dram_data": 0, "dram_bss": 0, "rtc": 0}
+    for _, kind, addr, size in sections(path):
+        for region, start, end in REGIONS:
+            if start <= addr < end:
+                break
+        else:
+            continue
+        if region == "dram":
+            region = "dram_bss" if kind == SHT_NOBITS else "dram_data"
+        sizes[region] += size
+    # The image holds everything but .bss: code, rodata and the initial values of IRAM/DRAM.
+    sizes["image"] = sizes["flash_code"] + sizes["flash_rodata"] + sizes["iram"] + sizes["dram_data"]
+    sizes["static_ram"] = sizes["dram_data"] + sizes["dram_bss"]
+    return sizes
+
+
+def line(label, sizes, base=None):
+    fields = ("image", "flash_code", "flash_rodata", "iram", "static_ram", "dram_bss")
+    parts = []
+    for key in fields:
+        if base is None:
+            parts.append("%s %d" % (key, sizes[key]))
+        else:
+            parts.append("%s %d (%+d)" % (key, sizes[key], sizes[key] - base[key]))
+    return "size %s: %s" % (label, ", ".join(parts))
+
+
+def report(path, features):
+    sizes = measure(path)
+    print(line(os.path.basename(os.path.dirname(path)) or path, sizes))
+    if features:
+        print("size features: " + " ".join("%s=%s" % kv for kv in sorted(features.items())))
+    doc = dict(sizes, features=features)
+    with open(os.path.splitext(path)[0] + ".size.json", "w", newline="\n") as f:
+        json.dump(doc, f, indent=1, sort_keys=True)
+        f.write("\n")
+    return sizes
+
+
+def build_features(env):
+    features = {}
+    for define in env.get("CPPDEFINES", []):
+        name, value = (define, "1") if isinstance(define, str) else (define[0], define[1] if len(define) > 1 else "1")
+        if str(name).startswith("HUM_FEATURE_") or str(name) in ("HUM_LOG_RING_BYTES", "HUM_MQTT_BUFFER_SIZE", "HUM_HISTORY_BYTES", "HUM_HTTP_WORKERS"):
+            features[str(name)] = str(value)
+    return features
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+
+    def _post_elf(source, target, env):
+        report(target[0].get_abspath(), build_features(env))
+
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", _post_elf)  # noqa: F821
+except NameError:
+    first = None
+    for arg in sys.argv[1:]:
+        sizes = measure(arg)
+        label = os.path.basename(os.path.dirname(arg)) or arg
+        print(line(label, sizes, first))
+        first = first or sizes
@@ -0,0 +1,331 @@
+// Host-side simulation of the humidifier control loop (env:native).
+//
+// Feeds humidity samples through the same throttle and hysteresis code the firmware
+// uses (lib/humidity_control) and reports relay switching and control quality for a
+// grid of filter / hysteresis / min-interval settings.
+//
+//   humidity_sim [--trace file.csv] [--days 7] [--sample-sec 10] [--setpoint 45]
+//                [--hyst 0.5,1,2,3] [--interval 0,30,60,120]
+//                [--filter none,median,ema,trimmed] [--window 5] [--alpha 0.3] [--max-rate 0]
+//                [--min-on 0] [--min-off 0] [--max-duty 100] [--mode hysteresis,predictive]
+//
+// --interval only applies to filter "none" (the legacy throttle), as on the device.
+// --min-on/--min-off (seconds) and --max-duty (% of an hour) set the relay guard; the
+// simulation evaluates on samples only, so a hold ends at the next sample after it expires.
+//
+// Without --trace a closed-loop room model is simulated (humidity decays towards a
+// daily-varying ambient, rises while the relay is on; the mist reaches the sensor with
+// a lag, so humidity keeps rising for a while after the relay turns off). With --trace, recorded samples
+// ("seconds,humidity" per line, '#' comments allowed) are replayed open-loop: the relay
+// does not influence the trace, so only the switching behaviour is meaningful.
+
+#include <chrono>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "humidity_control.h"
+
+struct Sample {
+  uint32_t ms;
+  float humidity;
+};
+
+struct SimOptions {
+  const char *trace = nullptr;
+  double days = 7.0;
+  uint32_t sampleSec = 10;
+  float setpoint = 45.0f;
+  std::vector<float> hysteresis = {0.5f, 1.0f, 2.0f, 3.0f};
+  std::vector<uint32_t> intervalSec = {0, 30, 60, 120};
+  std::vector<HumidityFilterMode> filters = {FILTER_NONE, FILTER_MEDIAN};
+  uint8_t window = 5;
+  float alpha = 0.3f;
+  float maxRate = 0.0f;
+  uint32_t minOnSec = 0;
+  uint32_t minOffSec = 0;
+  uint8_t maxDutyPct = 100;
+  std::vector<ControlMode> modes = {CONTROL_MODE_HYSTERESIS};
+};
+
+struct SimResult {
+  uint32_t switchesOn = 0;
+  uint64_t samples = 0;
+  uint64_t accepted = 0;
+  uint64_t rejected = 0;
+  double onSeconds = 0;
+  double totalSeconds = 0;
+  double absErrorSum = 0; // integrated |humidity - setpoint| (per second)
+  double inBandSeconds = 0;
+  float maxHumidity = -1e9f;
+  float minHumidity = 1e9f;
+};
+
+// Room model used without a trace; units are % RH and seconds.
+struct RoomModel {
+  static constexpr float AMBIENT_MEAN = 35.0f;
+  static constexpr float AMBIENT_SWING = 8.0f;     // daily +/- swing
+  static constexpr float DECAY_TAU_SEC = 3600.0f;  // leak towards ambient
+  static constexpr float GAIN_PER_SEC = 25.0f / 3600.0f;
+  static constexpr float LAG_TAU_SEC = 240.0f;     // humidifier output -> room
+  static constexpr float NOISE = 0.3f;             // sensor noise, +/-
+  static constexpr float RESOLUTION = 0.1f;        // sensor quantization
+
+  float humidity = 40.0f;
+  float output = 0.0f; // 0..1, lagging the relay
+  uint32_t rng = 12345;
+
+  float ambient(double t) const { return AMBIENT_MEAN + AMBIENT_SWING * (float)sin(2.0 * M_PI * t / 86400.0); }
+
+  void step(double t, float dt, bool relayOn) {
+    output += (dt / LAG_TAU_SEC) * ((relayOn ? 1.0f : 0.0f) - output);
+    humidity += dt * (-(humidity - ambient(t)) / DECAY_TAU_SEC + output * GAIN_PER_SEC);
+    if (humidity > 100.0f) humidity = 100.0f;
+  }
+
+  float read() {
+    rng = rng * 1664525u + 1013904223u;
+    const float noise = ((float)(rng >> 8) / (float)(1u << 24) * 2.0f - 1.0f) * NOISE;
+    return roundf((humidity + noise) / RESOLUTION) * RESOLUTION;
+  }
+};
+
+static bool loadTrace(const char *path, std::vector<Sample> &out) {
+  FILE *f = fopen(path, "r");
+  if (!f) return false;
+  char line[128];
+  while (fgets(line, sizeof(line), f)) {
+    if (line[0] == '#' || line[0] == '\n') continue;
+    double sec;
+    float h;
+    if (sscanf(line, "%lf%*[,; \t]%f", &sec, &h) == 2) out.push_back({(uint32_t)(sec * 1000.0), h});
+  }
+  fclose(f);
+  return !out.empty();
+}
+
+// The device state the firmware keeps between samples, minus the MQTT plumbing.
+struct Device {
+  float hysteresis = 0.0f;
+  uint32_t minIntervalMs = 0;
+  float target = 0.0f;
+  HumidityFilterMode filterMode = FILTER_NONE;
+  HumidityFilter filter;
+  RelayGuard guard;
+  ControlMode mode = CONTROL_MODE_HYSTERESIS;
+  HumidityPredictor predictor;
+  bool relayOn = false;
+  float humidity = NAN;
+  uint32_t lastAcceptMs = 0;
+  uint8_t samples = 0;
+
+  // One MQTT humidity message at now, followed by the control evaluation it triggers.
+  void onSample(uint32_t now, float value, SimResult &r) {
+    if (samples < 255) samples++;
+    r.samples++;
+    if (filterMode == FILTER_NONE) {
+      if (humidityThrottled(now, lastAcceptMs, minIntervalMs)) return;
+    } else {
+      if (!filter.push(now, value)) {
+        r.rejected++;
+        return;
+      }
+      value = filter.value();
+    }
+    humidity = value;
+    lastAcceptMs = now;
+    r.accepted++;
+    predictor.observe(now, humidity);
+
+    ControlInputs in;
+    in.linkUp = true;
+    in.enabled = true;
+    in.relayOn = relayOn;
+    in.humidity = humidity;
+    in.humiditySeen = true;
+    in.humidityAgeMs = 0; // evaluated right as the sample arrives
+    in.samples = samples;
+    in.target = target;
+    in.hysteresis = hysteresis;
+    in.earlyOn = 0.0f;
+    in.earlyOff = 0.0f;
+    if (mode == CONTROL_MODE_PREDICTIVE) predictiveShift(predictor.model(), hysteresis, in.earlyOn, in.earlyOff);
+    in.staleMs = 30U * 60U * 1000U;
+
+    const ControlDecision d = controlDecide(in);
+    guard.update(now);
+    const bool wanted = d.action == CONTROL_TURN_ON || (relayOn && d.action != CONTROL_TURN_OFF);
+    const RelayGate gate = guard.gate(now, wanted);
+    bool on = wanted;
+    if (gate == GATE_MIN_ON) on = true;
+    if (gate == GATE_MIN_OFF || gate == GATE_DUTY) on = false;
+    if (on != relayOn) {
+      guard.switched(now, on);
+      predictor.switched(now, on, humidity);
+      relayOn = on;
+      if (on) r.switchesOn++;
+    }
+  }
+};
+
+static void account(SimResult &r, const Device &dev, float trueHumidity, double dt) {
+  r.totalSeconds += dt;
+  if (dev.relayOn) r.onSeconds += dt;
+  r.absErrorSum += fabs(trueHumidity - dev.target) * dt;
+  if (fabs(trueHumidity - dev.target) <= dev.hysteresis) r.inBandSeconds += dt;
+  if (trueHumidity > r.maxHumidity) r.maxHumidity = trueHumidity;
+  if (trueHumidity < r.minHumidity) r.minHumidity = trueHumidity;
+}
+
+static Device makeDevice(const SimOptions &o, ControlMode ctl, HumidityFilterMode mode, float hyst,
+                         uint32_t intervalSec) {
+  Device dev;
+  dev.mode = ctl;
+  dev.hysteresis = hyst;
+  dev.minIntervalMs = intervalSec * 1000U;
+  dev.target = o.setpoint;
+  dev.filterMode = mode;
+  dev.filter.configure({mode, o.window, o.alpha, o.maxRate});
+  dev.guard.configure({o.minOnSec * 1000U, o.minOffSec * 1000U, o.maxDutyPct});
+  dev.guard.reset(0, false);
+  return dev;
+}
+
+static SimResult runModel(const SimOptions &o, ControlMode ctl, HumidityFilterMode mode, float hyst,
+                          uint32_t intervalSec) {
+  Device dev = makeDevice(o, ctl, mode, hyst, intervalSec);
+  RoomModel room;
+  SimResult r;
+  const uint64_t steps = (uint64_t)(o.days * 86400.0 / o.sampleSec);
+  const float dt = (float)o.sampleSec;
+  for (uint64_t i = 1; i <= steps; i++) {
+    const double t = (double)i * o.sampleSec;
+    room.step(t, dt, dev.relayOn);
+    // millis() wraps after ~49 days, exactly like on the device.
+    dev.onSample((uint32_t)(uint64_t)(t * 1000.0), room.read(), r);
+    account(r, dev, room.humidity, dt);
+  }
+  return r;
+}
+
+static SimResult runTrace(const SimOptions &o, const std::vector<Sample> &trace, ControlMode ctl,
+                          HumidityFilterMode mode, float hyst, uint32_t intervalSec) {
+  Device dev = makeDevice(o, ctl, mode, hyst, intervalSec);
+  SimResult r;
+  for (size_t i = 0; i < trace.size(); i++) {
+    // Timestamp 0 means "never accepted" to the throttle, as millis() does on the device.
+    const uint32_t now = trace[i].ms == 0 ? 1 : trace[i].ms;
+    dev.onSample(now, trace[i].humidity, r);
+    const double dt = (i + 1 < trace.size()) ? (trace[i + 1].ms - trace[i].ms) / 1000.0 : 0.0;
+    account(r, dev, trace[i].humidity, dt);
+  }
+  return r;
+}
+
+template <typename T>
+static std::vector<T> parseList(const char *s, T (*conv)(const char *)) {
+  std::vector<T> out;
+  while (*s) {
+    out.push_back(conv(s));
+    const char *comma = strchr(s, ',');
+    if (!comma) break;
+    s = comma + 1;
+  }
+  return out;
+}
+
+static float toFloat(const char *s) { return strtof(s, nullptr); }
+static uint32_t toUInt(const char *s) { return (uint32_t)strtoul(s, nullptr, 10); }
+
+static HumidityFilterMode toFilter(const char *s) {
+  if (strncmp(s, "median", 6) == 0) return FILTER_MEDIAN;
+  if (strncmp(s, "ema", 3) == 0) return FILTER_EMA;
+  if (strncmp(s, "trimmed", 7) == 0) return FILTER_TRIMMED_MEAN;
+  return FILTER_NONE;
+}
+
+static ControlMode toMode(const char *s) {
+  return strncmp(s, "predictive", 10) == 0 ? CONTROL_MODE_PREDICTIVE : CONTROL_MODE_HYSTERESIS;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: humidity_sim [--trace file.csv] [--days N] [--sample-sec N] [--setpoint RH]\n"
+          "                    [--hyst a,b,...] [--interval sec,sec,...]\n"
+          "                    [--filter none,median,ema,trimmed] [--window N] [--alpha A] [--max-rate R]\n"
+          "                    [--min-on sec] [--min-off sec] [--max-duty pct] [--mode hysteresis,predictive]\n");
+}
+
+int main(int argc, char **argv) {
+  SimOptions o;
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    const char *v = (i + 1 < argc) ? argv[i + 1] : nullptr;
+    if (!v) {
+      usage();
+      return 2;
+    }
+    if (strcmp(a, "--trace") == 0) o.trace = v;
+    else if (strcmp(a, "--days") == 0) o.days = atof(v);
+    else if (strcmp(a, "--sample-sec") == 0) o.sampleSec = toUInt(v) > 0 ? toUInt(v) : 1;
+    else if (strcmp(a, "--setpoint") == 0) o.setpoint = toFloat(v);
+    else if (strcmp(a, "--hyst") == 0) o.hysteresis = parseList<float>(v, toFloat);
+    else if (strcmp(a, "--interval") == 0) o.intervalSec = parseList<uint32_t>(v, toUInt);
+    else if (strcmp(a, "--filter") == 0) o.filters = parseList<HumidityFilterMode>(v, toFilter);
+    else if (strcmp(a, "--window") == 0) o.window = (uint8_t)toUInt(v);
+    else if (strcmp(a, "--alpha") == 0) o.alpha = toFloat(v);
+    else if (strcmp(a, "--max-rate") == 0) o.maxRate = toFloat(v);
+    else if (strcmp(a, "--min-on") == 0) o.minOnSec = toUInt(v);
+    else if (strcmp(a, "--min-off") == 0) o.minOffSec = toUInt(v);
+    else if (strcmp(a, "--max-duty") == 0) o.maxDutyPct = (uint8_t)toUInt(v);
+    else if (strcmp(a, "--mode") == 0) o.modes = parseList<ControlMode>(v, toMode);
+    else {
+      usage();
+      return 2;
+    }
+    i++;
+  }
+
+  std::vector<Sample> trace;
+  if (o.trace && !loadTrace(o.trace, trace)) {
+    fprintf(stderr, "cannot read trace %s\n", o.trace);
+    return 1;
+  }
+
+  if (o.trace) {
+    printf("trace %s: %zu samples (open loop), setpoint %.1f\n", o.trace, trace.size(), o.setpoint);
+  } else {
+    printf("room model: %.1f days, sample every %us, setpoint %.1f\n", o.days, (unsigned)o.sampleSec, o.setpoint);
+  }
+  printf("%-10s %-12s %6s %8s %9s %9s %9s %8s %9s %8s %8s %8s\n", "mode", "filter", "hyst", "interval", "switches", "per_day",
+         "on_time%", "mae", "in_band%", "min", "max", "rejected");
+
+  uint64_t totalSamples = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (ControlMode ctl : o.modes) {
+    for (HumidityFilterMode mode : o.filters) {
+      // The interval only matters for the unfiltered (throttled) path.
+      const std::vector<uint32_t> intervals = (mode == FILTER_NONE) ? o.intervalSec : std::vector<uint32_t>{0};
+      for (float hyst : o.hysteresis) {
+        for (uint32_t interval : intervals) {
+          const SimResult r =
+              o.trace ? runTrace(o, trace, ctl, mode, hyst, interval) : runModel(o, ctl, mode, hyst, interval);
+          totalSamples += r.samples;
+          const double days = r.totalSeconds / 86400.0;
+          const double t = r.totalSeconds > 0 ? r.totalSeconds : 1.0;
+          printf("%-10s %-12s %6.2f %7us %9u %9.1f %9.1f %8.2f %9.1f %8.1f %8.1f %8llu\n", controlModeName(ctl),
+                 humidityFilterModeName(mode), hyst, (unsigned)interval, (unsigned)r.switchesOn,
+                 days > 0 ? r.switchesOn / days : 0.0, 100.0 * r.onSeconds / t, r.absErrorSum / t,
+                 100.0 * r.inBandSeconds / t, r.minHumidity, r.maxHumidity, (unsigned long long)r.rejected);
+        }
+      }
+    }
+  }
+  const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("%llu samples in %.3fs (%.1f M samples/s)\n", (unsigned long long)totalSamples, elapsed,
+         elapsed > 0 ? totalSamples / elapsed / 1e6 : 0.0);
+  return 0;
+}
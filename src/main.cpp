@@ -2,19 +2,24 @@
 
 #include <stdarg.h>
 
+#include <atomic>
+#include <new>
+
 #include <WiFi.h>
-#include <WebServer.h>
-#include <DNSServer.h>
 #include <Preferences.h>
 
 #include <PubSubClient.h>
 
-#include <ArduinoOTA.h>
-#include <ESPmDNS.h>
+#include <driver/gpio.h>
+#include <driver/rmt.h>
+#include <Wire.h>
+#include <rom/crc.h>
 
-#include <Update.h>
+#include "humidity_control.h"
 
-#include <driver/gpio.h>
+#include <lwip/dns.h>
+#include <lwip/sockets.h>
+#include <mbedtls/base64.h>
 
 #ifndef HUM_DEVICE_NAME
 #define HUM_DEVICE_NAME "humidifier-esp32"
@@ -36,23 +41,156 @@
 #define HUM_DEFAULT_AP_PASS "12345678"
 #endif
 
+// 1 = relay control runs in its own high-priority task, networking in another one.
+// 0 = everything runs from the Arduino loop() as before.
+#ifndef HUM_SPLIT_TASKS
+#define HUM_SPLIT_TASKS 1
+#endif
+
+// HTTP worker tasks with HUM_SPLIT_TASKS=1: connections served at the same time.
+#ifndef HUM_HTTP_WORKERS
+#define HUM_HTTP_WORKERS 3
+#endif
+
+// 1 = run the boot micro-benchmarks (env:esp32bench) before normal startup.
+#ifndef HUM_BENCH
+#define HUM_BENCH 0
+#endif
+
+// Optional subsystems: 1 (default) = built in, 0 = compiled out entirely. env:esp32lean
+// drops the ones a unit that is provisioned once and then run over MQTT does not use.
+// Config fields of a disabled feature stay in AppConfig, so the NVS blob and /save
+// keep one layout for every build.
+#ifndef HUM_FEATURE_HA_DISCOVERY
+#define HUM_FEATURE_HA_DISCOVERY 1 // Home Assistant MQTT discovery
+#endif
+#ifndef HUM_FEATURE_CAPTIVE_DNS
+#define HUM_FEATURE_CAPTIVE_DNS 1 // setup AP answers every DNS name (otherwise browse to the AP IP)
+#endif
+#ifndef HUM_FEATURE_ARDUINO_OTA
+#define HUM_FEATURE_ARDUINO_OTA 1 // espota uploads (env:esp32ota)
+#endif
+#ifndef HUM_FEATURE_WEB_OTA
+#define HUM_FEATURE_WEB_OTA 1 // POST /update
+#endif
+#ifndef HUM_FEATURE_FLEET_OTA
+#define HUM_FEATURE_FLEET_OTA 1 // firmware pulled on an MQTT announcement
+#endif
+#ifndef HUM_FEATURE_WEB_UI
+#define HUM_FEATURE_WEB_UI 1 // HTML pages (/, /update form); the JSON API stays
+#endif
+
+// The streaming OTA writer, /update/status and <base>ota serve both update paths.
+#define HUM_OTA_WRITER (HUM_FEATURE_WEB_OTA || HUM_FEATURE_FLEET_OTA)
+
+// Buffer sizes, in bytes.
+#ifndef HUM_LOG_RING_BYTES
+#define HUM_LOG_RING_BYTES 6144 // binary log records, see logAppend()
+#endif
+#ifndef HUM_MQTT_BUFFER_SIZE
+#define HUM_MQTT_BUFFER_SIZE 1024 // PubSubClient packet buffer (heap): largest message in or out
+#endif
+#ifndef HUM_HISTORY_BYTES
+#define HUM_HISTORY_BYTES 8192 // humidity history, all zones together
+#endif
+
+#if HUM_BENCH
+#include <esp_heap_caps.h>
+#endif
+
+#if HUM_FEATURE_CAPTIVE_DNS
+#include <DNSServer.h>
+#endif
+
+#if HUM_FEATURE_ARDUINO_OTA
+#include <ArduinoOTA.h>
+#include <ESPmDNS.h>
+#endif
+
+#if HUM_OTA_WRITER
+#include <Update.h>
+#include <rom/miniz.h>
+#include <mbedtls/sha256.h>
+#endif
+
+#if HUM_FEATURE_FLEET_OTA
+#include <HTTPClient.h>
+#include <WiFiClientSecure.h>
+#endif
+
+#if HUM_FEATURE_WEB_UI
+#include "web_assets.h"
+#endif
+
 static constexpr uint16_t HTTP_PORT = 80;
 static constexpr uint16_t DNS_PORT = 53;
 
 static constexpr uint32_t WIFI_CONNECT_TIMEOUT_MS = 20000;
+static constexpr uint32_t WIFI_FAST_CONNECT_TIMEOUT_MS = 3000; // cached BSSID/channel, then a full scan
 static constexpr uint32_t MQTT_RECONNECT_MIN_MS = 1000;
 static constexpr uint32_t MQTT_RECONNECT_MAX_MS = 30000;
+static constexpr uint32_t MQTT_FIRST_ATTEMPT_JITTER_MS = 500; // spreads a site-wide power blip
+static constexpr uint32_t MQTT_DNS_TIMEOUT_MS = 5000;
+static constexpr uint32_t MQTT_TCP_CONNECT_TIMEOUT_MS = 5000;
+static constexpr uint32_t MQTT_CONNACK_TIMEOUT_MS = 5000;
+static constexpr uint16_t MQTT_SOCKET_TIMEOUT_SEC = 2; // PubSubClient's wait for the rest of a packet
+static constexpr uint16_t MQTT_KEEP_ALIVE_SEC = 15;    // PubSubClient's default
 
 static constexpr uint32_t DEFAULT_HUMIDITY_MIN_INTERVAL_MS = 5U * 60U * 1000U; // 5 minutes
 static constexpr float DEFAULT_HYSTERESIS = 2.0f;
 static constexpr float DEFAULT_SETPOINT = 45.0f;
 
+// Control is evaluated when its inputs change; the timer below only covers timeouts.
+static constexpr uint32_t HUMIDITY_STALE_MS = 30U * 60U * 1000U; // no sample for this long -> safe OFF
+static constexpr uint32_t CONTROL_IDLE_WAKE_MS = 60000;          // upper bound between evaluations
+
 static constexpr float SETPOINT_MIN = 10.0f;
 static constexpr float SETPOINT_MAX = 80.0f;
 
+// Zone 0 is the relay configured in the Control section; zones 1.. each drive one more
+// relay with their own setpoint, hysteresis, humidity topic and <base>zone<N>/ subtree.
+static constexpr uint8_t ZONES_MAX = 4;
+
+// Humidity history (HistoryRing), split evenly between the active zones. A sample
+// takes about a byte while nothing but humidity changes, so one zone at the default
+// 60 s step keeps several days, four zones about a day.
+static constexpr size_t HISTORY_BYTES = HUM_HISTORY_BYTES;
+static_assert(HISTORY_BYTES >= 256 * ZONES_MAX, "HUM_HISTORY_BYTES too small for ZONES_MAX zones");
+
+#if HUM_SPLIT_TASKS
+// Control stays on the app core, networking goes next to the Wi-Fi stack on core 0.
+static constexpr uint32_t CONTROL_TASK_STACK = 4096;
+static constexpr UBaseType_t CONTROL_TASK_PRIO = 5;
+static constexpr BaseType_t CONTROL_TASK_CORE = 1;
+static constexpr uint32_t NET_TASK_STACK = 8192;
+static constexpr UBaseType_t NET_TASK_PRIO = 2;
+static constexpr BaseType_t NET_TASK_CORE = 0;
+// HTTP below the network task, so a slow browser or scraper never delays MQTT: one
+// task accepts connections and runs captive DNS and the event streams, the workers
+// serve the requests (the handlers need the larger stack).
+static constexpr uint32_t HTTP_TASK_STACK = 6144;
+static constexpr UBaseType_t HTTP_TASK_PRIO = 1;
+static constexpr BaseType_t HTTP_TASK_CORE = 0;
+static constexpr uint8_t HTTP_WORKERS = HUM_HTTP_WORKERS;
+static constexpr uint32_t HTTP_WORKER_STACK = 8192;
+static_assert(HTTP_WORKERS >= 1, "HUM_HTTP_WORKERS must be at least 1");
+#endif
+
+struct ZoneConfig {
+  int8_t relayPin = -1; // -1 = zone not used
+  bool relayInverted = HUM_DEFAULT_RELAY_INVERTED != 0;
+  float hysteresis = DEFAULT_HYSTERESIS;
+  char name[25] = {0};
+  char topicHumidityIn[129] = {0};
+};
+
 struct AppConfig {
   char wifiSsid[33] = {0};
   char wifiPass[65] = {0};
+  char staticIp[16] = {0}; // empty = DHCP
+  char staticGateway[16] = {0};
+  char staticMask[16] = {0};
+  char staticDns[16] = {0}; // empty = gateway
 
   char webUser[33] = {0};
   char webPass[65] = {0};
@@ -64,15 +202,30 @@ struct AppConfig {
 
   char baseTopic[129] = {0};
   char topicHumidityIn[129] = {0};
+  char humiditySources[256] = {0}; // extra humidity topics: "topic [weight]" per line
   char topicSetpointIn[129] = {0};
   char topicEnableIn[129] = {0};
 
   int relayPin = HUM_DEFAULT_RELAY_PIN;
   bool relayInverted = HUM_DEFAULT_RELAY_INVERTED != 0;
 
-  uint32_t humidityMinIntervalMs = DEFAULT_HUMIDITY_MIN_INTERVAL_MS;
+  uint32_t humidityMinIntervalMs = DEFAULT_HUMIDITY_MIN_INTERVAL_MS; // only with filterMode == FILTER_NONE
   float hysteresis = DEFAULT_HYSTERESIS;
 
+  uint8_t filterMode = FILTER_MEDIAN; // HumidityFilterMode
+  uint8_t filterWindow = 5;
+  float filterAlpha = 0.3f;
+  float filterMaxRate = 0.0f; // %RH per minute, 0 = no outlier rejection
+
+  uint8_t fusionMode = FUSION_AVERAGE; // HumidityFusionMode, with more than one source
+  uint16_t sourceStaleSec = 600;       // a source silent for this long is left out
+
+  uint8_t controlMode = CONTROL_MODE_HYSTERESIS; // ControlMode, same for every zone
+
+  uint16_t relayMinOnSec = 60;  // RelayGuard, same for every zone
+  uint16_t relayMinOffSec = 60;
+  uint8_t relayMaxDutyPct = 100; // of any hour; 100 = no limit
+
   uint8_t logLevel = 2; // 0=ERROR, 1=WARN, 2=INFO, 3=DEBUG
 
   uint32_t hangTimeoutSec = 0; // 0 disables
@@ -81,6 +234,24 @@ struct AppConfig {
   bool haDiscoveryEnabled = false;
   char haDiscoveryPrefix[33] = "homeassistant";
   char haDeviceName[65] = {0};
+
+  bool stateJson = false; // also publish all state fields as one JSON document on <base>/state
+  uint16_t telemetrySec = 0; // period of the <base>/telemetry document, 0 = off
+
+  ZoneConfig zones[ZONES_MAX - 1]; // zones 1..ZONES_MAX-1
+
+  // New fields go below: the NVS config blob only ever grows at the end.
+  uint16_t historySec = 60; // step of the on-device humidity history
+
+  uint8_t sensorType = SENSOR_NONE; // LocalSensorType of an attached sensor
+  uint8_t sensorZone = 0;           // zone its readings feed
+  int8_t sensorSda = 21;            // I2C SDA, or the DHT data pin
+  int8_t sensorScl = 22;
+  uint8_t sensorAddr = 0; // I2C address, 0 = the type's default
+  uint16_t sensorIntervalSec = 10;
+
+  char fleetTopic[129] = {0};      // fleet firmware announcements, empty = off
+  uint16_t fleetDelayMaxSec = 900; // per-device rollout delay is spread over 0..this
 };
 
 static Preferences prefs;
@@ -100,11 +271,41 @@ enum LogLevel : uint8_t {
   LOG_DEBUG = 3,
 };
 
-static constexpr size_t LOG_LINE_MAX = 180;
-static constexpr size_t LOG_LINES_MAX = 120;
-static char logLines[LOG_LINES_MAX][LOG_LINE_MAX];
-static uint16_t logHead = 0;
-static uint16_t logCount = 0;
+// Log records are kept in binary form in a byte ring and formatted only when read
+// (/logs, serial drain task). A record is a fixed header plus the printf arguments
+// captured by walking the format string; the format itself is stored by pointer, so
+// logf()/logWriteLine() must be given string literals. %s arguments are copied.
+static constexpr size_t LOG_LINE_MAX = 180;  // formatted line, prefix included
+static constexpr size_t LOG_RING_BYTES = HUM_LOG_RING_BYTES;
+static constexpr size_t LOG_RECORD_MAX = 200; // header + captured arguments
+static_assert(LOG_RING_BYTES >= 4 * LOG_RECORD_MAX, "HUM_LOG_RING_BYTES must hold a few records");
+static constexpr size_t LOG_ARG_STR_MAX = 96;
+
+struct LogRecordHeader {
+  uint32_t ms;
+  const char *fmt;
+  uint16_t size; // header + arguments
+  uint8_t level;
+  uint8_t flags;
+};
+
+static constexpr uint8_t LOG_REC_RAW = 0x01;       // fmt is the message itself
+static constexpr uint8_t LOG_REC_TRUNCATED = 0x02; // arguments did not fit
+
+static uint8_t logRing[LOG_RING_BYTES];
+static size_t logTail = 0; // oldest record
+static size_t logHead = 0; // next write position
+static size_t logUsed = 0;
+static uint32_t logSeqOldest = 0; // sequence number of the record at logTail
+static uint32_t logSeqNext = 0;   // sequence number the next record will get
+static portMUX_TYPE logMux = portMUX_INITIALIZER_UNLOCKED; // ring is written from several tasks
+static TaskHandle_t logSerialTaskHandle = nullptr;
+
+// Reader position; a default-constructed cursor starts at the oldest record.
+struct LogCursor {
+  uint32_t seq = 0;
+  size_t pos = 0;
+};
 
 static const char *logLevelName(uint8_t lvl) {
   switch (lvl) {
@@ -116,1151 +317,6135 @@ static const char *logLevelName(uint8_t lvl) {
   }
 }
 
-static void logWriteLine(uint8_t level, const char *line) {
-  if (level > config.logLevel) return;
-
-  char buf[LOG_LINE_MAX];
-  snprintf(buf, sizeof(buf), "[%10lu] %-5s %s", (unsigned long)millis(), logLevelName(level), line);
-  Serial.println(buf);
-
-  strncpy(logLines[logHead], buf, LOG_LINE_MAX - 1);
-  logLines[logHead][LOG_LINE_MAX - 1] = '\0';
-  logHead = (uint16_t)((logHead + 1) % LOG_LINES_MAX);
-  if (logCount < LOG_LINES_MAX) logCount++;
+static void logRingWrite(size_t pos, const void *src, size_t n) {
+  const size_t first = (n < LOG_RING_BYTES - pos) ? n : (LOG_RING_BYTES - pos);
+  memcpy(logRing + pos, src, first);
+  memcpy(logRing, (const uint8_t *)src + first, n - first);
 }
 
-static void logf(uint8_t level, const char *fmt, ...) {
-  if (level > config.logLevel) return;
-  char msg[LOG_LINE_MAX];
-  va_list args;
-  va_start(args, fmt);
-  vsnprintf(msg, sizeof(msg), fmt, args);
-  va_end(args);
-  logWriteLine(level, msg);
+static void logRingRead(size_t pos, void *dst, size_t n) {
+  const size_t first = (n < LOG_RING_BYTES - pos) ? n : (LOG_RING_BYTES - pos);
+  memcpy(dst, logRing + pos, first);
+  memcpy((uint8_t *)dst + first, logRing, n - first);
 }
 
-static WebServer web(HTTP_PORT);
-static DNSServer dns;
+// The critical section only covers the copy; formatting and UART happen elsewhere.
+static void logAppend(const uint8_t *rec, size_t size) {
+  portENTER_CRITICAL(&logMux);
+  while (LOG_RING_BYTES - logUsed < size) {
+    LogRecordHeader old;
+    logRingRead(logTail, &old, sizeof(old));
+    logTail = (logTail + old.size) % LOG_RING_BYTES;
+    logUsed -= old.size;
+    logSeqOldest++;
+  }
+  logRingWrite(logHead, rec, size);
+  logHead = (logHead + size) % LOG_RING_BYTES;
+  logUsed += size;
+  logSeqNext++;
+  portEXIT_CRITICAL(&logMux);
 
-static WiFiClient wifiClient;
-static PubSubClient mqtt(wifiClient);
+  if (logSerialTaskHandle) xTaskNotifyGive(logSerialTaskHandle);
+}
 
-static bool captivePortalActive = false;
-static bool otaActive = false;
+// Copies the record at the cursor into rec (LOG_RECORD_MAX bytes) and advances it.
+// Returns false when the cursor is at the newest record. If the writer has lapped the
+// cursor, it is moved to the oldest record and *dropped gets the number of lost ones.
+static bool logReadNext(LogCursor &c, uint8_t *rec, uint32_t *dropped = nullptr) {
+  bool ok = false;
+  uint32_t lost = 0;
+  portENTER_CRITICAL(&logMux);
+  if ((int32_t)(c.seq - logSeqOldest) < 0) {
+    lost = logSeqOldest - c.seq;
+    c.seq = logSeqOldest;
+    c.pos = logTail;
+  }
+  if (c.seq != logSeqNext) {
+    LogRecordHeader h;
+    logRingRead(c.pos, &h, sizeof(h));
+    logRingRead(c.pos, rec, h.size);
+    c.pos = (c.pos + h.size) % LOG_RING_BYTES;
+    c.seq++;
+    ok = true;
+  }
+  portEXIT_CRITICAL(&logMux);
+  if (dropped) *dropped = lost;
+  return ok;
+}
 
-#ifndef HUM_OTA_PASSWORD
-#define HUM_OTA_PASSWORD ""
-#endif
+// Positions the cursor at sequence number seq (clamped to what the ring still holds).
+// Returns how many of the requested records were already overwritten. The walk from
+// the oldest record runs outside the lock, with interrupts on: the writer only evicts
+// at the tail, so the walked headers were intact if logSeqOldest did not move
+// meanwhile; otherwise the walk starts over from the new oldest record.
+static constexpr uint8_t LOG_SEEK_TRIES = 4;
+
+static uint32_t logSeek(LogCursor &c, uint32_t seq) {
+  for (uint8_t attempt = 0;; attempt++) {
+    uint32_t lost = 0;
+    portENTER_CRITICAL(&logMux);
+    if ((int32_t)(seq - logSeqOldest) < 0) {
+      lost = logSeqOldest - seq;
+      seq = logSeqOldest;
+    }
+    if ((int32_t)(seq - logSeqNext) > 0) seq = logSeqNext;
+    if (attempt + 1 == LOG_SEEK_TRIES) {
+      // The ring is being flooded: skip to the newest record and count the rest as lost.
+      lost += logSeqNext - seq;
+      c.seq = logSeqNext;
+      c.pos = logHead;
+      portEXIT_CRITICAL(&logMux);
+      return lost;
+    }
+    const uint32_t oldest = logSeqOldest;
+    c.seq = oldest;
+    c.pos = logTail;
+    portEXIT_CRITICAL(&logMux);
+
+    while (c.seq != seq) {
+      LogRecordHeader h;
+      logRingRead(c.pos, &h, sizeof(h));
+      c.pos = (c.pos + h.size) % LOG_RING_BYTES;
+      c.seq++;
+    }
 
-static bool systemEnabled = true;
-static bool relayOn = false;
+    portENTER_CRITICAL(&logMux);
+    const bool intact = logSeqOldest == oldest;
+    portEXIT_CRITICAL(&logMux);
+    if (intact) return lost;
+  }
+}
 
-static float targetHumidity = DEFAULT_SETPOINT;
-static float currentHumidity = NAN;
+static uint32_t logNextSeq() {
+  portENTER_CRITICAL(&logMux);
+  const uint32_t seq = logSeqNext;
+  portEXIT_CRITICAL(&logMux);
+  return seq;
+}
 
-static uint32_t lastHumidityAcceptMs = 0;
-static uint32_t lastHumiditySeenMs = 0;
+enum LogLength : uint8_t { LOG_LEN_NONE, LOG_LEN_HH, LOG_LEN_H, LOG_LEN_L, LOG_LEN_LL, LOG_LEN_Z, LOG_LEN_BIG_L };
 
-static uint8_t humiditySamplesSinceMqttConnect = 0;
+struct LogSpec {
+  char flags[6];
+  bool widthStar;
+  int width;     // -1 = none
+  bool precStar;
+  int precision; // -1 = none
+  LogLength length;
+  char conv;
+};
 
-static uint32_t lastMqttAttemptMs = 0;
-static uint32_t mqttBackoffMs = MQTT_RECONNECT_MIN_MS;
-static uint32_t lastStatePublishMs = 0;
+// Parses one conversion; p points just past the '%'. Returns the position after it.
+static const char *logParseSpec(const char *p, LogSpec &s) {
+  size_t nf = 0;
+  while (*p && strchr("-+ #0", *p)) {
+    if (nf < sizeof(s.flags) - 1) s.flags[nf++] = *p;
+    p++;
+  }
+  s.flags[nf] = '\0';
+
+  s.widthStar = false;
+  s.width = -1;
+  if (*p == '*') {
+    s.widthStar = true;
+    p++;
+  } else if (isdigit((unsigned char)*p)) {
+    s.width = 0;
+    while (isdigit((unsigned char)*p)) s.width = s.width * 10 + (*p++ - '0');
+  }
 
-static String lastAutomationReason;
+  s.precStar = false;
+  s.precision = -1;
+  if (*p == '.') {
+    p++;
+    s.precision = 0;
+    if (*p == '*') {
+      s.precStar = true;
+      p++;
+    } else {
+      while (isdigit((unsigned char)*p)) s.precision = s.precision * 10 + (*p++ - '0');
+    }
+  }
 
-// Arduino-ESP32 calls initVariant() before setup().
-// Use it to drive the relay GPIO to a safe state as early as possible.
-extern "C" void initVariant() {
-  const int pin = HUM_DEFAULT_RELAY_PIN;
-  if (pin < 0 || pin > 39) return;
+  s.length = LOG_LEN_NONE;
+  if (p[0] == 'h' && p[1] == 'h') { s.length = LOG_LEN_HH; p += 2; }
+  else if (p[0] == 'l' && p[1] == 'l') { s.length = LOG_LEN_LL; p += 2; }
+  else if (*p == 'h') { s.length = LOG_LEN_H; p++; }
+  else if (*p == 'l') { s.length = LOG_LEN_L; p++; }
+  else if (*p == 'j') { s.length = LOG_LEN_LL; p++; }
+  else if (*p == 'z' || *p == 't') { s.length = LOG_LEN_Z; p++; }
+  else if (*p == 'L') { s.length = LOG_LEN_BIG_L; p++; }
+
+  s.conv = *p;
+  if (*p) p++;
+  return p;
+}
 
-  const bool inverted = (HUM_DEFAULT_RELAY_INVERTED != 0);
-  bool level = false; // OFF
-  if (inverted) level = !level;
+static bool logIsIntConv(char c) { return c && strchr("diuoxXc", c) != nullptr; }
+static bool logIsFloatConv(char c) { return c && strchr("fFeEgGaA", c) != nullptr; }
 
-  const gpio_num_t gpio = (gpio_num_t)pin;
-  gpio_reset_pin(gpio);
-  gpio_set_direction(gpio, GPIO_MODE_OUTPUT);
-  gpio_set_level(gpio, level ? 1 : 0);
+static void logWriteLine(uint8_t level, const char *line) {
+  if (level > config.logLevel) return;
+  LogRecordHeader h{(uint32_t)millis(), line, (uint16_t)sizeof(LogRecordHeader), level, LOG_REC_RAW};
+  logAppend((const uint8_t *)&h, sizeof(h));
 }
 
-static uint32_t mqttDisconnectedSinceMs = 0;
-static uint32_t lastHangActionMs = 0;
+// Floating-point arguments are stored as float: plenty for log output, half the bytes.
+static void logf(uint8_t level, const char *fmt, ...) {
+  if (level > config.logLevel) return;
 
-static String deviceId() {
-  uint64_t mac = ESP.getEfuseMac();
-  char buf[32];
-  snprintf(buf, sizeof(buf), "%s-%04X", HUM_DEVICE_NAME, (unsigned)(mac & 0xFFFF));
-  return String(buf);
-}
+  uint8_t rec[LOG_RECORD_MAX];
+  LogRecordHeader h{(uint32_t)millis(), fmt, 0, level, 0};
+  size_t n = sizeof(h);
+  auto put = [&](const void *src, size_t len) -> bool {
+    if (n + len > sizeof(rec)) return false;
+    memcpy(rec + n, src, len);
+    n += len;
+    return true;
+  };
 
-static void setupOta() {
-  if (otaActive) return;
+  va_list args;
+  va_start(args, fmt);
+  for (const char *p = fmt; *p;) {
+    if (*p++ != '%') continue;
+    if (*p == '%') {
+      p++;
+      continue;
+    }
+    LogSpec s;
+    p = logParseSpec(p, s);
 
-  const String host = deviceId();
-  ArduinoOTA.setHostname(host.c_str());
+    bool ok = true;
+    if (s.widthStar) {
+      const int32_t w = va_arg(args, int);
+      ok = put(&w, sizeof(w));
+    }
+    if (ok && s.precStar) {
+      const int32_t pr = va_arg(args, int);
+      s.precision = pr;
+      ok = put(&pr, sizeof(pr));
+    }
 
-  static constexpr const char *OTA_PASSWORD = HUM_OTA_PASSWORD;
-  if (OTA_PASSWORD[0] != '\0') ArduinoOTA.setPassword(OTA_PASSWORD);
+    if (!ok) {
+      // no room left for the star arguments
+    } else if (logIsIntConv(s.conv)) {
+      if (s.length == LOG_LEN_LL) {
+        const long long v = va_arg(args, long long);
+        ok = put(&v, sizeof(v));
+      } else if (s.length == LOG_LEN_L) {
+        const int32_t v = (int32_t)va_arg(args, long);
+        ok = put(&v, sizeof(v));
+      } else if (s.length == LOG_LEN_Z) {
+        const uint32_t v = (uint32_t)va_arg(args, size_t);
+        ok = put(&v, sizeof(v));
+      } else {
+        const int32_t v = va_arg(args, int);
+        ok = put(&v, sizeof(v));
+      }
+    } else if (logIsFloatConv(s.conv)) {
+      const float v = (s.length == LOG_LEN_BIG_L) ? (float)va_arg(args, long double) : (float)va_arg(args, double);
+      ok = put(&v, sizeof(v));
+    } else if (s.conv == 's') {
+      const char *str = va_arg(args, const char *);
+      if (!str) str = "(null)";
+      size_t max = LOG_ARG_STR_MAX;
+      if (s.precision >= 0 && (size_t)s.precision < max) max = (size_t)s.precision;
+      if (n + 1 + max > sizeof(rec)) max = (n + 1 < sizeof(rec)) ? sizeof(rec) - n - 1 : 0;
+      const uint8_t len = (uint8_t)strnlen(str, max);
+      ok = put(&len, 1) && put(str, len);
+    } else {
+      ok = false; // unsupported conversion (%p, %n): stop capturing
+    }
 
-  ArduinoOTA.onStart([]() {
-    logWriteLine(LOG_INFO, "[OTA] Start");
-  });
-  ArduinoOTA.onEnd([]() {
-    logWriteLine(LOG_INFO, "[OTA] End");
-  });
-  ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
-    if (total == 0) return;
-    const unsigned int pct = (progress * 100U) / total;
-    static unsigned int lastPct = 101;
-    if (pct != lastPct) {
-      lastPct = pct;
-      logf(LOG_INFO, "[OTA] %u%%", pct);
+    if (!ok) {
+      h.flags |= LOG_REC_TRUNCATED;
+      break;
     }
-  });
-  ArduinoOTA.onError([](ota_error_t error) {
-    logf(LOG_ERROR, "[OTA] Error: %u", (unsigned)error);
-  });
+  }
+  va_end(args);
 
-  ArduinoOTA.begin();
-  otaActive = true;
-  logf(LOG_INFO, "[OTA] Ready. Hostname: %s", host.c_str());
+  h.size = (uint16_t)n;
+  memcpy(rec, &h, sizeof(h));
+  logAppend(rec, n);
 }
 
-static bool parseBool(const String &value, bool defaultValue) {
-  String v = value;
-  v.trim();
-  v.toLowerCase();
-  if (v == "1" || v == "on" || v == "true" || v == "yes" || v == "enable" || v == "enabled") return true;
-  if (v == "0" || v == "off" || v == "false" || v == "no" || v == "disable" || v == "disabled") return false;
-  return defaultValue;
-}
+// Formats a record produced by logf()/logWriteLine() as "[millis] LEVEL message".
+static size_t logFormatRecord(const uint8_t *rec, char *out, size_t outSize) {
+  LogRecordHeader h;
+  memcpy(&h, rec, sizeof(h));
 
-static bool parseFloat(const String &value, float &out) {
-  String v = value;
-  v.trim();
-  v.replace(',', '.');
-  char *endptr = nullptr;
-  float f = strtof(v.c_str(), &endptr);
-  if (endptr == v.c_str()) return false;
-  out = f;
-  return true;
-}
+  size_t n = 0;
+  auto advance = [&](int written) {
+    if (written <= 0) return;
+    n += (size_t)written;
+    if (n > outSize - 1) n = outSize - 1;
+  };
+  advance(snprintf(out, outSize, "[%10lu] %-5s ", (unsigned long)h.ms, logLevelName(h.level)));
 
-static void relayWrite(bool on) {
-  relayOn = on;
-  bool level = on;
-  if (config.relayInverted) level = !level;
-  digitalWrite(config.relayPin, level ? HIGH : LOW);
+  if (h.flags & LOG_REC_RAW) {
+    advance(snprintf(out + n, outSize - n, "%s", h.fmt));
+    return n;
+  }
+
+  const uint8_t *arg = rec + sizeof(h);
+  const uint8_t *argEnd = rec + h.size;
+  auto take = [&](void *dst, size_t len) -> bool {
+    if ((size_t)(argEnd - arg) < len) return false;
+    memcpy(dst, arg, len);
+    arg += len;
+    return true;
+  };
+
+  const char *p = h.fmt;
+  bool complete = true;
+  while (*p && n < outSize - 1) {
+    if (*p != '%') {
+      out[n++] = *p++;
+      continue;
+    }
+    p++;
+    if (*p == '%') {
+      out[n++] = *p++;
+      continue;
+    }
+
+    LogSpec s;
+    p = logParseSpec(p, s);
+    int32_t width = s.width < 0 ? 0 : s.width;
+    int32_t precision = s.precision;
+    if ((s.widthStar && !take(&width, sizeof(width))) || (s.precStar && !take(&precision, sizeof(precision)))) {
+      complete = false;
+      break;
+    }
+
+    // Everything is re-emitted through a canonical "%<flags>*.*<len><conv>" spec.
+    char spec[16];
+    static const char *const LEN_STR[] = {"", "hh", "h", "l", "ll", "z", ""};
+    const char *len = LEN_STR[s.length];
+    const bool withPrecision = s.conv != 'c';
+    snprintf(spec, sizeof(spec), "%%%s*%s%s%c", s.flags, withPrecision ? ".*" : "",
+             logIsFloatConv(s.conv) ? "" : len, s.conv);
+
+    char *dst = out + n;
+    const size_t room = outSize - n;
+    if (logIsIntConv(s.conv)) {
+      if (s.length == LOG_LEN_LL) {
+        long long v;
+        if (!take(&v, sizeof(v))) { complete = false; break; }
+        advance(snprintf(dst, room, spec, (int)width, (int)precision, v));
+      } else {
+        int32_t v;
+        if (!take(&v, sizeof(v))) { complete = false; break; }
+        if (s.conv == 'c') advance(snprintf(dst, room, spec, (int)width, (int)v));
+        else if (s.length == LOG_LEN_L) advance(snprintf(dst, room, spec, (int)width, (int)precision, (long)v));
+        else if (s.length == LOG_LEN_Z) advance(snprintf(dst, room, spec, (int)width, (int)precision, (size_t)(uint32_t)v));
+        else advance(snprintf(dst, room, spec, (int)width, (int)precision, (int)v));
+      }
+    } else if (logIsFloatConv(s.conv)) {
+      float v;
+      if (!take(&v, sizeof(v))) { complete = false; break; }
+      advance(snprintf(dst, room, spec, (int)width, (int)precision, (double)v));
+    } else if (s.conv == 's') {
+      uint8_t slen;
+      if (!take(&slen, 1) || (size_t)(argEnd - arg) < slen) { complete = false; break; }
+      advance(snprintf(dst, room, spec, (int)width, (int)slen, (const char *)arg));
+      arg += slen;
+    } else {
+      complete = false;
+      break;
+    }
+  }
+  if (!complete || (h.flags & LOG_REC_TRUNCATED)) advance(snprintf(out + n, outSize - n, "..."));
+  out[n] = '\0';
+  return n;
 }
 
-static String topicOf(const char *suffix) {
-  String base = String(config.baseTopic);
-  if (base.length() == 0) base = "humidifier/" + deviceId();
-  if (!base.endsWith("/")) base += "/";
-  return base + suffix;
+// Drains the ring to the UART at low priority, so callers never wait on 115200 baud.
+static constexpr uint32_t LOG_SERIAL_TASK_STACK = 3072;
+static constexpr UBaseType_t LOG_SERIAL_TASK_PRIO = 1;
+
+static void logSerialTask(void *arg) {
+  (void)arg;
+  LogCursor cursor;
+  uint8_t rec[LOG_RECORD_MAX];
+  char line[LOG_LINE_MAX];
+  for (;;) {
+    uint32_t dropped = 0;
+    while (logReadNext(cursor, rec, &dropped)) {
+      if (dropped) Serial.printf("... %lu log line(s) dropped\n", (unsigned long)dropped);
+      logFormatRecord(rec, line, sizeof(line));
+      Serial.println(line);
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
 }
 
-static void saveConfig() {
-  prefs.begin("hum", false);
-  prefs.putString("wifiSsid", config.wifiSsid);
-  prefs.putString("wifiPass", config.wifiPass);
-  prefs.putString("webUser", config.webUser);
-  prefs.putString("webPass", config.webPass);
-  prefs.putString("mqttHost", config.mqttHost);
-  prefs.putUShort("mqttPort", config.mqttPort);
-  prefs.putString("mqttUser", config.mqttUser);
-  prefs.putString("mqttPass", config.mqttPass);
-  prefs.putString("baseTopic", config.baseTopic);
-  prefs.putString("tHumIn", config.topicHumidityIn);
-  prefs.putString("tSetIn", config.topicSetpointIn);
-  prefs.putString("tEnIn", config.topicEnableIn);
-  prefs.putInt("relayPin", config.relayPin);
-  prefs.putBool("relayInv", config.relayInverted);
-  prefs.putULong("humInt", config.humidityMinIntervalMs);
-  prefs.putFloat("hyst", config.hysteresis);
-  prefs.putUChar("logLvl", config.logLevel);
-  prefs.putULong("hangSec", config.hangTimeoutSec);
-  prefs.putUChar("hangAct", config.hangAction);
-  prefs.putBool("haDisc", config.haDiscoveryEnabled);
-  prefs.putString("haPref", config.haDiscoveryPrefix);
-  prefs.putString("haName", config.haDeviceName);
-  prefs.putFloat("target", clampSetpoint(targetHumidity));
-  prefs.putBool("sysEn", systemEnabled);
-  prefs.end();
+static void startLogSerialTask() {
+  xTaskCreate(logSerialTask, "log_serial", LOG_SERIAL_TASK_STACK, nullptr, LOG_SERIAL_TASK_PRIO, &logSerialTaskHandle);
 }
 
-static void loadConfig() {
-  prefs.begin("hum", true);
+// Stage timings come from the CPU cycle counter. It is per core, but every stage starts
+// and ends in the same pinned task, so the difference is always taken on one core.
+// Each counter has a single writer task; a /metrics read racing an update at worst
+// shows the value from before it.
+enum MetricStage : uint8_t {
+  STAGE_LOOP,
+  STAGE_WIFI,
+  STAGE_HTTP,
+  STAGE_MQTT,
+  STAGE_OTA,
+  STAGE_CONTROL,
+  STAGE_STATE_FLUSH,
+  STAGE_COUNT,
+};
 
-  String wifiSsid = prefs.getString("wifiSsid", "");
-  String wifiPass = prefs.getString("wifiPass", "");
+static const char *const STAGE_NAMES[STAGE_COUNT] = {"loop", "wifi", "http", "mqtt", "ota", "control", "state_flush"};
 
-  String webUser = prefs.getString("webUser", "admin");
-  String webPass = prefs.getString("webPass", "admin");
+// Upper bounds in microseconds, with the matching Prometheus "le" labels (seconds).
+static constexpr uint32_t LATENCY_BUCKETS_US[] = {50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 1000000};
+static const char *const LATENCY_BUCKET_LE[] = {"0.00005", "0.0001", "0.00025", "0.0005", "0.001", "0.0025", "0.005",
+                                                "0.01", "0.025", "0.05", "0.1", "0.25", "1"};
+static constexpr size_t LATENCY_BUCKET_COUNT = sizeof(LATENCY_BUCKETS_US) / sizeof(LATENCY_BUCKETS_US[0]);
 
-  String mqttHost = prefs.getString("mqttHost", "");
-  uint16_t mqttPort = prefs.getUShort("mqttPort", 1883);
-  String mqttUser = prefs.getString("mqttUser", "");
-  String mqttPass = prefs.getString("mqttPass", "");
+struct LatencyHistogram {
+  uint32_t buckets[LATENCY_BUCKET_COUNT + 1]; // last one is +Inf; not cumulative
+  uint32_t count;
+  uint64_t sumUs;
+  uint32_t maxUs;
+};
 
-  String baseTopic = prefs.getString("baseTopic", ("humidifier/" + deviceId()).c_str());
-  String baseForDefaults = baseTopic;
-  if (baseForDefaults.length() == 0) baseForDefaults = "humidifier/" + deviceId();
-  if (!baseForDefaults.endsWith("/")) baseForDefaults += "/";
+static LatencyHistogram stageLatency[STAGE_COUNT];
+
+struct Metrics {
+  uint32_t mqttRx;
+  uint32_t mqttTx;
+  uint32_t mqttPublishFailed;
+  uint32_t mqttConnects;
+  uint32_t mqttQueueFull;    // enqueue refused, the caller retries later
+  uint32_t mqttResent;       // confirmed topic sent again (no echo in time, or reconnect)
+  uint32_t mqttConfirmLost;  // gave up waiting for an echo
+  uint32_t humidityThrottled;
+  uint32_t humidityRejected;
+  uint32_t nvsWrites;
+};
 
-  String tHumIn = prefs.getString("tHumIn", "");
-  String tSetIn = prefs.getString("tSetIn", (baseForDefaults + "cmd/setpoint").c_str());
-  String tEnIn = prefs.getString("tEnIn", (baseForDefaults + "cmd/enabled").c_str());
+static Metrics metrics;
+
+static void metricsRecord(MetricStage stage, uint32_t startCycles) {
+  const uint32_t us = (ESP.getCycleCount() - startCycles) / ESP.getCpuFreqMHz();
+  LatencyHistogram &h = stageLatency[stage];
+  size_t b = 0;
+  while (b < LATENCY_BUCKET_COUNT && us > LATENCY_BUCKETS_US[b]) b++;
+  h.buckets[b]++;
+  h.count++;
+  h.sumUs += us;
+  if (us > h.maxUs) h.maxUs = us;
+}
 
-  int relayPin = prefs.getInt("relayPin", HUM_DEFAULT_RELAY_PIN);
-  bool relayInv = prefs.getBool("relayInv", HUM_DEFAULT_RELAY_INVERTED != 0);
-  uint32_t humInt = prefs.getULong("humInt", DEFAULT_HUMIDITY_MIN_INTERVAL_MS);
-  float hyst = prefs.getFloat("hyst", DEFAULT_HYSTERESIS);
-  uint8_t logLvl = prefs.getUChar("logLvl", (uint8_t)LOG_INFO);
-  uint32_t hangSec = prefs.getULong("hangSec", 0);
-  uint8_t hangAct = prefs.getUChar("hangAct", 1);
+// HTTP/1.1 server. The HTTP task accepts connections and queues them for a pool of
+// HUM_HTTP_WORKERS worker tasks, each serving one connection at a time with keep-alive,
+// so a firmware upload or a slow reader ties up one worker and not the whole server.
+// Handlers therefore run concurrently with each other as well as with the other tasks.
+// With HUM_SPLIT_TASKS=0 the loop serves one request per connection, one at a time.
+static constexpr size_t HTTP_LINE_MAX = 512; // request line (path and query) or header line
+static constexpr size_t HTTP_RX_BUF = 1024;
+static constexpr uint8_t HTTP_ARGS_MAX = 96; // the /save form has about 70 fields
+static constexpr size_t HTTP_HEADERS_MAX = 384;
+static constexpr size_t HTTP_RESP_HEADERS_MAX = 384;
+static constexpr size_t HTTP_FORM_MAX = 8192; // urlencoded body, parsed in a heap copy
+static constexpr size_t HTTP_CHUNK_MAX = 512;
+static constexpr uint32_t HTTP_READ_TIMEOUT_MS = 5000;  // request head in total, body between segments
+static constexpr uint32_t HTTP_WRITE_TIMEOUT_MS = 5000; // without the client taking any data
+static constexpr uint32_t HTTP_KEEPALIVE_MS = 5000;     // idle connection kept open for the next request
+static constexpr uint8_t HTTP_ROUTES_MAX = 16;
+static constexpr uint8_t HTTP_ACCEPTS_PER_TICK = 4;
+
+// Request headers the handlers read; all others are skipped while parsing.
+static const char *const HTTP_KEPT_HEADERS[] = {"Authorization", "Content-Type", "If-None-Match", "Last-Event-ID",
+                                                "Accept-Encoding"};
+static constexpr uint8_t HTTP_KEPT_HEADER_COUNT = sizeof(HTTP_KEPT_HEADERS) / sizeof(HTTP_KEPT_HEADERS[0]);
+
+static std::atomic<uint32_t> httpRequestCount{0};
+static std::atomic<uint32_t> httpRefusedCount{0}; // connections turned away with a 503
+
+enum HttpUploadStatus : uint8_t {
+  HTTP_UPLOAD_START,
+  HTTP_UPLOAD_WRITE,
+  HTTP_UPLOAD_END,
+  HTTP_UPLOAD_ABORTED, // body cut off or malformed after START; the main handler does not run
+};
 
-  bool haDisc = prefs.getBool("haDisc", false);
-  String haPref = prefs.getString("haPref", "homeassistant");
-  String haName = prefs.getString("haName", "");
+// A file part of a multipart/form-data body, as passed to an upload handler.
+struct HttpUpload {
+  HttpUploadStatus status = HTTP_UPLOAD_START;
+  char filename[64] = "";
+  const uint8_t *buf = nullptr;
+  size_t currentSize = 0;
+  size_t totalSize = 0;
+  bool refused = false; // for the handlers: the rest of the file is to be ignored
+};
 
-  float storedTarget = prefs.getFloat("target", DEFAULT_SETPOINT);
-  bool storedEnabled = prefs.getBool("sysEn", true);
+static const char *httpStatusText(int code) {
+  switch (code) {
+    case 200: return "OK";
+    case 202: return "Accepted";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 404: return "Not Found";
+    case 406: return "Not Acceptable";
+    case 409: return "Conflict";
+    case 411: return "Length Required";
+    case 413: return "Payload Too Large";
+    case 414: return "URI Too Long";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    default: return "";
+  }
+}
 
-  prefs.end();
+static bool httpWaitSocket(int fd, bool forRead, uint32_t ms) {
+  fd_set set;
+  FD_ZERO(&set);
+  FD_SET(fd, &set);
+  timeval tv = {(time_t)(ms / 1000U), (suseconds_t)((ms % 1000U) * 1000U)};
+  return select(fd + 1, forRead ? &set : nullptr, forRead ? nullptr : &set, nullptr, &tv) > 0;
+}
 
-  strncpy(config.wifiSsid, wifiSsid.c_str(), sizeof(config.wifiSsid) - 1);
-  strncpy(config.wifiPass, wifiPass.c_str(), sizeof(config.wifiPass) - 1);
+class HttpRequest;
+typedef void (*HttpHandler)(HttpRequest &req);
+
+// One connection and the request being served on it. The socket is used directly,
+// not through WiFiClient's read buffer, so every wait has a timeout and the buffer
+// below is the only copy. Without a client (benchmarks) responses are discarded.
+class HttpRequest {
+ public:
+  // Request.
+  HttpMethod method() const { return method_; }
+  const char *path() const { return path_; }
+  bool hasArg(const char *name) const { return findArg(name) != nullptr; }
+  String arg(const char *name) const {
+    const HttpArg *a = findArg(name);
+    return a ? String(a->value) : String();
+  }
+  // One of HTTP_KEPT_HEADERS, "" if the request did not have it.
+  const char *header(const char *name) const;
+  bool hasHeader(const char *name) const { return header(name)[0] != '\0'; }
+  HttpUpload &upload() { return upload_; }
+  bool authenticate(const char *user, const char *pass) const;
+
+  // Response. Headers given to sendHeader() go out with the next send() or beginChunked().
+  void sendHeader(const char *name, const char *value);
+  void send(int code, const char *contentType, const char *body) {
+    send(code, contentType, (const uint8_t *)body, strlen(body));
+  }
+  void send(int code, const char *contentType, const String &body) {
+    send(code, contentType, (const uint8_t *)body.c_str(), body.length());
+  }
+  void send(int code, const char *contentType, const uint8_t *body, size_t len) {
+    if (writeHead(code, contentType, (long)len) && len > 0) write(body, len);
+  }
+  void requestAuthentication(const char *realm);
+  // Body of unknown length: chunked, or up to the connection close for HTTP/1.0.
+  void beginChunked(int code, const char *contentType) {
+    if (writeHead(code, contentType, -1)) streaming_ = true;
+  }
+  void sendChunk(const char *data, size_t len);
+  void endChunked();
+  // Hands the connection over (event streams): no response is sent and nothing more is
+  // read from it. The returned handle keeps the socket open after the request ends.
+  WiFiClient *detach();
+
+  // Server side, used by httpServe().
+  void attach(WiFiClient *client, bool keepAlive);
+  void reset();
+  bool awaitRequest(uint32_t idleMs, bool (*shed)());
+  bool readHead();
+  bool readBody(HttpHandler uploadHandler);
+  bool finish();
+
+ private:
+  const HttpArg *findArg(const char *name) const;
+  int fill(uint32_t timeoutMs);
+  int readLine(char *out, size_t size, uint32_t deadline);
+  size_t readSome(const uint8_t *&data, size_t max);
+  bool readUpload(HttpHandler handler);
+  static void onMultipart(void *ctx, MultipartEvent event, const uint8_t *data, size_t len);
+  void keepHeader(const char *name, const char *value);
+  bool fail(int code, const char *message);
+  bool writeHead(int code, const char *contentType, long length);
+  bool write(const void *data, size_t len);
+
+  WiFiClient *client_ = nullptr;
+  int fd_ = -1;
+  bool keepAliveAllowed_ = false;
+  bool failed_ = false; // connection unusable (closed, timed out, reset)
+  uint8_t rx_[HTTP_RX_BUF];
+  uint16_t rxPos_ = 0;
+  uint16_t rxLen_ = 0;
+
+  HttpMethod method_ = HTTP_REQ_GET;
+  bool http10_ = false;
+  bool keepAlive_ = false;
+  bool expectContinue_ = false;
+  bool chunkedBody_ = false;
+  uint32_t contentLength_ = 0;
+  char line_[HTTP_LINE_MAX]; // request line; path_ and the query args point into it
+  const char *path_ = "";
+  HttpArg args_[HTTP_ARGS_MAX];
+  uint8_t argCount_ = 0;
+  char headers_[HTTP_HEADERS_MAX];
+  uint16_t headerLen_ = 0;
+  int16_t headerOfs_[HTTP_KEPT_HEADER_COUNT];
+  char *body_ = nullptr; // form fields point into it
+  HttpUpload upload_;
+  HttpHandler uploadHandler_ = nullptr;
+  const MultipartParser *parser_ = nullptr;
+  bool uploadStarted_ = false;
+  bool inFile_ = false;
+
+  char respHeaders_[HTTP_RESP_HEADERS_MAX];
+  uint16_t respLen_ = 0;
+  bool responded_ = false;
+  bool streaming_ = false; // beginChunked() body open
+  bool chunked_ = false;
+  bool detached_ = false;
+};
 
-  strncpy(config.webUser, webUser.c_str(), sizeof(config.webUser) - 1);
-  strncpy(config.webPass, webPass.c_str(), sizeof(config.webPass) - 1);
+const char *HttpRequest::header(const char *name) const {
+  for (uint8_t i = 0; i < HTTP_KEPT_HEADER_COUNT; i++) {
+    if (strcasecmp(name, HTTP_KEPT_HEADERS[i]) == 0) return headerOfs_[i] >= 0 ? headers_ + headerOfs_[i] : "";
+  }
+  return "";
+}
 
-  strncpy(config.mqttHost, mqttHost.c_str(), sizeof(config.mqttHost) - 1);
-  config.mqttPort = mqttPort;
-  strncpy(config.mqttUser, mqttUser.c_str(), sizeof(config.mqttUser) - 1);
-  strncpy(config.mqttPass, mqttPass.c_str(), sizeof(config.mqttPass) - 1);
+const HttpArg *HttpRequest::findArg(const char *name) const {
+  for (uint8_t i = 0; i < argCount_; i++) {
+    if (strcmp(args_[i].name, name) == 0) return &args_[i];
+  }
+  return nullptr;
+}
 
-  strncpy(config.baseTopic, baseTopic.c_str(), sizeof(config.baseTopic) - 1);
-  strncpy(config.topicHumidityIn, tHumIn.c_str(), sizeof(config.topicHumidityIn) - 1);
-  strncpy(config.topicSetpointIn, tSetIn.c_str(), sizeof(config.topicSetpointIn) - 1);
-  strncpy(config.topicEnableIn, tEnIn.c_str(), sizeof(config.topicEnableIn) - 1);
+// Basic authentication; the comparison takes the same time wherever the first
+// difference is.
+bool HttpRequest::authenticate(const char *user, const char *pass) const {
+  const char *given = header("Authorization");
+  if (strncasecmp(given, "Basic ", 6) != 0) return false;
+  given += 6;
+  while (*given == ' ') given++;
+
+  char plain[sizeof(AppConfig::webUser) + sizeof(AppConfig::webPass)];
+  const int plainLen = snprintf(plain, sizeof(plain), "%s:%s", user, pass);
+  unsigned char expected[(sizeof(plain) + 2) / 3 * 4 + 1];
+  size_t len = 0;
+  if (plainLen < 0 ||
+      mbedtls_base64_encode(expected, sizeof(expected), &len, (const unsigned char *)plain, (size_t)plainLen) != 0) {
+    return false;
+  }
+  if (strlen(given) != len) return false;
+  uint8_t diff = 0;
+  for (size_t i = 0; i < len; i++) diff |= (uint8_t)((uint8_t)given[i] ^ expected[i]);
+  return diff == 0;
+}
 
-  config.relayPin = relayPin;
-  config.relayInverted = relayInv;
-  config.humidityMinIntervalMs = humInt;
-  config.hysteresis = hyst;
-  config.logLevel = logLvl;
-  config.hangTimeoutSec = hangSec;
-  config.hangAction = hangAct;
+void HttpRequest::sendHeader(const char *name, const char *value) {
+  const size_t room = sizeof(respHeaders_) - respLen_;
+  const int n = snprintf(respHeaders_ + respLen_, room, "%s: %s\r\n", name, value);
+  if (n > 0 && (size_t)n < room) {
+    respLen_ += (uint16_t)n;
+  } else {
+    respHeaders_[respLen_] = '\0'; // does not fit: dropped
+  }
+}
 
-  config.haDiscoveryEnabled = haDisc;
-  strncpy(config.haDiscoveryPrefix, haPref.c_str(), sizeof(config.haDiscoveryPrefix) - 1);
-  strncpy(config.haDeviceName, haName.c_str(), sizeof(config.haDeviceName) - 1);
+void HttpRequest::requestAuthentication(const char *realm) {
+  char value[64];
+  snprintf(value, sizeof(value), "Basic realm=\"%s\"", realm);
+  sendHeader("WWW-Authenticate", value);
+  send(401, "text/plain", "Authentication required");
+}
 
-  if (!isnan(storedTarget)) targetHumidity = clampSetpoint(storedTarget);
-  systemEnabled = storedEnabled;
+void HttpRequest::sendChunk(const char *data, size_t len) {
+  if (!streaming_) return;
+  if (!chunked_) {
+    write(data, len);
+    return;
+  }
+  // Size line, data and CRLF in one write, so each chunk is one segment.
+  char frame[8 + HTTP_CHUNK_MAX + 2];
+  while (len > 0) {
+    const size_t n = len < HTTP_CHUNK_MAX ? len : HTTP_CHUNK_MAX;
+    const int head = snprintf(frame, sizeof(frame), "%x\r\n", (unsigned)n);
+    memcpy(frame + head, data, n);
+    memcpy(frame + head + n, "\r\n", 2);
+    if (!write(frame, (size_t)head + n + 2)) return;
+    data += n;
+    len -= n;
+  }
+}
 
-  targetHumidity = clampSetpoint(targetHumidity);
+void HttpRequest::endChunked() {
+  if (streaming_ && chunked_) write("0\r\n\r\n", 5);
+  streaming_ = false;
+  chunked_ = false;
 }
 
-static void saveRuntimeState() {
-  prefs.begin("hum", false);
-  prefs.putFloat("target", clampSetpoint(targetHumidity));
-  prefs.putBool("sysEn", systemEnabled);
-  prefs.end();
+WiFiClient *HttpRequest::detach() {
+  if (!client_ || responded_) return nullptr;
+  WiFiClient *handle = new (std::nothrow) WiFiClient(*client_);
+  if (handle) {
+    detached_ = true;
+    responded_ = true;
+  }
+  return handle;
 }
 
-static void mqttPublishState(bool force);
-
-static String automationReason() {
-  if (!mqtt.connected()) return "mqtt_disconnected";
-  if (!systemEnabled) return "disabled";
-  if (isnan(currentHumidity)) return "no_humidity";
-  if (humiditySamplesSinceMqttConnect < 2) return "waiting_samples";
-
-  float low = targetHumidity - config.hysteresis;
-  float high = targetHumidity + config.hysteresis;
-
-  if (relayOn) return "humidifying";
-  if (currentHumidity < low) return "below_low";
-  if (currentHumidity > high) return "above_high";
-  return "within_band";
-}
-
-static String htmlEscape(const String &s) {
-  String o;
-  o.reserve(s.length());
-  for (size_t i = 0; i < s.length(); i++) {
-    char c = s[i];
-    switch (c) {
-      case '&': o += "&amp;"; break;
-      case '<': o += "&lt;"; break;
-      case '>': o += "&gt;"; break;
-      case '"': o += "&quot;"; break;
-      case '\'': o += "&#39;"; break;
-      default: o += c; break;
-    }
-  }
-  return o;
-}
-
-static String jsonEscape(const String &s) {
-  String o;
-  o.reserve(s.length() + 8);
-  for (size_t i = 0; i < s.length(); i++) {
-    char c = s[i];
-    switch (c) {
-      case '\\': o += "\\\\"; break;
-      case '"': o += "\\\""; break;
-      case '\n': o += "\\n"; break;
-      case '\r': o += "\\r"; break;
-      case '\t': o += "\\t"; break;
-      default: o += c; break;
-    }
-  }
-  return o;
-}
-
-static String configPage(const String &notice = "") {
-  String apMode = (WiFi.getMode() == WIFI_AP || WiFi.getMode() == WIFI_AP_STA) ? "AP" : "STA";
-
-  String page;
-  page.reserve(4000);
-  page += "<!doctype html><html><head><meta charset='utf-8'>";
-  page += "<meta name='viewport' content='width=device-width,initial-scale=1'>";
-  page += "<title>Humidifier Setup</title></head><body>";
-  page += "<h2>Humidifier Setup</h2>";
-  page += "<div>Device: <b>" + htmlEscape(deviceId()) + "</b></div>";
-  page += "<div>WiFi mode: <b>" + apMode + "</b></div>";
-  page += "<p><a href='/update'>Firmware update</a></p>";
-  page += "<p><a href='/logs'>Logs</a></p>";
-
-  if (notice.length() > 0) {
-    page += "<p><b>" + htmlEscape(notice) + "</b></p>";
-  }
-
-  page += "<form method='POST' action='/save'>";
-
-  page += "<h3>WiFi</h3>";
-  page += "SSID:<br><input name='wifi_ssid' maxlength='32' value='" + htmlEscape(String(config.wifiSsid)) + "'><br>";
-  page += "Password:<br><input name='wifi_pass' type='password' maxlength='64' value='" + htmlEscape(String(config.wifiPass)) + "'><br>";
-
-  page += "<h3>Web Access</h3>";
-  page += "Username:<br><input name='web_user' maxlength='32' value='" + htmlEscape(String(config.webUser)) + "'><br>";
-  page += "New password (leave blank to keep):<br><input name='web_pass' type='password' maxlength='64' value=''><br>";
-  page += "Confirm new password:<br><input name='web_pass2' type='password' maxlength='64' value=''><br>";
-
-  page += "<h3>MQTT</h3>";
-  page += "Host:<br><input name='mqtt_host' maxlength='64' value='" + htmlEscape(String(config.mqttHost)) + "'><br>";
-  page += "Port:<br><input name='mqtt_port' type='number' min='1' max='65535' value='" + String(config.mqttPort) + "'><br>";
-  page += "User:<br><input name='mqtt_user' maxlength='64' value='" + htmlEscape(String(config.mqttUser)) + "'><br>";
-  page += "Password:<br><input name='mqtt_pass' type='password' maxlength='64' value='" + htmlEscape(String(config.mqttPass)) + "'><br>";
-
-  page += "<h3>Home Assistant</h3>";
-  page += String("Enable MQTT Discovery: <input type='checkbox' name='ha_disc' value='1'") + (config.haDiscoveryEnabled ? " checked" : "") + "><br>";
-  page += "Discovery prefix:<br><input name='ha_prefix' maxlength='32' value='" + htmlEscape(String(config.haDiscoveryPrefix)) + "'><br>";
-  page += "Device name in HA (optional):<br><input name='ha_name' maxlength='64' value='" + htmlEscape(String(config.haDeviceName)) + "'><br>";
-  page += "<p><button type='submit'>Save & Reboot</button></p>";
-
-  page += "<h3>Topics</h3>";
-  page += "Base topic:<br><input name='base_topic' maxlength='128' value='" + htmlEscape(String(config.baseTopic)) + "'><br>";
-  page += "External humidity topic (subscribe):<br><input name='t_hum_in' maxlength='128' value='" + htmlEscape(String(config.topicHumidityIn)) + "'><br>";
-  page += "Setpoint topic (subscribe):<br><input name='t_set_in' maxlength='128' value='" + htmlEscape(String(config.topicSetpointIn)) + "'><br>";
-  page += "Enable topic (subscribe):<br><input name='t_en_in' maxlength='128' value='" + htmlEscape(String(config.topicEnableIn)) + "'><br>";
-
-  page += "<h3>Control</h3>";
-  page += "Relay pin (GPIO):<br><input name='relay_pin' type='number' min='0' max='39' value='" + String(config.relayPin) + "'><br>";
-  page += "Relay inverted (1=ON->LOW):<br><input name='relay_inv' maxlength='5' value='" + String(config.relayInverted ? "1" : "0") + "'><br>";
-  page += "Hysteresis (%RH):<br><input name='hyst' type='number' step='0.1' value='" + String(config.hysteresis, 1) + "'><br>";
-  page += "Humidity min interval (sec):<br><input name='hum_int_sec' type='number' min='0' value='" + String(config.humidityMinIntervalMs / 1000U) + "'><br>";
-
-  page += "<h3>Diagnostics</h3>";
-  page += "Log level:<br><select name='log_level'>";
-  page += String("<option value='0'") + (config.logLevel == 0 ? " selected" : "") + ">ERROR</option>";
-  page += String("<option value='1'") + (config.logLevel == 1 ? " selected" : "") + ">WARN</option>";
-  page += String("<option value='2'") + (config.logLevel == 2 ? " selected" : "") + ">INFO</option>";
-  page += String("<option value='3'") + (config.logLevel == 3 ? " selected" : "") + ">DEBUG</option>";
-  page += "</select><br>";
-
-  page += "Hang timeout (sec, 0=off):<br><input name='hang_sec' type='number' min='0' max='86400' value='" + String(config.hangTimeoutSec) + "'><br>";
-  page += "Hang action:<br><select name='hang_act'>";
-  page += String("<option value='1'") + (config.hangAction == 1 ? " selected" : "") + ">Restart MQTT</option>";
-  page += String("<option value='2'") + (config.hangAction == 2 ? " selected" : "") + ">Reboot device</option>";
-  page += "</select><br>";
-
-  page += "<p><button type='submit'>Save & Reboot</button></p>";
-  page += "</form>";
-
-  page += "<hr>";
-  page += "<h3>Quick control</h3>";
-  page += "<form method='POST' action='/control'>";
-  page += "Enable automation: <select name='enabled'>";
-  page += String("<option value='1'") + (systemEnabled ? " selected" : "") + ">ON</option>";
-  page += String("<option value='0'") + (!systemEnabled ? " selected" : "") + ">OFF</option>";
-  page += "</select><br>";
-  page += "Target humidity (%RH):<br><input name='setpoint' type='number' min='" + String(SETPOINT_MIN, 0) + "' max='" + String(SETPOINT_MAX, 0) + "' step='0.1' value='" + String(targetHumidity, 1) + "'><br>";
-  page += "<p><button type='submit'>Apply</button></p>";
-  page += "</form>";
-
-  page += "<hr>";
-  page += "<h3>Status</h3>";
-  page += "Enabled: <b>" + String(systemEnabled ? "YES" : "NO") + "</b><br>";
-  page += "Relay: <b>" + String(relayOn ? "ON" : "OFF") + "</b><br>";
-  page += "Target humidity: <b>" + String(targetHumidity, 1) + "</b><br>";
-  page += "Current humidity: <b>" + (isnan(currentHumidity) ? String("N/A") : String(currentHumidity, 1)) + "</b><br>";
-  if (lastHumiditySeenMs > 0) {
-    page += "Last humidity seen: <b>" + String((millis() - lastHumiditySeenMs) / 1000U) + "s ago</b><br>";
-  }
-  page += "WiFi IP: <b>" + WiFi.localIP().toString() + "</b><br>";
-  page += "MQTT: <b>" + String(mqtt.connected() ? "connected" : "disconnected") + "</b><br>";
-
-  page += "</body></html>";
-  return page;
-}
-
-static bool httpIsAuthorized() {
-  if (captivePortalActive) return true;
-  return web.authenticate(config.webUser, config.webPass);
+void HttpRequest::attach(WiFiClient *client, bool keepAlive) {
+  client_ = client;
+  fd_ = client ? client->fd() : -1;
+  keepAliveAllowed_ = keepAlive;
+  failed_ = false;
+  rxPos_ = rxLen_ = 0;
+  reset();
 }
 
-static bool httpRequireAuthorized() {
-  if (httpIsAuthorized()) return true;
-  web.requestAuthentication(BASIC_AUTH, "Humidifier", "Authentication required");
-  return false;
+// Clears the previous request; bytes already received for the next one are kept.
+void HttpRequest::reset() {
+  method_ = HTTP_REQ_GET;
+  http10_ = false;
+  keepAlive_ = false;
+  expectContinue_ = false;
+  chunkedBody_ = false;
+  contentLength_ = 0;
+  line_[0] = '\0';
+  path_ = line_;
+  argCount_ = 0;
+  headerLen_ = 0;
+  for (int16_t &ofs : headerOfs_) ofs = -1;
+  free(body_);
+  body_ = nullptr;
+  upload_ = HttpUpload();
+  uploadHandler_ = nullptr;
+  parser_ = nullptr;
+  uploadStarted_ = false;
+  inFile_ = false;
+  respLen_ = 0;
+  respHeaders_[0] = '\0';
+  responded_ = false;
+  streaming_ = false;
+  chunked_ = false;
+  detached_ = false;
 }
 
-static void httpSetupHandlers() {
-  web.on("/", HTTP_GET, []() {
-    if (!httpRequireAuthorized()) return;
-    web.send(200, "text/html", configPage());
-  });
+// Refills the receive buffer: 1 = data, 0 = nothing within timeoutMs, -1 = closed.
+int HttpRequest::fill(uint32_t timeoutMs) {
+  if (!client_ || failed_) return -1;
+  if (!httpWaitSocket(fd_, true, timeoutMs)) return 0;
+  const ssize_t n = recv(fd_, rx_, sizeof(rx_), MSG_DONTWAIT);
+  if (n > 0) {
+    rxPos_ = 0;
+    rxLen_ = (uint16_t)n;
+    return 1;
+  }
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+  failed_ = true;
+  return -1;
+}
 
-  web.on("/logs", HTTP_GET, []() {
-    if (!httpRequireAuthorized()) return;
+// Waits for the first byte of a request. An idle keep-alive connection gives its
+// worker up early when shed() reports connections waiting for one.
+bool HttpRequest::awaitRequest(uint32_t idleMs, bool (*shed)()) {
+  const uint32_t start = millis();
+  while (rxPos_ == rxLen_) {
+    const uint32_t idle = millis() - start;
+    if (idle >= idleMs || (shed && shed())) return false;
+    const uint32_t wait = idleMs - idle;
+    if (fill(wait < 100 ? wait : 100) < 0) return false;
+  }
+  return true;
+}
 
-    bool plain = web.hasArg("plain") && web.arg("plain") == "1";
+// One line without its CR LF, truncated to size - 1; returns the full length, or -1 if
+// the connection closed or the deadline passed first.
+int HttpRequest::readLine(char *out, size_t size, uint32_t deadline) {
+  size_t len = 0;
+  for (;;) {
+    while (rxPos_ == rxLen_) {
+      const int32_t left = (int32_t)(deadline - millis());
+      if (left <= 0 || fill((uint32_t)left) < 0) return -1;
+    }
+    const char c = (char)rx_[rxPos_++];
+    if (c == '\n') break;
+    if (c == '\r') continue;
+    if (len + 1 < size) out[len] = c;
+    len++;
+  }
+  out[len < size ? len : size - 1] = '\0';
+  return (int)len;
+}
+
+// Next body bytes straight from the receive buffer; 0 if the connection closed or the
+// client sent nothing for HTTP_READ_TIMEOUT_MS.
+size_t HttpRequest::readSome(const uint8_t *&data, size_t max) {
+  while (rxPos_ == rxLen_) {
+    if (fill(HTTP_READ_TIMEOUT_MS) <= 0) {
+      failed_ = true;
+      return 0;
+    }
+  }
+  size_t n = rxLen_ - rxPos_;
+  if (n > max) n = max;
+  data = rx_ + rxPos_;
+  rxPos_ += (uint16_t)n;
+  return n;
+}
+
+void HttpRequest::keepHeader(const char *name, const char *value) {
+  for (uint8_t i = 0; i < HTTP_KEPT_HEADER_COUNT; i++) {
+    if (strcasecmp(name, HTTP_KEPT_HEADERS[i]) != 0) continue;
+    const size_t n = strlen(value) + 1;
+    if (headerOfs_[i] < 0 && headerLen_ + n <= sizeof(headers_)) {
+      memcpy(headers_ + headerLen_, value, n);
+      headerOfs_[i] = (int16_t)headerLen_;
+      headerLen_ += (uint16_t)n;
+    }
+    return;
+  }
+}
+
+// Answers a request that cannot be served and ends the connection after it.
+bool HttpRequest::fail(int code, const char *message) {
+  keepAlive_ = false;
+  send(code, "text/plain", message);
+  return false;
+}
+
+// Request line and headers, within HTTP_READ_TIMEOUT_MS. False if the connection is
+// to be closed; a malformed request has been answered by then.
+bool HttpRequest::readHead() {
+  const uint32_t deadline = millis() + HTTP_READ_TIMEOUT_MS;
+  int len;
+  do {
+    len = readLine(line_, sizeof(line_), deadline);
+    if (len < 0) return false;
+  } while (len == 0); // empty lines before a request are allowed (RFC 9112)
+  if ((size_t)len >= sizeof(line_)) return fail(414, "Request line too long.\n");
+  HttpRequestLine rl;
+  if (!httpParseRequestLine(line_, rl)) return fail(400, "Bad request line.\n");
+  method_ = rl.method;
+  http10_ = rl.http10;
+  path_ = rl.path;
+  keepAlive_ = !http10_;
+  argCount_ = httpParseArgs(rl.query, args_, 0, HTTP_ARGS_MAX);
+
+  char line[HTTP_LINE_MAX];
+  for (;;) {
+    len = readLine(line, sizeof(line), deadline);
+    if (len < 0) return false;
+    if (len == 0) break;
+    char *value = strchr(line, ':');
+    if (!value) continue;
+    *value++ = '\0';
+    while (*value == ' ' || *value == '\t') value++;
+    for (char *end = value + strlen(value); end > value && (end[-1] == ' ' || end[-1] == '\t');) *--end = '\0';
+
+    if (strcasecmp(line, "Content-Length") == 0) {
+      char *end;
+      contentLength_ = (uint32_t)strtoul(value, &end, 10);
+      if (end == value || *end != '\0') return fail(400, "Bad Content-Length.\n");
+    } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+      chunkedBody_ = true;
+    } else if (strcasecmp(line, "Connection") == 0) {
+      if (httpHeaderHasToken(value, "close")) {
+        keepAlive_ = false;
+      } else if (httpHeaderHasToken(value, "keep-alive")) {
+        keepAlive_ = true;
+      }
+    } else if (strcasecmp(line, "Expect") == 0) {
+      expectContinue_ = strcasecmp(value, "100-continue") == 0;
+    } else {
+      keepHeader(line, value);
+    }
+  }
+  if (!keepAliveAllowed_) keepAlive_ = false;
+  if (chunkedBody_) return fail(411, "Chunked request bodies are not supported.\n");
+  return true;
+}
+
+// A multipart/form-data POST to an upload route streams its file parts to the upload
+// handler; any other body of up to HTTP_FORM_MAX is read, and its fields added to the
+// args if it is urlencoded. False if the connection is to be closed.
+bool HttpRequest::readBody(HttpHandler uploadHandler) {
+  if (contentLength_ == 0) return true;
+  const char *type = header("Content-Type");
+  const bool multipart = strncasecmp(type, "multipart/form-data", 19) == 0;
+  if (!(uploadHandler && multipart) && contentLength_ > HTTP_FORM_MAX) {
+    return fail(413, "Request body too large.\n");
+  }
+  if (expectContinue_ && !write("HTTP/1.1 100 Continue\r\n\r\n", 25)) return false;
+  if (uploadHandler && multipart) return readUpload(uploadHandler);
+
+  body_ = (char *)malloc(contentLength_ + 1);
+  if (!body_) return fail(503, "Out of memory.\n");
+  for (uint32_t got = 0; got < contentLength_;) {
+    const uint8_t *p;
+    const size_t n = readSome(p, contentLength_ - got);
+    if (n == 0) return false;
+    memcpy(body_ + got, p, n);
+    got += (uint32_t)n;
+  }
+  body_[contentLength_] = '\0';
+  if (strncasecmp(type, "application/x-www-form-urlencoded", 33) == 0) {
+    argCount_ = httpParseArgs(body_, args_, argCount_, HTTP_ARGS_MAX);
+  }
+  return true;
+}
+
+bool HttpRequest::readUpload(HttpHandler handler) {
+  char boundary[MULTIPART_BOUNDARY_MAX + 1];
+  MultipartParser parser;
+  if (!httpHeaderParam(header("Content-Type"), "boundary", boundary, sizeof(boundary)) ||
+      !parser.begin(boundary, onMultipart, this)) {
+    return fail(400, "Bad multipart boundary.\n");
+  }
+  uploadHandler_ = handler;
+  parser_ = &parser;
+  uint32_t left = contentLength_;
+  bool ok = true;
+  while (ok && left > 0) {
+    const uint8_t *p;
+    const size_t n = readSome(p, left);
+    if (n == 0) break;
+    left -= (uint32_t)n;
+    ok = parser.feed(p, n);
+  }
+  parser_ = nullptr;
+  if (ok && left == 0 && parser.done()) return true;
+
+  // Whoever saw START gets to clean up, even if the part itself was complete.
+  if (uploadStarted_) {
+    upload_.status = HTTP_UPLOAD_ABORTED;
+    upload_.buf = nullptr;
+    upload_.currentSize = 0;
+    handler(*this);
+  }
+  if (left > 0 && ok) return false; // connection lost
+  return fail(400, "Bad multipart body.\n");
+}
+
+void HttpRequest::onMultipart(void *ctx, MultipartEvent event, const uint8_t *data, size_t len) {
+  HttpRequest &req = *static_cast<HttpRequest *>(ctx);
+  HttpUpload &up = req.upload_;
+  switch (event) {
+    case MULTIPART_PART_BEGIN:
+      if (req.parser_->filename()[0] == '\0') return; // a plain form field
+      req.inFile_ = true;
+      req.uploadStarted_ = true;
+      up.status = HTTP_UPLOAD_START;
+      snprintf(up.filename, sizeof(up.filename), "%s", req.parser_->filename());
+      up.buf = nullptr;
+      up.currentSize = 0;
+      up.totalSize = 0;
+      break;
+    case MULTIPART_DATA:
+      if (!req.inFile_) return;
+      up.status = HTTP_UPLOAD_WRITE;
+      up.buf = data;
+      up.currentSize = len;
+      up.totalSize += len;
+      break;
+    case MULTIPART_PART_END:
+      if (!req.inFile_) return;
+      req.inFile_ = false;
+      up.status = HTTP_UPLOAD_END;
+      up.buf = nullptr;
+      up.currentSize = 0;
+      break;
+  }
+  req.uploadHandler_(req);
+}
+
+// Completes whatever the handler left open; true if the connection takes another request.
+bool HttpRequest::finish() {
+  if (detached_) return false;
+  if (!responded_) {
+    send(500, "text/plain", "No response.\n");
+  } else if (streaming_) {
+    endChunked();
+  }
+  return keepAlive_ && !failed_;
+}
+
+// Status line and headers; length < 0 = body of unknown length (beginChunked()).
+bool HttpRequest::writeHead(int code, const char *contentType, long length) {
+  if (responded_) return false;
+  responded_ = true;
+  char head[192 + HTTP_RESP_HEADERS_MAX];
+  size_t n = (size_t)snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\n", code, httpStatusText(code));
+  if (code != 304) {
+    n += (size_t)snprintf(head + n, sizeof(head) - n, "Content-Type: %s\r\n", contentType);
+    if (length >= 0) {
+      n += (size_t)snprintf(head + n, sizeof(head) - n, "Content-Length: %ld\r\n", length);
+    } else if (http10_) {
+      keepAlive_ = false; // the body ends with the connection
+    } else {
+      n += (size_t)snprintf(head + n, sizeof(head) - n, "Transfer-Encoding: chunked\r\n");
+      chunked_ = true;
+    }
+  }
+  n += (size_t)snprintf(head + n, sizeof(head) - n, "Connection: %s\r\n", keepAlive_ ? "keep-alive" : "close");
+  memcpy(head + n, respHeaders_, respLen_);
+  n += respLen_;
+  memcpy(head + n, "\r\n", 2);
+  return write(head, n + 2);
+}
+
+// All of it, or false (and the connection given up) once the client has taken nothing
+// for HTTP_WRITE_TIMEOUT_MS.
+bool HttpRequest::write(const void *data, size_t len) {
+  if (!client_) return true;
+  if (failed_) return false;
+  const uint8_t *p = (const uint8_t *)data;
+  uint32_t progressMs = millis();
+  while (len > 0) {
+    const ssize_t sent = ::send(fd_, p, len, MSG_DONTWAIT);
+    if (sent > 0) {
+      p += sent;
+      len -= (size_t)sent;
+      progressMs = millis();
+      continue;
+    }
+    if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) break;
+    if ((millis() - progressMs) >= HTTP_WRITE_TIMEOUT_MS) break;
+    httpWaitSocket(fd_, false, 100);
+  }
+  if (len > 0) failed_ = true;
+  return len == 0;
+}
+
+struct HttpRoute {
+  const char *path;
+  HttpMethod method;
+  HttpHandler handler;
+  HttpHandler upload; // file parts of a multipart body, before handler runs
+};
+
+static HttpRoute httpRoutes[HTTP_ROUTES_MAX];
+static uint8_t httpRouteCount = 0;
+static HttpHandler httpNotFound = nullptr;
+
+static WiFiServer httpServer(HTTP_PORT);
+
+// Routes are registered once, before webStarted lets the server accept.
+static void httpOn(const char *path, HttpMethod method, HttpHandler handler, HttpHandler upload = nullptr) {
+  if (httpRouteCount == HTTP_ROUTES_MAX) {
+    logf(LOG_ERROR, "[HTTP] Route table full, %s not served", path);
+    return;
+  }
+  httpRoutes[httpRouteCount++] = {path, method, handler, upload};
+}
+
+// One request; false once the connection is to be closed.
+static bool httpServeRequest(HttpRequest &req) {
+  req.reset();
+  if (!req.readHead()) return false;
+  httpRequestCount++;
+  const HttpRoute *route = nullptr;
+  for (uint8_t i = 0; i < httpRouteCount; i++) {
+    if (httpRoutes[i].method == req.method() && strcmp(httpRoutes[i].path, req.path()) == 0) {
+      route = &httpRoutes[i];
+      break;
+    }
+  }
+  if (!req.readBody(route ? route->upload : nullptr)) return false;
+  const HttpHandler handler = route ? route->handler : httpNotFound;
+  if (handler) handler(req);
+  return req.finish();
+}
+
+// Serves requests on the connection until it closes, fails or stays idle (one request
+// only without keepAlive).
+static void httpServe(HttpRequest &req, WiFiClient &client, bool keepAlive, bool (*shed)()) {
+  req.attach(&client, keepAlive);
+  uint32_t idleMs = HTTP_READ_TIMEOUT_MS;
+  while (req.awaitRequest(idleMs, shed) && httpServeRequest(req)) idleMs = HTTP_KEEPALIVE_MS;
+  req.attach(nullptr, false);
+  client.stop(); // drops this handle; an event stream keeps its own
+}
+
+// Answers a connection nobody can take without waiting on the client.
+static void httpRefuse(WiFiClient &client, const char *body) {
+  char resp[192];
+  const int n = snprintf(resp, sizeof(resp),
+                         "HTTP/1.1 503 Service Unavailable\r\nContent-Type: text/plain\r\nContent-Length: %u\r\n"
+                         "Retry-After: 1\r\nConnection: close\r\n\r\n%s",
+                         (unsigned)strlen(body), body);
+  if (n > 0) send(client.fd(), resp, (size_t)n < sizeof(resp) ? (size_t)n : sizeof(resp) - 1, MSG_DONTWAIT);
+  client.stop();
+  httpRefusedCount++;
+}
+
+#if HUM_SPLIT_TASKS
+static QueueHandle_t httpQueue = nullptr; // accepted connections (WiFiClient *) for the workers
+static HttpRequest httpWorkerRequests[HTTP_WORKERS];
+
+static bool httpConnectionsWaiting() {
+  return uxQueueMessagesWaiting(httpQueue) > 0;
+}
+
+static void httpWorkerTask(void *arg) {
+  HttpRequest &req = *static_cast<HttpRequest *>(arg);
+  for (;;) {
+    WiFiClient *client = nullptr;
+    if (xQueueReceive(httpQueue, &client, portMAX_DELAY) != pdTRUE) continue;
+    httpServe(req, *client, true, httpConnectionsWaiting);
+    delete client;
+  }
+}
+#else
+static HttpRequest httpLoopRequest;
+#endif
+
+// New connections go to a worker, or get a 503 when all of them are busy; the
+// acceptor itself never waits on a client.
+static void httpAcceptTick() {
+  for (uint8_t i = 0; i < HTTP_ACCEPTS_PER_TICK; i++) {
+    WiFiClient client = httpServer.available();
+    if (!client) return;
+#if HUM_SPLIT_TASKS
+    WiFiClient *queued = new (std::nothrow) WiFiClient(client);
+    if (queued && xQueueSend(httpQueue, &queued, 0) == pdTRUE) continue;
+    delete queued;
+    httpRefuse(client, "All HTTP workers are busy.\n");
+#else
+    httpServe(httpLoopRequest, client, false, nullptr);
+    return;
+#endif
+  }
+}
+
+#if HUM_FEATURE_CAPTIVE_DNS
+static DNSServer dns;
+#endif
+
+// PubSubClient has no non-blocking handshake: mqttTick() sends CONNECT and waits for the
+// CONNACK itself, then mqtt.connect() runs over a socket that already holds the CONNACK
+// and returns at once. The library's own CONNECT is dropped here, so the broker only
+// ever sees one.
+class MqttSocketClient : public WiFiClient {
+ public:
+  using WiFiClient::operator=;
+  using WiFiClient::write;
+
+  size_t write(const uint8_t *buf, size_t size) override {
+    if (dropNextWrite) {
+      dropNextWrite = false;
+      return size;
+    }
+    return WiFiClient::write(buf, size);
+  }
+
+  bool dropNextWrite = false;
+};
+
+static MqttSocketClient wifiClient;
+static PubSubClient mqtt(wifiClient);
+
+// Every publish goes through these so the TX and failure counters stay complete.
+static bool mqttCountPublish(bool ok) {
+  if (ok) {
+    metrics.mqttTx++;
+  } else {
+    metrics.mqttPublishFailed++;
+  }
+  return ok;
+}
+
+static bool mqttPublish(const char *topic, const char *payload, bool retained) {
+  return mqttCountPublish(mqtt.publish(topic, payload, retained));
+}
+
+static bool mqttPublish(const char *topic, const uint8_t *payload, unsigned int length, bool retained) {
+  return mqttCountPublish(mqtt.publish(topic, payload, length, retained));
+}
+
+// State publishes go through a preallocated outbound queue that the network loop
+// drains in enqueue order, at most MQTT_TX_BUDGET_BYTES per iteration (at least one
+// message), so a burst after a reconnect is spread over several iterations. Slots are
+// keyed by topic pointer (state topics live in ZoneTopics for the whole session): a
+// newer value for a queued retained topic replaces it instead of queueing behind it.
+//
+// PubSubClient only publishes with QoS 0. For MQTT_OUT_CONFIRM topics the device
+// subscribes to its own topic and keeps the slot after sending until the broker
+// echoes the payload back, re-sending after MQTT_CONFIRM_TIMEOUT_MS and on reconnect,
+// which covers a TCP session that died with the publish still in the send buffer.
+// Discovery (streamed, large), the online flag and telemetry are still sent directly.
+static constexpr size_t MQTT_OUT_SLOTS = 20;
+static constexpr size_t MQTT_OUT_PAYLOAD_MAX = 208; // fits the JSON state document
+static constexpr size_t MQTT_TX_BUDGET_BYTES = 1024;
+static constexpr uint32_t MQTT_CONFIRM_TIMEOUT_MS = 3000;
+static constexpr uint8_t MQTT_CONFIRM_ATTEMPTS = 5;
+
+static constexpr uint8_t MQTT_OUT_RETAINED = 0x01;
+static constexpr uint8_t MQTT_OUT_CONFIRM = 0x02;
+
+struct MqttOutbound {
+  const char *topic; // nullptr = free slot
+  uint32_t seq;      // enqueue order
+  uint32_t sentMs;   // 0 = not sent yet; else waiting for the echo
+  uint16_t len;
+  uint8_t flags;
+  uint8_t attempts;
+  char payload[MQTT_OUT_PAYLOAD_MAX];
+};
+
+static MqttOutbound mqttOut[MQTT_OUT_SLOTS];
+static uint32_t mqttOutSeq = 0;
+
+// Network task only. Returns false if the queue is full (the caller keeps the value
+// pending and retries), which is the backpressure towards the state flush.
+static bool mqttEnqueue(const char *topic, const void *payload, size_t len, uint8_t flags) {
+  if (len > MQTT_OUT_PAYLOAD_MAX) return false;
+  MqttOutbound *slot = nullptr;
+  if (flags & MQTT_OUT_RETAINED) {
+    for (MqttOutbound &o : mqttOut) {
+      if (o.topic == topic) {
+        slot = &o;
+        break;
+      }
+    }
+  }
+  for (size_t i = 0; !slot && i < MQTT_OUT_SLOTS; i++) {
+    if (!mqttOut[i].topic) slot = &mqttOut[i];
+  }
+  if (!slot) {
+    metrics.mqttQueueFull++;
+    return false;
+  }
+  slot->topic = topic;
+  slot->seq = ++mqttOutSeq;
+  slot->sentMs = 0;
+  slot->len = (uint16_t)len;
+  slot->flags = flags;
+  slot->attempts = 0;
+  memcpy(slot->payload, payload, len);
+  return true;
+}
+
+static bool mqttEnqueue(const char *topic, const char *payload, uint8_t flags) {
+  return mqttEnqueue(topic, payload, strlen(payload), flags);
+}
+
+static uint8_t mqttQueueDepth() {
+  uint8_t n = 0;
+  for (const MqttOutbound &o : mqttOut) n += o.topic ? 1 : 0;
+  return n;
+}
+
+static void mqttDrainQueue(uint32_t now) {
+  if (!mqtt.connected()) return;
+  size_t budget = MQTT_TX_BUDGET_BYTES;
+  for (;;) {
+    MqttOutbound *next = nullptr;
+    for (MqttOutbound &o : mqttOut) {
+      if (!o.topic) continue;
+      if (o.sentMs != 0) {
+        if ((now - o.sentMs) < MQTT_CONFIRM_TIMEOUT_MS) continue;
+        if (o.attempts >= MQTT_CONFIRM_ATTEMPTS) {
+          logf(LOG_WARN, "[MQTT] No echo for %s after %u attempts", o.topic, (unsigned)o.attempts);
+          metrics.mqttConfirmLost++;
+          o.topic = nullptr;
+          continue;
+        }
+      }
+      if (!next || (int32_t)(o.seq - next->seq) < 0) next = &o;
+    }
+    if (!next) return;
+
+    const size_t cost = strlen(next->topic) + next->len;
+    if (cost > budget && budget < MQTT_TX_BUDGET_BYTES) return;
+    // A failed write leaves the slot as it is; the next iteration tries again.
+    if (!mqttPublish(next->topic, (const uint8_t *)next->payload, next->len, (next->flags & MQTT_OUT_RETAINED) != 0)) return;
+    budget = cost < budget ? budget - cost : 0;
+    if (next->attempts > 0) metrics.mqttResent++;
+    next->attempts++;
+    if (next->flags & MQTT_OUT_CONFIRM) {
+      next->sentMs = now ? now : 1;
+    } else {
+      next->topic = nullptr;
+    }
+  }
+}
+
+// The broker sent one of our confirmed topics back; a matching payload completes it.
+static void mqttConfirmEcho(const char *topic, const byte *payload, unsigned int length) {
+  for (MqttOutbound &o : mqttOut) {
+    if (o.topic != topic || o.sentMs == 0) continue;
+    if (o.len == length && memcmp(o.payload, payload, length) == 0) o.topic = nullptr;
+    return;
+  }
+}
+
+// After a reconnect nothing sent on the old session counts as delivered.
+static void mqttQueueResendUnconfirmed() {
+  for (MqttOutbound &o : mqttOut) {
+    if (o.topic && o.sentMs != 0) o.sentMs = 0;
+  }
+}
+
+static std::atomic<bool> captivePortalActive{false}; // read by the HTTP task
+
+#if HUM_FEATURE_ARDUINO_OTA
+static bool otaActive = false;
+
+#ifndef HUM_OTA_PASSWORD
+#define HUM_OTA_PASSWORD ""
+#endif
+#endif
+
+// Compared with fleet announcements; set per build, e.g. -D HUM_FW_VERSION=\"1.4.0\".
+#ifndef HUM_FW_VERSION
+#define HUM_FW_VERSION "dev"
+#endif
+
+// Shared between the control task and the network task (see HUM_SPLIT_TASKS).
+// 32-bit atomics are lock-free on ESP32, so neither side can stall the other.
+// Per-zone values live in Zone, below.
+static std::atomic<bool> mqttLinkUp{false};            // network -> control
+static std::atomic<uint8_t> relayOffRequested{0};      // network -> control: zones (bits) to switch OFF now
+static std::atomic<bool> controlEvalPending{false};     // network -> control: inputs changed
+
+// Humidity sources: zone 0 has the primary topic (config.topicHumidityIn) plus the ones
+// from config.humiditySources, every other zone its own topic, and one zone may also
+// have the local sensor. Each source has its own filter and throttle; the fused value
+// of a zone's sources that reported within config.sourceStaleSec becomes the zone's
+// humidity. Network task only.
+static constexpr uint8_t HUMIDITY_SOURCE_SLOTS = HUMIDITY_SOURCES_MAX + ZONES_MAX;
+
+struct HumiditySource {
+  const char *topic = nullptr; // config.topicHumidityIn, humiditySourceTopics[], a zone topic or the sensor name
+  bool local = false;          // the local sensor: no MQTT route, survives a link loss
+  uint8_t zone = 0;
+  float weight = 1.0f;
+  HumidityFilter filter;
+  float value = NAN;
+  uint32_t lastAcceptMs = 0; // legacy throttle
+  uint32_t lastUpdateMs = 0;
+};
+
+static HumiditySource humiditySources[HUMIDITY_SOURCE_SLOTS];
+static char humiditySourceTopics[HUMIDITY_SOURCES_MAX - 1][129];
+static uint8_t humiditySourceCount = 0;
+
+// Local sensor readings (see localSensorTask()).
+static std::atomic<float> localSensorHumidity{NAN};    // sensor task -> network
+static std::atomic<float> localSensorTemperature{NAN};
+static std::atomic<uint32_t> localSensorReadings{0};   // bumped after each good reading
+static std::atomic<uint32_t> localSensorErrors{0};
+static std::atomic<bool> localSensorOk{false};
+static uint8_t localSensorSource = 0xFF; // index in humiditySources, 0xFF = none
+static uint32_t localSensorSeen = 0;     // network side: readings already taken
+
+// Published state fields. Producers only mark what may have changed (from any task);
+// the network loop flushes once per iteration and writes only topics whose value
+// actually differs from the last published one.
+enum StateField : uint8_t {
+  SF_ENABLED = 1U << 0,
+  SF_RELAY = 1U << 1,
+  SF_SETPOINT = 1U << 2,
+  SF_HUMIDITY = 1U << 3,
+  SF_HUMIDITY_AGE = 1U << 4,
+  SF_REASON = 1U << 5,
+  SF_ALL = 0x3F,
+};
+
+static constexpr uint32_t STATE_FULL_REFRESH_MS = 60000; // periodic republish of every field, 0 = off
+
+static bool stateFullRefreshPending = false;
+
+static TaskHandle_t controlTaskHandle = nullptr;
+
+static uint32_t lastMqttAttemptMs = 0;
+static uint32_t mqttBackoffMs = MQTT_RECONNECT_MIN_MS;
+
+// Connection managers. Both advance one step per loop() iteration and never wait:
+// Wi-Fi progress comes from WiFi events, MQTT uses async DNS and a non-blocking TCP connect.
+enum WifiState : uint8_t {
+  WIFI_ST_IDLE = 0,
+  WIFI_ST_CONNECTING,
+  WIFI_ST_CONNECTED,
+  WIFI_ST_PORTAL,
+};
+
+enum MqttState : uint8_t {
+  MQTT_ST_IDLE = 0,   // no Wi-Fi or no broker configured
+  MQTT_ST_BACKOFF,    // waiting for the next attempt
+  MQTT_ST_RESOLVING,  // async DNS lookup in flight
+  MQTT_ST_CONNECTING, // non-blocking TCP connect in flight
+  MQTT_ST_HANDSHAKE,  // CONNECT sent, waiting for the CONNACK
+  MQTT_ST_CONNECTED,
+};
+
+static WifiState wifiState = WIFI_ST_IDLE;
+static uint32_t wifiStateSinceMs = 0;
+static bool wifiEverConnected = false;
+static std::atomic<bool> webStarted{false}; // routes registered and the server listening
+static uint32_t wifiUpMs = 0; // boot -> first IP, for the boot timing
+static uint32_t mqttUpMs = 0; // boot -> first MQTT session
+
+// Set from the WiFi event task, consumed by loop().
+static volatile bool wifiEvtGotIp = false;
+static volatile bool wifiEvtDisconnected = false;
+
+static MqttState mqttState = MQTT_ST_IDLE;
+static uint32_t mqttStateSinceMs = 0;
+static int mqttSockFd = -1;
+static uint32_t mqttResolvedIp = 0;
+
+// Written by the lwIP DNS callback; the generation tag drops answers to abandoned lookups.
+static volatile bool mqttDnsDone = false;
+static volatile uint32_t mqttDnsIp = 0;
+static volatile uint32_t mqttDnsGen = 0;
+static uint32_t lastStateFullMs = 0;
+
+// Values as last written to the broker; compared against to suppress unchanged publishes.
+struct PublishedState {
+  bool enabled = false;
+  bool relay = false;
+  int32_t setpointX10 = INT32_MIN;
+  int32_t humidityX10 = INT32_MIN;
+  AutomationReason reason = REASON_NONE;
+};
+
+static constexpr size_t TOPIC_MAX = 160;
+static_assert(HUM_MQTT_BUFFER_SIZE >= TOPIC_MAX + MQTT_OUT_PAYLOAD_MAX + 8, "HUM_MQTT_BUFFER_SIZE too small for state");
+
+// Every topic the firmware publishes to, resolved once by buildTopics() after the
+// config is loaded, so the publish path only hands out pointers.
+struct MqttTopics {
+  char statusOnline[TOPIC_MAX];
+  char telemetry[TOPIC_MAX];
+  char otaState[TOPIC_MAX];
+
+  char discPrefix[sizeof(AppConfig::haDiscoveryPrefix)];
+  char discHumidifierOld[TOPIC_MAX]; // legacy 3-segment topic, only ever cleared
+  char discStatus[TOPIC_MAX]; // HA birth/LWT topic, <prefix>/status
+};
+
+static MqttTopics topics;
+
+// State topics live under <base> for zone 0 and <base>zone<N>/ for the others.
+struct ZoneTopics {
+  char stateEnabled[TOPIC_MAX];
+  char stateRelay[TOPIC_MAX];
+  char stateSetpoint[TOPIC_MAX];
+  char stateHumidity[TOPIC_MAX];
+  char stateHumidityAge[TOPIC_MAX];
+  char stateReason[TOPIC_MAX];
+  char stateJson[TOPIC_MAX];
+
+  // Command topics as announced in discovery (configured ones, or the defaults)
+  char cmdEnable[TOPIC_MAX];
+  char cmdSetpoint[TOPIC_MAX];
+};
+
+// One relay and its control state. The atomics are shared by the control and network
+// tasks like the globals above; the rest is set up before the tasks start or belongs
+// to the network task.
+struct Zone {
+  bool active = false;
+  bool localSensor = false; // has the local sensor as a source: regulates without MQTT
+  int relayPin = -1;
+  bool relayInverted = false;
+  float hysteresis = DEFAULT_HYSTERESIS;
+  const char *name = ""; // "" for zone 0, which uses the device name
+
+  std::atomic<bool> enabled{true};
+  std::atomic<bool> relayOn{false};
+  std::atomic<float> target{DEFAULT_SETPOINT};
+  std::atomic<float> humidity{NAN};
+  std::atomic<uint32_t> lastSeenMs{0};
+  std::atomic<uint8_t> samples{0}; // since the MQTT (re)connect, gates relay ON
+  std::atomic<uint8_t> dirty{0};   // StateField bits not yet published
+
+  // Owned by whoever drives the relay GPIO (control task, or loop() without split
+  // tasks); the atomics below are its outputs for the network task.
+  RelayGuard guard;
+  std::atomic<uint8_t> gate{GATE_PASS};  // RelayGate of the last evaluation
+  std::atomic<bool> relayWanted{false};  // controller decision before the guard
+  std::atomic<uint32_t> switches{0};
+  std::atomic<uint32_t> onSeconds{0};
+  std::atomic<uint32_t> onMsLastHour{0};
+
+  // Learns in every mode, so switching to predictive starts with a model. Same owner
+  // as the guard; the model is copied into the atomics after each evaluation.
+  HumidityPredictor predictor;
+  uint32_t predictorSeenMs = 0;
+  std::atomic<float> riseRate{NAN};
+  std::atomic<float> decayRate{NAN};
+  std::atomic<float> overshoot{NAN};
+  std::atomic<float> undershoot{NAN};
+
+  uint8_t freshSources = 0;
+  PublishedState published;
+  bool stateJsonPending = false; // last JSON document failed to go out
+  float persistedTarget = DEFAULT_SETPOINT;
+  bool persistedEnabled = true;
+  uint32_t persistedSwitches = 0;
+  uint32_t persistedOnSeconds = 0;
+  HumidityModel persistedModel = {NAN, NAN, NAN, NAN};
+  uint8_t refresh = 0; // StateField bits a full refresh still has to enqueue
+  ZoneTopics topics;
+
+  // Written by historyTick() (network task) and read by /api/history (HTTP workers)
+  // between historyReadBegin() and historyReadEnd().
+  HistoryRing history;
+  uint32_t historyNextMs = 0;
+  uint32_t historyLastMs = 0; // when the newest sample was taken
+};
+
+static Zone zones[ZONES_MAX];
+
+static uint8_t zoneIndex(const Zone &z) {
+  return (uint8_t)(&z - zones);
+}
+
+// A relay needs an output GPIO that exists on the chip (34..39 are input-only) and is
+// not wired to the SPI flash (6..11); GPIO 20 is only bonded out on the PICO parts.
+// Pins from NVS go through this too before initVariant() touches them.
+static bool relayPinValid(long pin) {
+  if (pin < 0 || pin >= GPIO_NUM_MAX || (pin >= 6 && pin <= 11) || pin == 20) return false;
+  return GPIO_IS_VALID_OUTPUT_GPIO(pin);
+}
+
+// Resolves the zone table from the config; zone 0 is always active.
+static void zonesConfigure() {
+  RelayGuardConfig guardCfg;
+  guardCfg.minOnMs = config.relayMinOnSec * 1000U;
+  guardCfg.minOffMs = config.relayMinOffSec * 1000U;
+  guardCfg.maxDutyPct = config.relayMaxDutyPct;
+  for (uint8_t i = 0; i < ZONES_MAX; i++) {
+    Zone &z = zones[i];
+    if (i == 0) {
+      z.relayPin = config.relayPin;
+      z.relayInverted = config.relayInverted;
+      z.hysteresis = config.hysteresis;
+      z.name = "";
+    } else {
+      const ZoneConfig &zc = config.zones[i - 1];
+      z.relayPin = zc.relayPin;
+      z.relayInverted = zc.relayInverted;
+      z.hysteresis = zc.hysteresis;
+      z.name = zc.name;
+    }
+    z.active = i == 0 || relayPinValid(z.relayPin);
+    z.guard.configure(guardCfg);
+    z.guard.reset(millis(), false);
+  }
+}
+
+static uint8_t historyStore[HISTORY_BYTES];
+// /api/history streams for as long as the client takes, so readers only count
+// themselves in under the mutex and several of them read at once. The writer never
+// waits: it skips the pass while the lock is taken or any reader is active.
+static SemaphoreHandle_t historyLock = nullptr;
+static std::atomic<uint8_t> historyReaders{0};
+
+static void historyReadBegin() {
+  xSemaphoreTake(historyLock, portMAX_DELAY);
+  historyReaders++;
+  xSemaphoreGive(historyLock);
+}
+
+static void historyReadEnd() {
+  historyReaders--;
+}
+
+static void historyConfigure() {
+  if (historyLock == nullptr) historyLock = xSemaphoreCreateMutex();
+  uint8_t active = 0;
+  for (const Zone &z : zones) active += z.active ? 1 : 0;
+  const size_t share = HISTORY_BYTES / active;
+  size_t offset = 0;
+  for (Zone &z : zones) {
+    if (!z.active) continue;
+    z.history.begin(historyStore + offset, share);
+    offset += share;
+  }
+}
+
+// One sample per zone every historySec. Steps missed during a stall (e.g. a blocking
+// reconnect, or a slow /api/history reader holding the lock) are recorded as gaps,
+// at most the whole ring's worth; the current state only goes into the step it is due.
+static void historyTick(uint32_t now) {
+  if (xSemaphoreTake(historyLock, 0) != pdTRUE) return; // next pass catches up
+  if (historyReaders > 0) {
+    xSemaphoreGive(historyLock);
+    return;
+  }
+  const uint32_t stepMs = config.historySec * 1000U;
+  for (Zone &z : zones) {
+    if (!z.active) continue;
+    if (z.historyNextMs == 0) z.historyNextMs = now;
+    if ((int32_t)(now - z.historyNextMs) < 0) continue;
+
+    const uint32_t seenMs = z.lastSeenMs;
+    HistorySample s;
+    s.humidity = (seenMs > 0 && now - seenMs < HUMIDITY_STALE_MS) ? z.humidity.load() : NAN;
+    s.setpoint = z.target;
+    s.relay = z.relayOn;
+    s.enabled = z.enabled;
+
+    uint32_t missed = (now - z.historyNextMs) / stepMs;
+    if (missed > z.history.capacity()) missed = z.history.capacity();
+    HistorySample gap;
+    gap.gap = true;
+    for (uint32_t i = 0; i < missed; i++) z.history.append(gap);
+    z.history.append(s);
+    z.historyNextMs += (missed + 1) * stepMs;
+    if ((int32_t)(now - z.historyNextMs) >= 0) z.historyNextMs = now + stepMs;
+    z.historyLastMs = now;
+  }
+  xSemaphoreGive(historyLock);
+}
+
+static uint32_t mqttDisconnectedSinceMs = 0;
+static uint32_t lastHangActionMs = 0;
+
+static constexpr uint32_t FNV1A_SEED = 2166136261u;
+
+static uint32_t fnv1a(uint32_t h, const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  for (size_t i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+// Formatted once on first use (from setup(), before any task starts).
+static const char *deviceId() {
+  static char buf[32] = {0};
+  if (buf[0] == '\0') {
+    uint64_t mac = ESP.getEfuseMac();
+    snprintf(buf, sizeof(buf), "%s-%04X", HUM_DEVICE_NAME, (unsigned)(mac & 0xFFFF));
+  }
+  return buf;
+}
+
+static void flushRuntimeState(bool now);
+
+#if HUM_FEATURE_ARDUINO_OTA
+static void setupOta() {
+  if (otaActive) return;
+
+  const char *host = deviceId();
+  ArduinoOTA.setHostname(host);
+
+  static constexpr const char *OTA_PASSWORD = HUM_OTA_PASSWORD;
+  if (OTA_PASSWORD[0] != '\0') ArduinoOTA.setPassword(OTA_PASSWORD);
+
+  ArduinoOTA.onStart([]() {
+    logWriteLine(LOG_INFO, "[OTA] Start");
+  });
+  ArduinoOTA.onEnd([]() {
+    logWriteLine(LOG_INFO, "[OTA] End");
+    flushRuntimeState(true);
+  });
+  ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
+    if (total == 0) return;
+    const unsigned int pct = (progress * 100U) / total;
+    static unsigned int lastPct = 101;
+    if (pct != lastPct) {
+      lastPct = pct;
+      logf(LOG_INFO, "[OTA] %u%%", pct);
+    }
+  });
+  ArduinoOTA.onError([](ota_error_t error) {
+    logf(LOG_ERROR, "[OTA] Error: %u", (unsigned)error);
+  });
+
+  ArduinoOTA.begin();
+  otaActive = true;
+  logf(LOG_INFO, "[OTA] Ready. Hostname: %s", host);
+}
+#endif
+
+#if HUM_OTA_WRITER
+// Firmware images written through Update from a byte stream (the /update upload;
+// any other source goes through the same calls). A gzip stream (1f 8b) is inflated
+// on the fly with the ROM inflater into a 32 KB window; anything else must be a raw
+// image (magic E9). The SHA-256 covers the decompressed image, so the digest of
+// firmware.bin checks both firmware.bin and firmware.bin.gz. An interrupted stream
+// keeps the Update session and the inflater state, and can be continued from the
+// byte count it reached until OTA_RESUME_TIMEOUT_MS passes. One job at a time, driven
+// by one task at a time (an HTTP worker for uploads, the fleet task for pulls, see
+// otaClaim()); the progress fields are atomic so the network task can report either.
+enum OtaPhase : uint8_t {
+  OTA_IDLE,
+  OTA_RUNNING,
+  OTA_INTERRUPTED,
+  OTA_DONE,
+  OTA_FAILED,
+};
+
+static const char *otaPhaseName(OtaPhase p) {
+  switch (p) {
+    case OTA_RUNNING:
+      return "running";
+    case OTA_INTERRUPTED:
+      return "interrupted";
+    case OTA_DONE:
+      return "done";
+    case OTA_FAILED:
+      return "failed";
+    default:
+      return "idle";
+  }
+}
+
+// gzip member framing around the deflate data (RFC 1952).
+enum OtaGzipStage : uint8_t {
+  GZ_HEADER,
+  GZ_EXTRA_LEN,
+  GZ_EXTRA,
+  GZ_NAME,
+  GZ_COMMENT,
+  GZ_HCRC,
+  GZ_DEFLATE,
+  GZ_TRAILER,
+  GZ_END,
+};
+
+static constexpr uint8_t GZ_FHCRC = 0x02;
+static constexpr uint8_t GZ_FEXTRA = 0x04;
+static constexpr uint8_t GZ_FNAME = 0x08;
+static constexpr uint8_t GZ_FCOMMENT = 0x10;
+static constexpr uint8_t ESP_IMAGE_MAGIC = 0xE9;
+
+static constexpr uint32_t OTA_RESUME_TIMEOUT_MS = 300000;
+static constexpr uint8_t OTA_PROGRESS_STEP_PCT = 5;
+static constexpr uint32_t OTA_SERVICE_INTERVAL_MS = 20;
+
+static const char OTA_SOURCE_WEB[] = "web";
+static const char OTA_SOURCE_FLEET[] = "fleet";
+
+struct OtaJob {
+  std::atomic<OtaPhase> phase{OTA_IDLE};
+  const char *source = "";
+  bool started = false; // Update.begin() called (after the first bytes)
+  bool gzip = false;
+  std::atomic<uint32_t> received{0}; // stream bytes consumed (the resume offset)
+  std::atomic<uint32_t> written{0};  // image bytes handed to Update
+  std::atomic<uint32_t> total{0};    // expected stream size, 0 = unknown
+  uint32_t lastActivityMs = 0;
+  bool haveDigest = false;
+  uint8_t digest[32];
+  mbedtls_sha256_context sha;
+  char error[64] = "";
+
+  OtaGzipStage gzStage = GZ_HEADER;
+  uint8_t gzFlags = 0;
+  uint8_t gzBuf[10];
+  uint16_t gzPos = 0;
+  uint16_t gzSkip = 0;
+  uint32_t gzCrc = 0;
+  uint8_t gzTail[8]; // last stream bytes: the trailer, wherever the inflater stopped
+  tinfl_decompressor *inflater = nullptr;
+  uint8_t *dict = nullptr;
+  size_t dictOfs = 0;
+
+  uint8_t reportedStep = 0xFF;
+  OtaPhase reportedPhase = OTA_IDLE;
+};
+
+static OtaJob ota;
+static std::atomic<uint32_t> otaSeq{0}; // bumped on every progress report (SSE, MQTT)
+
+static bool otaJobOpen() {
+  return ota.phase == OTA_RUNNING || ota.phase == OTA_INTERRUPTED;
+}
+
+// Update has one writer at a time: an upload request (claimed with its HttpRequest, so
+// a second upload is refused while one is received), the fleet task from start to exit,
+// or the HTTP task expiring a stalled upload. Whoever holds the claim may begin, resume
+// or fail the job; the others back off.
+static std::atomic<const void *> otaOwner{nullptr};
+
+static bool otaClaim(const void *owner) {
+  const void *expected = nullptr;
+  return otaOwner.compare_exchange_strong(expected, owner) || expected == owner;
+}
+
+static void otaUnclaim(const void *owner) {
+  const void *expected = owner;
+  otaOwner.compare_exchange_strong(expected, nullptr);
+}
+
+static uint8_t otaPercent() {
+  if (ota.phase == OTA_DONE) return 100;
+  const uint32_t total = ota.total;
+  if (total == 0) return 0;
+  const uint64_t pct = (uint64_t)ota.received * 100U / total;
+  return (uint8_t)(pct > 99 ? 99 : pct);
+}
+
+#if HUM_FEATURE_FLEET_OTA
+// Fleet update progress (see onFleetMessage); shown with the OTA state.
+enum FleetPhase : uint8_t {
+  FLEET_IDLE,
+  FLEET_WAITING,     // rollout delay or retry backoff
+  FLEET_DOWNLOADING, // fleet task running
+  FLEET_READY,       // image verified and set for boot, waiting for the relays to be OFF
+  FLEET_FAILED,
+};
+
+static const char *fleetPhaseName(FleetPhase p) {
+  switch (p) {
+    case FLEET_WAITING:
+      return "waiting";
+    case FLEET_DOWNLOADING:
+      return "downloading";
+    case FLEET_READY:
+      return "ready";
+    case FLEET_FAILED:
+      return "failed";
+    default:
+      return "idle";
+  }
+}
+
+static std::atomic<FleetPhase> fleetPhase{FLEET_IDLE};
+static FleetAnnouncement fleetTarget = {}; // network task only; the fleet task gets a copy
+static char fleetAppliedSha[65] = "";      // digest of the last image the fleet installed
+// fleetTarget.version for other tasks (formatOtaJson() also runs in the HTTP task).
+static char fleetVersion[sizeof(FleetAnnouncement::version)] = "";
+static portMUX_TYPE fleetVersionMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void fleetSetTarget(const FleetAnnouncement &a) {
+  fleetTarget = a;
+  portENTER_CRITICAL(&fleetVersionMux);
+  memcpy(fleetVersion, a.version, sizeof(fleetVersion));
+  portEXIT_CRITICAL(&fleetVersionMux);
+}
+
+static void fleetVersionCopy(char (&out)[sizeof(FleetAnnouncement::version)]) {
+  portENTER_CRITICAL(&fleetVersionMux);
+  memcpy(out, fleetVersion, sizeof(out));
+  portEXIT_CRITICAL(&fleetVersionMux);
+}
+#endif
+
+static constexpr size_t OTA_JSON_MAX = 288;
+static_assert(HUM_MQTT_BUFFER_SIZE >= TOPIC_MAX + OTA_JSON_MAX + 8, "HUM_MQTT_BUFFER_SIZE too small for <base>ota");
+
+static int formatOtaJson(char *buf, size_t size) {
+#if HUM_FEATURE_FLEET_OTA
+  const char *fleet = fleetPhaseName(fleetPhase);
+  char version[sizeof(FleetAnnouncement::version)];
+  fleetVersionCopy(version);
+#else
+  const char *fleet = "off";
+  const char *version = "";
+#endif
+  int len = snprintf(buf, size,
+                     "{\"state\":\"%s\",\"source\":\"%s\",\"gzip\":%s,\"received\":%lu,\"total\":%lu,\"written\":%lu,"
+                     "\"percent\":%u,\"error\":\"%s\",\"fleet\":\"%s\",\"fleet_version\":\"%s\"}",
+                     otaPhaseName(ota.phase), ota.source, ota.gzip ? "true" : "false", (unsigned long)ota.received,
+                     (unsigned long)ota.total, (unsigned long)ota.written, (unsigned)otaPercent(), ota.error, fleet,
+                     version);
+  if (len <= 0 || (size_t)len >= size) return -1;
+  return len;
+}
+
+// Every OTA_PROGRESS_STEP_PCT and phase change; otaTick() publishes it on <base>ota.
+static void otaReport(bool force) {
+  const uint8_t step = otaPercent() / OTA_PROGRESS_STEP_PCT;
+  if (!force && step == ota.reportedStep && ota.phase == ota.reportedPhase) return;
+  if (ota.phase == OTA_RUNNING && ota.reportedPhase == OTA_RUNNING && step != ota.reportedStep) {
+    logf(LOG_INFO, "[OTA] %s: %u%% (%lu bytes)", ota.source, (unsigned)otaPercent(), (unsigned long)ota.received);
+  }
+  ota.reportedStep = step;
+  ota.reportedPhase = ota.phase;
+  otaSeq++;
+}
+
+static void otaFreeInflater() {
+  free(ota.inflater);
+  free(ota.dict);
+  ota.inflater = nullptr;
+  ota.dict = nullptr;
+}
+
+static void otaRelease() {
+  otaFreeInflater();
+  mbedtls_sha256_free(&ota.sha);
+}
+
+static void otaFail(const char *why) {
+  if (!otaJobOpen()) return;
+  if (ota.started) Update.abort();
+  otaRelease();
+  snprintf(ota.error, sizeof(ota.error), "%s", why);
+  ota.phase = OTA_FAILED; // after the error text, which readers in other tasks show with it
+  logf(LOG_ERROR, "[OTA] %s failed at %lu bytes: %s", ota.source, (unsigned long)ota.received, why);
+  otaReport(true);
+}
+
+static bool parseSha256Hex(const char *hex, uint8_t out[32]) {
+  if (strlen(hex) != 64) return false;
+  for (uint8_t i = 0; i < 64; i++) {
+    const char c = hex[i];
+    uint8_t v;
+    if (c >= '0' && c <= '9') {
+      v = (uint8_t)(c - '0');
+    } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+      v = (uint8_t)((c | 0x20) - 'a' + 10);
+    } else {
+      return false;
+    }
+    out[i / 2] = (uint8_t)((i & 1) ? (out[i / 2] | v) : (v << 4));
+  }
+  return true;
+}
+
+// Starts a new job, dropping any open one. total = stream size if known (progress),
+// sha256Hex = expected digest of the image ("" = no check).
+static bool otaBegin(const char *source, uint32_t total, const char *sha256Hex) {
+  if (otaJobOpen()) otaFail("superseded");
+  otaRelease();
+  ota.source = source;
+  ota.started = false;
+  ota.gzip = false;
+  ota.received = 0;
+  ota.written = 0;
+  ota.total = total;
+  ota.lastActivityMs = millis();
+  ota.haveDigest = false;
+  ota.error[0] = '\0';
+  ota.gzStage = GZ_HEADER;
+  ota.gzPos = 0;
+  ota.gzCrc = 0;
+  memset(ota.gzTail, 0, sizeof(ota.gzTail));
+  ota.dictOfs = 0;
+  ota.reportedStep = 0xFF;
+  mbedtls_sha256_init(&ota.sha);
+  mbedtls_sha256_starts_ret(&ota.sha, 0);
+  ota.phase = OTA_RUNNING;
+  if (sha256Hex && sha256Hex[0] != '\0') {
+    if (!parseSha256Hex(sha256Hex, ota.digest)) {
+      otaFail("bad sha256");
+      return false;
+    }
+    ota.haveDigest = true;
+  }
+  logf(LOG_INFO, "[OTA] %s: start, %lu bytes%s", source, (unsigned long)total, ota.haveDigest ? ", sha256 given" : "");
+  otaReport(true);
+  return true;
+}
+
+// Continues an interrupted job; the stream must pick up exactly where it stopped.
+static bool otaResume(uint32_t offset) {
+  if (ota.phase != OTA_INTERRUPTED || offset != ota.received) return false;
+  ota.phase = OTA_RUNNING;
+  ota.lastActivityMs = millis();
+  logf(LOG_INFO, "[OTA] %s: resume at %lu bytes", ota.source, (unsigned long)offset);
+  otaReport(true);
+  return true;
+}
+
+static void otaInterrupt() {
+  if (ota.phase != OTA_RUNNING) return;
+  ota.phase = OTA_INTERRUPTED;
+  ota.lastActivityMs = millis();
+  logf(LOG_WARN, "[OTA] %s: interrupted at %lu bytes", ota.source, (unsigned long)ota.received);
+  otaReport(true);
+}
+
+// Image bytes (decompressed) to flash and into the digest.
+static bool otaSink(const uint8_t *p, size_t n) {
+  if (Update.write(const_cast<uint8_t *>(p), n) != n) {
+    otaFail(Update.errorString());
+    return false;
+  }
+  mbedtls_sha256_update_ret(&ota.sha, p, n);
+  if (ota.gzip) ota.gzCrc = crc32_le(ota.gzCrc, p, n);
+  ota.written += n;
+  return true;
+}
+
+// Feeds deflate data; returns the number of input bytes used (the rest is trailer).
+// The ROM inflater may read a few bytes past the end of the deflate data, so the
+// trailer is checked from ota.gzTail, not from what is left here.
+static size_t otaInflate(const uint8_t *p, size_t n) {
+  const uint8_t *start = p;
+  for (;;) {
+    size_t in = n;
+    size_t out = TINFL_LZ_DICT_SIZE - ota.dictOfs;
+    const tinfl_status st = tinfl_decompress(ota.inflater, p, &in, ota.dict, ota.dict + ota.dictOfs, &out,
+                                             TINFL_FLAG_HAS_MORE_INPUT);
+    p += in;
+    n -= in;
+    if (out > 0) {
+      if (!otaSink(ota.dict + ota.dictOfs, out)) break;
+      ota.dictOfs = (ota.dictOfs + out) & (TINFL_LZ_DICT_SIZE - 1);
+    }
+    if (st == TINFL_STATUS_DONE) {
+      ota.gzStage = GZ_TRAILER;
+      ota.gzPos = 0;
+      otaFreeInflater();
+      break;
+    }
+    if (st < 0) {
+      otaFail("corrupt deflate stream");
+      break;
+    }
+    if (st == TINFL_STATUS_NEEDS_MORE_INPUT && n == 0) break;
+    if (in == 0 && out == 0) {
+      otaFail("inflate stalled");
+      break;
+    }
+  }
+  return (size_t)(p - start);
+}
+
+// Walks the gzip framing byte by byte; the deflate body goes to otaInflate in bulk.
+static void otaGzipFeed(const uint8_t *p, size_t n) {
+  while (n > 0 && ota.phase == OTA_RUNNING) {
+    // Optional header fields that are absent take no bytes.
+    if (ota.gzStage == GZ_EXTRA_LEN && !(ota.gzFlags & GZ_FEXTRA)) ota.gzStage = GZ_NAME;
+    if (ota.gzStage == GZ_NAME && !(ota.gzFlags & GZ_FNAME)) ota.gzStage = GZ_COMMENT;
+    if (ota.gzStage == GZ_COMMENT && !(ota.gzFlags & GZ_FCOMMENT)) ota.gzStage = GZ_HCRC;
+    if (ota.gzStage == GZ_HCRC && !(ota.gzFlags & GZ_FHCRC)) ota.gzStage = GZ_DEFLATE;
+    if (ota.gzStage == GZ_DEFLATE) {
+      const size_t used = otaInflate(p, n);
+      p += used;
+      n -= used;
+      continue;
+    }
+
+    const uint8_t b = *p++;
+    n--;
+    switch (ota.gzStage) {
+      case GZ_HEADER:
+        ota.gzBuf[ota.gzPos++] = b;
+        if (ota.gzPos < 10) break;
+        if (ota.gzBuf[1] != 0x8b || ota.gzBuf[2] != 8) {
+          otaFail("not a gzip/deflate stream");
+          return;
+        }
+        ota.gzFlags = ota.gzBuf[3];
+        ota.gzPos = 0;
+        ota.gzStage = GZ_EXTRA_LEN;
+        break;
+      case GZ_EXTRA_LEN:
+        ota.gzBuf[ota.gzPos++] = b;
+        if (ota.gzPos < 2) break;
+        ota.gzSkip = (uint16_t)(ota.gzBuf[0] | (ota.gzBuf[1] << 8));
+        ota.gzPos = 0;
+        ota.gzStage = ota.gzSkip ? GZ_EXTRA : GZ_NAME;
+        break;
+      case GZ_EXTRA:
+        if (--ota.gzSkip == 0) ota.gzStage = GZ_NAME;
+        break;
+      case GZ_NAME:
+        if (b == 0) ota.gzStage = GZ_COMMENT;
+        break;
+      case GZ_COMMENT:
+        if (b == 0) ota.gzStage = GZ_HCRC;
+        break;
+      case GZ_HCRC:
+        if (++ota.gzPos == 2) ota.gzStage = GZ_DEFLATE;
+        break;
+      case GZ_TRAILER:
+        // At most 8 bytes; fewer if the inflater already consumed some of them.
+        if (++ota.gzPos == 8) ota.gzStage = GZ_END;
+        break;
+      default:
+        otaFail("data after the gzip trailer");
+        return;
+    }
+  }
+}
+
+// Slides the last n stream bytes into ota.gzTail.
+static void otaKeepTail(const uint8_t *p, size_t n) {
+  const size_t size = sizeof(ota.gzTail);
+  if (n >= size) {
+    memcpy(ota.gzTail, p + n - size, size);
+    return;
+  }
+  memmove(ota.gzTail, ota.gzTail + n, size - n);
+  memcpy(ota.gzTail + size - n, p, n);
+}
+
+// Feeds the next n stream bytes. The first bytes pick the format and open Update:
+// for a raw image of known size Update.begin() rejects one too big for the slot.
+static bool otaWrite(const uint8_t *p, size_t n) {
+  if (ota.phase != OTA_RUNNING) return false;
+  ota.lastActivityMs = millis();
+  if (n == 0) return true;
+  if (!ota.started) {
+    ota.gzip = p[0] == 0x1f;
+    if (!ota.gzip && p[0] != ESP_IMAGE_MAGIC) {
+      otaFail("not a firmware image");
+      return false;
+    }
+    if (ota.gzip) {
+      ota.inflater = (tinfl_decompressor *)malloc(sizeof(tinfl_decompressor));
+      ota.dict = (uint8_t *)malloc(TINFL_LZ_DICT_SIZE);
+      if (!ota.inflater || !ota.dict) {
+        otaFail("out of memory for the inflater");
+        return false;
+      }
+      tinfl_init(ota.inflater);
+    }
+    if (!Update.begin((ota.gzip || ota.total == 0) ? UPDATE_SIZE_UNKNOWN : ota.total.load())) {
+      otaFail(Update.errorString());
+      return false;
+    }
+    ota.started = true;
+  }
+
+  ota.received += n;
+  if (ota.gzip) {
+    otaKeepTail(p, n);
+    otaGzipFeed(p, n);
+  } else {
+    otaSink(p, n);
+  }
+  if (ota.phase != OTA_RUNNING) return false;
+  otaReport(false);
+  return true;
+}
+
+static uint32_t readLe32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// End of stream: checks the gzip trailer and the digest before the image is committed
+// as the boot partition; on any mismatch the slot is abandoned.
+static bool otaFinish() {
+  if (ota.phase != OTA_RUNNING) return false;
+  if (!ota.started) {
+    otaFail("empty image");
+    return false;
+  }
+  if (ota.gzip) {
+    // The deflate data must be complete; the trailer is the last 8 bytes of the stream.
+    if (ota.gzStage != GZ_TRAILER && ota.gzStage != GZ_END) {
+      otaFail("gzip stream truncated");
+      return false;
+    }
+    if (readLe32(ota.gzTail) != ota.gzCrc || readLe32(ota.gzTail + 4) != ota.written) {
+      otaFail("gzip crc/size mismatch");
+      return false;
+    }
+  }
+  uint8_t digest[32];
+  mbedtls_sha256_finish_ret(&ota.sha, digest);
+  if (ota.haveDigest && memcmp(digest, ota.digest, sizeof(digest)) != 0) {
+    otaFail("sha256 mismatch");
+    return false;
+  }
+  if (!Update.end(true)) {
+    otaFail(Update.errorString());
+    return false;
+  }
+  otaRelease();
+  ota.phase = OTA_DONE;
+  logf(LOG_INFO, "[OTA] %s: image ok, %lu bytes (%lu received)", ota.source, (unsigned long)ota.written,
+       (unsigned long)ota.received);
+  otaReport(true);
+  return true;
+}
+
+// Publishes the OTA state on <base>ota whenever otaReport() bumped otaSeq; network task.
+static void otaTick() {
+  static uint32_t publishedSeq = 0;
+  const uint32_t seq = otaSeq;
+  if (seq != publishedSeq && mqtt.connected()) {
+    char buf[OTA_JSON_MAX];
+    const int len = formatOtaJson(buf, sizeof(buf));
+    if (len > 0 && mqttPublish(topics.otaState, (const uint8_t *)buf, (unsigned int)len, false)) publishedSeq = seq;
+  }
+}
+
+// An abandoned upload is given up by the HTTP task (httpLoop), unless a worker is just
+// resuming it; a fleet pull has its own retry timing (fleetTick).
+static bool otaUploadExpired(uint32_t now) {
+  return otaJobOpen() && ota.source == OTA_SOURCE_WEB && (now - ota.lastActivityMs) > OTA_RESUME_TIMEOUT_MS;
+}
+
+static void otaExpireTick(uint32_t now) {
+  if (!otaUploadExpired(now) || !otaClaim(OTA_SOURCE_WEB)) return;
+  if (otaUploadExpired(millis())) otaFail("stalled, resume timed out");
+  otaUnclaim(OTA_SOURCE_WEB);
+}
+#endif
+
+// Parsers work on raw (not NUL-terminated) bytes so MQTT payloads can be parsed in
+// place; the String overloads below are for web form arguments.
+static bool parseBool(const String &value, bool defaultValue) {
+  return parseBoolRaw((const byte *)value.c_str(), value.length(), defaultValue);
+}
+
+static bool parseFloat(const String &value, float &out) {
+  return parseFloatRaw((const byte *)value.c_str(), value.length(), out);
+}
+
+static void relayWrite(Zone &z, bool on) {
+  if (on != z.relayOn) {
+    const uint32_t now = millis();
+    z.guard.switched(now, on);
+    z.predictor.switched(now, on, z.humidity.load());
+  }
+  z.relayOn = on;
+  bool level = on;
+  if (z.relayInverted) level = !level;
+  // A bad pin left in NVS by an older build is never driven; the zone just idles.
+  if (relayPinValid(z.relayPin)) digitalWrite(z.relayPin, level ? HIGH : LOW);
+}
+
+static void controlNotify() {
+  if (controlTaskHandle) xTaskNotifyGive(controlTaskHandle);
+}
+
+// Called whenever a control input changes (sample, setpoint, enable, MQTT link).
+// The control task wakes at once; in single-loop mode the evaluation runs at the end
+// of the current loop() iteration.
+static void controlRequestEval() {
+  controlEvalPending = true;
+  controlNotify();
+}
+
+static constexpr uint8_t ZONE_MASK_ALL = (uint8_t)((1U << ZONES_MAX) - 1);
+
+// With split tasks only the control task drives the relay GPIOs; other code asks it
+// to switch zones OFF and wakes it, instead of racing it for the pins.
+static void relayForceOff(uint8_t zoneMask = ZONE_MASK_ALL) {
+#if HUM_SPLIT_TASKS
+  relayOffRequested.fetch_or(zoneMask);
+  controlNotify();
+#else
+  for (uint8_t i = 0; i < ZONES_MAX; i++) {
+    if (zones[i].active && (zoneMask & (1U << i))) relayWrite(zones[i], false);
+  }
+#endif
+}
+
+static void buildTopics() {
+  char base[TOPIC_MAX];
+  if (config.baseTopic[0] != '\0') {
+    snprintf(base, sizeof(base), "%s", config.baseTopic);
+  } else {
+    snprintf(base, sizeof(base), "humidifier/%s", deviceId());
+  }
+  size_t n = strlen(base);
+  if ((n == 0 || base[n - 1] != '/') && n + 1 < sizeof(base)) {
+    base[n] = '/';
+    base[n + 1] = '\0';
+  }
+
+  snprintf(topics.statusOnline, TOPIC_MAX, "%sstatus/online", base);
+  snprintf(topics.telemetry, TOPIC_MAX, "%stelemetry", base);
+  snprintf(topics.otaState, TOPIC_MAX, "%sota", base);
+
+  for (uint8_t i = 0; i < ZONES_MAX; i++) {
+    ZoneTopics &zt = zones[i].topics;
+    char zb[TOPIC_MAX];
+    if (i == 0) {
+      snprintf(zb, sizeof(zb), "%s", base);
+    } else {
+      snprintf(zb, sizeof(zb), "%szone%u/", base, (unsigned)i);
+    }
+    snprintf(zt.stateEnabled, TOPIC_MAX, "%sstate/enabled", zb);
+    snprintf(zt.stateRelay, TOPIC_MAX, "%sstate/relay", zb);
+    snprintf(zt.stateSetpoint, TOPIC_MAX, "%sstate/setpoint", zb);
+    snprintf(zt.stateHumidity, TOPIC_MAX, "%sstate/humidity", zb);
+    snprintf(zt.stateHumidityAge, TOPIC_MAX, "%sstate/humidity_age_ms", zb);
+    snprintf(zt.stateReason, TOPIC_MAX, "%sstate/reason", zb);
+    snprintf(zt.stateJson, TOPIC_MAX, "%sstate", zb);
+
+    // Only zone 0 has configurable command topics
+    if (i == 0 && config.topicEnableIn[0] != '\0') {
+      snprintf(zt.cmdEnable, TOPIC_MAX, "%s", config.topicEnableIn);
+    } else {
+      snprintf(zt.cmdEnable, TOPIC_MAX, "%scmd/enabled", zb);
+    }
+    if (i == 0 && config.topicSetpointIn[0] != '\0') {
+      snprintf(zt.cmdSetpoint, TOPIC_MAX, "%s", config.topicSetpointIn);
+    } else {
+      snprintf(zt.cmdSetpoint, TOPIC_MAX, "%scmd/setpoint", zb);
+    }
+  }
+
+  // Discovery prefix: trimmed, without trailing slashes, "homeassistant" if empty
+  const char *pfx = config.haDiscoveryPrefix;
+  while (*pfx == ' ' || *pfx == '\t') pfx++;
+  snprintf(topics.discPrefix, sizeof(topics.discPrefix), "%s", pfx);
+  n = strlen(topics.discPrefix);
+  while (n > 0 && (topics.discPrefix[n - 1] == '/' || topics.discPrefix[n - 1] == ' ' || topics.discPrefix[n - 1] == '\t')) {
+    topics.discPrefix[--n] = '\0';
+  }
+  if (n == 0) snprintf(topics.discPrefix, sizeof(topics.discPrefix), "homeassistant");
+
+  const char *did = deviceId();
+  const char *dp = topics.discPrefix;
+  snprintf(topics.discHumidifierOld, TOPIC_MAX, "%s/humidifier/%s/config", dp, did);
+  snprintf(topics.discStatus, TOPIC_MAX, "%s/status", dp);
+}
+
+// Runtime state (setpoint, enable) is written behind: a change only marks it dirty,
+// and flushRuntimeState() writes once the value has been stable for the debounce time,
+// at most once per min interval, and only if it differs from what NVS already holds.
+// A slider drag or a chatty automation thus costs one flash write, not dozens.
+static constexpr uint32_t RUNTIME_SAVE_DEBOUNCE_MS = 5000;
+static constexpr uint32_t RUNTIME_SAVE_MIN_INTERVAL_MS = 15000;
+
+static std::atomic<bool> runtimeDirty{false}; // set from the HTTP and network tasks
+static std::atomic<uint32_t> runtimeChangedMs{0};
+static uint32_t runtimeSavedMs = 0;
+
+// Zone 0 keeps the single-zone NVS keys; zone N uses "z<N>" + suffix.
+static const char *zoneKey(char *buf, size_t size, uint8_t zone, const char *zone0Key, const char *suffix) {
+  if (zone == 0) return zone0Key;
+  snprintf(buf, size, "z%u%s", (unsigned)zone, suffix);
+  return buf;
+}
+
+static void saveRuntimeState() {
+  runtimeDirty = true;
+  runtimeChangedMs = millis();
+}
+
+// Relay switch and on-time totals change on every evaluation while a relay is ON, and
+// the learned room model on every cycle, so they are written at most once per
+// RELAY_TOTALS_SAVE_MS and otherwise only before a reboot; a power cut loses at most
+// that much.
+static constexpr uint32_t RELAY_TOTALS_SAVE_MS = 3600000;
+
+static uint32_t relayTotalsSavedMs = 0;
+
+static HumidityModel zoneModel(const Zone &z) {
+  return {z.riseRate.load(), z.decayRate.load(), z.overshoot.load(), z.undershoot.load()};
+}
+
+static void flushRelayTotals(bool now) {
+  const uint32_t t = millis();
+  if (!now && (t - relayTotalsSavedMs) < RELAY_TOTALS_SAVE_MS) return;
+  relayTotalsSavedMs = t;
+
+  bool open = false;
+  for (Zone &z : zones) {
+    if (!z.active) continue;
+    const uint32_t switches = z.switches;
+    const uint32_t onSeconds = z.onSeconds;
+    const HumidityModel model = zoneModel(z);
+    const bool modelChanged = memcmp(&model, &z.persistedModel, sizeof(model)) != 0;
+    if (switches == z.persistedSwitches && onSeconds == z.persistedOnSeconds && !modelChanged) continue;
+
+    if (!open) {
+      prefs.begin("hum", false);
+      open = true;
+    }
+    char key[16];
+    if (switches != z.persistedSwitches) {
+      prefs.putULong(zoneKey(key, sizeof(key), zoneIndex(z), "relaySw", "Sw"), switches);
+      metrics.nvsWrites++;
+    }
+    if (onSeconds != z.persistedOnSeconds) {
+      prefs.putULong(zoneKey(key, sizeof(key), zoneIndex(z), "relayOnS", "OnS"), onSeconds);
+      metrics.nvsWrites++;
+    }
+    if (modelChanged) {
+      prefs.putBytes(zoneKey(key, sizeof(key), zoneIndex(z), "model", "Mdl"), &model, sizeof(model));
+      metrics.nvsWrites++;
+    }
+    z.persistedSwitches = switches;
+    z.persistedOnSeconds = onSeconds;
+    z.persistedModel = model;
+  }
+  if (open) prefs.end();
+}
+
+// now=true writes immediately (before a reboot); otherwise honours debounce/min interval.
+static void flushRuntimeState(bool now) {
+  flushRelayTotals(now);
+  if (!runtimeDirty) return;
+  const uint32_t t = millis();
+  if (!now) {
+    if ((t - runtimeChangedMs) < RUNTIME_SAVE_DEBOUNCE_MS) return;
+    if (runtimeSavedMs != 0 && (t - runtimeSavedMs) < RUNTIME_SAVE_MIN_INTERVAL_MS) return;
+  }
+  runtimeDirty = false;
+
+  bool open = false;
+  for (Zone &z : zones) {
+    if (!z.active) continue;
+    const float target = clampSetpoint(z.target);
+    const bool enabled = z.enabled;
+    if (target == z.persistedTarget && enabled == z.persistedEnabled) continue;
+
+    if (!open) {
+      prefs.begin("hum", false);
+      open = true;
+    }
+    char key[16];
+    if (target != z.persistedTarget) {
+      prefs.putFloat(zoneKey(key, sizeof(key), zoneIndex(z), "target", "Tgt"), target);
+      metrics.nvsWrites++;
+    }
+    if (enabled != z.persistedEnabled) {
+      prefs.putBool(zoneKey(key, sizeof(key), zoneIndex(z), "sysEn", "En"), enabled);
+      metrics.nvsWrites++;
+    }
+    z.persistedTarget = target;
+    z.persistedEnabled = enabled;
+  }
+  if (!open) return;
+  prefs.end();
+  runtimeSavedMs = t;
+}
+
+// AppConfig lives in NVS as one binary blob: a small header (magic, version, length,
+// CRC) followed by the struct itself, so boot and /save are one flash read or write
+// each. Fields are only ever appended to AppConfig: a shorter blob from older firmware
+// loads with the new tail at its defaults, a longer one from newer firmware (within
+// CONFIG_BLOB_SLACK) has its tail ignored. The stored length ends at the last field,
+// not at sizeof(AppConfig): a field appended into what was the trailing padding is
+// then past every older blob and keeps its default. CONFIG_BLOB_LENGTH must name the
+// new last field. Reordering or retyping fields needs CONFIG_BLOB_VERSION bumped,
+// which makes old blobs fall back to the per-key layout.
+static constexpr const char *CONFIG_BLOB_KEY = "cfg";
+static constexpr uint32_t CONFIG_BLOB_MAGIC = 0x47464348; // "HCFG"
+static constexpr uint16_t CONFIG_BLOB_VERSION = 1;
+static constexpr size_t CONFIG_BLOB_SLACK = 512;
+static constexpr size_t CONFIG_BLOB_LENGTH = offsetof(AppConfig, fleetDelayMaxSec) + sizeof(AppConfig::fleetDelayMaxSec);
+
+struct ConfigBlobHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t length; // of the AppConfig part
+  uint32_t crc;    // crc32_le over the AppConfig part
+};
+
+static_assert(CONFIG_BLOB_LENGTH + CONFIG_BLOB_SLACK <= UINT16_MAX, "config blob length is 16 bits");
+static_assert(sizeof(AppConfig) - CONFIG_BLOB_LENGTH < alignof(AppConfig), "CONFIG_BLOB_LENGTH must end at the last field");
+
+// Static so that neither boot nor /save puts ~2.5 KB on the stack or the heap.
+alignas(4) static uint8_t configBlob[sizeof(ConfigBlobHeader) + CONFIG_BLOB_LENGTH + CONFIG_BLOB_SLACK];
+
+static bool configBlobStored = false;
+static bool configMigrated = false; // this boot read the per-key layout of older firmware
+
+static uint32_t configCrc(const void *data, size_t len) {
+  return crc32_le(0, (const uint8_t *)data, (uint32_t)len);
+}
+
+static void writeConfigBlob() {
+  ConfigBlobHeader h{CONFIG_BLOB_MAGIC, CONFIG_BLOB_VERSION, (uint16_t)CONFIG_BLOB_LENGTH, configCrc(&config, CONFIG_BLOB_LENGTH)};
+  memcpy(configBlob, &h, sizeof(h));
+  memcpy(configBlob + sizeof(h), &config, CONFIG_BLOB_LENGTH);
+  if (prefs.putBytes(CONFIG_BLOB_KEY, configBlob, sizeof(h) + CONFIG_BLOB_LENGTH) == sizeof(h) + CONFIG_BLOB_LENGTH) {
+    configBlobStored = true;
+    metrics.nvsWrites++;
+  } else {
+    logf(LOG_ERROR, "Config: NVS write failed");
+  }
+}
+
+// Only /save gets here, so the blob is written unconditionally; comparing AppConfig
+// images would compare their padding too.
+static void saveConfig() {
+  prefs.begin("hum", false);
+  writeConfigBlob();
+  prefs.end();
+
+  flushRuntimeState(true);
+}
+
+// HTTP handlers neither write NVS (prefs belongs to the network task) nor reboot in the
+// middle of their response: they leave both to rebootTick().
+static constexpr uint32_t REBOOT_DELAY_MS = 500; // lets the response reach the client
+
+static AppConfig pendingConfig; // filled by /save before it requests the reboot
+static std::atomic<bool> rebootRequested{false};
+static std::atomic<bool> rebootSaveConfig{false};
+static std::atomic<uint32_t> rebootAtMs{0};
+
+static void requestReboot(bool savePendingConfig) {
+  rebootSaveConfig = savePendingConfig;
+  rebootAtMs = millis() + REBOOT_DELAY_MS;
+  rebootRequested = true;
+}
+
+static void rebootTick(uint32_t now) {
+  if (!rebootRequested || (int32_t)(now - rebootAtMs) < 0) return;
+  if (rebootSaveConfig) {
+    config = pendingConfig;
+    saveConfig();
+  }
+  flushRuntimeState(true);
+  ESP.restart();
+}
+
+// Returns false (config untouched) when the blob is absent, too large, or fails the
+// header or CRC check.
+static bool loadConfigBlob() {
+  const size_t len = prefs.getBytesLength(CONFIG_BLOB_KEY);
+  if (len < sizeof(ConfigBlobHeader) || len > sizeof(configBlob)) return false;
+  if (prefs.getBytes(CONFIG_BLOB_KEY, configBlob, len) != len) return false;
+
+  ConfigBlobHeader h;
+  memcpy(&h, configBlob, sizeof(h));
+  if (h.magic != CONFIG_BLOB_MAGIC || h.version != CONFIG_BLOB_VERSION) return false;
+  if (h.length != len - sizeof(h)) return false;
+  if (configCrc(configBlob + sizeof(h), h.length) != h.crc) return false;
+
+  memcpy(&config, configBlob + sizeof(h), h.length < CONFIG_BLOB_LENGTH ? h.length : CONFIG_BLOB_LENGTH);
+  return true;
+}
+
+// Per-key layout of firmware before the config blob. Old keys are left in place, so
+// a downgrade still finds the config as it was at migration.
+static void loadConfigLegacy() {
+  String wifiSsid = prefs.getString("wifiSsid", "");
+  String wifiPass = prefs.getString("wifiPass", "");
+  String ipAddr = prefs.getString("ipAddr", "");
+  String ipGw = prefs.getString("ipGw", "");
+  String ipMask = prefs.getString("ipMask", "");
+  String ipDns = prefs.getString("ipDns", "");
+
+  String webUser = prefs.getString("webUser", "admin");
+  String webPass = prefs.getString("webPass", "admin");
+
+  String mqttHost = prefs.getString("mqttHost", "");
+  uint16_t mqttPort = prefs.getUShort("mqttPort", 1883);
+  String mqttUser = prefs.getString("mqttUser", "");
+  String mqttPass = prefs.getString("mqttPass", "");
+
+  String baseTopic = prefs.getString("baseTopic", (String("humidifier/") + deviceId()).c_str());
+  String baseForDefaults = baseTopic;
+  if (baseForDefaults.length() == 0) baseForDefaults = String("humidifier/") + deviceId();
+  if (!baseForDefaults.endsWith("/")) baseForDefaults += "/";
+
+  String tHumIn = prefs.getString("tHumIn", "");
+  String tSetIn = prefs.getString("tSetIn", (baseForDefaults + "cmd/setpoint").c_str());
+  String tEnIn = prefs.getString("tEnIn", (baseForDefaults + "cmd/enabled").c_str());
+
+  int relayPin = prefs.getInt("relayPin", HUM_DEFAULT_RELAY_PIN);
+  bool relayInv = prefs.getBool("relayInv", HUM_DEFAULT_RELAY_INVERTED != 0);
+  uint32_t humInt = prefs.getULong("humInt", DEFAULT_HUMIDITY_MIN_INTERVAL_MS);
+  float hyst = prefs.getFloat("hyst", DEFAULT_HYSTERESIS);
+  uint8_t fltMode = prefs.getUChar("fltMode", FILTER_MEDIAN);
+  uint8_t fltWin = prefs.getUChar("fltWin", 5);
+  float fltAlpha = prefs.getFloat("fltAlpha", 0.3f);
+  float fltRate = prefs.getFloat("fltRate", 0.0f);
+  String hSrc = prefs.getString("hSrc", "");
+  uint8_t fuseMode = prefs.getUChar("fuseMode", FUSION_AVERAGE);
+  uint16_t hSrcStale = prefs.getUShort("hSrcStale", 600);
+  uint8_t ctlMode = prefs.getUChar("ctlMode", CONTROL_MODE_HYSTERESIS);
+  uint16_t minOnS = prefs.getUShort("minOnS", 60);
+  uint16_t minOffS = prefs.getUShort("minOffS", 60);
+  uint8_t dutyMax = prefs.getUChar("dutyMax", 100);
+  uint8_t logLvl = prefs.getUChar("logLvl", (uint8_t)LOG_INFO);
+  uint32_t hangSec = prefs.getULong("hangSec", 0);
+  uint8_t hangAct = prefs.getUChar("hangAct", 1);
+
+  bool haDisc = prefs.getBool("haDisc", false);
+  String haPref = prefs.getString("haPref", "homeassistant");
+  String haName = prefs.getString("haName", "");
+  bool stJson = prefs.getBool("stJson", false);
+  uint16_t telSec = prefs.getUShort("telSec", 0);
+
+  for (uint8_t i = 1; i < ZONES_MAX; i++) {
+    ZoneConfig &zc = config.zones[i - 1];
+    char key[16];
+    zc.relayPin = (int8_t)prefs.getInt(zoneKey(key, sizeof(key), i, nullptr, "Pin"), -1);
+    zc.relayInverted = prefs.getBool(zoneKey(key, sizeof(key), i, nullptr, "Inv"), HUM_DEFAULT_RELAY_INVERTED != 0);
+    zc.hysteresis = prefs.getFloat(zoneKey(key, sizeof(key), i, nullptr, "Hyst"), DEFAULT_HYSTERESIS);
+    String name = prefs.getString(zoneKey(key, sizeof(key), i, nullptr, "Name"), "");
+    String hum = prefs.getString(zoneKey(key, sizeof(key), i, nullptr, "Hum"), "");
+    strncpy(zc.name, name.c_str(), sizeof(zc.name) - 1);
+    strncpy(zc.topicHumidityIn, hum.c_str(), sizeof(zc.topicHumidityIn) - 1);
+    if (zc.name[0] == '\0') snprintf(zc.name, sizeof(zc.name), "Zone %u", (unsigned)i);
+  }
+
+  strncpy(config.wifiSsid, wifiSsid.c_str(), sizeof(config.wifiSsid) - 1);
+  strncpy(config.wifiPass, wifiPass.c_str(), sizeof(config.wifiPass) - 1);
+  strncpy(config.staticIp, ipAddr.c_str(), sizeof(config.staticIp) - 1);
+  strncpy(config.staticGateway, ipGw.c_str(), sizeof(config.staticGateway) - 1);
+  strncpy(config.staticMask, ipMask.c_str(), sizeof(config.staticMask) - 1);
+  strncpy(config.staticDns, ipDns.c_str(), sizeof(config.staticDns) - 1);
+
+  strncpy(config.webUser, webUser.c_str(), sizeof(config.webUser) - 1);
+  strncpy(config.webPass, webPass.c_str(), sizeof(config.webPass) - 1);
+
+  strncpy(config.mqttHost, mqttHost.c_str(), sizeof(config.mqttHost) - 1);
+  config.mqttPort = mqttPort;
+  strncpy(config.mqttUser, mqttUser.c_str(), sizeof(config.mqttUser) - 1);
+  strncpy(config.mqttPass, mqttPass.c_str(), sizeof(config.mqttPass) - 1);
+
+  strncpy(config.baseTopic, baseTopic.c_str(), sizeof(config.baseTopic) - 1);
+  strncpy(config.topicHumidityIn, tHumIn.c_str(), sizeof(config.topicHumidityIn) - 1);
+  strncpy(config.topicSetpointIn, tSetIn.c_str(), sizeof(config.topicSetpointIn) - 1);
+  strncpy(config.topicEnableIn, tEnIn.c_str(), sizeof(config.topicEnableIn) - 1);
+
+  config.relayPin = relayPin;
+  config.relayInverted = relayInv;
+  config.humidityMinIntervalMs = humInt;
+  config.hysteresis = hyst;
+  config.filterMode = fltMode;
+  config.filterWindow = fltWin;
+  config.filterAlpha = fltAlpha;
+  config.filterMaxRate = fltRate;
+  strncpy(config.humiditySources, hSrc.c_str(), sizeof(config.humiditySources) - 1);
+  config.fusionMode = fuseMode;
+  config.sourceStaleSec = hSrcStale;
+  config.controlMode = ctlMode;
+  config.relayMinOnSec = minOnS;
+  config.relayMinOffSec = minOffS;
+  config.relayMaxDutyPct = dutyMax;
+  config.logLevel = logLvl;
+  config.hangTimeoutSec = hangSec;
+  config.hangAction = hangAct;
+
+  config.haDiscoveryEnabled = haDisc;
+  strncpy(config.haDiscoveryPrefix, haPref.c_str(), sizeof(config.haDiscoveryPrefix) - 1);
+  strncpy(config.haDeviceName, haName.c_str(), sizeof(config.haDeviceName) - 1);
+  config.stateJson = stJson;
+  config.telemetrySec = telSec;
+}
+
+// Setpoint, enable, relay totals and the learned model change at runtime and are
+// written behind per key (see flushRuntimeState()), so they stay out of the blob.
+static void loadRuntimeState() {
+#if HUM_FEATURE_FLEET_OTA
+  prefs.getString("fleetSha", fleetAppliedSha, sizeof(fleetAppliedSha));
+#endif
+  for (uint8_t i = 0; i < ZONES_MAX; i++) {
+    Zone &z = zones[i];
+    char key[16];
+
+    const float storedTarget = prefs.getFloat(zoneKey(key, sizeof(key), i, "target", "Tgt"), DEFAULT_SETPOINT);
+    const bool storedEnabled = prefs.getBool(zoneKey(key, sizeof(key), i, "sysEn", "En"), true);
+    z.target = isnan(storedTarget) ? DEFAULT_SETPOINT : clampSetpoint(storedTarget);
+    z.enabled = storedEnabled;
+    z.persistedTarget = storedTarget;
+    z.persistedEnabled = storedEnabled;
+
+    const uint32_t switches = prefs.getULong(zoneKey(key, sizeof(key), i, "relaySw", "Sw"), 0);
+    const uint32_t onSeconds = prefs.getULong(zoneKey(key, sizeof(key), i, "relayOnS", "OnS"), 0);
+    z.guard.restoreTotals(switches, onSeconds);
+    z.switches = switches;
+    z.onSeconds = onSeconds;
+    z.persistedSwitches = switches;
+    z.persistedOnSeconds = onSeconds;
+
+    HumidityModel model;
+    if (prefs.getBytes(zoneKey(key, sizeof(key), i, "model", "Mdl"), &model, sizeof(model)) == sizeof(model)) {
+      z.predictor.restore(model);
+      z.riseRate = model.riseRate;
+      z.decayRate = model.decayRate;
+      z.overshoot = model.overshoot;
+      z.undershoot = model.undershoot;
+      z.persistedModel = model;
+    }
+  }
+}
+
+static void loadConfig() {
+  prefs.begin("hum", true);
+  configBlobStored = loadConfigBlob();
+  if (!configBlobStored) loadConfigLegacy();
+  loadRuntimeState();
+  prefs.end();
+
+  if (!configBlobStored) {
+    // First boot after the upgrade (or a damaged blob): store the blob right away,
+    // so the next boot skips the per-key reads.
+    configMigrated = true;
+    prefs.begin("hum", false);
+    writeConfigBlob();
+    prefs.end();
+  }
+}
+
+// Drives every configured relay GPIO to its OFF level; plain gpio_* calls, so it
+// works before the Arduino pin layer is used.
+static void relayPinsSafe() {
+  auto safe = [](int pin, bool inverted) {
+    if (!relayPinValid(pin)) return;
+    const gpio_num_t gpio = (gpio_num_t)pin;
+    gpio_reset_pin(gpio);
+    gpio_set_direction(gpio, GPIO_MODE_OUTPUT);
+    gpio_set_level(gpio, inverted ? 1 : 0);
+  };
+  safe(config.relayPin, config.relayInverted);
+  for (const ZoneConfig &zc : config.zones) safe(zc.relayPin, zc.relayInverted);
+}
+
+// Arduino-ESP32 calls initVariant() before setup(), after NVS is initialised. The
+// config is a single blob read, so it is loaded here and every zone's relay GPIO is
+// driven to a safe state before delays and Wi-Fi/MQTT.
+extern "C" void initVariant() {
+  loadConfig();
+  relayPinsSafe();
+}
+
+
+static void markStateDirty(Zone &z, uint8_t fields) {
+  z.dirty.fetch_or(fields);
+}
+
+static void markAllStateDirty(uint8_t fields) {
+  for (Zone &z : zones) {
+    if (z.active) markStateDirty(z, fields);
+  }
+}
+
+// Snapshot of a zone's control inputs. linkUp is mqttLinkUp, the network task's view of
+// the session, also for the published reason: other tasks must not poke PubSubClient.
+static ControlInputs controlInputs(const Zone &z, bool linkUp) {
+  const uint32_t seenMs = z.lastSeenMs.load();
+  ControlInputs in;
+  // Humidity from the local sensor keeps arriving without MQTT.
+  in.linkUp = linkUp || z.localSensor;
+  in.enabled = z.enabled;
+  in.relayOn = z.relayOn;
+  in.humidity = z.humidity.load();
+  in.humiditySeen = seenMs > 0;
+  in.humidityAgeMs = seenMs > 0 ? millis() - seenMs : 0;
+  in.samples = z.samples;
+  in.target = z.target.load();
+  in.hysteresis = z.hysteresis;
+  in.earlyOn = 0.0f;
+  in.earlyOff = 0.0f;
+  if (config.controlMode == CONTROL_MODE_PREDICTIVE) predictiveShift(zoneModel(z), z.hysteresis, in.earlyOn, in.earlyOff);
+  in.staleMs = HUMIDITY_STALE_MS;
+  return in;
+}
+
+// While the relay guard holds the relay against the controller, the reason says so
+// (relay_wanted in the state documents has the controller's side).
+static AutomationReason automationReason(const Zone &z) {
+  const AutomationReason r = controlReason(controlInputs(z, mqttLinkUp));
+  if (r == REASON_MQTT_DISCONNECTED || r == REASON_DISABLED || r == REASON_NO_HUMIDITY || r == REASON_WAITING_SAMPLES) {
+    return r;
+  }
+  switch ((RelayGate)z.gate.load()) {
+    case GATE_MIN_ON: return REASON_MIN_ON_HOLD;
+    case GATE_MIN_OFF: return REASON_MIN_OFF_HOLD;
+    case GATE_DUTY: return REASON_DUTY_LIMIT;
+    default: return r;
+  }
+}
+
+static int32_t tenths(float v) {
+  return (int32_t)lroundf(v * 10.0f);
+}
+
+// The compact state document shared by the MQTT JSON topic and /events. Documents of
+// zones other than 0 start with their "zone" number.
+static int formatStateJson(const Zone &z, char *buf, size_t size, uint32_t now) {
+  char zone[16] = "";
+  char hum[16];
+  char setpoint[16];
+  char age[16];
+
+  if (zoneIndex(z) > 0) snprintf(zone, sizeof(zone), "\"zone\":%u,", (unsigned)zoneIndex(z));
+  const float h = z.humidity.load();
+  if (isnan(h)) {
+    strcpy(hum, "null");
+  } else {
+    dtostrf(h, 0, 1, hum);
+  }
+  dtostrf(z.target.load(), 0, 1, setpoint);
+
+  const uint32_t seenMs = z.lastSeenMs.load();
+  if (seenMs > 0) {
+    snprintf(age, sizeof(age), "%lu", (unsigned long)(now - seenMs));
+  } else {
+    strcpy(age, "null");
+  }
+
+  int len = snprintf(buf, size,
+                     "{%s\"enabled\":%s,\"relay\":%s,\"relay_wanted\":%s,\"setpoint\":%s,\"humidity\":%s,"
+                     "\"humidity_age_ms\":%s,\"reason\":\"%s\"}",
+                     zone, z.enabled ? "true" : "false", z.relayOn ? "true" : "false", z.relayWanted ? "true" : "false",
+                     setpoint, hum, age,
+                     automationReasonName(automationReason(z)));
+  if (len <= 0 || (size_t)len >= size) return -1;
+  return len;
+}
+
+// Streams an HTTP response with chunked transfer encoding through a small fixed
+// buffer, escaping in place, so peak heap per request does not depend on page size.
+class ChunkedResponse {
+ public:
+  static constexpr size_t BUF_SIZE = HTTP_CHUNK_MAX;
+
+  explicit ChunkedResponse(HttpRequest &req) : req_(req) {}
+
+  void begin(int code, const char *contentType) {
+    req_.beginChunked(code, contentType);
+    len_ = 0;
+  }
+
+  void write(const char *s) { write(s, strlen(s)); }
+
+  void write(const char *s, size_t n) {
+    while (n > 0) {
+      if (len_ == BUF_SIZE) flush();
+      size_t take = BUF_SIZE - len_;
+      if (take > n) take = n;
+      memcpy(buf_ + len_, s, take);
+      len_ += take;
+      s += take;
+      n -= take;
+    }
+  }
+
+  void writeEscaped(const char *s) {
+    for (; *s; s++) {
+      switch (*s) {
+        case '&': write("&amp;", 5); break;
+        case '<': write("&lt;", 4); break;
+        case '>': write("&gt;", 4); break;
+        case '"': write("&quot;", 6); break;
+        case '\'': write("&#39;", 5); break;
+        default: put(*s); break;
+      }
+    }
+  }
+
+  void writeUInt(unsigned long v) {
+    char tmp[12];
+    snprintf(tmp, sizeof(tmp), "%lu", v);
+    write(tmp);
+  }
+
+  void writeInt(long v) {
+    char tmp[12];
+    snprintf(tmp, sizeof(tmp), "%ld", v);
+    write(tmp);
+  }
+
+  void writeFloat(float v, uint8_t decimals) {
+    char tmp[24];
+    dtostrf(v, 0, decimals, tmp);
+    write(tmp);
+  }
+
+  void writeIp(const IPAddress &ip) {
+    char tmp[16];
+    snprintf(tmp, sizeof(tmp), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+    write(tmp);
+  }
+
+  // Quoted JSON string with escaping done straight into the buffer.
+  void writeJsonString(const char *s) {
+    put('"');
+    for (; *s; s++) {
+      switch (*s) {
+        case '\\': write("\\\\", 2); break;
+        case '"': write("\\\"", 2); break;
+        case '\n': write("\\n", 2); break;
+        case '\r': write("\\r", 2); break;
+        case '\t': write("\\t", 2); break;
+        default: put(*s); break;
+      }
+    }
+    put('"');
+  }
+
+  // JSON number, or null for NaN.
+  void writeJsonFloat(float v, uint8_t decimals) {
+    if (isnan(v)) {
+      write("null", 4);
+    } else {
+      writeFloat(v, decimals);
+    }
+  }
+
+  void writeJsonBool(bool v) { write(v ? "true" : "false"); }
+
+  // ,"key": - every JSON field below goes through this so the key list stays readable.
+  void writeJsonKey(const char *key, bool first = false) {
+    if (!first) put(',');
+    put('"');
+    write(key);
+    write("\":", 2);
+  }
+
+  void put(char c) {
+    if (len_ == BUF_SIZE) flush();
+    buf_[len_++] = c;
+  }
+
+  void end() {
+    flush();
+    req_.endChunked();
+  }
+
+ private:
+  void flush() {
+    if (len_ == 0) return;
+    req_.sendChunk(buf_, len_);
+    len_ = 0;
+  }
+
+  HttpRequest &req_;
+  char buf_[BUF_SIZE];
+  size_t len_ = 0;
+};
+
+#if HUM_FEATURE_WEB_UI
+static void sendPageHead(ChunkedResponse &out, const char *title) {
+  out.write("<!doctype html><html><head><meta charset='utf-8'>");
+  out.write("<meta name='viewport' content='width=device-width,initial-scale=1'>");
+  out.write("<title>");
+  out.write(title);
+  out.write("</title></head><body>");
+}
+
+// GET / - the UI is a static, precompressed bundle (web/index.html -> src/web_assets.h)
+// that fetches /api/config and /api/state. The ETag lets browsers revalidate with a 304.
+// Only the gzip copy is in flash, so a client that does not accept gzip gets a 406.
+static void sendIndex(HttpRequest &req) {
+  req.sendHeader("Vary", "Accept-Encoding");
+  if (!httpAcceptsEncoding(req.header("Accept-Encoding"), "gzip")) {
+    req.send(406, "text/plain", "This page is served gzip-compressed only (Accept-Encoding: gzip).\n");
+    return;
+  }
+  req.sendHeader("ETag", INDEX_HTML_ETAG);
+  req.sendHeader("Cache-Control", "no-cache");
+  if (strcmp(req.header("If-None-Match"), INDEX_HTML_ETAG) == 0) {
+    req.send(304, "text/html", "");
+    return;
+  }
+  req.sendHeader("Content-Encoding", "gzip");
+  req.send(200, "text/html", (const uint8_t *)INDEX_HTML_GZ, INDEX_HTML_GZ_LEN);
+}
+#else
+// Built without the UI (HUM_FEATURE_WEB_UI=0): GET / only lists the API.
+static void sendIndex(HttpRequest &req) {
+  req.send(200, "text/plain",
+           "GET /api/state /api/config /api/history /logs /metrics /events\n"
+           "POST /control /save\n");
+}
+#endif
+
+static void writeZoneStateJson(ChunkedResponse &out, const Zone &z, uint32_t now) {
+  const uint32_t seenMs = z.lastSeenMs.load();
+  out.writeJsonKey("enabled");
+  out.writeJsonBool(z.enabled);
+  out.writeJsonKey("relay");
+  out.writeJsonBool(z.relayOn);
+  out.writeJsonKey("relay_wanted");
+  out.writeJsonBool(z.relayWanted);
+  out.writeJsonKey("relay_switches");
+  out.writeUInt(z.switches);
+  out.writeJsonKey("relay_on_sec");
+  out.writeUInt(z.onSeconds);
+  out.writeJsonKey("relay_on_last_hour_sec");
+  out.writeUInt(z.onMsLastHour / 1000U);
+  out.writeJsonKey("model");
+  out.write("{");
+  out.writeJsonKey("rise_rate", true);
+  out.writeJsonFloat(z.riseRate.load(), 2);
+  out.writeJsonKey("decay_rate");
+  out.writeJsonFloat(z.decayRate.load(), 2);
+  out.writeJsonKey("overshoot");
+  out.writeJsonFloat(z.overshoot.load(), 2);
+  out.writeJsonKey("undershoot");
+  out.writeJsonFloat(z.undershoot.load(), 2);
+  out.write("}");
+  out.writeJsonKey("setpoint");
+  out.writeJsonFloat(z.target.load(), 1);
+  out.writeJsonKey("humidity");
+  out.writeJsonFloat(z.humidity.load(), 1);
+  out.writeJsonKey("humidity_age_ms");
+  if (seenMs > 0) {
+    out.writeUInt(now - seenMs);
+  } else {
+    out.write("null");
+  }
+  out.writeJsonKey("reason");
+  out.writeJsonString(automationReasonName(automationReason(z)));
+}
+
+// Zone 0 at the top level (as before zones existed), the other active zones in "zones".
+static void sendStateJson(HttpRequest &req) {
+  const uint32_t now = millis();
+  const bool apMode = (WiFi.getMode() == WIFI_AP || WiFi.getMode() == WIFI_AP_STA);
+
+  ChunkedResponse out(req);
+  out.begin(200, "application/json");
+  out.write("{");
+  out.writeJsonKey("device", true);
+  out.writeJsonString(deviceId());
+  out.writeJsonKey("fw_version");
+  out.writeJsonString(HUM_FW_VERSION);
+  out.writeJsonKey("wifi_mode");
+  out.writeJsonString(apMode ? "AP" : "STA");
+  out.writeJsonKey("ip");
+  out.put('"');
+  out.writeIp(WiFi.localIP());
+  out.put('"');
+  out.writeJsonKey("mqtt");
+  out.writeJsonBool(mqttLinkUp);
+  out.writeJsonKey("control_mode");
+  out.writeJsonString(controlModeName((ControlMode)config.controlMode));
+  writeZoneStateJson(out, zones[0], now);
+  out.writeJsonKey("sources");
+  out.put('[');
+  for (uint8_t i = 0; i < humiditySourceCount; i++) {
+    const HumiditySource &src = humiditySources[i];
+    if (i > 0) out.put(',');
+    out.write("{");
+    out.writeJsonKey("zone", true);
+    out.writeUInt(src.zone);
+    out.writeJsonKey("topic");
+    out.writeJsonString(src.topic);
+    out.writeJsonKey("weight");
+    out.writeFloat(src.weight, 2);
+    out.writeJsonKey("humidity");
+    out.writeJsonFloat(src.value, 1);
+    out.writeJsonKey("age_ms");
+    if (src.lastUpdateMs > 0) {
+      out.writeUInt(now - src.lastUpdateMs);
+    } else {
+      out.write("null");
+    }
+    out.write("}");
+  }
+  out.put(']');
+  if (localSensorSource != 0xFF) {
+    out.writeJsonKey("sensor");
+    out.write("{");
+    out.writeJsonKey("type", true);
+    out.writeJsonString(localSensorTypeName((LocalSensorType)config.sensorType));
+    out.writeJsonKey("zone");
+    out.writeUInt(config.sensorZone);
+    out.writeJsonKey("ok");
+    out.writeJsonBool(localSensorOk);
+    out.writeJsonKey("humidity");
+    out.writeJsonFloat(localSensorHumidity.load(), 1);
+    out.writeJsonKey("temperature");
+    out.writeJsonFloat(localSensorTemperature.load(), 1);
+    out.writeJsonKey("readings");
+    out.writeUInt(localSensorReadings);
+    out.writeJsonKey("errors");
+    out.writeUInt(localSensorErrors);
+    out.write("}");
+  }
+  out.writeJsonKey("zones");
+  out.put('[');
+  bool first = true;
+  for (uint8_t i = 1; i < ZONES_MAX; i++) {
+    const Zone &z = zones[i];
+    if (!z.active) continue;
+    if (!first) out.put(',');
+    first = false;
+    out.write("{");
+    out.writeJsonKey("zone", true);
+    out.writeUInt(i);
+    out.writeJsonKey("name");
+    out.writeJsonString(z.name);
+    writeZoneStateJson(out, z, now);
+    out.write("}");
+  }
+  out.put(']');
+  out.write("}");
+  out.end();
+}
+
+// GET /api/history?zone=&from=&step= - from: seconds back from now (default: all that
+// is kept); step: output resolution in seconds, rounded up to a multiple of historySec.
+// Rows run oldest first as [humidity, setpoint, relay, enabled]: humidity is the mean
+// of the readings in the step (null if none), relay the share of it spent ON, the
+// other two as of the step's last sample. "age" is the newest row's age in seconds.
+static void sendHistoryJson(HttpRequest &req) {
+  const uint32_t now = millis();
+  const long zoneArg = req.hasArg("zone") ? req.arg("zone").toInt() : 0;
+  if (zoneArg < 0 || zoneArg >= ZONES_MAX || !zones[zoneArg].active) {
+    req.send(400, "text/plain", "Unknown zone.");
+    return;
+  }
+  const Zone &z = zones[zoneArg];
+  const uint32_t stepSec = config.historySec;
+
+  const long stepArg = req.hasArg("step") ? req.arg("step").toInt() : 0;
+  uint32_t group = stepArg > 0 ? ((uint32_t)stepArg + stepSec - 1) / stepSec : 1;
+  if (group < 1) group = 1;
+  historyReadBegin();
+  uint32_t rows = z.history.count();
+  if (req.hasArg("from")) {
+    const long from = req.arg("from").toInt();
+    const uint32_t want = from > 0 ? ((uint32_t)from + stepSec - 1) / stepSec : 0;
+    if (want < rows) rows = want;
+  }
+  const uint32_t skip = z.history.count() - rows;
+
+  ChunkedResponse out(req);
+  req.sendHeader("Cache-Control", "no-store");
+  out.begin(200, "application/json");
+  out.write("{");
+  out.writeJsonKey("zone", true);
+  out.writeUInt((unsigned long)zoneArg);
+  out.writeJsonKey("step");
+  out.writeUInt(group * stepSec);
+  out.writeJsonKey("age");
+  out.writeUInt(rows > 0 ? (now - z.historyLastMs) / 1000U : 0);
+  out.writeJsonKey("samples");
+  out.put('[');
+
+  // The first row takes the remainder, so the newest row always covers a full step.
+  uint32_t take = rows % group != 0 ? rows % group : group;
+  uint32_t index = 0;
+  uint32_t inRow = 0, readings = 0, known = 0, on = 0;
+  float sum = 0.0f;
+  bool first = true;
+  bool enabled = false;
+  HistorySample s;
+  HistoryRing::Reader reader(z.history);
+  while (reader.next(s)) {
+    if (index++ < skip) continue;
+    inRow++;
+    if (!isnan(s.humidity)) {
+      sum += s.humidity;
+      readings++;
+    }
+    // Gap steps have no relay state; the share covers the steps that were sampled.
+    if (!s.gap) {
+      known++;
+      if (s.relay) on++;
+      enabled = s.enabled;
+    }
+    if (inRow < take) continue;
+
+    if (!first) out.put(',');
+    first = false;
+    out.put('[');
+    out.writeJsonFloat(readings > 0 ? sum / (float)readings : NAN, 1);
+    out.put(',');
+    out.writeFloat(s.setpoint, 1);
+    out.put(',');
+    out.writeJsonFloat(known > 0 ? (float)on / (float)known : NAN, 2);
+    out.put(',');
+    out.writeJsonBool(enabled);
+    out.put(']');
+    take = group;
+    inRow = readings = known = on = 0;
+    sum = 0.0f;
+  }
+  out.put(']');
+  out.write("}");
+  out.end();
+  historyReadEnd();
+}
+
+// Field names match the /save form, so the page can fill its inputs directly.
+static void sendConfigJson(HttpRequest &req) {
+  ChunkedResponse out(req);
+  out.begin(200, "application/json");
+  out.write("{");
+  out.writeJsonKey("wifi_ssid", true);
+  out.writeJsonString(config.wifiSsid);
+  out.writeJsonKey("wifi_pass");
+  out.writeJsonString(config.wifiPass);
+  out.writeJsonKey("ip_addr");
+  out.writeJsonString(config.staticIp);
+  out.writeJsonKey("ip_gw");
+  out.writeJsonString(config.staticGateway);
+  out.writeJsonKey("ip_mask");
+  out.writeJsonString(config.staticMask);
+  out.writeJsonKey("ip_dns");
+  out.writeJsonString(config.staticDns);
+  out.writeJsonKey("web_user");
+  out.writeJsonString(config.webUser);
+  out.writeJsonKey("mqtt_host");
+  out.writeJsonString(config.mqttHost);
+  out.writeJsonKey("mqtt_port");
+  out.writeUInt(config.mqttPort);
+  out.writeJsonKey("mqtt_user");
+  out.writeJsonString(config.mqttUser);
+  out.writeJsonKey("mqtt_pass");
+  out.writeJsonString(config.mqttPass);
+  out.writeJsonKey("state_json");
+  out.writeJsonBool(config.stateJson);
+  out.writeJsonKey("telemetry_sec");
+  out.writeUInt(config.telemetrySec);
+  out.writeJsonKey("ha_disc");
+  out.writeJsonBool(config.haDiscoveryEnabled);
+  out.writeJsonKey("ha_prefix");
+  out.writeJsonString(config.haDiscoveryPrefix);
+  out.writeJsonKey("ha_name");
+  out.writeJsonString(config.haDeviceName);
+  out.writeJsonKey("base_topic");
+  out.writeJsonString(config.baseTopic);
+  out.writeJsonKey("t_hum_in");
+  out.writeJsonString(config.topicHumidityIn);
+  out.writeJsonKey("t_set_in");
+  out.writeJsonString(config.topicSetpointIn);
+  out.writeJsonKey("t_en_in");
+  out.writeJsonString(config.topicEnableIn);
+  out.writeJsonKey("relay_pin");
+  out.writeInt(config.relayPin);
+  out.writeJsonKey("relay_inv");
+  out.writeJsonString(config.relayInverted ? "1" : "0");
+  out.writeJsonKey("hyst");
+  out.writeFloat(config.hysteresis, 1);
+  out.writeJsonKey("hum_int_sec");
+  out.writeUInt(config.humidityMinIntervalMs / 1000U);
+  out.writeJsonKey("filter_mode");
+  out.writeUInt(config.filterMode);
+  out.writeJsonKey("filter_window");
+  out.writeUInt(config.filterWindow);
+  out.writeJsonKey("filter_alpha");
+  out.writeFloat(config.filterAlpha, 2);
+  out.writeJsonKey("filter_rate");
+  out.writeFloat(config.filterMaxRate, 1);
+  out.writeJsonKey("hum_sources");
+  out.writeJsonString(config.humiditySources);
+  out.writeJsonKey("fusion_mode");
+  out.writeUInt(config.fusionMode);
+  out.writeJsonKey("source_stale_sec");
+  out.writeUInt(config.sourceStaleSec);
+  out.writeJsonKey("control_mode");
+  out.writeUInt(config.controlMode);
+  out.writeJsonKey("min_on_sec");
+  out.writeUInt(config.relayMinOnSec);
+  out.writeJsonKey("min_off_sec");
+  out.writeUInt(config.relayMinOffSec);
+  out.writeJsonKey("max_duty_pct");
+  out.writeUInt(config.relayMaxDutyPct);
+  out.writeJsonKey("log_level");
+  out.writeUInt(config.logLevel);
+  out.writeJsonKey("hang_sec");
+  out.writeUInt(config.hangTimeoutSec);
+  out.writeJsonKey("hang_act");
+  out.writeUInt(config.hangAction);
+  out.writeJsonKey("history_sec");
+  out.writeUInt(config.historySec);
+  out.writeJsonKey("sensor_type");
+  out.writeUInt(config.sensorType);
+  out.writeJsonKey("sensor_zone");
+  out.writeUInt(config.sensorZone);
+  out.writeJsonKey("sensor_sda");
+  out.writeInt(config.sensorSda);
+  out.writeJsonKey("sensor_scl");
+  out.writeInt(config.sensorScl);
+  out.writeJsonKey("sensor_addr");
+  out.writeUInt(config.sensorAddr);
+  out.writeJsonKey("sensor_interval_sec");
+  out.writeUInt(config.sensorIntervalSec);
+  out.writeJsonKey("fleet_topic");
+  out.writeJsonString(config.fleetTopic);
+  out.writeJsonKey("fleet_delay_sec");
+  out.writeUInt(config.fleetDelayMaxSec);
+  for (uint8_t i = 1; i < ZONES_MAX; i++) {
+    const ZoneConfig &zc = config.zones[i - 1];
+    char key[16];
+    snprintf(key, sizeof(key), "z%u_pin", (unsigned)i);
+    out.writeJsonKey(key);
+    out.writeInt(zc.relayPin);
+    snprintf(key, sizeof(key), "z%u_inv", (unsigned)i);
+    out.writeJsonKey(key);
+    out.writeJsonString(zc.relayInverted ? "1" : "0");
+    snprintf(key, sizeof(key), "z%u_hyst", (unsigned)i);
+    out.writeJsonKey(key);
+    out.writeFloat(zc.hysteresis, 1);
+    snprintf(key, sizeof(key), "z%u_name", (unsigned)i);
+    out.writeJsonKey(key);
+    out.writeJsonString(zc.name);
+    snprintf(key, sizeof(key), "z%u_hum", (unsigned)i);
+    out.writeJsonKey(key);
+    out.writeJsonString(zc.topicHumidityIn);
+  }
+  out.write("}");
+  out.end();
+}
+
+// GET /events - Server-Sent Events: "log" events (id = log sequence number), "state"
+// events with the compact state document and "ota" progress events. The worker hands
+// the socket to the HTTP task (sseQueue), which serves every stream with non-blocking
+// sends, so a slow reader only falls behind (skipping log lines the ring has
+// overwritten) and never holds a worker.
+static constexpr uint8_t SSE_MAX_CLIENTS = 2;
+static constexpr size_t SSE_BUF_SIZE = 320;
+static constexpr uint8_t SSE_EVENTS_PER_TICK = 8;
+static constexpr uint32_t SSE_KEEPALIVE_MS = 15000;
+static constexpr uint32_t SSE_STALL_TIMEOUT_MS = 30000;
+
+struct SseClient {
+  WiFiClient client;
+  bool active = false;
+  uint8_t stateSent = 0; // bit per zone
+  LogCursor cursor;
+  uint32_t stateSig[ZONES_MAX] = {0};
+#if HUM_OTA_WRITER
+  uint32_t otaSeq = 0;
+#endif
+  uint32_t lastProgressMs = 0;
+  char buf[SSE_BUF_SIZE];
+  size_t len = 0;
+  size_t off = 0;
+};
+
+static SseClient sseClients[SSE_MAX_CLIENTS];
+
+// A stream on its way from the worker that accepted it to the HTTP task.
+struct SsePending {
+  WiFiClient *client;
+  bool haveSince;
+  uint32_t since;
+};
+
+static QueueHandle_t sseQueue = nullptr;
+
+// Changes whenever a field other than the (continuously growing) sample age does.
+static uint32_t stateSignature(const Zone &z) {
+  const float h = z.humidity.load();
+  const int32_t fields[] = {z.enabled ? 1 : 0, z.relayOn ? 1 : 0, z.relayWanted ? 1 : 0, tenths(z.target.load()),
+                            isnan(h) ? INT32_MIN : tenths(h), (int32_t)automationReason(z)};
+  return fnv1a(FNV1A_SEED, fields, sizeof(fields));
+}
+
+// Parses ?since=<seq> (or the Last-Event-ID header of a reconnecting EventSource).
+static bool httpLogSince(const HttpRequest &req, uint32_t &seq) {
+  if (req.hasArg("since")) {
+    seq = (uint32_t)strtoul(req.arg("since").c_str(), nullptr, 10);
+    return true;
+  }
+  if (req.hasHeader("Last-Event-ID")) {
+    seq = (uint32_t)strtoul(req.header("Last-Event-ID"), nullptr, 10) + 1;
+    return true;
+  }
+  return false;
+}
+
+static void sseAccept(HttpRequest &req) {
+  SsePending p = {};
+  p.haveSince = httpLogSince(req, p.since);
+  if (uxQueueSpacesAvailable(sseQueue) == 0 || !(p.client = req.detach())) {
+    req.send(503, "text/plain", "Too many event streams.\n");
+    return;
+  }
+  if (xQueueSend(sseQueue, &p, 0) != pdTRUE) {
+    httpRefuse(*p.client, "Too many event streams.\n");
+    delete p.client;
+  }
+}
+
+// Takes over the streams the workers queued; HTTP task.
+static void sseAdopt() {
+  SsePending p;
+  while (xQueueReceive(sseQueue, &p, 0) == pdTRUE) {
+    SseClient *slot = nullptr;
+    for (SseClient &c : sseClients) {
+      if (!c.active) {
+        slot = &c;
+        break;
+      }
+    }
+    if (!slot) {
+      httpRefuse(*p.client, "Too many event streams.\n");
+      delete p.client;
+      continue;
+    }
+
+    slot->client = *p.client;
+    delete p.client;
+    slot->client.setNoDelay(true);
+    slot->client.print("HTTP/1.1 200 OK\r\n"
+                       "Content-Type: text/event-stream\r\n"
+                       "Cache-Control: no-cache\r\n"
+                       "Connection: keep-alive\r\n"
+                       "\r\n"
+                       "retry: 3000\n\n");
+
+    if (p.haveSince) {
+      logSeek(slot->cursor, p.since);
+    } else {
+      logSeek(slot->cursor, logNextSeq()); // live lines only
+    }
+    slot->active = true;
+    slot->stateSent = 0;
+#if HUM_OTA_WRITER
+    slot->otaSeq = otaJobOpen() ? otaSeq - 1 : otaSeq.load(); // a running update is sent at once
+#endif
+    slot->len = 0;
+    slot->off = 0;
+    slot->lastProgressMs = millis();
+  }
+}
+
+static void sseDrop(SseClient &c) {
+  c.client.stop();
+  c.client = WiFiClient();
+  c.active = false;
+}
+
+// Fills c.buf with the next event, if there is one: OTA progress and zone states
+// first, then log lines, then a keepalive comment once the stream has been quiet.
+static bool sseCompose(SseClient &c, uint32_t now) {
+#if HUM_OTA_WRITER
+  const uint32_t seq = otaSeq;
+  if (c.otaSeq != seq) {
+    char doc[OTA_JSON_MAX];
+    if (formatOtaJson(doc, sizeof(doc)) > 0) {
+      c.len = (size_t)snprintf(c.buf, sizeof(c.buf), "event: ota\ndata: %s\n\n", doc);
+      c.otaSeq = seq;
+      return true;
+    }
+  }
+#endif
+
+  for (uint8_t i = 0; i < ZONES_MAX; i++) {
+    const Zone &z = zones[i];
+    if (!z.active) continue;
+    const uint32_t sig = stateSignature(z);
+    if ((c.stateSent & (1U << i)) && sig == c.stateSig[i]) continue;
+    char doc[208];
+    const int n = formatStateJson(z, doc, sizeof(doc), now);
+    if (n > 0) {
+      c.len = (size_t)snprintf(c.buf, sizeof(c.buf), "event: state\ndata: %s\n\n", doc);
+      c.stateSig[i] = sig;
+      c.stateSent |= (uint8_t)(1U << i);
+      return true;
+    }
+  }
+
+  uint8_t rec[LOG_RECORD_MAX];
+  uint32_t dropped = 0;
+  if (logReadNext(c.cursor, rec, &dropped)) {
+    char line[LOG_LINE_MAX];
+    logFormatRecord(rec, line, sizeof(line));
+    for (char *p = line; *p; p++) {
+      if (*p == '\n' || *p == '\r') *p = ' ';
+    }
+    int n = 0;
+    if (dropped) n = snprintf(c.buf, sizeof(c.buf), "event: dropped\ndata: %lu\n\n", (unsigned long)dropped);
+    n += snprintf(c.buf + n, sizeof(c.buf) - n, "id: %lu\nevent: log\ndata: %s\n\n", (unsigned long)(c.cursor.seq - 1), line);
+    c.len = ((size_t)n < sizeof(c.buf)) ? (size_t)n : sizeof(c.buf) - 1;
+    return true;
+  }
+
+  if ((now - c.lastProgressMs) >= SSE_KEEPALIVE_MS) {
+    c.len = (size_t)snprintf(c.buf, sizeof(c.buf), ": keepalive\n\n");
+    return true;
+  }
+  return false;
+}
+
+static void sseTick(uint32_t now) {
+  sseAdopt();
+  for (SseClient &c : sseClients) {
+    if (!c.active) continue;
+    if (!c.client.connected()) {
+      sseDrop(c);
+      continue;
+    }
+
+    for (uint8_t i = 0; i < SSE_EVENTS_PER_TICK; i++) {
+      if (c.off == c.len) {
+        c.off = c.len = 0;
+        if (!sseCompose(c, now)) break;
+      }
+      const ssize_t sent = send(c.client.fd(), c.buf + c.off, c.len - c.off, MSG_DONTWAIT);
+      if (sent > 0) {
+        c.off += (size_t)sent;
+        c.lastProgressMs = now;
+      } else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        sseDrop(c);
+        break;
+      }
+      if (c.off < c.len) break; // socket buffer full; resume next tick
+    }
+
+    if (c.active && c.off < c.len && (now - c.lastProgressMs) > SSE_STALL_TIMEOUT_MS) sseDrop(c);
+  }
+}
+
+// GET /metrics - Prometheus text exposition of the stage histograms, counters and heap.
+static void sendMetrics(HttpRequest &req) {
+  ChunkedResponse out(req);
+  out.begin(200, "text/plain; version=0.0.4");
+
+  out.write("# HELP humidifier_stage_duration_seconds Time spent per loop stage.\n"
+            "# TYPE humidifier_stage_duration_seconds histogram\n");
+  for (uint8_t st = 0; st < STAGE_COUNT; st++) {
+    const LatencyHistogram &h = stageLatency[st];
+    uint32_t cumulative = 0;
+    for (size_t b = 0; b <= LATENCY_BUCKET_COUNT; b++) {
+      cumulative += h.buckets[b];
+      out.write("humidifier_stage_duration_seconds_bucket{stage=\"");
+      out.write(STAGE_NAMES[st]);
+      out.write("\",le=\"");
+      out.write(b < LATENCY_BUCKET_COUNT ? LATENCY_BUCKET_LE[b] : "+Inf");
+      out.write("\"} ");
+      out.writeUInt(cumulative);
+      out.put('\n');
+    }
+    char tmp[24];
+    out.write("humidifier_stage_duration_seconds_sum{stage=\"");
+    out.write(STAGE_NAMES[st]);
+    snprintf(tmp, sizeof(tmp), "\"} %.6f\n", (double)h.sumUs / 1e6);
+    out.write(tmp);
+    out.write("humidifier_stage_duration_seconds_count{stage=\"");
+    out.write(STAGE_NAMES[st]);
+    out.write("\"} ");
+    out.writeUInt(h.count);
+    out.put('\n');
+  }
+
+  out.write("# HELP humidifier_stage_duration_max_seconds Longest single run per loop stage.\n"
+            "# TYPE humidifier_stage_duration_max_seconds gauge\n");
+  for (uint8_t st = 0; st < STAGE_COUNT; st++) {
+    char tmp[24];
+    out.write("humidifier_stage_duration_max_seconds{stage=\"");
+    out.write(STAGE_NAMES[st]);
+    snprintf(tmp, sizeof(tmp), "\"} %.6f\n", (double)stageLatency[st].maxUs / 1e6);
+    out.write(tmp);
+  }
+
+  auto metric = [&](const char *name, const char *type, unsigned long value) {
+    out.write("# TYPE ");
+    out.write(name);
+    out.put(' ');
+    out.write(type);
+    out.put('\n');
+    out.write(name);
+    out.put(' ');
+    out.writeUInt(value);
+    out.put('\n');
+  };
+  metric("humidifier_mqtt_rx_messages_total", "counter", metrics.mqttRx);
+  metric("humidifier_mqtt_tx_messages_total", "counter", metrics.mqttTx);
+  metric("humidifier_mqtt_publish_failures_total", "counter", metrics.mqttPublishFailed);
+  metric("humidifier_mqtt_connects_total", "counter", metrics.mqttConnects);
+  metric("humidifier_mqtt_queue_depth", "gauge", mqttQueueDepth());
+  metric("humidifier_mqtt_queue_full_total", "counter", metrics.mqttQueueFull);
+  metric("humidifier_mqtt_resent_total", "counter", metrics.mqttResent);
+  metric("humidifier_mqtt_confirm_lost_total", "counter", metrics.mqttConfirmLost);
+  metric("humidifier_humidity_throttled_total", "counter", metrics.humidityThrottled);
+  metric("humidifier_humidity_rejected_total", "counter", metrics.humidityRejected);
+  metric("humidifier_local_sensor_readings_total", "counter", localSensorReadings);
+  metric("humidifier_local_sensor_errors_total", "counter", localSensorErrors);
+  metric("humidifier_nvs_writes_total", "counter", metrics.nvsWrites);
+  metric("humidifier_http_requests_total", "counter", httpRequestCount);
+  metric("humidifier_http_refused_total", "counter", httpRefusedCount);
+  metric("humidifier_heap_free_bytes", "gauge", ESP.getFreeHeap());
+  metric("humidifier_heap_min_free_bytes", "gauge", ESP.getMinFreeHeap());
+  metric("humidifier_heap_max_block_bytes", "gauge", ESP.getMaxAllocHeap());
+  metric("humidifier_uptime_seconds", "counter", millis() / 1000U);
+  metric("humidifier_boot_wifi_up_ms", "gauge", wifiUpMs);
+  metric("humidifier_boot_mqtt_up_ms", "gauge", mqttUpMs);
+  // Zone 0 unlabeled (as before zones existed), the others with a zone label.
+  auto zoneMetric = [&](const char *name, const char *type, uint32_t (*value)(const Zone &)) {
+    metric(name, type, value(zones[0]));
+    for (uint8_t i = 1; i < ZONES_MAX; i++) {
+      if (!zones[i].active) continue;
+      char tmp[16];
+      snprintf(tmp, sizeof(tmp), "{zone=\"%u\"} ", (unsigned)i);
+      out.write(name);
+      out.write(tmp);
+      out.writeUInt(value(zones[i]));
+      out.put('\n');
+    }
+  };
+  zoneMetric("humidifier_relay_on", "gauge", [](const Zone &z) -> uint32_t { return z.relayOn ? 1 : 0; });
+  zoneMetric("humidifier_relay_switches_total", "counter", [](const Zone &z) -> uint32_t { return z.switches; });
+  zoneMetric("humidifier_relay_on_seconds_total", "counter", [](const Zone &z) -> uint32_t { return z.onSeconds; });
+  zoneMetric("humidifier_relay_on_last_hour_seconds", "gauge",
+             [](const Zone &z) -> uint32_t { return z.onMsLastHour / 1000U; });
+  zoneMetric("humidifier_history_samples", "gauge", [](const Zone &z) -> uint32_t { return z.history.count(); });
+  zoneMetric("humidifier_history_bytes", "gauge", [](const Zone &z) -> uint32_t { return (uint32_t)z.history.bytesUsed(); });
+  out.end();
+}
+
+static bool httpIsAuthorized(const HttpRequest &req) {
+  if (captivePortalActive) return true;
+  return req.authenticate(config.webUser, config.webPass);
+}
+
+static bool httpRequireAuthorized(HttpRequest &req) {
+  if (httpIsAuthorized(req)) return true;
+  req.requestAuthentication("Humidifier");
+  return false;
+}
+
+#if HUM_FEATURE_WEB_OTA && !HUM_SPLIT_TASKS
+static void otaServiceNetwork();
+#endif
+#if HUM_FEATURE_FLEET_OTA && HUM_FEATURE_WEB_OTA
+static void fleetSupersede();
+#endif
+
+static std::atomic<bool> saveBusy{false};
+
+static void httpSetupHandlers() {
+  httpOn("/", HTTP_REQ_GET, [](HttpRequest &req) {
+    if (!httpRequireAuthorized(req)) return;
+    sendIndex(req);
+  });
+
+  httpOn("/api/state", HTTP_REQ_GET, [](HttpRequest &req) {
+    if (!httpRequireAuthorized(req)) return;
+    sendStateJson(req);
+  });
+
+  httpOn("/api/config", HTTP_REQ_GET, [](HttpRequest &req) {
+    if (!httpRequireAuthorized(req)) return;
+    sendConfigJson(req);
+  });
+
+  httpOn("/api/history", HTTP_REQ_GET, [](HttpRequest &req) {
+    if (!httpRequireAuthorized(req)) return;
+    sendHistoryJson(req);
+  });
+
+  httpOn("/logs", HTTP_REQ_GET, [](HttpRequest &req) {
+    if (!httpRequireAuthorized(req)) return;
+
+    bool plain = !HUM_FEATURE_WEB_UI || (req.hasArg("plain") && req.arg("plain") == "1");
+
+    uint8_t rec[LOG_RECORD_MAX];
+    char line[LOG_LINE_MAX];
+    LogCursor cursor;
+    ChunkedResponse out(req);
+
+    // ?since=<seq> returns only records with that sequence number or newer. X-Log-Next
+    // is the value to pass next time; X-Log-Dropped counts requested lines already lost.
+    uint32_t since = 0;
+    const uint32_t dropped = httpLogSince(req, since) ? logSeek(cursor, since) : 0;
+    const uint32_t next = logNextSeq();
+    char hdr[12];
+    snprintf(hdr, sizeof(hdr), "%lu", (unsigned long)next);
+    req.sendHeader("X-Log-Next", hdr);
+    snprintf(hdr, sizeof(hdr), "%lu", (unsigned long)dropped);
+    req.sendHeader("X-Log-Dropped", hdr);
+    req.sendHeader("Cache-Control", "no-store");
+
+    if (plain) {
+      out.begin(200, "text/plain");
+      while (cursor.seq != next && logReadNext(cursor, rec)) {
+        out.write(line, logFormatRecord(rec, line, sizeof(line)));
+        out.write("\n", 1);
+      }
+      out.end();
+      return;
+    }
+
+#if HUM_FEATURE_WEB_UI
+    out.begin(200, "text/html");
+    sendPageHead(out, "Logs");
+    out.write("<h2>Logs</h2>");
+    out.write("<p><a href='/'>Back</a> | <a href='/logs?plain=1'>Plain</a></p>");
+    out.write("<pre style='white-space:pre-wrap'>");
+
+    while (cursor.seq != next && logReadNext(cursor, rec)) {
+      logFormatRecord(rec, line, sizeof(line));
+      out.writeEscaped(line);
+      out.write("\n", 1);
+    }
+
+    out.write("</pre>");
+    out.write("</body></html>");
+    out.end();
+#endif
+  });
+
+  httpOn("/metrics", HTTP_REQ_GET, [](HttpRequest &req) {
+    if (!httpRequireAuthorized(req)) return;
+    sendMetrics(req);
+  });
+
+  httpOn("/events", HTTP_REQ_GET, [](HttpRequest &req) {
+    if (!httpRequireAuthorized(req)) return;
+    sseAccept(req);
+  });
+
+  httpOn("/control", HTTP_REQ_POST, [](HttpRequest &req) {
+    if (!httpRequireAuthorized(req)) return;
+    auto arg = [&](const char *name) -> String {
+      return req.hasArg(name) ? req.arg(name) : String("");
+    };
+
+    bool changed = false;
+
+    // Optional zone=<N>, default 0
+    const long zoneArg = req.hasArg("zone") ? req.arg("zone").toInt() : 0;
+    if (zoneArg < 0 || zoneArg >= ZONES_MAX || !zones[zoneArg].active) {
+      req.send(400, "text/plain", "Unknown zone.");
+      return;
+    }
+    Zone &z = zones[zoneArg];
+
+    String enabledStr = arg("enabled");
+    bool newEnabled = parseBool(enabledStr, z.enabled);
+    if (newEnabled != z.enabled) {
+      z.enabled = newEnabled;
+      changed = true;
+    }
+    // Disabling automation must always force the humidifier OFF immediately.
+    if (!z.enabled) relayForceOff((uint8_t)(1U << zoneArg));
+
+    String setpointStr = arg("setpoint");
+    float newSetpoint;
+    if (parseFloat(setpointStr, newSetpoint) && !isnan(newSetpoint)) {
+      float clamped = clampSetpoint(newSetpoint);
+      if (!isnan(clamped) && clamped != z.target) {
+        z.target = clamped;
+        changed = true;
+      }
+    }
+
+    if (changed) {
+      controlRequestEval();
+      saveRuntimeState();
+    }
+    markStateDirty(z, SF_ENABLED | SF_SETPOINT | SF_RELAY | SF_REASON);
+
+    req.send(200, "text/plain", changed ? "Applied." : "No changes.");
+  });
+
+#if HUM_FEATURE_WEB_OTA && HUM_FEATURE_WEB_UI
+  httpOn("/update", HTTP_REQ_GET, [](HttpRequest &req) {
+    if (!httpRequireAuthorized(req)) return;
+    ChunkedResponse out(req);
+    out.begin(200, "text/html");
+    sendPageHead(out, "Firmware Update");
+    out.write("<h2>Firmware Update</h2>");
+    out.write("<p>Upload <b>firmware.bin</b> or <b>firmware.bin.gz</b> built by PlatformIO. "
+              "The SHA-256 (firmware.bin.sha256) is optional; the image is rejected if it does not match.</p>");
+    out.write("<form id='f' method='POST' action='/update' enctype='multipart/form-data'>");
+    out.write("<input type='file' id='file' name='update' accept='.bin,.gz' required><br><br>");
+    out.write("<input type='text' id='sha' size='66' maxlength='64' placeholder='SHA-256 of firmware.bin (hex)'><br><br>");
+    out.write("<button type='submit'>Upload & Flash</button>");
+    out.write("</form>");
+    out.write("<p><progress id='bar' max='100' value='0' style='width:100%'></progress></p><p id='msg'></p>");
+    // Interrupted uploads continue from the byte count the device reports.
+    out.write("<script>"
+              "const $=id=>document.getElementById(id);let tries=0;"
+              "function send(file,sha,offset){"
+              "const x=new XMLHttpRequest(),fd=new FormData();"
+              "fd.append('update',file.slice(offset),file.name);"
+              "x.open('POST','/update?size='+file.size+'&offset='+offset+'&sha256='+encodeURIComponent(sha));"
+              "x.upload.onprogress=e=>{$('bar').value=100*(offset+e.loaded)/file.size;};"
+              "x.onload=()=>{$('msg').textContent=x.responseText;"
+              "if(x.status==202)retry(file,sha);};"
+              "x.onerror=()=>retry(file,sha);x.send(fd);}"
+              "function retry(file,sha){"
+              "if(++tries>10){$('msg').textContent='Upload failed.';return;}"
+              "$('msg').textContent='Connection lost, resuming...';"
+              "setTimeout(()=>fetch('/update/status').then(r=>r.json()).then(s=>{"
+              "if(s.state=='interrupted')send(file,sha,s.received);"
+              "else if(s.state=='running')retry(file,sha);"
+              "else $('msg').textContent='Upload failed: '+(s.error||s.state);"
+              "}).catch(()=>retry(file,sha)),2000);}"
+              "$('f').onsubmit=e=>{e.preventDefault();tries=0;"
+              "send($('file').files[0],$('sha').value.trim(),0);};"
+              "</script>");
+    out.write("<p><a href='/'>Back</a></p>");
+    out.write("</body></html>");
+    out.end();
+  });
+
+#endif
+
+#if HUM_OTA_WRITER
+  httpOn("/update/status", HTTP_REQ_GET, [](HttpRequest &req) {
+    if (!httpRequireAuthorized(req)) return;
+    char doc[OTA_JSON_MAX];
+    if (formatOtaJson(doc, sizeof(doc)) <= 0) {
+      req.send(500, "text/plain", "Error\n");
+      return;
+    }
+    req.send(200, "application/json", doc);
+  });
+#endif
+
+#if HUM_FEATURE_WEB_OTA
+  // POST /update?size=<bytes>&sha256=<hex>&offset=<bytes>: offset > 0 continues an
+  // interrupted upload with the rest of the file (409 if it is not where the device is,
+  // or while a fleet download runs).
+  httpOn(
+      "/update",
+      HTTP_REQ_POST,
+      [](HttpRequest &req) {
+        if (!httpRequireAuthorized(req)) return;
+        otaUnclaim(&req);
+        if (req.upload().refused) {
+          char doc[OTA_JSON_MAX];
+          formatOtaJson(doc, sizeof(doc));
+          req.send(409, "application/json", doc);
+          return;
+        }
+        if (ota.phase == OTA_DONE) {
+          req.send(200, "text/plain", "OK\nRebooting...");
+          requestReboot(false);
+        } else if (ota.phase == OTA_INTERRUPTED) {
+          req.send(202, "text/plain", "INCOMPLETE\n");
+        } else {
+          req.send(200, "text/plain", String("FAIL\n") + ota.error);
+        }
+      },
+      [](HttpRequest &req) {
+        if (!httpIsAuthorized(req)) return;
+        HttpUpload &upload = req.upload();
+        if (upload.status == HTTP_UPLOAD_START) {
+          const uint32_t offset = req.hasArg("offset") ? (uint32_t)strtoul(req.arg("offset").c_str(), nullptr, 10) : 0;
+          if (!otaClaim(&req)) {
+            upload.refused = true; // a fleet download or another upload owns Update
+            logWriteLine(LOG_WARN, "[WEB OTA] Refused: another update in progress");
+          } else if (offset == 0) {
+#if HUM_FEATURE_FLEET_OTA
+            fleetSupersede();
+#endif
+            const uint32_t size = req.hasArg("size") ? (uint32_t)strtoul(req.arg("size").c_str(), nullptr, 10) : 0;
+            otaBegin(OTA_SOURCE_WEB, size, req.hasArg("sha256") ? req.arg("sha256").c_str() : "");
+          } else {
+            upload.refused = !otaResume(offset);
+            if (upload.refused) logf(LOG_WARN, "[WEB OTA] Resume at %lu refused", (unsigned long)offset);
+          }
+        } else if (upload.status == HTTP_UPLOAD_ABORTED) {
+          if (!upload.refused) otaInterrupt();
+          otaUnclaim(&req); // the main handler does not run
+        } else if (upload.refused) {
+          return;
+        } else if (upload.status == HTTP_UPLOAD_WRITE) {
+#if HUM_SPLIT_TASKS
+          otaWrite(upload.buf, upload.currentSize);
+#else
+          if (otaWrite(upload.buf, upload.currentSize)) otaServiceNetwork();
+#endif
+        } else if (upload.status == HTTP_UPLOAD_END) {
+          // Without a size every completed upload is the whole image.
+          if (ota.total != 0 && ota.received < ota.total) {
+            otaInterrupt();
+          } else {
+            otaFinish();
+          }
+        }
+      });
+#endif
+
+  httpOn("/save", HTTP_REQ_POST, [](HttpRequest &req) {
+    if (!httpRequireAuthorized(req)) return;
+    // pendingConfig is shared: one save at a time.
+    bool idle = false;
+    if (!saveBusy.compare_exchange_strong(idle, true)) {
+      req.send(503, "text/plain", "Another save is in progress.");
+      return;
+    }
+    struct SaveRelease {
+      ~SaveRelease() { saveBusy = false; }
+    } release;
+    if (rebootRequested) {
+      req.send(503, "text/plain", "Rebooting.");
+      return;
+    }
+    pendingConfig = config;
+    auto arg = [&](const char *name) -> String {
+      return req.hasArg(name) ? req.arg(name) : String("");
+    };
+
+    String wifiSsid = arg("wifi_ssid");
+    String wifiPass = arg("wifi_pass");
+    String ipAddr = arg("ip_addr");
+    String ipGw = arg("ip_gw");
+    String ipMask = arg("ip_mask");
+    String ipDns = arg("ip_dns");
+
+    String webUser = arg("web_user");
+    String webPass = arg("web_pass");
+    String webPass2 = arg("web_pass2");
+
+    String mqttHost = arg("mqtt_host");
+    String mqttPort = arg("mqtt_port");
+    String mqttUser = arg("mqtt_user");
+    String mqttPass = arg("mqtt_pass");
+
+    String baseTopic = arg("base_topic");
+    String tHumIn = arg("t_hum_in");
+    String tSetIn = arg("t_set_in");
+    String tEnIn = arg("t_en_in");
+
+    String relayPin = arg("relay_pin");
+    String relayInv = arg("relay_inv");
+    String hyst = arg("hyst");
+    String humIntSec = arg("hum_int_sec");
+    String filterModeStr = arg("filter_mode");
+    String filterWindowStr = arg("filter_window");
+    String filterAlphaStr = arg("filter_alpha");
+    String filterRateStr = arg("filter_rate");
+    String humSources = arg("hum_sources");
+    String fusionModeStr = arg("fusion_mode");
+    String sourceStaleStr = arg("source_stale_sec");
+    String controlModeStr = arg("control_mode");
+    String minOnStr = arg("min_on_sec");
+    String minOffStr = arg("min_off_sec");
+    String maxDutyStr = arg("max_duty_pct");
+    String logLevelStr = arg("log_level");
+    String hangSecStr = arg("hang_sec");
+    String hangActStr = arg("hang_act");
+    String historySecStr = arg("history_sec");
+    String sensorTypeStr = arg("sensor_type");
+    String sensorZoneStr = arg("sensor_zone");
+    String sensorSdaStr = arg("sensor_sda");
+    String sensorSclStr = arg("sensor_scl");
+    String sensorAddrStr = arg("sensor_addr");
+    String sensorIntervalStr = arg("sensor_interval_sec");
+    String fleetTopic = arg("fleet_topic");
+    String fleetDelayStr = arg("fleet_delay_sec");
+
+    bool stateJson = req.hasArg("state_json");
+    String telemetrySecStr = arg("telemetry_sec");
+    bool haDisc = req.hasArg("ha_disc");
+    String haPrefix = arg("ha_prefix");
+    String haName = arg("ha_name");
+
+    wifiSsid.trim();
+    ipAddr.trim();
+    ipGw.trim();
+    ipMask.trim();
+    ipDns.trim();
+    webUser.trim();
+    mqttHost.trim();
+    baseTopic.trim();
+    tHumIn.trim();
+    tSetIn.trim();
+    tEnIn.trim();
+    humSources.trim();
+
+    haPrefix.trim();
+    haName.trim();
+
+    if (webPass.length() > 0 && webPass != webPass2) {
+      req.send(400, "text/plain", "Web password mismatch (not saved).");
+      return;
+    }
+
+    if (ipAddr.length() > 0) {
+      IPAddress check;
+      if (!check.fromString(ipAddr.c_str()) || !check.fromString(ipGw.c_str()) || !check.fromString(ipMask.c_str()) ||
+          (ipDns.length() > 0 && !check.fromString(ipDns.c_str()))) {
+        req.send(400, "text/plain", "Static IP needs address, gateway and mask (not saved).");
+        return;
+      }
+    }
+
+    if (wifiSsid.length() >= sizeof(pendingConfig.wifiSsid)) wifiSsid = wifiSsid.substring(0, sizeof(pendingConfig.wifiSsid) - 1);
+    if (wifiPass.length() >= sizeof(pendingConfig.wifiPass)) wifiPass = wifiPass.substring(0, sizeof(pendingConfig.wifiPass) - 1);
+    if (webUser.length() >= sizeof(pendingConfig.webUser)) webUser = webUser.substring(0, sizeof(pendingConfig.webUser) - 1);
+    if (webPass.length() >= sizeof(pendingConfig.webPass)) webPass = webPass.substring(0, sizeof(pendingConfig.webPass) - 1);
+    if (mqttHost.length() >= sizeof(pendingConfig.mqttHost)) mqttHost = mqttHost.substring(0, sizeof(pendingConfig.mqttHost) - 1);
+    if (mqttUser.length() >= sizeof(pendingConfig.mqttUser)) mqttUser = mqttUser.substring(0, sizeof(pendingConfig.mqttUser) - 1);
+    if (mqttPass.length() >= sizeof(pendingConfig.mqttPass)) mqttPass = mqttPass.substring(0, sizeof(pendingConfig.mqttPass) - 1);
+    if (baseTopic.length() >= sizeof(pendingConfig.baseTopic)) baseTopic = baseTopic.substring(0, sizeof(pendingConfig.baseTopic) - 1);
+    if (tHumIn.length() >= sizeof(pendingConfig.topicHumidityIn)) tHumIn = tHumIn.substring(0, sizeof(pendingConfig.topicHumidityIn) - 1);
+    if (tSetIn.length() >= sizeof(pendingConfig.topicSetpointIn)) tSetIn = tSetIn.substring(0, sizeof(pendingConfig.topicSetpointIn) - 1);
+    if (tEnIn.length() >= sizeof(pendingConfig.topicEnableIn)) tEnIn = tEnIn.substring(0, sizeof(pendingConfig.topicEnableIn) - 1);
+    if (humSources.length() >= sizeof(pendingConfig.humiditySources)) {
+      req.send(400, "text/plain", "Humidity source list too long (not saved).");
+      return;
+    }
+
+    relayPin.trim();
+    if (relayPin.length() == 0 || !relayPinValid(relayPin.toInt())) {
+      req.send(400, "text/plain", "Relay pin must be an output GPIO 0..5, 12..19, 21..23, 25..27 or 32..33 (not saved).");
+      return;
+    }
+
+    // Zones 1..: an empty or negative pin disables the zone; a pin may drive one relay only.
+    ZoneConfig zoneCfg[ZONES_MAX - 1];
+    for (uint8_t i = 1; i < ZONES_MAX; i++) {
+      ZoneConfig &zc = zoneCfg[i - 1];
+      zc = pendingConfig.zones[i - 1];
+      char key[16];
+      snprintf(key, sizeof(key), "z%u_pin", (unsigned)i);
+      String pinStr = arg(key);
+      pinStr.trim();
+      long pin = pinStr.length() > 0 ? pinStr.toInt() : -1;
+      if (pin < 0) pin = -1;
+      if (pin >= 0 && !relayPinValid(pin)) {
+        req.send(400, "text/plain", "Zone relay pin must be an output GPIO 0..5, 12..19, 21..23, 25..27 or 32..33 (not saved).");
+        return;
+      }
+      bool clash = pin >= 0 && pin == relayPin.toInt();
+      for (uint8_t j = 0; j + 1 < i; j++) clash = clash || (pin >= 0 && zoneCfg[j].relayPin == pin);
+      if (clash) {
+        req.send(400, "text/plain", "Relay pin used by more than one zone (not saved).");
+        return;
+      }
+      zc.relayPin = (int8_t)pin;
+
+      snprintf(key, sizeof(key), "z%u_inv", (unsigned)i);
+      zc.relayInverted = parseBool(arg(key), zc.relayInverted);
+      snprintf(key, sizeof(key), "z%u_hyst", (unsigned)i);
+      float zoneHyst;
+      if (parseFloat(arg(key), zoneHyst) && zoneHyst >= 0.0f) zc.hysteresis = zoneHyst;
+
+      snprintf(key, sizeof(key), "z%u_name", (unsigned)i);
+      String name = arg(key);
+      name.trim();
+      if (name.length() == 0) name = String("Zone ") + i;
+      if (name.length() >= sizeof(zc.name)) name = name.substring(0, sizeof(zc.name) - 1);
+      strncpy(zc.name, name.c_str(), sizeof(zc.name) - 1);
+
+      snprintf(key, sizeof(key), "z%u_hum", (unsigned)i);
+      String hum = arg(key);
+      hum.trim();
+      if (hum.length() >= sizeof(zc.topicHumidityIn)) hum = hum.substring(0, sizeof(zc.topicHumidityIn) - 1);
+      strncpy(zc.topicHumidityIn, hum.c_str(), sizeof(zc.topicHumidityIn) - 1);
+    }
+
+    long sensorType = sensorTypeStr.toInt();
+    if (sensorType < 0 || sensorType >= SENSOR_TYPE_COUNT) sensorType = SENSOR_NONE;
+    long sensorSda = sensorSdaStr.length() > 0 ? sensorSdaStr.toInt() : 21;
+    long sensorScl = sensorSclStr.length() > 0 ? sensorSclStr.toInt() : 22;
+    if (sensorSda < 0 || sensorSda > 39) sensorSda = -1;
+    if (sensorScl < 0 || sensorScl > 39) sensorScl = -1;
+    if (sensorType != SENSOR_NONE) {
+      const bool i2c = sensorType == SENSOR_SHT3X || sensorType == SENSOR_BME280;
+      bool clash = false;
+      for (long pin : {sensorSda, i2c ? sensorScl : -1L}) {
+        clash = clash || (pin >= 0 && pin == relayPin.toInt());
+        for (const ZoneConfig &zc : zoneCfg) clash = clash || (pin >= 0 && zc.relayPin == pin);
+      }
+      if (clash) {
+        req.send(400, "text/plain", "Sensor pin used by a relay (not saved).");
+        return;
+      }
+    }
+
+    if (haPrefix.length() >= sizeof(pendingConfig.haDiscoveryPrefix)) haPrefix = haPrefix.substring(0, sizeof(pendingConfig.haDiscoveryPrefix) - 1);
+    if (haName.length() >= sizeof(pendingConfig.haDeviceName)) haName = haName.substring(0, sizeof(pendingConfig.haDeviceName) - 1);
+
+    strncpy(pendingConfig.wifiSsid, wifiSsid.c_str(), sizeof(pendingConfig.wifiSsid) - 1);
+    strncpy(pendingConfig.wifiPass, wifiPass.c_str(), sizeof(pendingConfig.wifiPass) - 1);
+    snprintf(pendingConfig.staticIp, sizeof(pendingConfig.staticIp), "%s", ipAddr.c_str());
+    snprintf(pendingConfig.staticGateway, sizeof(pendingConfig.staticGateway), "%s", ipGw.c_str());
+    snprintf(pendingConfig.staticMask, sizeof(pendingConfig.staticMask), "%s", ipMask.c_str());
+    snprintf(pendingConfig.staticDns, sizeof(pendingConfig.staticDns), "%s", ipDns.c_str());
+
+    if (webUser.length() > 0) strncpy(pendingConfig.webUser, webUser.c_str(), sizeof(pendingConfig.webUser) - 1);
+    if (webPass.length() > 0) strncpy(pendingConfig.webPass, webPass.c_str(), sizeof(pendingConfig.webPass) - 1);
+
+    strncpy(pendingConfig.mqttHost, mqttHost.c_str(), sizeof(pendingConfig.mqttHost) - 1);
+    pendingConfig.mqttPort = (uint16_t)mqttPort.toInt();
+    strncpy(pendingConfig.mqttUser, mqttUser.c_str(), sizeof(pendingConfig.mqttUser) - 1);
+    strncpy(pendingConfig.mqttPass, mqttPass.c_str(), sizeof(pendingConfig.mqttPass) - 1);
+
+    strncpy(pendingConfig.baseTopic, baseTopic.c_str(), sizeof(pendingConfig.baseTopic) - 1);
+    strncpy(pendingConfig.topicHumidityIn, tHumIn.c_str(), sizeof(pendingConfig.topicHumidityIn) - 1);
+    strncpy(pendingConfig.topicSetpointIn, tSetIn.c_str(), sizeof(pendingConfig.topicSetpointIn) - 1);
+    strncpy(pendingConfig.topicEnableIn, tEnIn.c_str(), sizeof(pendingConfig.topicEnableIn) - 1);
+
+    pendingConfig.relayPin = relayPin.toInt();
+    pendingConfig.relayInverted = parseBool(relayInv, pendingConfig.relayInverted);
+
+    float hystF;
+    if (parseFloat(hyst, hystF)) pendingConfig.hysteresis = hystF;
+    for (uint8_t i = 1; i < ZONES_MAX; i++) pendingConfig.zones[i - 1] = zoneCfg[i - 1];
+
+    uint32_t sec = (uint32_t)humIntSec.toInt();
+    pendingConfig.humidityMinIntervalMs = sec * 1000U;
+
+    long fltMode = filterModeStr.toInt();
+    if (fltMode < FILTER_NONE || fltMode > FILTER_TRIMMED_MEAN) fltMode = FILTER_MEDIAN;
+    pendingConfig.filterMode = (uint8_t)fltMode;
+    long fltWin = filterWindowStr.toInt();
+    if (fltWin < 1) fltWin = 1;
+    if (fltWin > FILTER_WINDOW_MAX) fltWin = FILTER_WINDOW_MAX;
+    pendingConfig.filterWindow = (uint8_t)fltWin;
+    float fltF;
+    if (parseFloat(filterAlphaStr, fltF) && fltF > 0.0f && fltF <= 1.0f) pendingConfig.filterAlpha = fltF;
+    if (parseFloat(filterRateStr, fltF) && fltF >= 0.0f) pendingConfig.filterMaxRate = fltF;
+
+    strncpy(pendingConfig.humiditySources, humSources.c_str(), sizeof(pendingConfig.humiditySources) - 1);
+    pendingConfig.humiditySources[humSources.length()] = 0;
+    long fuseMode = fusionModeStr.toInt();
+    if (fuseMode < FUSION_AVERAGE || fuseMode > FUSION_MEDIAN) fuseMode = FUSION_AVERAGE;
+    pendingConfig.fusionMode = (uint8_t)fuseMode;
+    long staleSec = sourceStaleStr.toInt();
+    if (staleSec < 10) staleSec = 10;
+    if (staleSec > 3600) staleSec = 3600;
+    pendingConfig.sourceStaleSec = (uint16_t)staleSec;
+    long ctlMode = controlModeStr.toInt();
+    if (ctlMode < CONTROL_MODE_HYSTERESIS || ctlMode > CONTROL_MODE_PREDICTIVE) ctlMode = CONTROL_MODE_HYSTERESIS;
+    pendingConfig.controlMode = (uint8_t)ctlMode;
+    long minOn = minOnStr.toInt();
+    if (minOn < 0) minOn = 0;
+    if (minOn > 3600) minOn = 3600;
+    pendingConfig.relayMinOnSec = (uint16_t)minOn;
+    long minOff = minOffStr.toInt();
+    if (minOff < 0) minOff = 0;
+    if (minOff > 3600) minOff = 3600;
+    pendingConfig.relayMinOffSec = (uint16_t)minOff;
+    long maxDuty = maxDutyStr.length() > 0 ? maxDutyStr.toInt() : 100;
+    if (maxDuty < 1) maxDuty = 1;
+    if (maxDuty > 100) maxDuty = 100;
+    pendingConfig.relayMaxDutyPct = (uint8_t)maxDuty;
+
+    int lvl = logLevelStr.toInt();
+    if (lvl < 0) lvl = 0;
+    if (lvl > 3) lvl = 3;
+    pendingConfig.logLevel = (uint8_t)lvl;
+
+    uint32_t hangSec = (uint32_t)hangSecStr.toInt();
+    if (hangSec > 86400U) hangSec = 86400U;
+    pendingConfig.hangTimeoutSec = hangSec;
+
+    int hangAct = hangActStr.toInt();
+    if (hangAct != 2) hangAct = 1;
+    pendingConfig.hangAction = (uint8_t)hangAct;
+
+    long historySec = historySecStr.toInt();
+    if (historySec < 10) historySec = 10;
+    if (historySec > 3600) historySec = 3600;
+    pendingConfig.historySec = (uint16_t)historySec;
+
+    long sensorZone = sensorZoneStr.toInt();
+    if (sensorZone < 0 || sensorZone >= ZONES_MAX) sensorZone = 0;
+    long sensorAddr = strtol(sensorAddrStr.c_str(), nullptr, 0); // 0x44 or 68
+    if (sensorAddr < 0 || sensorAddr > 0x7F) sensorAddr = 0;
+    long sensorInterval = sensorIntervalStr.toInt();
+    if (sensorInterval < 2) sensorInterval = 2;
+    if (sensorInterval > 3600) sensorInterval = 3600;
+    pendingConfig.sensorType = (uint8_t)sensorType;
+    pendingConfig.sensorZone = (uint8_t)sensorZone;
+    pendingConfig.sensorSda = (int8_t)sensorSda;
+    pendingConfig.sensorScl = (int8_t)sensorScl;
+    pendingConfig.sensorAddr = (uint8_t)sensorAddr;
+    pendingConfig.sensorIntervalSec = (uint16_t)sensorInterval;
+
+    fleetTopic.trim();
+    strncpy(pendingConfig.fleetTopic, fleetTopic.c_str(), sizeof(pendingConfig.fleetTopic) - 1);
+    long fleetDelay = fleetDelayStr.toInt();
+    if (fleetDelay < 0) fleetDelay = 0;
+    if (fleetDelay > 43200) fleetDelay = 43200;
+    pendingConfig.fleetDelayMaxSec = (uint16_t)fleetDelay;
+
+    pendingConfig.stateJson = stateJson;
+    long telSec = telemetrySecStr.toInt();
+    if (telSec < 0) telSec = 0;
+    if (telSec > 65535) telSec = 65535; // uint16_t field, about 18 h
+    pendingConfig.telemetrySec = (uint16_t)telSec;
+    pendingConfig.haDiscoveryEnabled = haDisc;
+    if (haPrefix.length() == 0) haPrefix = "homeassistant";
+    strncpy(pendingConfig.haDiscoveryPrefix, haPrefix.c_str(), sizeof(pendingConfig.haDiscoveryPrefix) - 1);
+    strncpy(pendingConfig.haDeviceName, haName.c_str(), sizeof(pendingConfig.haDeviceName) - 1);
+
+    req.send(200, "text/plain", "Saved. Rebooting...");
+    requestReboot(true);
+  });
+
+  httpNotFound = [](HttpRequest &req) {
+    if (captivePortalActive) {
+      // Captive portal: always redirect to /
+      req.sendHeader("Location", (String("http://") + WiFi.softAPIP().toString() + "/").c_str());
+      req.send(302, "text/plain", "");
+      return;
+    }
+
+    if (!httpRequireAuthorized(req)) return;
+    req.send(404, "text/plain", "Not found");
+  };
+}
+
+static void startWebServices() {
+  if (webStarted) return;
+  httpSetupHandlers();
+  sseQueue = xQueueCreate(SSE_MAX_CLIENTS, sizeof(SsePending));
+  httpServer.begin();
+  httpServer.setNoDelay(true);
+  webStarted = true;
+}
+
+static void startCaptivePortal() {
+  WiFi.mode(WIFI_AP);
+  WiFi.softAP(HUM_DEFAULT_AP_SSID, HUM_DEFAULT_AP_PASS);
+
+  IPAddress apIP = WiFi.softAPIP();
+#if HUM_FEATURE_CAPTIVE_DNS
+  dns.start(DNS_PORT, "*", apIP);
+#endif
+  captivePortalActive = true;
+
+  startWebServices();
+
+  logf(LOG_INFO, "[AP] SSID: %s", HUM_DEFAULT_AP_SSID);
+  logf(LOG_INFO, "[AP] IP: %s", apIP.toString().c_str());
+}
+
+static void wifiSetState(WifiState st) {
+  wifiState = st;
+  wifiStateSinceMs = millis();
+}
+
+static void onWifiEvent(WiFiEvent_t event, WiFiEventInfo_t info) {
+  (void)info;
+  switch (event) {
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP: wifiEvtGotIp = true; break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+    case ARDUINO_EVENT_WIFI_STA_LOST_IP: wifiEvtDisconnected = true; break;
+    default: break;
+  }
+}
+
+// The AP last associated with, kept in NVS namespace "wifi" so the next boot (and the
+// stack's auto-reconnect) can skip the channel scan. It belongs to one SSID: ssidHash.
+struct WifiFastCache {
+  uint32_t ssidHash;
+  uint8_t bssid[6];
+  uint8_t channel;
+};
+
+static WifiFastCache wifiCache = {0, {0}, 0};
+static bool wifiFastAttempt = false; // current association uses wifiCache
+
+static uint32_t wifiSsidHash() {
+  return fnv1a(FNV1A_SEED, config.wifiSsid, strlen(config.wifiSsid));
+}
+
+static void wifiCacheLoad() {
+  Preferences p;
+  if (!p.begin("wifi", true)) return;
+  if (p.getBytes("fast", &wifiCache, sizeof(wifiCache)) != sizeof(wifiCache)) memset(&wifiCache, 0, sizeof(wifiCache));
+  p.end();
+}
+
+// Written only when the AP or channel changed, so a stable site costs no flash writes.
+static void wifiCacheStore() {
+  WifiFastCache c;
+  c.ssidHash = wifiSsidHash();
+  const uint8_t *bssid = WiFi.BSSID();
+  if (!bssid) return;
+  memcpy(c.bssid, bssid, sizeof(c.bssid));
+  c.channel = (uint8_t)WiFi.channel();
+  if (memcmp(&c, &wifiCache, sizeof(c)) == 0) return;
+  wifiCache = c;
+  Preferences p;
+  if (!p.begin("wifi", false)) return;
+  p.putBytes("fast", &wifiCache, sizeof(wifiCache));
+  p.end();
+  metrics.nvsWrites++;
+}
+
+static void wifiApplyStaticIp() {
+  if (config.staticIp[0] == '\0') return;
+  IPAddress ip, gw, mask, dnsIp;
+  if (!ip.fromString(config.staticIp) || !gw.fromString(config.staticGateway) || !mask.fromString(config.staticMask)) {
+    logWriteLine(LOG_WARN, "[WiFi] Static IP config invalid, using DHCP");
+    return;
+  }
+  if (!dnsIp.fromString(config.staticDns)) dnsIp = gw;
+  WiFi.config(ip, gw, mask, dnsIp);
+}
+
+// Starts association and returns immediately; wifiTick() finishes the job. With a
+// cached BSSID/channel for this SSID the scan is skipped; wifiTick() falls back to a
+// plain begin() if that does not connect within WIFI_FAST_CONNECT_TIMEOUT_MS.
+static bool connectWiFiSta() {
+  if (strlen(config.wifiSsid) == 0) return false;
+
+  static bool eventsRegistered = false;
+  if (!eventsRegistered) {
+    WiFi.onEvent(onWifiEvent);
+    eventsRegistered = true;
+    wifiCacheLoad();
+  }
+
+  wifiEvtGotIp = false;
+  wifiEvtDisconnected = false;
+
+  WiFi.persistent(false); // the config lives in our NVS keys; no SDK flash write per begin()
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(true);
+  wifiApplyStaticIp();
+  wifiFastAttempt = wifiCache.channel != 0 && wifiCache.ssidHash == wifiSsidHash();
+  if (wifiFastAttempt) {
+    WiFi.begin(config.wifiSsid, config.wifiPass, wifiCache.channel, wifiCache.bssid);
+  } else {
+    WiFi.begin(config.wifiSsid, config.wifiPass);
+  }
+
+  wifiSetState(WIFI_ST_CONNECTING);
+  logf(LOG_INFO, "[WiFi] Connecting to '%s'%s", config.wifiSsid, wifiFastAttempt ? " (cached AP)" : "");
+  return true;
+}
+
+static void wifiTick(uint32_t now) {
+  if (wifiState == WIFI_ST_IDLE || wifiState == WIFI_ST_PORTAL) return;
+
+  if (wifiEvtDisconnected) {
+    wifiEvtDisconnected = false;
+    if (wifiState == WIFI_ST_CONNECTED) {
+      // Auto-reconnect is handled by the Wi-Fi stack; we only track the state.
+      logWriteLine(LOG_WARN, "[WiFi] Disconnected");
+      wifiSetState(WIFI_ST_CONNECTING);
+    }
+  }
+
+  if (wifiEvtGotIp) {
+    wifiEvtGotIp = false;
+    if (WiFi.status() == WL_CONNECTED) {
+      wifiSetState(WIFI_ST_CONNECTED);
+      if (!wifiEverConnected) wifiUpMs = now;
+      wifiEverConnected = true;
+      captivePortalActive = false;
+      wifiCacheStore();
+
+      startWebServices();
+#if HUM_FEATURE_ARDUINO_OTA
+      setupOta();
+#endif
+
+      logf(LOG_INFO, "[WiFi] Connected, IP: %s, channel %d, %lums after boot", WiFi.localIP().toString().c_str(),
+           (int)WiFi.channel(), (unsigned long)now);
+    }
+    return;
+  }
+
+  // The cached AP is gone or moved channel: forget it and scan.
+  if (wifiState == WIFI_ST_CONNECTING && wifiFastAttempt && (now - wifiStateSinceMs) >= WIFI_FAST_CONNECT_TIMEOUT_MS) {
+    wifiFastAttempt = false;
+    logWriteLine(LOG_WARN, "[WiFi] Cached AP not reachable -> full scan");
+    WiFi.disconnect();
+    WiFi.begin(config.wifiSsid, config.wifiPass);
+  }
+
+  // First association after boot failed -> fall back to the setup portal.
+  // Once we have been online, keep retrying in the background instead.
+  if (wifiState == WIFI_ST_CONNECTING && !wifiEverConnected && (now - wifiStateSinceMs) >= WIFI_CONNECT_TIMEOUT_MS) {
+    WiFi.disconnect(true);
+    logWriteLine(LOG_WARN, "[WiFi] STA connect timeout -> starting captive portal");
+    startCaptivePortal();
+    wifiSetState(WIFI_ST_PORTAL);
+  }
+}
+
+#if HUM_FEATURE_HA_DISCOVERY
+// Discovery payloads are produced twice by the same builder: a measuring pass that
+// only counts bytes and hashes them, then (if the hash differs from the one stored in
+// NVS) an emitting pass that streams through a small staging buffer straight into the
+// socket via beginPublish()/write(). No payload is ever held in RAM as a whole.
+class DiscoveryWriter {
+ public:
+  DiscoveryWriter(const char *topic, bool emit) : emit_(emit), hash_(fnv1a(FNV1A_SEED, topic, strlen(topic))) {}
+
+  void raw(const char *s) { bytes(s, strlen(s)); }
+
+  void str(const char *a, const char *b = "") {
+    put('"');
+    escaped(a);
+    escaped(b);
+    put('"');
+  }
+
+  void beginObject() {
+    put('{');
+    first_ = true;
+  }
+
+  void endObject() {
+    put('}');
+    first_ = false;
+  }
+
+  void key(const char *k) {
+    if (!first_) put(',');
+    first_ = false;
+    put('"');
+    raw(k);
+    raw("\":");
+  }
+
+  void field(const char *k, const char *a, const char *b = "") {
+    key(k);
+    str(a, b);
+  }
+
+  void field(const char *k, int v) {
+    char tmp[12];
+    snprintf(tmp, sizeof(tmp), "%d", v);
+    key(k);
+    raw(tmp);
+  }
+
+  size_t length() const { return len_; }
+
+  // Never 0 or 1: those values mean "unknown" and "cleared" in NVS.
+  uint32_t hash() const { return hash_ < 2U ? hash_ + 2U : hash_; }
+
+  bool finish() {
+    flush();
+    return ok_;
+  }
+
+ private:
+  void escaped(const char *s) {
+    for (; *s; s++) {
+      switch (*s) {
+        case '\\': raw("\\\\"); break;
+        case '"': raw("\\\""); break;
+        case '\n': raw("\\n"); break;
+        case '\r': raw("\\r"); break;
+        case '\t': raw("\\t"); break;
+        default: put(*s); break;
+      }
+    }
+  }
+
+  void put(char c) { bytes(&c, 1); }
+
+  void bytes(const char *s, size_t n) {
+    len_ += n;
+    if (!emit_) {
+      hash_ = fnv1a(hash_, s, n);
+      return;
+    }
+    while (n > 0) {
+      if (fill_ == sizeof(stage_)) flush();
+      size_t take = sizeof(stage_) - fill_;
+      if (take > n) take = n;
+      memcpy(stage_ + fill_, s, take);
+      fill_ += take;
+      s += take;
+      n -= take;
+    }
+  }
+
+  void flush() {
+    if (!emit_ || fill_ == 0) return;
+    if (mqtt.write((const uint8_t *)stage_, fill_) != fill_) ok_ = false;
+    fill_ = 0;
+  }
+
+  bool emit_;
+  bool ok_ = true;
+  bool first_ = true;
+  uint32_t hash_;
+  size_t len_ = 0;
+  char stage_[128];
+  size_t fill_ = 0;
+};
+
+typedef void (*DiscoveryBuilder)(DiscoveryWriter &w, const Zone &z);
+
+static const char *discoveryDeviceName() {
+  return (strlen(config.haDeviceName) > 0) ? config.haDeviceName : deviceId();
+}
+
+// Entity names: the device name for zone 0, the zone name for the others.
+static const char *discZoneName(const Zone &z) {
+  return zoneIndex(z) == 0 ? discoveryDeviceName() : z.name;
+}
+
+// Unique id / object id suffix: "_humidity" for zone 0, "_z2_humidity" for zone 2.
+static const char *discZoneSuffix(char *buf, size_t size, const Zone &z, const char *object) {
+  if (zoneIndex(z) == 0) {
+    snprintf(buf, size, "_%s", object);
+  } else {
+    snprintf(buf, size, "_z%u_%s", (unsigned)zoneIndex(z), object);
+  }
+  return buf;
+}
+
+static void discWriteDevice(DiscoveryWriter &w) {
+  w.key("dev");
+  w.beginObject();
+  w.key("ids");
+  w.raw("[");
+  w.str(deviceId());
+  w.raw("]");
+  w.field("name", discoveryDeviceName());
+  w.field("mdl", "ESP32 Humidifier");
+  w.field("mf", "Custom");
+  w.field("sw", HUM_DEVICE_NAME);
+  w.endObject();
+}
+
+static void discWriteAvailability(DiscoveryWriter &w) {
+  w.field("avty_t", topics.statusOnline);
+  w.field("pl_avail", "1");
+  w.field("pl_not_avail", "0");
+}
+
+static void discBuildHumidifier(DiscoveryWriter &w, const Zone &z) {
+  char uid[32];
+  w.beginObject();
+  w.field("name", discZoneName(z));
+  w.field("unique_id", deviceId(), discZoneSuffix(uid, sizeof(uid), z, "humidifier"));
+  w.field("availability_topic", topics.statusOnline);
+  w.field("payload_available", "1");
+  w.field("payload_not_available", "0");
+  w.field("command_topic", z.topics.cmdEnable);
+  w.field("state_topic", z.topics.stateEnabled);
+  w.field("payload_on", "1");
+  w.field("payload_off", "0");
+  w.field("target_humidity_command_topic", z.topics.cmdSetpoint);
+  w.field("target_humidity_state_topic", z.topics.stateSetpoint);
+  w.field("current_humidity_topic", z.topics.stateHumidity);
+  w.field("min_humidity", (int)SETPOINT_MIN);
+  w.field("max_humidity", (int)SETPOINT_MAX);
+  w.field("device_class", "humidifier");
+  discWriteDevice(w);
+  w.endObject();
+}
+
+static void discBuildHumidity(DiscoveryWriter &w, const Zone &z) {
+  char uid[32];
+  w.beginObject();
+  w.field("name", discZoneName(z), " Humidity");
+  w.field("uniq_id", deviceId(), discZoneSuffix(uid, sizeof(uid), z, "humidity"));
+  w.field("stat_t", z.topics.stateHumidity);
+  w.field("unit_of_meas", "%");
+  w.field("dev_cla", "humidity");
+  discWriteAvailability(w);
+  discWriteDevice(w);
+  w.endObject();
+}
+
+static void discBuildHumidityAge(DiscoveryWriter &w, const Zone &z) {
+  char uid[32];
+  w.beginObject();
+  w.field("name", discZoneName(z), " Humidity age");
+  w.field("uniq_id", deviceId(), discZoneSuffix(uid, sizeof(uid), z, "humidity_age_ms"));
+  w.field("stat_t", z.topics.stateHumidityAge);
+  w.field("unit_of_meas", "ms");
+  discWriteAvailability(w);
+  discWriteDevice(w);
+  w.endObject();
+}
+
+static void discBuildRelay(DiscoveryWriter &w, const Zone &z) {
+  char uid[32];
+  w.beginObject();
+  w.field("name", discZoneName(z), " Relay");
+  w.field("uniq_id", deviceId(), discZoneSuffix(uid, sizeof(uid), z, "relay"));
+  w.field("stat_t", z.topics.stateRelay);
+  w.field("pl_on", "ON");
+  w.field("pl_off", "OFF");
+  w.field("dev_cla", "power");
+  discWriteAvailability(w);
+  discWriteDevice(w);
+  w.endObject();
+}
+
+static void discBuildReason(DiscoveryWriter &w, const Zone &z) {
+  char uid[32];
+  w.beginObject();
+  w.field("name", discZoneName(z), " Automation reason");
+  w.field("uniq_id", deviceId(), discZoneSuffix(uid, sizeof(uid), z, "automation_reason"));
+  w.field("stat_t", z.topics.stateReason);
+  discWriteAvailability(w);
+  discWriteDevice(w);
+  w.endObject();
+}
+
+// Published once per zone; topic <prefix>/<component>/<device id>/<object id>/config,
+// with the object id carrying the zone (see discZoneSuffix).
+struct DiscoveryEntity {
+  const char *nvsKey; // hash of the last retained payload in namespace "disc", "z<N>" prepended
+  const char *component;
+  const char *object;
+  DiscoveryBuilder build;
+};
+
+static const DiscoveryEntity DISCOVERY_ENTITIES[] = {
+    {"hum", "humidifier", "humidifier", discBuildHumidifier},
+    {"rh", "sensor", "humidity", discBuildHumidity},
+    {"rhAge", "sensor", "humidity_age_ms", discBuildHumidityAge},
+    {"relay", "binary_sensor", "relay", discBuildRelay},
+    {"reason", "sensor", "automation_reason", discBuildReason},
+};
+
+static constexpr uint32_t DISC_HASH_UNKNOWN = 0;
+static constexpr uint32_t DISC_HASH_CLEARED = 1;
+
+// HA birth ("online" on <prefix>/status) requests a full republish after a random delay,
+// so a HA restart does not get every device's discovery burst at the same instant.
+static constexpr uint32_t DISCOVERY_BIRTH_JITTER_MS = 10000;
+static bool discoveryForcePending = false;
+static uint32_t discoveryForceAtMs = 0;
+
+static bool discPublishEntity(const char *topic, DiscoveryBuilder build, const Zone &z, size_t length) {
+  if (!mqtt.beginPublish(topic, length, true)) return mqttCountPublish(false);
+  DiscoveryWriter w(topic, true);
+  build(w, z);
+  return mqttCountPublish(w.finish() && mqtt.endPublish() == 1);
+}
+
+// Compares the wanted payload hash of one entity with the stored one and publishes
+// (or clears, build == nullptr) it if they differ. Returns -1 failed, 0 unchanged, 1 sent.
+static int discSyncEntity(Preferences &discPrefs, const char *nvsKey, const char *topic, DiscoveryBuilder build,
+                          const Zone &z, bool force) {
+  const uint32_t stored = discPrefs.getUInt(nvsKey, DISC_HASH_UNKNOWN);
+
+  uint32_t want = DISC_HASH_CLEARED;
+  size_t length = 0;
+  if (build) {
+    DiscoveryWriter measure(topic, false);
+    build(measure, z);
+    want = measure.hash();
+    length = measure.length();
+  }
+
+  if (!force && want == stored) return 0;
+
+  bool ok;
+  if (want == DISC_HASH_CLEARED) {
+    ok = mqttPublish(topic, "", true);
+  } else {
+    ok = discPublishEntity(topic, build, z, length);
+  }
 
-    if (plain) {
-      String out;
-      out.reserve((size_t)logCount * 80U + 64U);
-      uint16_t start = (uint16_t)((logHead + LOG_LINES_MAX - logCount) % LOG_LINES_MAX);
-      for (uint16_t i = 0; i < logCount; i++) {
-        uint16_t idx = (uint16_t)((start + i) % LOG_LINES_MAX);
-        out += logLines[idx];
-        out += "\n";
-      }
-      web.send(200, "text/plain", out);
-      return;
+  if (!ok) {
+    logf(LOG_WARN, "[MQTT] Publish failed: %s", topic);
+    return -1;
+  }
+  if (want != stored) {
+    discPrefs.putUInt(nvsKey, want);
+    metrics.nvsWrites++;
+  }
+  return 1;
+}
+
+// Publishes (or, with discovery disabled, clears) only the entities whose retained
+// payload changed since the last successful publish; force ignores the stored hashes.
+static void mqttPublishDiscovery(bool force = false) {
+  if (!mqtt.connected()) return;
+
+  Preferences discPrefs;
+  discPrefs.begin("disc", false);
+
+  unsigned published = 0;
+  unsigned skipped = 0;
+  auto count = [&](int r) {
+    if (r > 0) published++;
+    if (r == 0) skipped++;
+  };
+
+  count(discSyncEntity(discPrefs, "old", topics.discHumidifierOld, nullptr, zones[0], force));
+
+  // Inactive zones are cleared, so removing a zone removes its entities from HA.
+  for (const Zone &z : zones) {
+    for (const DiscoveryEntity &e : DISCOVERY_ENTITIES) {
+      char key[16];
+      char object[32];
+      char topic[TOPIC_MAX];
+      discZoneSuffix(object, sizeof(object), z, e.object);
+      snprintf(topic, sizeof(topic), "%s/%s/%s/%s/config", topics.discPrefix, e.component, deviceId(), object + 1);
+      const bool want = config.haDiscoveryEnabled && z.active;
+      count(discSyncEntity(discPrefs, zoneKey(key, sizeof(key), zoneIndex(z), e.nvsKey, e.nvsKey), topic,
+                           want ? e.build : nullptr, z, force));
     }
+  }
+
+  discPrefs.end();
 
-    String page;
-    page.reserve(2000);
-    page += "<!doctype html><html><head><meta charset='utf-8'>";
-    page += "<meta name='viewport' content='width=device-width,initial-scale=1'>";
-    page += "<title>Logs</title></head><body>";
-    page += "<h2>Logs</h2>";
-    page += "<p><a href='/'>Back</a> | <a href='/logs?plain=1'>Plain</a></p>";
-    page += "<pre style='white-space:pre-wrap'>";
+  if (!config.haDiscoveryEnabled) {
+    logf(LOG_INFO, "[MQTT] HA discovery disabled; cleared %u stale topic(s) under %s/* for %s", published, topics.discPrefix,
+         deviceId());
+    return;
+  }
+  logf(LOG_INFO, "[MQTT] Discovery under %s/* for %s: %u published, %u unchanged", topics.discPrefix, deviceId(), published,
+       skipped);
+}
+#endif
+
+// One retained document with every field. The per-field topics stay for existing
+// subscribers; this is opt-in (config.stateJson).
+static bool mqttPublishStateJson(const Zone &z, uint32_t now) {
+  char buf[208];
+  const int len = formatStateJson(z, buf, sizeof(buf), now);
+  if (len < 0) return false;
+  return mqttEnqueue(z.topics.stateJson, buf, (size_t)len, MQTT_OUT_RETAINED);
+}
 
-    uint16_t start = (uint16_t)((logHead + LOG_LINES_MAX - logCount) % LOG_LINES_MAX);
-    for (uint16_t i = 0; i < logCount; i++) {
-      uint16_t idx = (uint16_t)((start + i) % LOG_LINES_MAX);
-      page += htmlEscape(String(logLines[idx]));
-      page += "\n";
+// Enqueues the dirty fields of a zone whose value differs from what the broker has (or
+// that a full refresh still owes). A field the queue refused stays dirty, so the next
+// flush retries it.
+static void mqttFlushZoneState(Zone &z, bool full, uint32_t now) {
+  if (full) z.refresh = SF_ALL;
+  const uint8_t dirty = z.dirty.exchange(0) | z.refresh;
+  if (dirty == 0) return;
+
+  uint8_t failed = 0;
+  uint8_t sent = 0;
+
+  if (dirty & SF_ENABLED) {
+    const bool v = z.enabled;
+    if ((z.refresh & SF_ENABLED) || v != z.published.enabled) {
+      if (mqttEnqueue(z.topics.stateEnabled, v ? "1" : "0", MQTT_OUT_RETAINED | MQTT_OUT_CONFIRM)) {
+        z.published.enabled = v;
+        sent |= SF_ENABLED;
+      } else {
+        failed |= SF_ENABLED;
+      }
     }
+  }
 
-    page += "</pre>";
-    page += "</body></html>";
-    web.send(200, "text/html", page);
-  });
+  if (dirty & SF_RELAY) {
+    const bool v = z.relayOn;
+    if ((z.refresh & SF_RELAY) || v != z.published.relay) {
+      if (mqttEnqueue(z.topics.stateRelay, v ? "ON" : "OFF", MQTT_OUT_RETAINED | MQTT_OUT_CONFIRM)) {
+        z.published.relay = v;
+        sent |= SF_RELAY;
+      } else {
+        failed |= SF_RELAY;
+      }
+    }
+  }
 
-  web.on("/control", HTTP_POST, []() {
-    if (!httpRequireAuthorized()) return;
-    auto arg = [&](const char *name) -> String {
-      return web.hasArg(name) ? web.arg(name) : String("");
-    };
+  if (dirty & SF_SETPOINT) {
+    const float v = z.target.load();
+    if ((z.refresh & SF_SETPOINT) || tenths(v) != z.published.setpointX10) {
+      char buf[32];
+      dtostrf(v, 0, 1, buf);
+      if (mqttEnqueue(z.topics.stateSetpoint, buf, MQTT_OUT_RETAINED)) {
+        z.published.setpointX10 = tenths(v);
+        sent |= SF_SETPOINT;
+      } else {
+        failed |= SF_SETPOINT;
+      }
+    }
+  }
 
-    bool changed = false;
+  if (dirty & SF_HUMIDITY) {
+    const float v = z.humidity.load();
+    if (!isnan(v) && ((z.refresh & SF_HUMIDITY) || tenths(v) != z.published.humidityX10)) {
+      char buf[32];
+      dtostrf(v, 0, 1, buf);
+      if (mqttEnqueue(z.topics.stateHumidity, buf, MQTT_OUT_RETAINED)) {
+        z.published.humidityX10 = tenths(v);
+        sent |= SF_HUMIDITY;
+      } else {
+        failed |= SF_HUMIDITY;
+      }
+    }
+  }
 
-    String enabledStr = arg("enabled");
-    bool newEnabled = parseBool(enabledStr, systemEnabled);
-    if (newEnabled != systemEnabled) {
-      systemEnabled = newEnabled;
-      changed = true;
+  // The age changes continuously: it goes out when a sample arrives or on a full refresh.
+  if (dirty & SF_HUMIDITY_AGE) {
+    const uint32_t seenMs = z.lastSeenMs.load();
+    if (seenMs > 0) {
+      char buf[32];
+      snprintf(buf, sizeof(buf), "%lu", (unsigned long)(now - seenMs));
+      if (mqttEnqueue(z.topics.stateHumidityAge, buf, MQTT_OUT_RETAINED)) {
+        sent |= SF_HUMIDITY_AGE;
+      } else {
+        failed |= SF_HUMIDITY_AGE;
+      }
     }
-    // Disabling automation must always force the humidifier OFF immediately.
-    if (!systemEnabled) relayWrite(false);
+  }
 
-    String setpointStr = arg("setpoint");
-    float newSetpoint;
-    if (parseFloat(setpointStr, newSetpoint) && !isnan(newSetpoint)) {
-      float clamped = clampSetpoint(newSetpoint);
-      if (!isnan(clamped) && clamped != targetHumidity) {
-        targetHumidity = clamped;
-        changed = true;
+  if (dirty & SF_REASON) {
+    const AutomationReason r = automationReason(z);
+    if ((z.refresh & SF_REASON) || r != z.published.reason) {
+      if (mqttEnqueue(z.topics.stateReason, automationReasonName(r), MQTT_OUT_RETAINED)) {
+        z.published.reason = r;
+        sent |= SF_REASON;
+      } else {
+        failed |= SF_REASON;
       }
     }
+  }
 
-    if (changed) saveRuntimeState();
-    mqttPublishState(true);
+  if (config.stateJson && (sent != 0 || z.stateJsonPending)) {
+    z.stateJsonPending = !mqttPublishStateJson(z, now);
+  }
 
-    web.send(200, "text/html", configPage(changed ? "Applied." : "No changes."));
-  });
+  // Fields that had nothing to publish (no humidity yet) are done with the refresh too.
+  z.refresh &= failed;
+  if (failed) markStateDirty(z, failed);
+}
 
-  web.on("/update", HTTP_GET, []() {
-    if (!httpRequireAuthorized()) return;
-    String page;
-    page.reserve(1200);
-    page += "<!doctype html><html><head><meta charset='utf-8'>";
-    page += "<meta name='viewport' content='width=device-width,initial-scale=1'>";
-    page += "<title>Firmware Update</title></head><body>";
-    page += "<h2>Firmware Update</h2>";
-    page += "<p>Upload <b>firmware.bin</b> built by PlatformIO.</p>";
-    page += "<form method='POST' action='/update' enctype='multipart/form-data'>";
-    page += "<input type='file' name='update' accept='.bin' required><br><br>";
-    page += "<button type='submit'>Upload & Flash</button>";
-    page += "</form>";
-    page += "<p><a href='/'>Back</a></p>";
-    page += "</body></html>";
-    web.send(200, "text/html", page);
-  });
+static void mqttFlushState() {
+  if (!mqtt.connected()) return;
 
-  web.on(
-      "/update",
-      HTTP_POST,
-      []() {
-        if (!httpRequireAuthorized()) return;
-        const bool ok = !Update.hasError();
-        web.send(200, "text/plain", ok ? "OK\nRebooting..." : "FAIL\n");
-        delay(300);
-        if (ok) ESP.restart();
-      },
-      []() {
-        if (!httpIsAuthorized()) return;
-        HTTPUpload &upload = web.upload();
-        if (upload.status == UPLOAD_FILE_START) {
-          logf(LOG_INFO, "[WEB OTA] Start: %s, size=%u", upload.filename.c_str(), (unsigned)upload.totalSize);
-          if (!Update.begin(UPDATE_SIZE_UNKNOWN)) {
-            Update.printError(Serial);
-          }
-        } else if (upload.status == UPLOAD_FILE_WRITE) {
-          if (Update.write(upload.buf, upload.currentSize) != upload.currentSize) {
-            Update.printError(Serial);
-          }
-        } else if (upload.status == UPLOAD_FILE_END) {
-          if (Update.end(true)) {
-            logf(LOG_INFO, "[WEB OTA] Success: %u bytes", (unsigned)upload.totalSize);
-          } else {
-            Update.printError(Serial);
-          }
-        } else if (upload.status == UPLOAD_FILE_ABORTED) {
-          Update.end();
-          logWriteLine(LOG_WARN, "[WEB OTA] Aborted");
-        }
-      });
+  const uint32_t now = millis();
+  bool full = stateFullRefreshPending;
+  if (STATE_FULL_REFRESH_MS > 0 && (now - lastStateFullMs) >= STATE_FULL_REFRESH_MS) full = true;
+  if (full) {
+    stateFullRefreshPending = false;
+    lastStateFullMs = now;
+  }
+  for (Zone &z : zones) {
+    if (z.active) mqttFlushZoneState(z, full, now);
+  }
+  mqttDrainQueue(now);
+}
 
-  web.on("/save", HTTP_POST, []() {
-    if (!httpRequireAuthorized()) return;
-    auto arg = [&](const char *name) -> String {
-      return web.hasArg(name) ? web.arg(name) : String("");
-    };
+// Echo of a confirmed state topic; tag = zone * 2 + (1 for enabled, 0 for relay).
+static void onStateEchoMessage(uint8_t tag, const char *topic, const byte *payload, unsigned int length) {
+  (void)topic;
+  if ((tag >> 1) >= ZONES_MAX) return;
+  const ZoneTopics &zt = zones[tag >> 1].topics;
+  mqttConfirmEcho((tag & 1) ? zt.stateEnabled : zt.stateRelay, payload, length);
+}
 
-    String wifiSsid = arg("wifi_ssid");
-    String wifiPass = arg("wifi_pass");
+// Command handlers: the route tag is the zone index.
+static void onEnableMessage(uint8_t tag, const char *topic, const byte *payload, unsigned int length) {
+  if (tag >= ZONES_MAX) return;
+  Zone &z = zones[tag];
+  if (config.logLevel >= LOG_INFO) {
+    logf(LOG_INFO, "[MQTT] CMD enabled topic=%s payload='%.*s'", topic, (int)length, (const char *)payload);
+  }
+  const uint8_t mask = (uint8_t)(1U << tag);
+  bool newEnabled = parseBoolRaw(payload, length, z.enabled);
+  if (newEnabled != z.enabled) {
+    z.enabled = newEnabled;
+    if (!z.enabled) relayForceOff(mask);
+    saveRuntimeState();
+  } else if (!newEnabled) {
+    // ensure relay stays off if command repeats disable
+    relayForceOff(mask);
+  }
+  controlRequestEval();
+  markStateDirty(z, SF_ENABLED | SF_RELAY | SF_REASON);
+}
 
-    String webUser = arg("web_user");
-    String webPass = arg("web_pass");
-    String webPass2 = arg("web_pass2");
+static void onSetpointMessage(uint8_t tag, const char *topic, const byte *payload, unsigned int length) {
+  if (tag >= ZONES_MAX) return;
+  Zone &z = zones[tag];
+  if (config.logLevel >= LOG_INFO) {
+    logf(LOG_INFO, "[MQTT] CMD setpoint topic=%s payload='%.*s'", topic, (int)length, (const char *)payload);
+  }
+  float v;
+  if (parseFloatRaw(payload, length, v)) {
+    v = clampSetpoint(v);
+    if (!isnan(v) && v != z.target) {
+      z.target = v;
+      controlRequestEval();
+      saveRuntimeState();
+    }
+    markStateDirty(z, SF_SETPOINT | SF_REASON);
+  }
+}
 
-    String mqttHost = arg("mqtt_host");
-    String mqttPort = arg("mqtt_port");
-    String mqttUser = arg("mqtt_user");
-    String mqttPass = arg("mqtt_pass");
+// Local sensor: runs in its own task, so I2C transfers, conversion waits and the DHT
+// frame (captured by the RMT peripheral) never hold up the control or network loop. Readings cross over to the
+// network side through the atomics below and then take the same filter/fusion path as
+// MQTT humidity; the zone they feed keeps regulating while MQTT is down.
+static constexpr uint32_t LOCAL_SENSOR_TASK_STACK = 3072;
+static constexpr UBaseType_t LOCAL_SENSOR_TASK_PRIO = 3;
+// The task only ever sleeps on the bus, so it may share core 1 with control.
+static constexpr BaseType_t LOCAL_SENSOR_TASK_CORE = 1;
+static constexpr uint32_t LOCAL_SENSOR_RETRY_MS = 30000;   // after a failed probe
+static constexpr uint8_t LOCAL_SENSOR_ERRORS_REINIT = 3;   // failed reads in a row -> probe again
+static constexpr uint32_t LOCAL_SENSOR_I2C_HZ = 100000;
+
+static Bme280Calib bme280Calib;
+
+static bool localSensorConfigured() {
+  const uint8_t t = config.sensorType;
+  if (t == SENSOR_NONE || t >= SENSOR_TYPE_COUNT) return false;
+  if (config.sensorZone >= ZONES_MAX || !zones[config.sensorZone].active) return false;
+  if (config.sensorSda < 0 || config.sensorSda > 39) return false;
+  const bool i2c = t == SENSOR_SHT3X || t == SENSOR_BME280;
+  return !i2c || (config.sensorScl >= 0 && config.sensorScl <= 39);
+}
 
-    String baseTopic = arg("base_topic");
-    String tHumIn = arg("t_hum_in");
-    String tSetIn = arg("t_set_in");
-    String tEnIn = arg("t_en_in");
+static uint8_t localSensorAddr() {
+  if (config.sensorAddr != 0) return config.sensorAddr;
+  return config.sensorType == SENSOR_BME280 ? 0x76 : 0x44;
+}
 
-    String relayPin = arg("relay_pin");
-    String relayInv = arg("relay_inv");
-    String hyst = arg("hyst");
-    String humIntSec = arg("hum_int_sec");
-    String logLevelStr = arg("log_level");
-    String hangSecStr = arg("hang_sec");
-    String hangActStr = arg("hang_act");
+static bool i2cWrite(const uint8_t *data, size_t len) {
+  Wire.beginTransmission(localSensorAddr());
+  Wire.write(data, len);
+  return Wire.endTransmission() == 0;
+}
 
-    bool haDisc = web.hasArg("ha_disc");
-    String haPrefix = arg("ha_prefix");
-    String haName = arg("ha_name");
+static bool i2cRead(uint8_t *out, size_t len) {
+  if (Wire.requestFrom(localSensorAddr(), len) != len) return false;
+  for (size_t i = 0; i < len; i++) out[i] = (uint8_t)Wire.read();
+  return true;
+}
 
-    wifiSsid.trim();
-    webUser.trim();
-    mqttHost.trim();
-    baseTopic.trim();
-    tHumIn.trim();
-    tSetIn.trim();
-    tEnIn.trim();
+static bool i2cReadReg(uint8_t reg, uint8_t *out, size_t len) {
+  Wire.beginTransmission(localSensorAddr());
+  Wire.write(reg);
+  if (Wire.endTransmission(false) != 0) return false;
+  return i2cRead(out, len);
+}
 
-    haPrefix.trim();
-    haName.trim();
+static bool sht3xInit() {
+  if (!Wire.begin(config.sensorSda, config.sensorScl, LOCAL_SENSOR_I2C_HZ)) return false;
+  static const uint8_t SOFT_RESET[] = {0x30, 0xA2};
+  if (!i2cWrite(SOFT_RESET, sizeof(SOFT_RESET))) return false;
+  vTaskDelay(pdMS_TO_TICKS(2));
+  return true;
+}
 
-    if (webPass.length() > 0 && webPass != webPass2) {
-      web.send(400, "text/html", configPage("Web password mismatch (not saved)."));
-      return;
+static bool sht3xTrigger() {
+  static const uint8_t MEASURE_HIGH[] = {0x24, 0x00}; // single shot, no clock stretching
+  return i2cWrite(MEASURE_HIGH, sizeof(MEASURE_HIGH));
+}
+
+static bool sht3xFetch(float &humidity, float &temperature) {
+  uint8_t frame[6];
+  return i2cRead(frame, sizeof(frame)) && sht3xDecode(frame, humidity, temperature);
+}
+
+static bool bme280Init() {
+  if (!Wire.begin(config.sensorSda, config.sensorScl, LOCAL_SENSOR_I2C_HZ)) return false;
+  uint8_t id = 0;
+  if (!i2cReadReg(0xD0, &id, 1)) return false;
+  if (id != 0x60) {
+    logf(LOG_WARN, "[SENSOR] Chip id 0x%02X is not a BME280 (BMP280 has no humidity)", (unsigned)id);
+    return false;
+  }
+  uint8_t regs88[26], regsE1[7];
+  if (!i2cReadReg(0x88, regs88, sizeof(regs88)) || !i2cReadReg(0xE1, regsE1, sizeof(regsE1))) return false;
+  bme280ParseCalib(regs88, regsE1, bme280Calib);
+  return true;
+}
+
+static bool bme280Trigger() {
+  static const uint8_t CTRL_HUM[] = {0xF2, 0x01};  // humidity x1; applies on the ctrl_meas write
+  static const uint8_t CTRL_MEAS[] = {0xF4, 0x21}; // temperature x1, no pressure, forced mode
+  return i2cWrite(CTRL_HUM, sizeof(CTRL_HUM)) && i2cWrite(CTRL_MEAS, sizeof(CTRL_MEAS));
+}
+
+static bool bme280Fetch(float &humidity, float &temperature) {
+  uint8_t frame[8];
+  return i2cReadReg(0xF7, frame, sizeof(frame)) && bme280Decode(bme280Calib, frame, humidity, temperature);
+}
+
+// DHT: an RMT channel times the line, so the task sleeps while the sensor answers and
+// no core runs with interrupts off. The pin is open drain with the pull-up: it drives
+// the start signal while the RMT keeps watching the line.
+static constexpr rmt_channel_t DHT_RMT_CHANNEL = RMT_CHANNEL_4;
+static constexpr uint16_t DHT_RMT_IDLE_US = 200;         // no edge for this long ends the frame
+static constexpr uint8_t DHT_RMT_FILTER_CYCLES = 200;    // APB cycles, drops glitches under 2.5 us
+static constexpr uint32_t DHT_FRAME_TIMEOUT_MS = 10;     // the frame itself takes about 4 ms
+static constexpr size_t DHT_PULSES_MAX = 48;             // 40 bits plus the response
+static RingbufHandle_t dhtRing = nullptr;
+
+// No way to probe, the first read tells.
+static bool dhtInit() {
+  const gpio_num_t pin = (gpio_num_t)config.sensorSda;
+  if (dhtRing == nullptr) {
+    rmt_config_t rc = RMT_DEFAULT_CONFIG_RX(pin, DHT_RMT_CHANNEL);
+    rc.clk_div = 80; // 1 us per tick
+    rc.rx_config.filter_en = true;
+    rc.rx_config.filter_ticks_thresh = DHT_RMT_FILTER_CYCLES;
+    rc.rx_config.idle_threshold = DHT_RMT_IDLE_US;
+    if (rmt_config(&rc) != ESP_OK || rmt_driver_install(DHT_RMT_CHANNEL, 512, 0) != ESP_OK) return false;
+    if (rmt_get_ringbuf_handle(DHT_RMT_CHANNEL, &dhtRing) != ESP_OK) return false;
+  }
+  gpio_set_pull_mode(pin, GPIO_PULLUP_ONLY);
+  gpio_set_direction(pin, GPIO_MODE_INPUT_OUTPUT_OD);
+  gpio_set_level(pin, 1);
+  return true;
+}
+
+// Start signal: the line is held low for the conversion wait, then released in dhtFetch().
+static bool dhtTrigger() {
+  gpio_set_level((gpio_num_t)config.sensorSda, 0);
+  return true;
+}
+
+// 40 bits, each a ~50 us low followed by a 26-28 us (0) or 70 us (1) high; only the
+// high pulses are needed.
+static bool dhtFetch(float &humidity, float &temperature) {
+  size_t size = 0;
+  while (void *stale = xRingbufferReceive(dhtRing, &size, 0)) vRingbufferReturnItem(dhtRing, stale);
+  rmt_rx_start(DHT_RMT_CHANNEL, true);
+  gpio_set_level((gpio_num_t)config.sensorSda, 1);
+  rmt_item32_t *items = (rmt_item32_t *)xRingbufferReceive(dhtRing, &size, pdMS_TO_TICKS(DHT_FRAME_TIMEOUT_MS));
+  rmt_rx_stop(DHT_RMT_CHANNEL);
+  if (items == nullptr) return false;
+
+  uint16_t highs[DHT_PULSES_MAX];
+  size_t count = 0;
+  bool ok = true;
+  auto pulse = [&](uint32_t level, uint32_t duration) {
+    if (!level || duration == 0) return;
+    if (count == DHT_PULSES_MAX) ok = false;
+    else highs[count++] = (uint16_t)duration;
+  };
+  for (size_t i = 0; i < size / sizeof(rmt_item32_t); i++) {
+    pulse(items[i].level0, items[i].duration0);
+    pulse(items[i].level1, items[i].duration1);
+  }
+  vRingbufferReturnItem(dhtRing, items);
+
+  uint8_t frame[5];
+  return ok && dhtFrameFromPulses(highs, count, frame) &&
+         dhtDecode(frame, config.sensorType == SENSOR_DHT11, humidity, temperature);
+}
+
+// One measurement is trigger(), a convertMs sleep, then fetch().
+struct LocalSensorDriver {
+  bool (*init)();
+  bool (*trigger)();
+  uint16_t convertMs;
+  bool (*fetch)(float &humidity, float &temperature);
+};
+
+// Indexed by LocalSensorType.
+static const LocalSensorDriver LOCAL_SENSOR_DRIVERS[SENSOR_TYPE_COUNT] = {
+    {nullptr, nullptr, 0, nullptr},
+    {sht3xInit, sht3xTrigger, 16, sht3xFetch},
+    {bme280Init, bme280Trigger, 10, bme280Fetch},
+    {dhtInit, dhtTrigger, 2, dhtFetch},
+    {dhtInit, dhtTrigger, 20, dhtFetch},
+};
+
+static void localSensorTask(void *arg) {
+  (void)arg;
+  const LocalSensorDriver &drv = LOCAL_SENSOR_DRIVERS[config.sensorType];
+  const char *name = localSensorTypeName((LocalSensorType)config.sensorType);
+  uint32_t intervalMs = config.sensorIntervalSec * 1000U;
+  if (intervalMs < 2000U) intervalMs = 2000U; // DHTs need 2 s between reads
+  bool ready = false;
+  bool warned = false;
+  uint8_t errorsInRow = 0;
+
+  for (;;) {
+    if (!ready) {
+      ready = drv.init();
+      if (!ready) {
+        if (!warned) logf(LOG_WARN, "[SENSOR] %s not found, retrying every %lus", name, (unsigned long)(LOCAL_SENSOR_RETRY_MS / 1000U));
+        warned = true;
+        localSensorOk = false;
+        vTaskDelay(pdMS_TO_TICKS(LOCAL_SENSOR_RETRY_MS));
+        continue;
+      }
+      logf(LOG_INFO, "[SENSOR] %s ready, every %lus", name, (unsigned long)(intervalMs / 1000U));
+      warned = false;
+      errorsInRow = 0;
     }
 
-    if (wifiSsid.length() >= sizeof(config.wifiSsid)) wifiSsid = wifiSsid.substring(0, sizeof(config.wifiSsid) - 1);
-    if (wifiPass.length() >= sizeof(config.wifiPass)) wifiPass = wifiPass.substring(0, sizeof(config.wifiPass) - 1);
-    if (webUser.length() >= sizeof(config.webUser)) webUser = webUser.substring(0, sizeof(config.webUser) - 1);
-    if (webPass.length() >= sizeof(config.webPass)) webPass = webPass.substring(0, sizeof(config.webPass) - 1);
-    if (mqttHost.length() >= sizeof(config.mqttHost)) mqttHost = mqttHost.substring(0, sizeof(config.mqttHost) - 1);
-    if (mqttUser.length() >= sizeof(config.mqttUser)) mqttUser = mqttUser.substring(0, sizeof(config.mqttUser) - 1);
-    if (mqttPass.length() >= sizeof(config.mqttPass)) mqttPass = mqttPass.substring(0, sizeof(config.mqttPass) - 1);
-    if (baseTopic.length() >= sizeof(config.baseTopic)) baseTopic = baseTopic.substring(0, sizeof(config.baseTopic) - 1);
-    if (tHumIn.length() >= sizeof(config.topicHumidityIn)) tHumIn = tHumIn.substring(0, sizeof(config.topicHumidityIn) - 1);
-    if (tSetIn.length() >= sizeof(config.topicSetpointIn)) tSetIn = tSetIn.substring(0, sizeof(config.topicSetpointIn) - 1);
-    if (tEnIn.length() >= sizeof(config.topicEnableIn)) tEnIn = tEnIn.substring(0, sizeof(config.topicEnableIn) - 1);
+    TickType_t wake = xTaskGetTickCount();
+    float humidity = NAN, temperature = NAN;
+    bool ok = drv.trigger();
+    if (ok) {
+      vTaskDelay(pdMS_TO_TICKS(drv.convertMs));
+      ok = drv.fetch(humidity, temperature);
+    }
+    if (ok) {
+      localSensorHumidity = humidity;
+      localSensorTemperature = temperature;
+      localSensorReadings++;
+      localSensorOk = true;
+      errorsInRow = 0;
+    } else {
+      localSensorErrors++;
+      localSensorOk = false;
+      if (++errorsInRow >= LOCAL_SENSOR_ERRORS_REINIT) {
+        logf(LOG_WARN, "[SENSOR] %s: %u failed reads, probing again", name, (unsigned)errorsInRow);
+        ready = false;
+      }
+    }
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(intervalMs));
+  }
+}
 
-    if (haPrefix.length() >= sizeof(config.haDiscoveryPrefix)) haPrefix = haPrefix.substring(0, sizeof(config.haDiscoveryPrefix) - 1);
-    if (haName.length() >= sizeof(config.haDeviceName)) haName = haName.substring(0, sizeof(config.haDeviceName) - 1);
+static void startLocalSensorTask() {
+  if (localSensorSource == 0xFF) return;
+  xTaskCreatePinnedToCore(localSensorTask, "hum_sensor", LOCAL_SENSOR_TASK_STACK, nullptr, LOCAL_SENSOR_TASK_PRIO, nullptr,
+                          LOCAL_SENSOR_TASK_CORE);
+}
 
-    strncpy(config.wifiSsid, wifiSsid.c_str(), sizeof(config.wifiSsid) - 1);
-    strncpy(config.wifiPass, wifiPass.c_str(), sizeof(config.wifiPass) - 1);
+// Zone 0: config.topicHumidityIn plus config.humiditySources, one "topic [weight]" entry
+// per line (or ';'-separated). Other active zones: their own topic, if set.
+static void humiditySourcesConfigure() {
+  HumidityFilterConfig cfg;
+  cfg.mode = (HumidityFilterMode)config.filterMode;
+  cfg.window = config.filterWindow;
+  cfg.emaAlpha = config.filterAlpha;
+  cfg.maxRatePerMin = config.filterMaxRate;
+
+  humiditySourceCount = 0;
+  auto add = [](const char *topic, uint8_t zone, float weight) {
+    HumiditySource &src = humiditySources[humiditySourceCount++];
+    src.topic = topic;
+    src.local = false;
+    src.zone = zone;
+    src.weight = weight;
+  };
 
-    if (webUser.length() > 0) strncpy(config.webUser, webUser.c_str(), sizeof(config.webUser) - 1);
-    if (webPass.length() > 0) strncpy(config.webPass, webPass.c_str(), sizeof(config.webPass) - 1);
+  if (config.topicHumidityIn[0]) add(config.topicHumidityIn, 0, 1.0f);
+
+  uint8_t extra = 0;
+  const char *p = config.humiditySources;
+  while (*p && extra < HUMIDITY_SOURCES_MAX - 1) {
+    const char *eol = p + strcspn(p, "\r\n;");
+    const char *q = p;
+    while (q < eol && isspace((unsigned char)*q)) q++;
+    const char *topicEnd = q;
+    while (topicEnd < eol && !isspace((unsigned char)*topicEnd)) topicEnd++;
+    const size_t len = topicEnd - q;
+    if (len > 0 && len < sizeof(humiditySourceTopics[0])) {
+      char *topic = humiditySourceTopics[extra++];
+      memcpy(topic, q, len);
+      topic[len] = 0;
+      float w = 1.0f;
+      if (!parseFloatRaw((const uint8_t *)topicEnd, eol - topicEnd, w) || w < 0.0f) w = 1.0f;
+      add(topic, 0, w);
+    }
+    p = *eol ? eol + 1 : eol;
+  }
 
-    strncpy(config.mqttHost, mqttHost.c_str(), sizeof(config.mqttHost) - 1);
-    config.mqttPort = (uint16_t)mqttPort.toInt();
-    strncpy(config.mqttUser, mqttUser.c_str(), sizeof(config.mqttUser) - 1);
-    strncpy(config.mqttPass, mqttPass.c_str(), sizeof(config.mqttPass) - 1);
+  for (uint8_t i = 1; i < ZONES_MAX; i++) {
+    if (zones[i].active && config.zones[i - 1].topicHumidityIn[0]) add(config.zones[i - 1].topicHumidityIn, i, 1.0f);
+  }
 
-    strncpy(config.baseTopic, baseTopic.c_str(), sizeof(config.baseTopic) - 1);
-    strncpy(config.topicHumidityIn, tHumIn.c_str(), sizeof(config.topicHumidityIn) - 1);
-    strncpy(config.topicSetpointIn, tSetIn.c_str(), sizeof(config.topicSetpointIn) - 1);
-    strncpy(config.topicEnableIn, tEnIn.c_str(), sizeof(config.topicEnableIn) - 1);
+  localSensorSource = 0xFF;
+  for (Zone &z : zones) z.localSensor = false;
+  if (localSensorConfigured()) {
+    localSensorSource = humiditySourceCount;
+    add(localSensorTypeName((LocalSensorType)config.sensorType), config.sensorZone, 1.0f);
+    humiditySources[localSensorSource].local = true;
+    zones[config.sensorZone].localSensor = true;
+  }
 
-    config.relayPin = relayPin.toInt();
-    config.relayInverted = parseBool(relayInv, config.relayInverted);
+  for (uint8_t i = 0; i < humiditySourceCount; i++) humiditySources[i].filter.configure(cfg);
+}
 
-    float hystF;
-    if (parseFloat(hyst, hystF)) config.hysteresis = hystF;
+static void humiditySourceReset(HumiditySource &src) {
+  src.filter.reset();
+  src.value = NAN;
+  src.lastAcceptMs = 0;
+  src.lastUpdateMs = 0;
+}
 
-    uint32_t sec = (uint32_t)humIntSec.toInt();
-    config.humidityMinIntervalMs = sec * 1000U;
+#if HUM_BENCH
+static void humiditySourcesReset() {
+  for (uint8_t i = 0; i < humiditySourceCount; i++) humiditySourceReset(humiditySources[i]);
+  for (Zone &z : zones) z.freshSources = 0;
+}
+#endif
 
-    int lvl = logLevelStr.toInt();
-    if (lvl < 0) lvl = 0;
-    if (lvl > 3) lvl = 3;
-    config.logLevel = (uint8_t)lvl;
+// Fuses a zone's sources updated within config.sourceStaleSec; returns how many took
+// part (0: nothing fresh, out is NaN).
+static uint8_t humiditySourcesFuse(uint8_t zone, uint32_t now, float &out) {
+  HumidityReading readings[HUMIDITY_SOURCE_SLOTS];
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < humiditySourceCount; i++) {
+    const HumiditySource &src = humiditySources[i];
+    if (src.zone == zone) readings[n++] = {src.value, src.lastUpdateMs, src.weight};
+  }
+  uint8_t fresh = 0;
+  out = fuseHumidity(readings, n, now, config.sourceStaleSec * 1000U, (HumidityFusionMode)config.fusionMode, &fresh);
+  return fresh;
+}
 
-    uint32_t hangSec = (uint32_t)hangSecStr.toInt();
-    if (hangSec > 86400U) hangSec = 86400U;
-    config.hangTimeoutSec = hangSec;
+// Drops sources that went silent without waiting for another source's next sample.
+// With none left the zone keeps its value and the global stale timeout applies.
+// Only zone 0 and the local sensor's zone can have more than one source.
+static void humiditySourcesTick(uint32_t now) {
+  static uint32_t lastCheckMs = 0;
+  if (humiditySourceCount < 2 || now - lastCheckMs < 1000U) return;
+  lastCheckMs = now;
+  for (uint8_t i = 0; i < ZONES_MAX; i++) {
+    Zone &z = zones[i];
+    if (i != 0 && !z.localSensor) continue;
+    float v;
+    const uint8_t fresh = humiditySourcesFuse(i, now, v);
+    if (fresh == z.freshSources) continue;
+    logf(LOG_INFO, "[HUM] Zone %u fresh sources %u -> %u", (unsigned)i, (unsigned)z.freshSources, (unsigned)fresh);
+    z.freshSources = fresh;
+    if (fresh == 0) continue;
+    z.humidity = v;
+    controlRequestEval();
+    markStateDirty(z, SF_HUMIDITY | SF_REASON);
+  }
+}
 
-    int hangAct = hangActStr.toInt();
-    if (hangAct != 2) hangAct = 1;
-    config.hangAction = (uint8_t)hangAct;
+// One reading of source tag (NaN: a payload that did not parse), from MQTT or the
+// local sensor alike.
+static void humiditySourceSample(uint8_t tag, uint32_t now, float v) {
+  HumiditySource &src = humiditySources[tag];
+  Zone &z = zones[src.zone];
 
-    config.haDiscoveryEnabled = haDisc;
-    if (haPrefix.length() == 0) haPrefix = "homeassistant";
-    strncpy(config.haDiscoveryPrefix, haPrefix.c_str(), sizeof(config.haDiscoveryPrefix) - 1);
-    strncpy(config.haDeviceName, haName.c_str(), sizeof(config.haDeviceName) - 1);
+  // Always count received messages as valid samples for connection stability check
+  if (z.samples < 255) {
+    // The count gates relay ON after a reconnect, so a new sample is a control input too.
+    if (++z.samples <= CONTROL_MIN_SAMPLES) controlRequestEval();
+  }
 
-    saveConfig();
+  // Legacy mode (no filter): accept no more often than the configured interval
+  const bool filtered = config.filterMode != FILTER_NONE;
+  if (!filtered && humidityThrottled(now, src.lastAcceptMs, config.humidityMinIntervalMs)) {
+    z.lastSeenMs = now; // still mark seen, but don't change value
+    src.lastUpdateMs = now;
+    metrics.humidityThrottled++;
+    if (config.logLevel >= LOG_DEBUG) {
+      logf(LOG_DEBUG, "[HUM] Throttled src=%u (%lums < %lums), keep=%.2f", (unsigned)tag,
+           (unsigned long)(now - src.lastAcceptMs), (unsigned long)config.humidityMinIntervalMs,
+           isnan(src.value) ? -1.0f : src.value);
+    }
+    return;
+  }
 
-    web.send(200, "text/html", configPage("Saved. Rebooting..."));
-    delay(500);
-    ESP.restart();
-  });
+  if (isnan(v)) return;
 
-  web.onNotFound([]() {
-    if (captivePortalActive) {
-      // Captive portal: always redirect to /
-      web.sendHeader("Location", String("http://") + WiFi.softAPIP().toString() + "/", true);
-      web.send(302, "text/plain", "");
+  if (filtered) {
+    if (!src.filter.push(now, v)) {
+      z.lastSeenMs = now;
+      metrics.humidityRejected++;
+      if (config.logLevel >= LOG_DEBUG) logf(LOG_DEBUG, "[HUM] Rejected outlier src=%u: %.2f", (unsigned)tag, v);
       return;
     }
+    v = src.filter.value();
+  }
+  src.value = v;
+  src.lastAcceptMs = now;
+  src.lastUpdateMs = now;
+  z.freshSources = humiditySourcesFuse(src.zone, now, v);
+  if (z.freshSources == 0) return; // only zero-weight (monitor) sources reported
+  z.humidity = v;
+  z.lastSeenMs = now;
+  controlRequestEval();
+  if (config.logLevel >= LOG_DEBUG) {
+    logf(LOG_DEBUG, "[HUM] Accepted zone=%u src=%u: %.2f -> %.2f (fresh=%u samples=%u)", (unsigned)src.zone,
+         (unsigned)tag, src.value, v, (unsigned)z.freshSources, (unsigned)z.samples);
+  }
+  markStateDirty(z, SF_HUMIDITY | SF_HUMIDITY_AGE | SF_REASON);
+}
 
-    if (!httpRequireAuthorized()) return;
-    web.send(404, "text/plain", "Not found");
-  });
+static void onHumidityMessage(uint8_t tag, const char *topic, const byte *payload, unsigned int length) {
+  (void)topic;
+  if (tag >= humiditySourceCount) return;
+  float v;
+  if (!parseFloatRaw(payload, length, v)) {
+    if (config.logLevel >= LOG_WARN) {
+      logf(LOG_WARN, "[HUM] Parse failed for payload='%.*s'", (int)length, (const char *)payload);
+    }
+    v = NAN;
+  }
+  humiditySourceSample(tag, millis(), v);
 }
 
-static void startCaptivePortal() {
-  WiFi.mode(WIFI_AP);
-  WiFi.softAP(HUM_DEFAULT_AP_SSID, HUM_DEFAULT_AP_PASS);
+// Hands a new local sensor reading to the source pipeline.
+static void localSensorTick(uint32_t now) {
+  if (localSensorSource == 0xFF) return;
+  const uint32_t readings = localSensorReadings;
+  if (readings == localSensorSeen) return;
+  localSensorSeen = readings;
+  humiditySourceSample(localSensorSource, now, localSensorHumidity);
+}
+
+#if HUM_FEATURE_HA_DISCOVERY
+static void onHaStatusMessage(uint8_t tag, const char *topic, const byte *payload, unsigned int length) {
+  (void)tag;
+  (void)topic;
+  if (length != 6 || memcmp(payload, "online", 6) != 0) return;
+  discoveryForcePending = true;
+  discoveryForceAtMs = millis() + (esp_random() % DISCOVERY_BIRTH_JITTER_MS);
+  logf(LOG_INFO, "[MQTT] HA online; discovery republish in %lums", (unsigned long)(discoveryForceAtMs - millis()));
+}
+#endif
+
+#if HUM_FEATURE_FLEET_OTA
+// Fleet update: a (retained) announcement {"version","url","sha256"} on
+// config.fleetTopic. A new version is pulled after a per-device delay spread over
+// fleetDelayMaxSec, so a rollout does not hit the Wi-Fi and the file server at once.
+// The download runs in its own task straight into the OTA writer (gzip or raw, the
+// announced SHA-256 is required), failed attempts resume with an HTTP Range request,
+// and the reboot waits until every relay is OFF. The digest of the image applied last
+// is kept in NVS, so an image whose build forgot to bump HUM_FW_VERSION is not
+// installed again and again.
+static constexpr uint32_t FLEET_TASK_STACK = 8192; // TLS handshake + inflater calls
+static constexpr UBaseType_t FLEET_TASK_PRIO = 1;
+static constexpr uint8_t FLEET_MAX_ATTEMPTS = 5;
+static constexpr uint32_t FLEET_RETRY_MIN_MS = 60000;
+static constexpr uint32_t FLEET_RETRY_MAX_MS = 1800000;
+static constexpr uint32_t FLEET_CONNECT_TIMEOUT_MS = 10000;
+static constexpr uint32_t FLEET_READ_TIMEOUT_MS = 20000;
+static constexpr uint32_t FLEET_APPLY_MAX_WAIT_MS = 3600000; // then relays are forced OFF
+
+enum FleetResult : uint8_t {
+  FLEET_RESULT_NONE = 0, // task still running
+  FLEET_RESULT_OK,
+  FLEET_RESULT_RETRY, // network trouble; the job is interrupted and can resume
+  FLEET_RESULT_FATAL, // bad image or refused by the server
+};
+
+static std::atomic<uint8_t> fleetResult{FLEET_RESULT_NONE};
+static std::atomic<bool> fleetCancel{false}; // a newer announcement arrived mid-download
+static uint32_t fleetStartAtMs = 0;
+static uint32_t fleetReadySinceMs = 0;
+static uint8_t fleetAttempts = 0;
+
+static uint32_t fleetRolloutDelayMs(const FleetAnnouncement &a) {
+  if (config.fleetDelayMaxSec == 0) return 0;
+  // Stable per device and image: re-deliveries of the retained message keep the slot.
+  const char *id = deviceId();
+  const uint32_t h = fnv1a(fnv1a(FNV1A_SEED, id, strlen(id)), a.sha256, strlen(a.sha256));
+  return h % ((uint32_t)config.fleetDelayMaxSec * 1000U);
+}
+
+static void onFleetMessage(uint8_t tag, const char *topic, const byte *payload, unsigned int length) {
+  (void)tag;
+  (void)topic;
+  if (length == 0) return; // retained announcement cleared
+  FleetAnnouncement a;
+  if (!parseFleetAnnouncement(payload, length, a)) {
+    logWriteLine(LOG_WARN, "[FLEET] Ignoring malformed announcement");
+    return;
+  }
+  if (strcmp(a.version, HUM_FW_VERSION) == 0 || strcmp(a.sha256, fleetAppliedSha) == 0) {
+    if (fleetPhase == FLEET_WAITING || fleetPhase == FLEET_FAILED) fleetPhase = FLEET_IDLE; // rolled back to ours
+    logf(LOG_DEBUG, "[FLEET] %s is already installed", a.version);
+    return;
+  }
+  if (fleetPhase != FLEET_IDLE && strcmp(a.sha256, fleetTarget.sha256) == 0) return; // re-delivered on reconnect
+
+  fleetSetTarget(a);
+  fleetAttempts = 0;
+  const uint32_t delayMs = fleetRolloutDelayMs(a);
+  fleetStartAtMs = millis() + delayMs;
+  if (fleetPhase == FLEET_DOWNLOADING) {
+    fleetCancel = true; // fleetTick() moves on to the new one once the task exits
+  } else {
+    fleetPhase = FLEET_WAITING;
+  }
+  logf(LOG_INFO, "[FLEET] %s announced (running %s), download in %lus", a.version, HUM_FW_VERSION,
+       (unsigned long)(delayMs / 1000U));
+  otaSeq++;
+}
+
+#if HUM_FEATURE_WEB_OTA
+// A web upload replaces whatever the fleet had scheduled or written.
+static void fleetSupersede() {
+  if (fleetPhase == FLEET_IDLE || fleetPhase == FLEET_DOWNLOADING) return;
+  char version[sizeof(FleetAnnouncement::version)];
+  fleetVersionCopy(version);
+  logf(LOG_INFO, "[FLEET] %s superseded by a web upload", version);
+  fleetPhase = FLEET_IDLE;
+}
+#endif
+
+static FleetResult fleetDownload(const FleetAnnouncement &a) {
+  const bool https = strncmp(a.url, "https://", 8) == 0;
+  WiFiClient plain;
+  WiFiClientSecure secure;
+  // No CA check: the announced SHA-256 is what authenticates the image.
+  if (https) secure.setInsecure();
+
+  uint8_t digest[32];
+  if (!parseSha256Hex(a.sha256, digest)) return FLEET_RESULT_FATAL;
+  uint32_t offset = 0;
+  if (ota.phase == OTA_INTERRUPTED && ota.source == OTA_SOURCE_FLEET && memcmp(ota.digest, digest, sizeof(digest)) == 0) {
+    offset = ota.received;
+  }
+
+  HTTPClient http;
+  http.useHTTP10(true); // no chunked framing in the body stream
+  http.setConnectTimeout(FLEET_CONNECT_TIMEOUT_MS);
+  http.setTimeout(FLEET_READ_TIMEOUT_MS);
+  if (!http.begin(https ? (WiFiClient &)secure : plain, a.url)) return FLEET_RESULT_FATAL;
+  if (offset > 0) {
+    char range[24];
+    snprintf(range, sizeof(range), "bytes=%lu-", (unsigned long)offset);
+    http.addHeader("Range", range);
+  }
+
+  const int code = http.GET();
+  int remaining = http.getSize(); // -1: until the server closes
+  if (code == 206 && offset > 0 && otaResume(offset)) {
+    // continues below
+  } else if (code == 200) {
+    // Fresh start, also when the server ignored the Range header.
+    otaBegin(OTA_SOURCE_FLEET, remaining > 0 ? (uint32_t)remaining : 0, a.sha256);
+  } else {
+    logf(LOG_WARN, "[FLEET] HTTP %d for %s", code, a.url);
+    http.end();
+    return (code >= 400 && code < 500) ? FLEET_RESULT_FATAL : FLEET_RESULT_RETRY;
+  }
+
+  WiFiClient *stream = http.getStreamPtr();
+  static uint8_t buf[1024]; // one fleet task at a time; keeps it off the stack
+  uint32_t lastDataMs = millis();
+  while (ota.phase == OTA_RUNNING && remaining != 0) {
+    if (fleetCancel) {
+      otaFail("superseded");
+      break;
+    }
+    const int avail = stream->available();
+    if (avail <= 0) {
+      if (!stream->connected() || (millis() - lastDataMs) > FLEET_READ_TIMEOUT_MS) break;
+      vTaskDelay(pdMS_TO_TICKS(5));
+      continue;
+    }
+    size_t want = (size_t)avail < sizeof(buf) ? (size_t)avail : sizeof(buf);
+    if (remaining > 0 && (size_t)remaining < want) want = (size_t)remaining;
+    const int n = stream->read(buf, want);
+    if (n <= 0) continue;
+    lastDataMs = millis();
+    if (remaining > 0) remaining -= n;
+    otaWrite(buf, (size_t)n);
+  }
+  const bool closed = !stream->connected();
+  http.end();
+
+  if (ota.phase != OTA_RUNNING) return FLEET_RESULT_FATAL;
+  if (remaining == 0 || (remaining < 0 && closed)) return otaFinish() ? FLEET_RESULT_OK : FLEET_RESULT_FATAL;
+  otaInterrupt();
+  return FLEET_RESULT_RETRY;
+}
+
+static void fleetTask(void *arg) {
+  FleetAnnouncement *a = (FleetAnnouncement *)arg;
+  const FleetResult r = fleetDownload(*a);
+  delete a;
+  fleetResult = r;
+  vTaskDelete(nullptr);
+}
+
+static bool anyRelayOn() {
+  for (const Zone &z : zones) {
+    if (z.active && z.relayOn) return true;
+  }
+  return false;
+}
+
+// Stored as soon as the image is set for boot, so a power cut before the planned
+// reboot does not make the (already running) image look new again.
+static void fleetRememberApplied() {
+  snprintf(fleetAppliedSha, sizeof(fleetAppliedSha), "%s", fleetTarget.sha256);
+  prefs.begin("hum", false);
+  prefs.putString("fleetSha", fleetAppliedSha);
+  prefs.end();
+  metrics.nvsWrites++;
+}
+
+static void fleetTick(uint32_t now, bool wifiUp) {
+  switch (fleetPhase.load()) {
+    case FLEET_WAITING: {
+      if ((int32_t)(now - fleetStartAtMs) < 0 || !wifiUp) return;
+      if (!otaClaim(OTA_SOURCE_FLEET)) return; // an upload is being received
+      if (otaJobOpen() && ota.source != OTA_SOURCE_FLEET) {
+        otaUnclaim(OTA_SOURCE_FLEET); // an interrupted upload may still be resumed
+        return;
+      }
+      FleetAnnouncement *copy = new (std::nothrow) FleetAnnouncement(fleetTarget);
+      fleetCancel = false;
+      fleetResult = FLEET_RESULT_NONE;
+      fleetPhase = FLEET_DOWNLOADING;
+      logf(LOG_INFO, "[FLEET] Downloading %s (attempt %u)", fleetTarget.url, (unsigned)(fleetAttempts + 1));
+      // Out of memory is reported like any other interrupted attempt.
+      if (!copy || xTaskCreate(fleetTask, "hum_fleet", FLEET_TASK_STACK, copy, FLEET_TASK_PRIO, nullptr) != pdPASS) {
+        delete copy;
+        fleetResult = FLEET_RESULT_RETRY;
+      }
+      return;
+    }
+    case FLEET_DOWNLOADING: {
+      const uint8_t r = fleetResult;
+      if (r == FLEET_RESULT_NONE) return;
+      if (fleetCancel.exchange(false)) {
+        fleetPhase = FLEET_WAITING; // onFleetMessage() already set the new target and time
+      } else if (r == FLEET_RESULT_OK) {
+        fleetReadySinceMs = now;
+        fleetPhase = FLEET_READY;
+        fleetRememberApplied();
+        logf(LOG_INFO, "[FLEET] %s ready; reboot once all relays are OFF", fleetTarget.version);
+      } else if (r == FLEET_RESULT_RETRY && ++fleetAttempts < FLEET_MAX_ATTEMPTS) {
+        uint32_t backoff = FLEET_RETRY_MIN_MS << (fleetAttempts - 1);
+        if (backoff > FLEET_RETRY_MAX_MS) backoff = FLEET_RETRY_MAX_MS;
+        backoff += esp_random() % (backoff / 2);
+        fleetStartAtMs = now + backoff;
+        fleetPhase = FLEET_WAITING;
+        logf(LOG_WARN, "[FLEET] Download interrupted, retry in %lus", (unsigned long)(backoff / 1000U));
+      } else {
+        if (otaJobOpen() && ota.source == OTA_SOURCE_FLEET) otaFail("gave up");
+        fleetPhase = FLEET_FAILED;
+        logf(LOG_ERROR, "[FLEET] %s failed: %s", fleetTarget.version, ota.error);
+      }
+      otaUnclaim(OTA_SOURCE_FLEET); // the task has exited
+      otaSeq++;
+      return;
+    }
+    case FLEET_READY:
+      if (anyRelayOn()) {
+        if ((now - fleetReadySinceMs) >= FLEET_APPLY_MAX_WAIT_MS) relayForceOff();
+        return;
+      }
+      logf(LOG_INFO, "[FLEET] Relays OFF, rebooting into %s", fleetTarget.version);
+      flushRuntimeState(true);
+      delay(300);
+      ESP.restart();
+      return;
+    default:
+      return;
+  }
+}
+#endif
 
-  IPAddress apIP = WiFi.softAPIP();
-  dns.start(DNS_PORT, "*", apIP);
-  captivePortalActive = true;
+// Subscribed topics and their handlers, rebuilt on every (re)connect. Incoming topics
+// are looked up by FNV-1a hash in a small open-addressing index (linear probing), then
+// confirmed by length and one memcmp. The tag tells a handler which of several routes
+// sharing it matched (zone index for commands, source index for humidity).
+typedef void (*MqttHandler)(uint8_t tag, const char *topic, const byte *payload, unsigned int length);
+
+struct MqttRoute {
+  const char *topic; // points into config, stable for the session
+  uint16_t len;
+  uint32_t hash;
+  MqttHandler handler;
+  uint8_t tag;
+};
 
-  httpSetupHandlers();
-  web.begin();
+// Per zone: two commands and two confirmed state echoes.
+static constexpr size_t MQTT_ROUTES_MAX = 4 * ZONES_MAX + HUMIDITY_SOURCE_SLOTS + 1;
+static constexpr size_t MQTT_ROUTE_SLOTS = 64; // power of two, >= 2x routes
+static MqttRoute mqttRoutes[MQTT_ROUTES_MAX];
+static uint8_t mqttRouteSlots[MQTT_ROUTE_SLOTS]; // route index + 1, 0 = empty
+static uint8_t mqttRouteCount = 0;
 
-  logf(LOG_INFO, "[AP] SSID: %s", HUM_DEFAULT_AP_SSID);
-  logf(LOG_INFO, "[AP] IP: %s", apIP.toString().c_str());
+static uint32_t topicHash(const char *s, size_t len) {
+  return fnv1a(FNV1A_SEED, s, len);
 }
 
-static bool connectWiFiSta() {
-  if (strlen(config.wifiSsid) == 0) return false;
-
-  WiFi.mode(WIFI_STA);
-  WiFi.setAutoReconnect(true);
-  WiFi.begin(config.wifiSsid, config.wifiPass);
+static void mqttClearRoutes() {
+  mqttRouteCount = 0;
+  memset(mqttRouteSlots, 0, sizeof(mqttRouteSlots));
+}
 
-  uint32_t start = millis();
-  while (WiFi.status() != WL_CONNECTED && (millis() - start) < WIFI_CONNECT_TIMEOUT_MS) {
-    delay(200);
+static const MqttRoute *mqttFindRoute(const char *topic, size_t len, uint32_t hash) {
+  for (size_t i = 0; i < MQTT_ROUTE_SLOTS; i++) {
+    const uint8_t slot = mqttRouteSlots[(hash + i) & (MQTT_ROUTE_SLOTS - 1)];
+    if (slot == 0) return nullptr;
+    const MqttRoute &r = mqttRoutes[slot - 1];
+    if (r.hash == hash && r.len == len && memcmp(r.topic, topic, len) == 0) return &r;
   }
+  return nullptr;
+}
 
-  if (WiFi.status() != WL_CONNECTED) {
-    WiFi.disconnect(true);
-    return false;
+// A topic that is already routed keeps its first handler (and is not subscribed twice).
+static void mqttAddRoute(const char *topic, MqttHandler handler, uint8_t tag = 0) {
+  const size_t len = strlen(topic);
+  if (len == 0 || mqttRouteCount >= MQTT_ROUTES_MAX) return;
+  const uint32_t h = topicHash(topic, len);
+  if (mqttFindRoute(topic, len, h)) {
+    logf(LOG_WARN, "[MQTT] Topic '%s' already subscribed, ignored", topic);
+    return;
   }
+  mqttRoutes[mqttRouteCount] = {topic, (uint16_t)len, h, handler, tag};
+  size_t i = h & (MQTT_ROUTE_SLOTS - 1);
+  while (mqttRouteSlots[i] != 0) i = (i + 1) & (MQTT_ROUTE_SLOTS - 1);
+  mqttRouteSlots[i] = ++mqttRouteCount;
+  mqtt.subscribe(topic);
+}
 
-  captivePortalActive = false;
-
-  httpSetupHandlers();
-  web.begin();
+static void mqttCallback(char *topic, byte *payload, unsigned int length) {
+  metrics.mqttRx++;
+  const size_t tlen = strlen(topic);
 
-  setupOta();
+  if (config.logLevel >= LOG_DEBUG) {
+    logf(LOG_DEBUG, "[MQTT] RX topic=%s payload='%.*s'", topic, (int)length, (const char *)payload);
+  }
 
-  logf(LOG_INFO, "[WiFi] Connected, IP: %s", WiFi.localIP().toString().c_str());
-  return true;
+  const MqttRoute *r = mqttFindRoute(topic, tlen, topicHash(topic, tlen));
+  if (r) r->handler(r->tag, topic, payload, length);
 }
 
-static void mqttPublishBool(const String &topic, bool value, bool retain = true) {
-  mqtt.publish(topic.c_str(), value ? "1" : "0", retain);
+static void mqttSetState(MqttState st) {
+  mqttState = st;
+  mqttStateSinceMs = millis();
 }
 
-static void mqttPublishFloat(const String &topic, float value, uint8_t decimals = 1, bool retain = true) {
-  char buf[32];
-  dtostrf(value, 0, decimals, buf);
-  mqtt.publish(topic.c_str(), buf, retain);
+static void mqttCloseSocket() {
+  if (mqttSockFd >= 0) {
+    close(mqttSockFd);
+    mqttSockFd = -1;
+  }
 }
 
-static void mqttPublishDiscovery() {
-  if (!mqtt.connected()) return;
+// Uniform in [0, range); hardware RNG, so devices that booted together still differ.
+static uint32_t randomJitterMs(uint32_t range) {
+  return range > 0 ? esp_random() % range : 0;
+}
 
-  const String did = deviceId();
+// Exponential backoff with "equal jitter": the wait is half the doubled base plus a
+// random share of the other half, so devices that lost the broker at the same moment
+// do not come back in lockstep, and none retries much sooner than the backoff says.
+static uint32_t mqttBackoffBaseMs = MQTT_RECONNECT_MIN_MS;
+
+static void mqttScheduleRetry() {
+  mqttCloseSocket();
+  lastMqttAttemptMs = millis();
+  uint32_t nextBaseMs = mqttBackoffBaseMs * 2U;
+  if (nextBaseMs > MQTT_RECONNECT_MAX_MS) nextBaseMs = MQTT_RECONNECT_MAX_MS;
+  mqttBackoffBaseMs = nextBaseMs;
+  mqttBackoffMs = nextBaseMs / 2U + randomJitterMs(nextBaseMs / 2U + 1U);
+  mqttSetState(MQTT_ST_BACKOFF);
+}
 
-  String prefix = String(config.haDiscoveryPrefix);
-  prefix.trim();
-  if (prefix.length() == 0) prefix = "homeassistant";
-  while (prefix.endsWith("/")) prefix.remove(prefix.length() - 1);
+static void mqttDnsFound(const char *name, const ip_addr_t *ipaddr, void *arg) {
+  (void)name;
+  if ((uint32_t)(uintptr_t)arg != mqttDnsGen) return;
+  mqttDnsIp = ipaddr ? ip4_addr_get_u32(ip_2_ip4(ipaddr)) : 0;
+  mqttDnsDone = true;
+}
 
-  const String devName = (strlen(config.haDeviceName) > 0) ? String(config.haDeviceName) : did;
+static bool mqttStartTcpConnect(uint32_t ip) {
+  mqttCloseSocket();
+  wifiClient.stop();
 
-  const String availTopic = topicOf("status/online");
-  const String stateEnabled = topicOf("state/enabled");
-  const String stateSetpoint = topicOf("state/setpoint");
-  const String stateHumidity = topicOf("state/humidity");
-  const String stateHumidityAge = topicOf("state/humidity_age_ms");
-  const String stateRelay = topicOf("state/relay");
-  const String stateReason = topicOf("state/reason");
+  int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (fd < 0) return false;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
 
-  const String cmdEnable = (strlen(config.topicEnableIn) > 0) ? String(config.topicEnableIn) : topicOf("cmd/enabled");
-  const String cmdSetpoint = (strlen(config.topicSetpointIn) > 0) ? String(config.topicSetpointIn) : topicOf("cmd/setpoint");
+  struct sockaddr_in sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(config.mqttPort);
+  sa.sin_addr.s_addr = ip;
 
-    const String dev =
-      String("\"dev\":{\"ids\":[\"") + jsonEscape(did) +
-      String("\"],\"name\":\"") + jsonEscape(devName) +
-      String("\",\"mdl\":\"ESP32 Humidifier\",\"mf\":\"Custom\",\"sw\":\"") +
-      jsonEscape(String(HUM_DEVICE_NAME)) + String("\"}");
+  int res = connect(fd, (struct sockaddr *)&sa, sizeof(sa));
+  if (res < 0 && errno != EINPROGRESS) {
+    close(fd);
+    return false;
+  }
 
-  auto pub = [&](const String &topic, const String &payload) {
-    if (!mqtt.publish(topic.c_str(), payload.c_str(), true)) {
-      logf(LOG_WARN, "[MQTT] Publish failed (len=%u): %s", (unsigned)payload.length(), topic.c_str());
-    }
-  };
+  mqttSockFd = fd;
+  return true;
+}
 
-  const String oldHumidifierTopic = prefix + String("/humidifier/") + did + String("/config");
-  const String humidifierTopic = prefix + String("/humidifier/") + did + String("/humidifier/config");
-  const String humiditySensorTopic = prefix + String("/sensor/") + did + String("/humidity/config");
-  const String humidityAgeSensorTopic = prefix + String("/sensor/") + did + String("/humidity_age_ms/config");
-  const String relayBinarySensorTopic = prefix + String("/binary_sensor/") + did + String("/relay/config");
-  const String reasonSensorTopic = prefix + String("/sensor/") + did + String("/automation_reason/config");
+// Returns 1 when connected, 0 while in progress, -1 on failure.
+static int mqttPollTcpConnect() {
+  fd_set wfds;
+  FD_ZERO(&wfds);
+  FD_SET(mqttSockFd, &wfds);
+  struct timeval tv = {0, 0};
+  if (select(mqttSockFd + 1, nullptr, &wfds, nullptr, &tv) <= 0) return 0;
+
+  int err = 0;
+  socklen_t len = sizeof(err);
+  if (getsockopt(mqttSockFd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) return -1;
+  return 1;
+}
 
-  if (!config.haDiscoveryEnabled) {
-    mqtt.publish(oldHumidifierTopic.c_str(), "", true);
-    mqtt.publish(humidifierTopic.c_str(), "", true);
-    mqtt.publish(humiditySensorTopic.c_str(), "", true);
-    mqtt.publish(humidityAgeSensorTopic.c_str(), "", true);
-    mqtt.publish(relayBinarySensorTopic.c_str(), "", true);
-    mqtt.publish(reasonSensorTopic.c_str(), "", true);
-    logf(LOG_INFO, "[MQTT] HA discovery disabled; cleared %s/* for %s", prefix.c_str(), did.c_str());
-    return;
+// Subscriptions (first match wins, same precedence as before: enable, setpoint, humidity)
+static void mqttRegisterRoutes() {
+  mqttClearRoutes();
+  mqttAddRoute(config.topicEnableIn, onEnableMessage, 0);
+  mqttAddRoute(config.topicSetpointIn, onSetpointMessage, 0);
+  for (uint8_t i = 1; i < ZONES_MAX; i++) {
+    if (!zones[i].active) continue;
+    mqttAddRoute(zones[i].topics.cmdEnable, onEnableMessage, i);
+    mqttAddRoute(zones[i].topics.cmdSetpoint, onSetpointMessage, i);
   }
-
-  // Humidifier entity
-  {
-    // Backward-compat cleanup: remove old (incorrect) 3-segment topic if it exists
-    mqtt.publish(oldHumidifierTopic.c_str(), "", true);
-
-    String payload;
-    payload.reserve(820);
-    payload += "{";
-    payload += String("\"name\":\"") + jsonEscape(devName) + "\",";
-    payload += String("\"unique_id\":\"") + jsonEscape(did + String("_humidifier")) + "\",";
-    payload += String("\"availability_topic\":\"") + jsonEscape(availTopic) + "\",";
-    payload += "\"payload_available\":\"1\",\"payload_not_available\":\"0\",";
-    payload += String("\"command_topic\":\"") + jsonEscape(cmdEnable) + "\",";
-    payload += String("\"state_topic\":\"") + jsonEscape(stateEnabled) + "\",";
-    payload += "\"payload_on\":\"1\",\"payload_off\":\"0\",";
-    payload += String("\"target_humidity_command_topic\":\"") + jsonEscape(cmdSetpoint) + "\",";
-    payload += String("\"target_humidity_state_topic\":\"") + jsonEscape(stateSetpoint) + "\",";
-    payload += String("\"current_humidity_topic\":\"") + jsonEscape(stateHumidity) + "\",";
-    payload += String("\"min_humidity\":") + String((int)SETPOINT_MIN) + ",";
-    payload += String("\"max_humidity\":") + String((int)SETPOINT_MAX) + ",";
-    payload += "\"device_class\":\"humidifier\",";
-    payload += dev;
-    payload += "}";
-    pub(humidifierTopic, payload);
-  }
-
-  // Current humidity sensor
-  {
-    const String topic = humiditySensorTopic;
-    String payload;
-    payload.reserve(520);
-    payload += "{";
-    payload += String("\"name\":\"") + jsonEscape(devName + String(" Humidity")) + "\",";
-    payload += String("\"uniq_id\":\"") + jsonEscape(did + String("_humidity")) + "\",";
-    payload += String("\"stat_t\":\"") + jsonEscape(stateHumidity) + "\",";
-    payload += String("\"unit_of_meas\":\"%\",\"dev_cla\":\"humidity\",");
-    payload += String("\"avty_t\":\"") + jsonEscape(availTopic) + "\",";
-    payload += "\"pl_avail\":\"1\",\"pl_not_avail\":\"0\",";
-    payload += dev;
-    payload += "}";
-    pub(topic, payload);
-  }
-
-  // Humidity age sensor (ms)
-  {
-    const String topic = humidityAgeSensorTopic;
-    String payload;
-    payload.reserve(540);
-    payload += "{";
-    payload += String("\"name\":\"") + jsonEscape(devName + String(" Humidity age")) + "\",";
-    payload += String("\"uniq_id\":\"") + jsonEscape(did + String("_humidity_age_ms")) + "\",";
-    payload += String("\"stat_t\":\"") + jsonEscape(stateHumidityAge) + "\",";
-    payload += String("\"unit_of_meas\":\"ms\",");
-    payload += String("\"avty_t\":\"") + jsonEscape(availTopic) + "\",";
-    payload += "\"pl_avail\":\"1\",\"pl_not_avail\":\"0\",";
-    payload += dev;
-    payload += "}";
-    pub(topic, payload);
-  }
-
-  // Relay binary sensor
-  {
-    const String topic = relayBinarySensorTopic;
-    String payload;
-    payload.reserve(540);
-    payload += "{";
-    payload += String("\"name\":\"") + jsonEscape(devName + String(" Relay")) + "\",";
-    payload += String("\"uniq_id\":\"") + jsonEscape(did + String("_relay")) + "\",";
-    payload += String("\"stat_t\":\"") + jsonEscape(stateRelay) + "\",";
-    payload += "\"pl_on\":\"ON\",\"pl_off\":\"OFF\",\"dev_cla\":\"power\",";
-    payload += String("\"avty_t\":\"") + jsonEscape(availTopic) + "\",";
-    payload += "\"pl_avail\":\"1\",\"pl_not_avail\":\"0\",";
-    payload += dev;
-    payload += "}";
-    pub(topic, payload);
-  }
-
-  // Automation reason sensor
-  {
-    const String topic = reasonSensorTopic;
-    String payload;
-    payload.reserve(560);
-    payload += "{";
-    payload += String("\"name\":\"") + jsonEscape(devName + String(" Automation reason")) + "\",";
-    payload += String("\"uniq_id\":\"") + jsonEscape(did + String("_automation_reason")) + "\",";
-    payload += String("\"stat_t\":\"") + jsonEscape(stateReason) + "\",";
-    payload += String("\"avty_t\":\"") + jsonEscape(availTopic) + "\",";
-    payload += "\"pl_avail\":\"1\",\"pl_not_avail\":\"0\",";
-    payload += dev;
-    payload += "}";
-    pub(topic, payload);
-  }
-
-  logf(LOG_INFO, "[MQTT] Discovery published under %s/* for %s", prefix.c_str(), did.c_str());
-}
-
-static void mqttPublishState(bool force) {
-  uint32_t now = millis();
-  if (!force && (now - lastStatePublishMs) < 60000U) return;
-  lastStatePublishMs = now;
-
-  mqttPublishBool(topicOf("state/enabled"), systemEnabled);
-  mqtt.publish(topicOf("state/relay").c_str(), relayOn ? "ON" : "OFF", true);
-  mqttPublishFloat(topicOf("state/setpoint"), targetHumidity);
-  if (!isnan(currentHumidity)) mqttPublishFloat(topicOf("state/humidity"), currentHumidity);
-  if (lastHumiditySeenMs > 0) {
-    char buf[32];
-    snprintf(buf, sizeof(buf), "%lu", (unsigned long)(now - lastHumiditySeenMs));
-    mqtt.publish(topicOf("state/humidity_age_ms").c_str(), buf, true);
+  for (uint8_t i = 0; i < humiditySourceCount; i++) {
+    if (!humiditySources[i].local) mqttAddRoute(humiditySources[i].topic, onHumidityMessage, i);
+  }
+#if HUM_FEATURE_HA_DISCOVERY
+  if (config.haDiscoveryEnabled) mqttAddRoute(topics.discStatus, onHaStatusMessage);
+#endif
+#if HUM_FEATURE_FLEET_OTA
+  if (config.fleetTopic[0] != '\0') mqttAddRoute(config.fleetTopic, onFleetMessage);
+#endif
+  for (uint8_t i = 0; i < ZONES_MAX; i++) {
+    if (!zones[i].active) continue;
+    mqttAddRoute(zones[i].topics.stateRelay, onStateEchoMessage, (uint8_t)(i * 2));
+    mqttAddRoute(zones[i].topics.stateEnabled, onStateEchoMessage, (uint8_t)(i * 2 + 1));
   }
-
-  String r = automationReason();
-  mqtt.publish(topicOf("state/reason").c_str(), r.c_str(), true);
 }
 
-static void mqttCallback(char *topic, byte *payload, unsigned int length) {
-  String t(topic);
-  String p;
-  p.reserve(length);
-  for (unsigned int i = 0; i < length; i++) p += (char)payload[i];
-  p.trim();
-
-  if (config.logLevel >= LOG_DEBUG) {
-    logf(LOG_DEBUG, "[MQTT] RX topic=%s payload='%s'", t.c_str(), p.c_str());
+static void mqttOnSessionStarted() {
+  mqttBackoffMs = MQTT_RECONNECT_MIN_MS;
+  mqttBackoffBaseMs = MQTT_RECONNECT_MIN_MS;
+  metrics.mqttConnects++;
+  if (mqttUpMs == 0) {
+    mqttUpMs = millis();
+    logf(LOG_INFO, "[BOOT] MQTT up %lums after boot (WiFi %lums)", (unsigned long)mqttUpMs, (unsigned long)wifiUpMs);
   }
 
-  if (strlen(config.topicEnableIn) > 0 && t == String(config.topicEnableIn)) {
-    if (config.logLevel >= LOG_INFO) {
-      logf(LOG_INFO, "[MQTT] CMD enabled topic=%s payload='%s'", t.c_str(), p.c_str());
-    }
-    bool newEnabled = parseBool(p, systemEnabled);
-    if (newEnabled != systemEnabled) {
-      systemEnabled = newEnabled;
-      if (!systemEnabled) relayWrite(false);
-      saveRuntimeState();
-    } else if (!newEnabled) {
-      // ensure relay stays off if command repeats disable
-      relayWrite(false);
-    }
-    mqttPublishState(true);
-    return;
-  }
+  // Mark MQTT session as (re)connected; require fresh humidity samples before turning relay ON
+  for (Zone &z : zones) z.samples = 0;
 
-  if (strlen(config.topicSetpointIn) > 0 && t == String(config.topicSetpointIn)) {
-    if (config.logLevel >= LOG_INFO) {
-      logf(LOG_INFO, "[MQTT] CMD setpoint topic=%s payload='%s'", t.c_str(), p.c_str());
-    }
-    float v;
-    if (parseFloat(p, v)) {
-      v = clampSetpoint(v);
-      if (!isnan(v) && v != targetHumidity) {
-        targetHumidity = v;
-        saveRuntimeState();
-      }
-      mqttPublishState(true);
-    }
-    return;
-  }
+  mqttPublish(topics.statusOnline, "1", true);
 
-  if (strlen(config.topicHumidityIn) > 0 && t == String(config.topicHumidityIn)) {
-    uint32_t now = millis();
+  mqttRegisterRoutes();
 
-    // Always count received messages as valid samples for connection stability check
-    if (humiditySamplesSinceMqttConnect < 255) humiditySamplesSinceMqttConnect++;
+  uint8_t activeZones = 0;
+  for (const Zone &z : zones) activeZones += z.active ? 1 : 0;
+  logf(LOG_INFO, "[MQTT] Connected. sub hum='%s' set='%s' en='%s' sources=%u zones=%u humInt=%lus filter=%s fusion=%s",
+       config.topicHumidityIn, config.topicSetpointIn, config.topicEnableIn, (unsigned)humiditySourceCount,
+       (unsigned)activeZones, (unsigned long)(config.humidityMinIntervalMs / 1000U),
+       humidityFilterModeName((HumidityFilterMode)config.filterMode),
+       humidityFusionModeName((HumidityFusionMode)config.fusionMode));
 
-    // Throttle: accept no more often than configured interval
-    if (config.humidityMinIntervalMs > 0 && lastHumidityAcceptMs > 0 && (now - lastHumidityAcceptMs) < config.humidityMinIntervalMs) {
-      lastHumiditySeenMs = now; // still mark seen, but don't change value
-      if (config.logLevel >= LOG_DEBUG) {
-        logf(LOG_DEBUG, "[HUM] Throttled (%lums < %lums), keep=%.2f", (unsigned long)(now - lastHumidityAcceptMs),
-             (unsigned long)config.humidityMinIntervalMs, isnan(currentHumidity) ? -1.0f : currentHumidity);
-      }
-      return;
-    }
+#if HUM_FEATURE_HA_DISCOVERY
+  mqttPublishDiscovery();
+#endif
 
-    float v;
-    if (parseFloat(p, v)) {
-      currentHumidity = v;
-      lastHumidityAcceptMs = now;
-      lastHumiditySeenMs = now;
-      if (config.logLevel >= LOG_DEBUG) {
-        logf(LOG_DEBUG, "[HUM] Accepted: %.2f (samples=%u)", currentHumidity, (unsigned)humiditySamplesSinceMqttConnect);
-      }
-      mqttPublishState(true);
-    } else {
-      if (config.logLevel >= LOG_WARN) {
-        logf(LOG_WARN, "[HUM] Parse failed for payload='%s'", p.c_str());
-      }
-    }
-    return;
-  }
+  // Broker may have lost or never had our retained state: republish everything.
+  mqttQueueResendUnconfirmed();
+  stateFullRefreshPending = true;
 }
 
-static bool mqttConnectIfNeeded() {
-  if (mqtt.connected()) return true;
-  if (strlen(config.mqttHost) == 0) return false;
+// CONNECT goes out on the still non-blocking socket; MQTT_ST_HANDSHAKE then peeks for
+// the CONNACK, so the network task never waits on the broker.
+static bool mqttSendConnect() {
+  buildTopics();
+  const bool login = strlen(config.mqttUser) > 0;
+  const MqttConnectOptions opt = {deviceId(), login ? config.mqttUser : nullptr, login ? config.mqttPass : nullptr,
+                                  topics.statusOnline, "0", 0, true, MQTT_KEEP_ALIVE_SEC};
+  // Fixed header, protocol fields and the length-prefixed strings at their largest.
+  uint8_t packet[15 + 2 + 32 + 2 + TOPIC_MAX + 2 + 1 + 2 + sizeof(config.mqttUser) + 2 + sizeof(config.mqttPass)];
+  const size_t len = mqttEncodeConnect(opt, packet, sizeof(packet));
+  return len > 0 && send(mqttSockFd, packet, len, 0) == (ssize_t)len;
+}
 
-  uint32_t now = millis();
-  if ((now - lastMqttAttemptMs) < mqttBackoffMs) return false;
+// Hands the socket, with the accepted CONNACK waiting in it, to PubSubClient.
+// mqtt.connect() skips its TCP connect because the client is connected, its CONNECT
+// is dropped by MqttSocketClient, and it reads the CONNACK without waiting.
+static bool mqttStartSession() {
+  const int one = 1;
+  fcntl(mqttSockFd, F_SETFL, fcntl(mqttSockFd, F_GETFL, 0) & ~O_NONBLOCK);
+  setsockopt(mqttSockFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
 
-  lastMqttAttemptMs = now;
+  wifiClient = WiFiClient(mqttSockFd);
+  mqttSockFd = -1; // owned by wifiClient now
 
-  mqtt.setServer(config.mqttHost, config.mqttPort);
+  mqtt.setServer(IPAddress(mqttResolvedIp), config.mqttPort);
   mqtt.setCallback(mqttCallback);
-  mqtt.setBufferSize(1024);
-
-  String clientId = deviceId();
-
-  String willTopic = topicOf("status/online");
+  mqtt.setBufferSize(HUM_MQTT_BUFFER_SIZE);
+  mqtt.setSocketTimeout(MQTT_SOCKET_TIMEOUT_SEC);
+  mqtt.setKeepAlive(MQTT_KEEP_ALIVE_SEC);
 
+  wifiClient.dropNextWrite = true;
   bool ok;
   if (strlen(config.mqttUser) > 0) {
-    ok = mqtt.connect(clientId.c_str(), config.mqttUser, config.mqttPass, willTopic.c_str(), 0, true, "0");
+    ok = mqtt.connect(deviceId(), config.mqttUser, config.mqttPass, topics.statusOnline, 0, true, "0");
   } else {
-    ok = mqtt.connect(clientId.c_str(), nullptr, nullptr, willTopic.c_str(), 0, true, "0");
+    ok = mqtt.connect(deviceId(), nullptr, nullptr, topics.statusOnline, 0, true, "0");
   }
+  wifiClient.dropNextWrite = false;
 
   if (!ok) {
-    uint32_t nextBackoffMs = mqttBackoffMs * 2U;
-    if (nextBackoffMs > MQTT_RECONNECT_MAX_MS) nextBackoffMs = MQTT_RECONNECT_MAX_MS;
-    mqttBackoffMs = nextBackoffMs;
+    wifiClient.stop();
     return false;
   }
 
-  mqttBackoffMs = MQTT_RECONNECT_MIN_MS;
+  mqttOnSessionStarted();
+  return true;
+}
 
-  // Mark MQTT session as (re)connected; require fresh humidity samples before turning relay ON
-  humiditySamplesSinceMqttConnect = 0;
+static void mqttTick(uint32_t now) {
+  if (wifiState != WIFI_ST_CONNECTED || strlen(config.mqttHost) == 0) {
+    if (mqttState != MQTT_ST_IDLE) {
+      if (mqttState == MQTT_ST_CONNECTED) {
+        mqtt.disconnect();
+        wifiClient.stop();
+      }
+      mqttCloseSocket();
+      mqttSetState(MQTT_ST_IDLE);
+    }
+    return;
+  }
 
-  mqtt.publish(willTopic.c_str(), "1", true);
+  switch (mqttState) {
+    case MQTT_ST_IDLE:
+      // First attempt almost right away, with a little jitter against lockstep storms.
+      lastMqttAttemptMs = now - mqttBackoffMs + randomJitterMs(MQTT_FIRST_ATTEMPT_JITTER_MS);
+      mqttSetState(MQTT_ST_BACKOFF);
+      break;
 
-  // Subscriptions
-  if (strlen(config.topicHumidityIn) > 0) mqtt.subscribe(config.topicHumidityIn);
-  if (strlen(config.topicSetpointIn) > 0) mqtt.subscribe(config.topicSetpointIn);
-  if (strlen(config.topicEnableIn) > 0) mqtt.subscribe(config.topicEnableIn);
+    case MQTT_ST_BACKOFF: {
+      if ((now - lastMqttAttemptMs) < mqttBackoffMs) break;
+      lastMqttAttemptMs = now;
 
-    logf(LOG_INFO, "[MQTT] Connected. sub hum='%s' set='%s' en='%s' humInt=%lus", config.topicHumidityIn, config.topicSetpointIn,
-      config.topicEnableIn, (unsigned long)(config.humidityMinIntervalMs / 1000U));
+      IPAddress literal;
+      if (literal.fromString(config.mqttHost)) {
+        mqttResolvedIp = (uint32_t)literal;
+      } else {
+        ip_addr_t addr;
+        mqttDnsDone = false;
+        const uint32_t gen = mqttDnsGen + 1U;
+        mqttDnsGen = gen;
+        err_t err = dns_gethostbyname(config.mqttHost, &addr, mqttDnsFound, (void *)(uintptr_t)gen);
+        if (err == ERR_INPROGRESS) {
+          mqttSetState(MQTT_ST_RESOLVING);
+          break;
+        }
+        if (err != ERR_OK) {
+          logf(LOG_WARN, "[MQTT] DNS lookup failed for %s", config.mqttHost);
+          mqttScheduleRetry();
+          break;
+        }
+        mqttResolvedIp = ip4_addr_get_u32(ip_2_ip4(&addr));
+      }
 
-  mqttPublishDiscovery();
+      if (mqttStartTcpConnect(mqttResolvedIp)) {
+        mqttSetState(MQTT_ST_CONNECTING);
+      } else {
+        mqttScheduleRetry();
+      }
+      break;
+    }
 
-  mqttPublishState(true);
-  return true;
-}
+    case MQTT_ST_RESOLVING:
+      if (mqttDnsDone) {
+        mqttDnsDone = false;
+        mqttResolvedIp = mqttDnsIp;
+        if (mqttResolvedIp == 0 || !mqttStartTcpConnect(mqttResolvedIp)) {
+          logf(LOG_WARN, "[MQTT] DNS lookup failed for %s", config.mqttHost);
+          mqttScheduleRetry();
+        } else {
+          mqttSetState(MQTT_ST_CONNECTING);
+        }
+      } else if ((now - mqttStateSinceMs) >= MQTT_DNS_TIMEOUT_MS) {
+        mqttDnsGen = mqttDnsGen + 1U; // ignore a late answer
+        logf(LOG_WARN, "[MQTT] DNS timeout for %s", config.mqttHost);
+        mqttScheduleRetry();
+      }
+      break;
 
-static void controlLoopTick() {
-  // Without MQTT, we cannot receive external humidity reliably -> safe OFF
-  if (!mqtt.connected()) {
-    if (relayOn) relayWrite(false);
-    return;
+    case MQTT_ST_CONNECTING: {
+      int res = mqttPollTcpConnect();
+      if (res > 0) {
+        if (mqttSendConnect()) {
+          mqttSetState(MQTT_ST_HANDSHAKE);
+        } else {
+          mqttScheduleRetry();
+        }
+      } else if (res < 0 || (now - mqttStateSinceMs) >= MQTT_TCP_CONNECT_TIMEOUT_MS) {
+        if (config.logLevel >= LOG_DEBUG) {
+          logf(LOG_DEBUG, "[MQTT] TCP connect to %s:%u failed", config.mqttHost, (unsigned)config.mqttPort);
+        }
+        mqttScheduleRetry();
+      }
+      break;
+    }
+
+    case MQTT_ST_HANDSHAKE: {
+      // Peek, so that mqtt.connect() still finds the CONNACK in the socket.
+      uint8_t ack[4];
+      const int n = recv(mqttSockFd, ack, sizeof(ack), MSG_PEEK | MSG_DONTWAIT);
+      if (n == (int)sizeof(ack)) {
+        const int code = mqttConnackCode(ack);
+        if (code == 0 && mqttStartSession()) {
+          mqttSetState(MQTT_ST_CONNECTED);
+        } else {
+          logf(LOG_WARN, "[MQTT] Broker %s refused the connection (code %d)", config.mqttHost, code);
+          mqttScheduleRetry();
+        }
+      } else if (n == 0 || (n < 0 && errno != EWOULDBLOCK && errno != EAGAIN) ||
+                 (now - mqttStateSinceMs) >= MQTT_CONNACK_TIMEOUT_MS) {
+        logf(LOG_WARN, "[MQTT] No CONNACK from %s:%u", config.mqttHost, (unsigned)config.mqttPort);
+        mqttScheduleRetry();
+      }
+      break;
+    }
+
+    case MQTT_ST_CONNECTED:
+      if (!mqtt.connected()) {
+        wifiClient.stop();
+        mqttScheduleRetry();
+      }
+      break;
   }
+}
 
-  if (!systemEnabled) {
-    if (relayOn) relayWrite(false);
-    return;
+// Drops the current session (or attempt) and lets mqttTick() reconnect right away.
+static void mqttRestart() {
+  mqtt.disconnect();
+  wifiClient.stop();
+  mqttCloseSocket();
+  mqttBackoffMs = MQTT_RECONNECT_MIN_MS;
+  mqttBackoffBaseMs = MQTT_RECONNECT_MIN_MS;
+  lastMqttAttemptMs = millis() - mqttBackoffMs;
+  mqttSetState(MQTT_ST_BACKOFF);
+}
+
+// Relay transitions from the control loop; the network loop does the actual publish.
+static void requestStatePublish(Zone &z) {
+  markStateDirty(z, SF_RELAY | SF_REASON);
+}
+
+// Time until the next evaluation is needed without any new input: the staleness
+// timeout while a relay is ON, and the end of a relay guard hold or duty budget.
+static uint32_t controlWaitMs() {
+  const uint32_t now = millis();
+  uint32_t wait = CONTROL_IDLE_WAKE_MS;
+  for (const Zone &z : zones) {
+    if (!z.active) continue;
+    const uint32_t w = controlNextWakeMs(controlInputs(z, mqttLinkUp), CONTROL_IDLE_WAKE_MS);
+    if (w < wait) wait = w;
+    const uint32_t g = z.guard.nextWakeMs(now, CONTROL_IDLE_WAKE_MS);
+    if (g < wait) wait = g;
   }
+  return wait;
+}
 
-  if (isnan(currentHumidity)) {
-    // No sensor yet -> safe OFF
-    if (relayOn) relayWrite(false);
-    return;
+static const char *relayGateName(RelayGate g) {
+  switch (g) {
+    case GATE_MIN_ON: return "min on time";
+    case GATE_MIN_OFF: return "min off time";
+    case GATE_DUTY: return "duty limit";
+    default: return "none";
   }
+}
 
-  float low = targetHumidity - config.hysteresis;
-  float high = targetHumidity + config.hysteresis;
+static void controlZoneTick(Zone &z) {
+  const uint32_t now = millis();
+  const uint32_t seenMs = z.lastSeenMs.load();
+  if (seenMs != 0 && seenMs != z.predictorSeenMs) {
+    z.predictorSeenMs = seenMs;
+    z.predictor.observe(seenMs, z.humidity.load());
+  }
 
-  if (!relayOn && currentHumidity < low) {
-    // Avoid turning ON based on a potentially stale retained value after reconnect.
-    if (humiditySamplesSinceMqttConnect < 2) {
+  const ControlInputs in = controlInputs(z, mqttLinkUp);
+  ControlDecision d = controlDecide(in);
+  float low, high;
+  controlBand(in, low, high);
+  const unsigned zone = zoneIndex(z);
+
+  // The guard only gets the controller's own decisions; safety OFFs go straight through.
+  z.guard.update(now);
+  const bool safetyOff = d.cause == CAUSE_LINK_DOWN || d.cause == CAUSE_DISABLED || d.cause == CAUSE_NO_HUMIDITY ||
+                         d.cause == CAUSE_STALE;
+  const bool wanted = !safetyOff && (d.action == CONTROL_TURN_ON || (in.relayOn && d.action != CONTROL_TURN_OFF));
+  const RelayGate gate = safetyOff ? GATE_PASS : z.guard.gate(now, wanted);
+  const RelayGate prevGate = (RelayGate)z.gate.exchange(gate);
+  z.relayWanted = wanted;
+  if (gate != GATE_PASS) {
+    if (gate == GATE_DUTY && in.relayOn) {
+      relayWrite(z, false);
+      logf(LOG_INFO, "[CTRL] Zone %u relay OFF: duty limit (%lus on in the last hour)", zone,
+           (unsigned long)(z.guard.onMsLastHour() / 1000U));
+      requestStatePublish(z);
+    } else if (gate != prevGate && config.logLevel >= LOG_DEBUG) {
+      logf(LOG_DEBUG, "[CTRL] Zone %u want %s, held by %s", zone, wanted ? "ON" : "OFF", relayGateName(gate));
+    }
+    d.action = CONTROL_KEEP;
+    d.cause = CAUSE_NONE;
+  }
+  if (gate != prevGate) markStateDirty(z, SF_REASON);
+
+  switch (d.cause) {
+    case CAUSE_LINK_DOWN:
+    case CAUSE_DISABLED:
+    case CAUSE_NO_HUMIDITY:
+      if (d.action == CONTROL_TURN_OFF) relayWrite(z, false);
+      break;
+    case CAUSE_STALE:
+      if (d.action == CONTROL_TURN_OFF) {
+        relayWrite(z, false);
+        logf(LOG_WARN, "[CTRL] Zone %u relay OFF: humidity stale (%lus)", zone, (unsigned long)(in.humidityAgeMs / 1000U));
+        requestStatePublish(z);
+      }
+      break;
+    case CAUSE_WAITING_SAMPLES:
       if (config.logLevel >= LOG_DEBUG) {
-        logf(LOG_DEBUG, "[CTRL] Want ON but waiting samples=%u", (unsigned)humiditySamplesSinceMqttConnect);
+        logf(LOG_DEBUG, "[CTRL] Zone %u want ON but waiting samples=%u", zone, (unsigned)in.samples);
       }
-      return;
-    }
-    relayWrite(true);
-    if (config.logLevel >= LOG_INFO) {
-      logf(LOG_INFO, "[CTRL] Relay ON (hum=%.2f low=%.2f target=%.2f)", currentHumidity, low, targetHumidity);
-    }
-    mqttPublishState(true);
-  } else if (relayOn && currentHumidity > high) {
-    relayWrite(false);
-    if (config.logLevel >= LOG_INFO) {
-      logf(LOG_INFO, "[CTRL] Relay OFF (hum=%.2f high=%.2f target=%.2f)", currentHumidity, high, targetHumidity);
-    }
-    mqttPublishState(true);
+      break;
+    case CAUSE_BELOW_LOW:
+      relayWrite(z, true);
+      if (config.logLevel >= LOG_INFO) {
+        logf(LOG_INFO, "[CTRL] Zone %u relay ON (hum=%.2f low=%.2f target=%.2f)", zone, in.humidity, low, in.target);
+      }
+      requestStatePublish(z);
+      break;
+    case CAUSE_ABOVE_HIGH:
+      relayWrite(z, false);
+      if (config.logLevel >= LOG_INFO) {
+        logf(LOG_INFO, "[CTRL] Zone %u relay OFF (hum=%.2f high=%.2f target=%.2f)", zone, in.humidity, high, in.target);
+      }
+      requestStatePublish(z);
+      break;
+    case CAUSE_NONE:
+      break;
   }
+
+  z.switches = z.guard.switches();
+  z.onSeconds = z.guard.onSeconds();
+  z.onMsLastHour = z.guard.onMsLastHour();
+  const HumidityModel &m = z.predictor.model();
+  z.riseRate = m.riseRate;
+  z.decayRate = m.decayRate;
+  z.overshoot = m.overshoot;
+  z.undershoot = m.undershoot;
 }
 
-void setup() {
-  // Try to avoid relay glitches at boot: drive the default relay pin to a safe OFF
-  // level as early as possible, before delays, Wi-Fi/MQTT, and config load.
-  int bootRelayPin = HUM_DEFAULT_RELAY_PIN;
-  bool bootRelayInverted = (HUM_DEFAULT_RELAY_INVERTED != 0);
-  {
-    Preferences bootPrefs;
-    if (bootPrefs.begin("hum", true)) {
-      bootRelayPin = bootPrefs.getInt("relayPin", HUM_DEFAULT_RELAY_PIN);
-      bootRelayInverted = bootPrefs.getBool("relayInv", HUM_DEFAULT_RELAY_INVERTED != 0);
-      bootPrefs.end();
+// Runs in the control task when HUM_SPLIT_TASKS=1: it only touches atomics, config
+// and the relay GPIOs, never the MQTT client or the web server. Every active zone is
+// evaluated on each wake-up; an evaluation is a handful of comparisons.
+static void controlLoopTick() {
+  const uint8_t offMask = relayOffRequested.exchange(0);
+  for (uint8_t i = 0; i < ZONES_MAX; i++) {
+    Zone &z = zones[i];
+    if (!z.active) continue;
+    if ((offMask & (1U << i)) && z.relayOn) {
+      relayWrite(z, false);
+      requestStatePublish(z);
     }
+    controlZoneTick(z);
   }
-  if (bootRelayPin >= 0 && bootRelayPin <= 39) {
-    pinMode(bootRelayPin, OUTPUT);
-    bool bootLevel = false; // OFF
-    if (bootRelayInverted) bootLevel = !bootLevel;
-    digitalWrite(bootRelayPin, bootLevel ? HIGH : LOW);
-  }
-
-  Serial.begin(115200);
-  delay(50);
+}
 
-  loadConfig();
+// Periodic counters/heap snapshot on <base>/telemetry (not retained), if enabled.
+static void mqttPublishTelemetry(uint32_t now) {
+  static uint32_t lastTelemetryMs = 0;
+  if (config.telemetrySec == 0 || !mqtt.connected()) return;
+  if (lastTelemetryMs != 0 && (now - lastTelemetryMs) < config.telemetrySec * 1000U) return;
+  lastTelemetryMs = now;
+
+  const LatencyHistogram &loop = stageLatency[STAGE_LOOP];
+  char buf[352];
+  int len = snprintf(buf, sizeof(buf),
+                     "{\"uptime_s\":%lu,\"heap_free\":%lu,\"heap_min_free\":%lu,\"heap_max_block\":%lu,"
+                     "\"mqtt_rx\":%lu,\"mqtt_tx\":%lu,\"mqtt_publish_failed\":%lu,\"mqtt_connects\":%lu,"
+                     "\"humidity_throttled\":%lu,\"humidity_rejected\":%lu,\"nvs_writes\":%lu,\"loop_avg_us\":%lu,\"loop_max_us\":%lu}",
+                     (unsigned long)(now / 1000U), (unsigned long)ESP.getFreeHeap(), (unsigned long)ESP.getMinFreeHeap(),
+                     (unsigned long)ESP.getMaxAllocHeap(), (unsigned long)metrics.mqttRx, (unsigned long)metrics.mqttTx,
+                     (unsigned long)metrics.mqttPublishFailed, (unsigned long)metrics.mqttConnects,
+                     (unsigned long)metrics.humidityThrottled, (unsigned long)metrics.humidityRejected,
+                     (unsigned long)metrics.nvsWrites,
+                     (unsigned long)(loop.count ? loop.sumUs / loop.count : 0), (unsigned long)loop.maxUs);
+  if (len <= 0 || (size_t)len >= sizeof(buf)) return;
+  mqttPublish(topics.telemetry, (const uint8_t *)buf, (unsigned int)len, false);
+}
 
-  // If user config uses a different pin than default, release the default pin.
-  if (config.relayPin != bootRelayPin && bootRelayPin >= 0 && bootRelayPin <= 39) {
-    pinMode(bootRelayPin, INPUT);
+// Link loss: MQTT humidity is presumed stale and relays go safe OFF, except in the
+// zone with the local sensor, which carries on with that alone.
+static void humidityInputsLost() {
+  const uint32_t now = millis();
+  for (uint8_t i = 0; i < humiditySourceCount; i++) {
+    if (!humiditySources[i].local) humiditySourceReset(humiditySources[i]);
   }
+  uint8_t onMask = 0;
+  for (uint8_t i = 0; i < ZONES_MAX; i++) {
+    Zone &z = zones[i];
+    float v = NAN;
+    z.freshSources = z.localSensor ? humiditySourcesFuse(i, now, v) : 0;
+    if (z.freshSources > 0) {
+      z.humidity = v;
+      markStateDirty(z, SF_HUMIDITY | SF_REASON);
+      continue;
+    }
+    z.humidity = NAN;
+    z.lastSeenMs = 0;
+    z.samples = 0;
+    if (z.relayOn) onMask |= (uint8_t)(1U << i);
+  }
+  if (onMask) relayForceOff(onMask);
+}
 
-  pinMode(config.relayPin, OUTPUT);
-  relayWrite(false);
+#if !HUM_SPLIT_TASKS
+// Single-loop mode: the control evaluation that the control task would run.
+static void controlEvalTick(uint32_t now) {
+  static uint32_t lastControlEvalMs = 0;
+  if (controlEvalPending.exchange(false) || (now - lastControlEvalMs) >= controlWaitMs()) {
+    lastControlEvalMs = now;
+    const uint32_t t0 = ESP.getCycleCount();
+    controlLoopTick();
+    metricsRecord(STAGE_CONTROL, t0);
+  }
+}
+#endif
 
-  logf(LOG_INFO, "Device: %s", deviceId().c_str());
-  logf(LOG_INFO, "Relay pin: %d, inverted: %s", config.relayPin, config.relayInverted ? "yes" : "no");
+#if HUM_FEATURE_WEB_OTA && !HUM_SPLIT_TASKS
+// In single-loop mode a firmware upload keeps the loop in one request for the whole
+// transfer; between chunks the upload handler calls this so MQTT (commands, state, OTA
+// progress), control and the event streams keep going.
+static void otaServiceNetwork() {
+  static uint32_t lastServiceMs = 0;
+  const uint32_t now = millis();
+  if ((now - lastServiceMs) < OTA_SERVICE_INTERVAL_MS) return;
+  lastServiceMs = now;
+  if (mqttState == MQTT_ST_CONNECTED) mqtt.loop();
+  mqttFlushState();
+  otaTick();
+  controlEvalTick(now);
+  sseTick(now);
+}
+#endif
 
-  bool staOk = connectWiFiSta();
-  if (!staOk) {
-    logWriteLine(LOG_WARN, "[WiFi] STA failed or not configured -> starting captive portal");
-    startCaptivePortal();
-  }
+// Accepting connections, captive portal DNS and event streams. With HUM_SPLIT_TASKS=1
+// this runs in the HTTP task and the requests in the workers, concurrently with each
+// other; handlers only touch atomics, the locked log and history rings, and leave NVS
+// writes and reboots to the network task (requestReboot()).
+static void httpLoop() {
+  const uint32_t t0 = ESP.getCycleCount();
+  const uint32_t now = millis();
+#if HUM_FEATURE_CAPTIVE_DNS
+  if (captivePortalActive) dns.processNextRequest();
+#endif
+  httpAcceptTick();
+  sseTick(now);
+#if HUM_OTA_WRITER
+  otaExpireTick(now);
+#endif
+  metricsRecord(STAGE_HTTP, t0);
 }
 
-void loop() {
+// Wi-Fi, HTTP, DNS, MQTT, OTA and the hang watchdog. With HUM_SPLIT_TASKS=1 this runs
+// in its own task and may block on the network without delaying relay decisions.
+static void networkLoop() {
   static wl_status_t lastWifiStatus = WL_IDLE_STATUS;
   static bool lastMqttConnected = false;
 
-  wl_status_t wifiStatus = WiFi.status();
+  const uint32_t loopStart = ESP.getCycleCount();
+  uint32_t now = millis();
+
+  uint32_t t0 = ESP.getCycleCount();
+  wifiTick(now);
+  metricsRecord(STAGE_WIFI, t0);
+
+  wl_status_t wifiStatus = (wifiState == WIFI_ST_CONNECTED) ? WL_CONNECTED : WL_DISCONNECTED;
   if (lastWifiStatus == WL_CONNECTED && wifiStatus != WL_CONNECTED) {
     // WiFi dropped -> external humidity likely stale; safe OFF
-    currentHumidity = NAN;
-    lastHumidityAcceptMs = 0;
-    lastHumiditySeenMs = 0;
-    humiditySamplesSinceMqttConnect = 0;
-    if (relayOn) relayWrite(false);
+    humidityInputsLost();
   }
   lastWifiStatus = wifiStatus;
 
-  if (captivePortalActive) dns.processNextRequest();
-  web.handleClient();
+#if !HUM_SPLIT_TASKS
+  if (webStarted) httpLoop();
+#endif
 
+  t0 = ESP.getCycleCount();
+  mqttTick(now);
+  localSensorTick(now);
+  humiditySourcesTick(now);
   if (wifiStatus == WL_CONNECTED) {
-    mqttConnectIfNeeded();
-    mqtt.loop();
-    if (otaActive) ArduinoOTA.handle();
+    if (mqttState == MQTT_ST_CONNECTED) mqtt.loop();
+#if HUM_FEATURE_HA_DISCOVERY
+    if (discoveryForcePending && mqtt.connected() && (int32_t)(now - discoveryForceAtMs) >= 0) {
+      discoveryForcePending = false;
+      mqttPublishDiscovery(true);
+    }
+#endif
   }
+  metricsRecord(STAGE_MQTT, t0);
+
+#if HUM_FEATURE_ARDUINO_OTA
+  if (wifiStatus == WL_CONNECTED && otaActive) {
+    t0 = ESP.getCycleCount();
+    ArduinoOTA.handle();
+    metricsRecord(STAGE_OTA, t0);
+  }
+#endif
 
   bool mqttConnected = mqtt.connected();
   if (lastMqttConnected && !mqttConnected) {
     // MQTT dropped -> external humidity stale; safe OFF
-    currentHumidity = NAN;
-    lastHumidityAcceptMs = 0;
-    lastHumiditySeenMs = 0;
-    humiditySamplesSinceMqttConnect = 0;
-    if (relayOn) relayWrite(false);
+    humidityInputsLost();
   }
   lastMqttConnected = mqttConnected;
+  if (mqttLinkUp.exchange(mqttConnected) != mqttConnected) controlRequestEval();
+
+#if !HUM_SPLIT_TASKS
+  controlEvalTick(millis());
+#endif
 
   if (wifiStatus == WL_CONNECTED) {
     if (!mqttConnected) {
@@ -1273,20 +6458,13 @@ void loop() {
   }
 
   static uint32_t lastControlMs = 0;
-  uint32_t now = millis();
+  now = millis();
   if ((now - lastControlMs) >= 1000U) {
     lastControlMs = now;
-    controlLoopTick();
-
-    if (mqtt.connected()) {
-      String r = automationReason();
-      if (r != lastAutomationReason) {
-        lastAutomationReason = r;
-        mqtt.publish(topicOf("state/reason").c_str(), r.c_str(), true);
-      }
-    }
 
-    if (mqtt.connected()) mqttPublishState(false);
+    // The reason also depends on inputs nobody marks (e.g. link state); the flush
+    // drops it again when it is unchanged.
+    markAllStateDirty(SF_REASON);
 
     // Anti-hang watchdog
     if (wifiStatus == WL_CONNECTED && config.hangTimeoutSec > 0) {
@@ -1300,7 +6478,13 @@ void loop() {
           hangWhy = "mqtt_disconnected";
         }
       } else {
-        if (lastHumiditySeenMs > 0 && (now - lastHumiditySeenMs) > timeoutMs) {
+        // Only when every zone has gone quiet: one dead sensor is not a hang.
+        uint32_t lastSeenMs = 0;
+        for (const Zone &z : zones) {
+          const uint32_t seen = z.lastSeenMs;
+          if (z.active && seen > 0 && (lastSeenMs == 0 || (int32_t)(seen - lastSeenMs) > 0)) lastSeenMs = seen;
+        }
+        if (lastSeenMs > 0 && (now - lastSeenMs) > timeoutMs) {
           hang = true;
           hangWhy = "no_humidity";
         }
@@ -1310,14 +6494,284 @@ void loop() {
         lastHangActionMs = now;
         logf(LOG_WARN, "[WATCHDOG] Hang detected (%s), action=%u", hangWhy ? hangWhy : "unknown", (unsigned)config.hangAction);
         if (config.hangAction == 2) {
+          flushRuntimeState(true);
           delay(50);
           ESP.restart();
         } else {
-          mqtt.disconnect();
-          lastMqttAttemptMs = 0;
-          mqttBackoffMs = MQTT_RECONNECT_MIN_MS;
+          mqttRestart();
         }
       }
     }
   }
+
+  t0 = ESP.getCycleCount();
+  mqttFlushState();
+  metricsRecord(STAGE_STATE_FLUSH, t0);
+
+  mqttPublishTelemetry(millis());
+  historyTick(millis());
+#if HUM_OTA_WRITER
+  otaTick();
+#endif
+#if HUM_FEATURE_FLEET_OTA
+  fleetTick(millis(), wifiStatus == WL_CONNECTED);
+#endif
+  rebootTick(millis());
+  flushRuntimeState(false);
+  metricsRecord(STAGE_LOOP, loopStart);
+}
+
+#if HUM_SPLIT_TASKS
+static void controlTask(void *arg) {
+  (void)arg;
+  for (;;) {
+    // Sleeps until an input changes (controlRequestEval/relayForceOff) or a timeout is due.
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(controlWaitMs()));
+    controlEvalPending = false;
+    const uint32_t t0 = ESP.getCycleCount();
+    controlLoopTick();
+    metricsRecord(STAGE_CONTROL, t0);
+  }
+}
+
+static void networkTask(void *arg) {
+  (void)arg;
+  for (;;) {
+    networkLoop();
+    vTaskDelay(1);
+  }
+}
+
+static void httpTask(void *arg) {
+  (void)arg;
+  for (;;) {
+    if (webStarted) httpLoop(); // the network task starts the server once there is an interface
+    vTaskDelay(1);
+  }
+}
+
+static void startTasks() {
+  // The captive portal may already have started the web services, so the HTTP task can
+  // accept a client as soon as it runs; the queue it hands clients to must exist first.
+  httpQueue = xQueueCreate(HTTP_WORKERS, sizeof(WiFiClient *));
+  xTaskCreatePinnedToCore(controlTask, "hum_ctrl", CONTROL_TASK_STACK, nullptr, CONTROL_TASK_PRIO, &controlTaskHandle, CONTROL_TASK_CORE);
+  xTaskCreatePinnedToCore(networkTask, "hum_net", NET_TASK_STACK, nullptr, NET_TASK_PRIO, nullptr, NET_TASK_CORE);
+  xTaskCreatePinnedToCore(httpTask, "hum_http", HTTP_TASK_STACK, nullptr, HTTP_TASK_PRIO, nullptr, HTTP_TASK_CORE);
+  for (uint8_t i = 0; i < HTTP_WORKERS; i++) {
+    char name[12];
+    snprintf(name, sizeof(name), "hum_http%u", (unsigned)i);
+    xTaskCreatePinnedToCore(httpWorkerTask, name, HTTP_WORKER_STACK, &httpWorkerRequests[i], HTTP_TASK_PRIO, nullptr,
+                            HTTP_TASK_CORE);
+  }
+  logf(LOG_INFO, "[TASK] control on core %d (prio %u), network on core %d (prio %u), http prio %u with %u workers",
+       (int)CONTROL_TASK_CORE, (unsigned)CONTROL_TASK_PRIO, (int)NET_TASK_CORE, (unsigned)NET_TASK_PRIO,
+       (unsigned)HTTP_TASK_PRIO, (unsigned)HTTP_WORKERS);
+}
+#endif
+
+#if HUM_BENCH
+// Boot-time micro-benchmarks (env:esp32bench), printed straight to Serial before Wi-Fi
+// starts so nothing else competes for the CPU. Cycles are per iteration; heap and block
+// deltas are the net change over the whole run (non-zero = leak or growing cache);
+// allocs is the number of malloc/calloc/realloc calls per iteration, counted through
+// the linker wraps set up in platformio.ini.
+static constexpr uint32_t BENCH_ITERATIONS = 200;
+
+static volatile uint32_t benchAllocCount = 0;
+
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  benchAllocCount++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+  benchAllocCount++;
+  return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size) {
+  benchAllocCount++;
+  return __real_realloc(p, size);
+}
+}
+
+typedef void (*BenchFn)(uint32_t i);
+
+static void benchRun(const char *name, BenchFn fn, uint32_t iters = BENCH_ITERATIONS) {
+  fn(0); // warm-up: lazy statics, first-use allocations
+
+  multi_heap_info_t before;
+  multi_heap_info_t after;
+  heap_caps_get_info(&before, MALLOC_CAP_8BIT);
+  const uint32_t allocsBefore = benchAllocCount;
+
+  uint32_t minCycles = UINT32_MAX;
+  uint32_t maxCycles = 0;
+  uint64_t totalCycles = 0;
+  for (uint32_t i = 0; i < iters; i++) {
+    const uint32_t t0 = ESP.getCycleCount();
+    fn(i);
+    const uint32_t c = ESP.getCycleCount() - t0;
+    totalCycles += c;
+    if (c < minCycles) minCycles = c;
+    if (c > maxCycles) maxCycles = c;
+  }
+
+  const uint32_t allocs = benchAllocCount - allocsBefore;
+  heap_caps_get_info(&after, MALLOC_CAP_8BIT);
+
+  const uint32_t avg = (uint32_t)(totalCycles / iters);
+  Serial.printf("[BENCH] %-20s n=%lu cyc_avg=%lu cyc_min=%lu cyc_max=%lu us_avg=%.2f allocs=%.2f heap_delta=%ld blocks_delta=%ld\n",
+                name, (unsigned long)iters, (unsigned long)avg, (unsigned long)minCycles, (unsigned long)maxCycles,
+                (double)avg / ESP.getCpuFreqMHz(), (double)allocs / iters,
+                (long)before.total_free_bytes - (long)after.total_free_bytes,
+                (long)after.allocated_blocks - (long)before.allocated_blocks);
+}
+
+static void benchMqttMessage(const char *topic, const char *payload) {
+  // PubSubClient hands the callback a writable topic buffer and a raw payload.
+  char t[TOPIC_MAX];
+  strncpy(t, topic, sizeof(t) - 1);
+  t[sizeof(t) - 1] = '\0';
+  mqttCallback(t, (byte *)payload, strlen(payload));
+}
+
+#if HUM_FEATURE_HA_DISCOVERY
+static void discBuildAllMeasure() {
+  for (const DiscoveryEntity &e : DISCOVERY_ENTITIES) {
+    DiscoveryWriter w(e.object, false);
+    e.build(w, zones[0]);
+    w.finish();
+  }
+}
+#endif
+
+// Runs with fixed bench topics and the log level at ERROR; the real config and
+// runtime state are restored afterwards, and nothing is persisted.
+static void runBootBenchmarks() {
+  const AppConfig savedConfig = config;
+  const float savedTarget = zones[0].target;
+  const bool savedEnabled = zones[0].enabled;
+
+  strcpy(config.topicHumidityIn, "bench/humidity");
+  strcpy(config.topicSetpointIn, "bench/setpoint");
+  strcpy(config.topicEnableIn, "bench/enabled");
+  config.humidityMinIntervalMs = 0;
+  config.humiditySources[0] = '\0';
+  config.logLevel = LOG_ERROR;
+  humiditySourcesConfigure();
+  mqttRegisterRoutes();
+
+  Serial.printf("[BENCH] start: cpu=%luMHz heap_free=%lu heap_max_block=%lu\n", (unsigned long)ESP.getCpuFreqMHz(),
+                (unsigned long)ESP.getFreeHeap(), (unsigned long)ESP.getMaxAllocHeap());
+
+  benchRun("parse_float", [](uint32_t) {
+    float v;
+    parseFloatRaw((const byte *)" 45.5 ", 6, v);
+  });
+  benchRun("parse_bool", [](uint32_t) { parseBoolRaw((const byte *)"ON", 2, false); });
+  benchRun("mqtt_rx_humidity", [](uint32_t i) { benchMqttMessage("bench/humidity", (i & 1) ? "43.2" : "43.4"); });
+  benchRun("mqtt_rx_setpoint", [](uint32_t i) { benchMqttMessage("bench/setpoint", (i & 1) ? "45" : "46"); });
+  benchRun("mqtt_rx_enable", [](uint32_t) { benchMqttMessage("bench/enabled", "1"); });
+  benchRun("mqtt_rx_unrouted", [](uint32_t) { benchMqttMessage("bench/other", "1"); });
+  benchRun("state_json", [](uint32_t) {
+    char buf[192];
+    formatStateJson(zones[0], buf, sizeof(buf), millis());
+  });
+#if HUM_FEATURE_HA_DISCOVERY
+  benchRun("discovery_measure", [](uint32_t) { discBuildAllMeasure(); });
+#endif
+  benchRun("log_write", [](uint32_t i) { logf(LOG_ERROR, "[BENCH] value=%lu hum=%.2f topic=%s", (unsigned long)i, 43.2, "bench/x"); });
+  benchRun("log_format", [](uint32_t) {
+    LogCursor c;
+    uint8_t rec[LOG_RECORD_MAX];
+    char line[LOG_LINE_MAX];
+    if (logReadNext(c, rec)) logFormatRecord(rec, line, sizeof(line));
+  });
+  // No client is attached, so these measure rendering and header building only.
+  static HttpRequest benchRequest;
+  benchRun("render_state_json", [](uint32_t) {
+    benchRequest.reset();
+    sendStateJson(benchRequest);
+  });
+  benchRun("render_config_json", [](uint32_t) {
+    benchRequest.reset();
+    sendConfigJson(benchRequest);
+  });
+
+  config = savedConfig;
+  zones[0].target = savedTarget;
+  zones[0].enabled = savedEnabled;
+  for (Zone &z : zones) {
+    z.humidity = NAN;
+    z.lastSeenMs = 0;
+    z.samples = 0;
+    z.dirty = 0;
+  }
+  humiditySourcesConfigure();
+  humiditySourcesReset();
+  relayOffRequested = 0;
+  runtimeDirty = false;
+  mqttClearRoutes();
+  metrics = Metrics();
+  memset(stageLatency, 0, sizeof(stageLatency));
+
+  Serial.println("[BENCH] done");
+}
+#endif
+
+void setup() {
+  // The config is already loaded and the relay pins are OFF (initVariant()).
+  Serial.begin(115200);
+  delay(50);
+  startLogSerialTask();
+  if (configMigrated) logf(LOG_INFO, "Config: migrated to the config blob");
+
+  zonesConfigure();
+  historyConfigure();
+  humiditySourcesConfigure();
+  startLocalSensorTask();
+
+  for (Zone &z : zones) {
+    if (!z.active || !relayPinValid(z.relayPin)) continue;
+    pinMode(z.relayPin, OUTPUT);
+    relayWrite(z, false);
+  }
+
+  buildTopics();
+
+  logf(LOG_INFO, "Device: %s", deviceId());
+  for (const Zone &z : zones) {
+    if (!z.active) continue;
+    logf(LOG_INFO, "Zone %u relay pin: %d, inverted: %s", (unsigned)zoneIndex(z), z.relayPin, z.relayInverted ? "yes" : "no");
+  }
+
+#if HUM_BENCH
+  runBootBenchmarks();
+#endif
+
+  bool staOk = connectWiFiSta();
+  if (!staOk) {
+    logWriteLine(LOG_WARN, "[WiFi] STA not configured -> starting captive portal");
+    startCaptivePortal();
+    wifiSetState(WIFI_ST_PORTAL);
+  }
+
+#if HUM_SPLIT_TASKS
+  startTasks();
+#endif
+}
+
+void loop() {
+#if HUM_SPLIT_TASKS
+  // All work happens in the control/network tasks.
+  vTaskDelete(nullptr);
+#else
+  networkLoop();
+#endif
 }
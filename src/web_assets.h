@@ -0,0 +1,272 @@
+// Generated by scripts/build_web_assets.py from web/index.html - do not edit.
+#pragma once
+
+#include <Arduino.h>
+
+static constexpr const char *INDEX_HTML_ETAG = "\"ca7f11c9aca3bd06\"";
+static constexpr size_t INDEX_HTML_GZ_LEN = 4205;
+static const uint8_t INDEX_HTML_GZ[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x9d, 0x3b, 0x6b, 0x73, 0xdb, 0xb6,
+  0xb2, 0xdf, 0xfd, 0x2b, 0x10, 0xb6, 0xcd, 0x50, 0x37, 0x7a, 0xdb, 0xc9, 0xb8, 0x96, 0xe4, 0x33,
+  0x8e, 0xed, 0xd4, 0x39, 0xd7, 0xb1, 0x73, 0x6c, 0x77, 0x3a, 0xe7, 0xc4, 0x1e, 0x0d, 0x44, 0x42,
+  0x22, 0x6b, 0xbe, 0x4a, 0x80, 0xb2, 0xe4, 0x1c, 0xff, 0xf7, 0xbb, 0x0b, 0x80, 0x24, 0x28, 0x91,
+  0x8a, 0x6f, 0x3b, 0xe3, 0x48, 0x04, 0x76, 0x17, 0xbb, 0x8b, 0x7d, 0x53, 0x1d, 0xbf, 0x71, 0x63,
+  0x47, 0xac, 0x13, 0x46, 0x3c, 0x11, 0x06, 0xc7, 0x7b, 0xe3, 0xfc, 0x83, 0x51, 0x17, 0x3e, 0x42,
+  0x26, 0x28, 0x71, 0x3c, 0x9a, 0x72, 0x26, 0x26, 0x56, 0x26, 0xe6, 0x9d, 0x43, 0x2b, 0x5f, 0x8e,
+  0x68, 0xc8, 0x26, 0xd6, 0xd2, 0x67, 0x4f, 0x49, 0x9c, 0x0a, 0x8b, 0x38, 0x71, 0x24, 0x58, 0x04,
+  0x60, 0x4f, 0xbe, 0x2b, 0xbc, 0x89, 0xcb, 0x96, 0xbe, 0xc3, 0x3a, 0xf2, 0xa1, 0xed, 0x47, 0xbe,
+  0xf0, 0x69, 0xd0, 0xe1, 0x0e, 0x0d, 0xd8, 0x64, 0x80, 0x34, 0x84, 0x2f, 0x02, 0x76, 0x7c, 0x91,
+  0x85, 0xbe, 0xeb, 0xcf, 0x7d, 0x96, 0x92, 0x5b, 0x26, 0xb2, 0x64, 0xdc, 0x53, 0xeb, 0x7b, 0x63,
+  0x2e, 0xd6, 0xf8, 0x39, 0x8b, 0xdd, 0xf5, 0xf7, 0x39, 0x90, 0xee, 0xcc, 0x69, 0xe8, 0x07, 0xeb,
+  0x23, 0x4e, 0x23, 0xde, 0xe1, 0x2c, 0xf5, 0xe7, 0xa3, 0x90, 0xa6, 0x0b, 0x3f, 0x3a, 0x1a, 0xb0,
+  0x10, 0xbe, 0xae, 0xd4, 0x51, 0x47, 0x07, 0x7d, 0x16, 0xbe, 0xec, 0xf9, 0x51, 0x92, 0x89, 0x36,
+  0x67, 0x01, 0x73, 0xc4, 0x77, 0x05, 0xd7, 0x99, 0xc5, 0x42, 0xc4, 0xe1, 0x51, 0xf7, 0x00, 0x01,
+  0x7e, 0x0a, 0xf9, 0x42, 0xd1, 0x7d, 0x62, 0xfe, 0xc2, 0x13, 0x47, 0xb3, 0x38, 0x70, 0x61, 0x19,
+  0x85, 0x15, 0xdf, 0x15, 0xa9, 0x41, 0xbf, 0xff, 0xcb, 0xc8, 0x53, 0xdb, 0x03, 0x20, 0x3b, 0x9a,
+  0xc5, 0xa9, 0xcb, 0xd2, 0xa3, 0x41, 0xb2, 0x22, 0x3c, 0x0e, 0x7c, 0x97, 0xfc, 0xe4, 0x38, 0xce,
+  0xcb, 0xde, 0xb8, 0xa7, 0x99, 0x1d, 0xf7, 0xb4, 0xde, 0x90, 0x6b, 0xd4, 0xe2, 0xb0, 0x46, 0x40,
+  0x58, 0xdc, 0x1b, 0xbb, 0xfe, 0xf2, 0xf8, 0x4c, 0x6a, 0xe8, 0x88, 0x8c, 0x67, 0xc4, 0x77, 0x27,
+  0x96, 0x52, 0x98, 0x75, 0x3c, 0xee, 0xcd, 0xe0, 0x0f, 0x01, 0x14, 0xd8, 0x1f, 0xfe, 0x27, 0x9f,
+  0x84, 0xb1, 0x5b, 0x42, 0x3e, 0x01, 0xbd, 0x29, 0xae, 0x54, 0x81, 0x93, 0xe3, 0x31, 0x25, 0x5e,
+  0xca, 0xe6, 0x13, 0xab, 0x97, 0x25, 0x2e, 0x15, 0xb0, 0xff, 0xc9, 0x4f, 0xc3, 0x27, 0x9a, 0x32,
+  0xa2, 0x16, 0xc6, 0x3d, 0x0a, 0xe0, 0xc9, 0x06, 0x70, 0x10, 0x2f, 0xb8, 0x75, 0x7c, 0x09, 0xff,
+  0x1a, 0xfb, 0xf2, 0x24, 0x50, 0x92, 0xa5, 0x16, 0xf6, 0xc6, 0xf3, 0x38, 0x0d, 0xe5, 0xa2, 0x33,
+  0x5f, 0x58, 0x04, 0x4c, 0xc0, 0x8b, 0xe1, 0xe1, 0xeb, 0xf5, 0xed, 0x9d, 0x45, 0xa8, 0x23, 0xfc,
+  0x38, 0x02, 0x52, 0x9c, 0x2e, 0x19, 0xde, 0xae, 0xb7, 0x2f, 0xf9, 0x06, 0x69, 0xf7, 0x8f, 0xf7,
+  0x6e, 0x6f, 0x3f, 0x9f, 0x1d, 0x8d, 0x67, 0xe9, 0xf1, 0x58, 0x5e, 0x8b, 0xb6, 0x1c, 0x29, 0x05,
+  0xe7, 0xbe, 0x0b, 0xc4, 0xe8, 0x2a, 0x60, 0xd1, 0x02, 0xac, 0xc6, 0xda, 0x1f, 0xc2, 0x81, 0x00,
+  0xba, 0xf7, 0x95, 0x72, 0xfe, 0x04, 0xfa, 0x6e, 0x40, 0x4c, 0x60, 0xdb, 0x22, 0x68, 0xb9, 0x13,
+  0x2b, 0xd1, 0xa0, 0x15, 0x42, 0x1f, 0x0e, 0x34, 0xa1, 0x5b, 0x41, 0x85, 0xef, 0x90, 0xcf, 0x5f,
+  0x89, 0xcd, 0xc2, 0x44, 0xac, 0xc9, 0x84, 0x9c, 0x5d, 0x9c, 0x7e, 0x6d, 0x6d, 0x13, 0xf6, 0x93,
+  0x29, 0x75, 0xdd, 0xb4, 0x42, 0x66, 0xf0, 0x5e, 0x93, 0xf9, 0x0d, 0xd4, 0xf7, 0x44, 0xd7, 0xb5,
+  0x58, 0x8b, 0xa7, 0x7a, 0x9c, 0xdb, 0x6c, 0x16, 0x31, 0x01, 0x5b, 0xfc, 0xb1, 0x16, 0x0f, 0x37,
+  0xea, 0x31, 0xcf, 0xae, 0x6e, 0x4b, 0x76, 0x17, 0xea, 0xe8, 0x7a, 0x8e, 0xdd, 0x88, 0xd7, 0x93,
+  0x50, 0x97, 0xc0, 0x66, 0xe4, 0xc4, 0x71, 0x18, 0xe7, 0xea, 0x2a, 0x7e, 0x07, 0xcf, 0x41, 0xd4,
+  0x1a, 0xad, 0xb2, 0xd9, 0x34, 0x83, 0xdd, 0xfa, 0xdb, 0xb8, 0x62, 0x4f, 0x24, 0x57, 0x33, 0xb1,
+  0x03, 0x06, 0xd7, 0x4c, 0x66, 0x01, 0x8d, 0x1e, 0x89, 0x88, 0xc9, 0x23, 0x63, 0x49, 0xab, 0x9e,
+  0xe2, 0xeb, 0xaf, 0xe9, 0x34, 0x8e, 0xe6, 0x60, 0xac, 0x24, 0x32, 0x4e, 0x6a, 0xa6, 0x39, 0x7c,
+  0x1d, 0x51, 0xa9, 0x83, 0x2f, 0xff, 0xba, 0xbb, 0x53, 0xd2, 0x5f, 0xc4, 0x5c, 0x6c, 0xd3, 0x0c,
+  0xff, 0x12, 0x62, 0xea, 0xc1, 0x56, 0x3d, 0x8d, 0xaf, 0x10, 0xdd, 0x1a, 0x90, 0x54, 0xe0, 0x53,
+  0x8c, 0x44, 0x59, 0x38, 0x93, 0xda, 0xf3, 0xc1, 0x0f, 0x06, 0x92, 0x14, 0x10, 0x79, 0xff, 0x7e,
+  0x3f, 0xbf, 0x0f, 0x54, 0x7d, 0x03, 0x9d, 0x2d, 0xbd, 0x97, 0x87, 0x37, 0x6a, 0x42, 0x31, 0xf0,
+  0x6a, 0xf5, 0x9e, 0x04, 0x3c, 0x26, 0x49, 0x36, 0x0b, 0x7c, 0xee, 0x91, 0x7f, 0xde, 0x5e, 0x5f,
+  0x11, 0x0e, 0x7e, 0xc1, 0x48, 0x1c, 0x91, 0xb7, 0x81, 0x18, 0xcd, 0x28, 0x67, 0x6f, 0x17, 0x62,
+  0xd4, 0x93, 0xab, 0x10, 0x69, 0xd4, 0x51, 0x8a, 0xb2, 0xe3, 0x31, 0xe7, 0x71, 0x16, 0xaf, 0x2c,
+  0x7d, 0xb4, 0x84, 0x99, 0xfe, 0xc9, 0xe3, 0xc8, 0x22, 0x4b, 0x1a, 0x64, 0x0c, 0x05, 0x56, 0xc7,
+  0xdc, 0x41, 0xc4, 0x85, 0xd0, 0x90, 0xae, 0xb7, 0x08, 0x8b, 0x62, 0x87, 0x2d, 0x19, 0xfc, 0x6b,
+  0x73, 0xe6, 0xb4, 0x49, 0x7f, 0x12, 0xcf, 0xe7, 0x35, 0xb6, 0x53, 0x40, 0x4f, 0x01, 0xac, 0x56,
+  0xc5, 0xfd, 0x1a, 0x15, 0xcb, 0xeb, 0xbe, 0x88, 0x43, 0x46, 0x4e, 0x20, 0xb0, 0x00, 0x9b, 0x91,
+  0x50, 0x17, 0x7f, 0x1e, 0xd1, 0x59, 0xc0, 0x08, 0x5a, 0x02, 0x39, 0xf3, 0xb9, 0x13, 0x23, 0x0b,
+  0x3f, 0x90, 0xd2, 0xa3, 0x53, 0x17, 0x40, 0xb7, 0x44, 0x2c, 0xf0, 0x49, 0x02, 0xe1, 0xd3, 0x5f,
+  0x6d, 0x33, 0x0f, 0x98, 0x6a, 0xab, 0xde, 0x97, 0x54, 0xdc, 0x97, 0xb0, 0xc4, 0x8f, 0xc8, 0xc5,
+  0x09, 0xb1, 0xe3, 0x04, 0xe3, 0x27, 0x0d, 0x5a, 0xb5, 0xc4, 0xf0, 0x4b, 0xfd, 0xad, 0x62, 0x18,
+  0x9f, 0x65, 0x90, 0xd6, 0x22, 0x2d, 0x04, 0xcf, 0x66, 0xa1, 0x2f, 0xac, 0xe3, 0x5b, 0x74, 0xd0,
+  0xb7, 0x34, 0x4c, 0x46, 0xe4, 0x86, 0xcd, 0xe2, 0x18, 0xf4, 0xa0, 0xe0, 0xf2, 0x68, 0x0e, 0x5a,
+  0xb9, 0x8b, 0x13, 0xdf, 0xd1, 0x71, 0xe1, 0x23, 0x5c, 0x13, 0xb8, 0x32, 0x2c, 0x6c, 0x73, 0x80,
+  0x57, 0x38, 0x95, 0x7b, 0xd5, 0x40, 0x33, 0x3c, 0xd4, 0x5c, 0x9c, 0xaf, 0x04, 0x46, 0x95, 0x80,
+  0x78, 0x32, 0xd9, 0x41, 0xcc, 0x92, 0xd0, 0x70, 0xc5, 0xd9, 0x8c, 0x3b, 0xa9, 0x3f, 0x63, 0x75,
+  0x37, 0x3c, 0x05, 0xe8, 0xa9, 0x1f, 0x35, 0xd3, 0x4c, 0xe9, 0x06, 0x41, 0x0e, 0x8a, 0x8a, 0x18,
+  0xb1, 0x14, 0xf5, 0x6f, 0x2a, 0x71, 0x3f, 0x58, 0x24, 0x81, 0xe4, 0x1a, 0xf8, 0x11, 0x6b, 0x43,
+  0x96, 0xc3, 0x78, 0xb4, 0xaf, 0x8f, 0x13, 0x6c, 0x25, 0x20, 0xf7, 0xe5, 0xa5, 0x0a, 0x9e, 0xc7,
+  0xe3, 0x2c, 0x85, 0x68, 0x68, 0x91, 0x34, 0x7e, 0xe2, 0x70, 0x27, 0x58, 0xb6, 0x04, 0xf0, 0xe5,
+  0xa0, 0x5f, 0xe1, 0x63, 0xf8, 0x1e, 0x4d, 0xaa, 0x97, 0x13, 0xd0, 0xd1, 0x9c, 0x89, 0x24, 0xf6,
+  0x23, 0xf1, 0x3a, 0xe9, 0xa0, 0x62, 0xda, 0x21, 0x9d, 0xb2, 0xc7, 0x57, 0x11, 0x62, 0x51, 0x33,
+  0x9d, 0x4f, 0x01, 0x83, 0xfc, 0x32, 0xcf, 0x93, 0xfc, 0x26, 0xbd, 0x36, 0x91, 0x29, 0xa4, 0xc1,
+  0xc7, 0xe6, 0x88, 0xbc, 0xf3, 0x62, 0x15, 0xf9, 0x34, 0x0e, 0x82, 0x18, 0xb0, 0x5c, 0x16, 0xd0,
+  0x75, 0xae, 0x63, 0xed, 0xbe, 0x9d, 0x83, 0xfd, 0x61, 0xbf, 0xdf, 0x48, 0x5c, 0xa2, 0xfc, 0xd0,
+  0x85, 0x25, 0x0d, 0xd3, 0x85, 0x21, 0x17, 0x08, 0x38, 0x55, 0x99, 0xe6, 0x0d, 0xd2, 0x20, 0x09,
+  0x78, 0x8a, 0xfd, 0xdb, 0xd7, 0xcf, 0xd7, 0x35, 0x67, 0xa5, 0xf2, 0x94, 0x04, 0xb5, 0xb4, 0xe3,
+  0x94, 0xfd, 0x7d, 0x7d, 0x84, 0x22, 0xe8, 0x47, 0xe0, 0xc3, 0x82, 0x41, 0x36, 0x1b, 0x4c, 0xae,
+  0xaf, 0x3a, 0x18, 0xa3, 0x2e, 0xaf, 0xff, 0x68, 0xa4, 0x0e, 0xe0, 0x15, 0x25, 0xe5, 0x21, 0xe7,
+  0x62, 0xcd, 0xc1, 0xf8, 0x19, 0x44, 0x1b, 0x62, 0xff, 0x72, 0x73, 0x51, 0xe7, 0xc0, 0x6b, 0xbe,
+  0x95, 0x24, 0x00, 0x27, 0x01, 0xce, 0xba, 0x83, 0x32, 0xf9, 0xa1, 0xc0, 0xaa, 0xcc, 0x93, 0x14,
+  0x54, 0xe9, 0xaa, 0x49, 0x38, 0x6a, 0x5b, 0xd7, 0x7c, 0x7b, 0x63, 0x15, 0x2e, 0xf2, 0xc0, 0x04,
+  0xaa, 0xf3, 0x0a, 0x2e, 0xc6, 0x3d, 0xb5, 0x79, 0xbc, 0x01, 0x04, 0x27, 0x41, 0x4c, 0x72, 0x7d,
+  0x28, 0xd4, 0x20, 0x32, 0xd8, 0xfc, 0xc9, 0x17, 0x8e, 0x47, 0x18, 0x4d, 0x83, 0x35, 0x99, 0xad,
+  0x09, 0x64, 0xf4, 0x34, 0x02, 0x65, 0x60, 0x60, 0xe3, 0x1e, 0xc4, 0x8b, 0x56, 0x41, 0x08, 0xcb,
+  0x5b, 0xc9, 0x8c, 0x16, 0x38, 0x77, 0xc9, 0xb9, 0x1f, 0x88, 0x3c, 0xa3, 0x55, 0xb8, 0x55, 0x1b,
+  0xcd, 0xcc, 0x46, 0xe8, 0xc4, 0x36, 0xdc, 0x0d, 0xdc, 0x01, 0x00, 0xc2, 0x46, 0x6b, 0x07, 0xd7,
+  0x21, 0x30, 0x4d, 0xa3, 0x26, 0x00, 0x88, 0xa9, 0xe7, 0x5f, 0x4e, 0x9a, 0x76, 0xe1, 0xc6, 0x45,
+  0xea, 0x87, 0x40, 0x02, 0xea, 0x55, 0x83, 0x48, 0x93, 0x48, 0x26, 0x4f, 0xda, 0xc2, 0x95, 0x30,
+  0xc4, 0x42, 0xa6, 0x2d, 0x48, 0x6a, 0x41, 0x5d, 0x19, 0xa6, 0x22, 0x99, 0xd8, 0x61, 0xe8, 0xda,
+  0x9f, 0x14, 0xb1, 0x27, 0x3f, 0x72, 0xe3, 0x27, 0x38, 0x00, 0xe2, 0x73, 0xc0, 0x78, 0x9b, 0x0c,
+  0x3a, 0x83, 0xf7, 0x75, 0x3e, 0xa4, 0x14, 0xa9, 0xc0, 0x77, 0xd6, 0x19, 0x45, 0xd1, 0x07, 0xca,
+  0x20, 0x34, 0x48, 0x3c, 0x4a, 0xec, 0x7e, 0x67, 0xf0, 0xd0, 0x48, 0x53, 0xc2, 0x34, 0x59, 0x65,
+  0x7f, 0x90, 0xf3, 0xad, 0xbe, 0xca, 0x13, 0xf4, 0x01, 0x5f, 0xe8, 0x8a, 0xa4, 0xb2, 0x70, 0x98,
+  0x63, 0x63, 0x18, 0x2d, 0x98, 0xb4, 0xfb, 0x1e, 0xc0, 0x37, 0x67, 0x73, 0x7d, 0x28, 0xe2, 0x35,
+  0x7b, 0x42, 0x55, 0x55, 0xa7, 0x71, 0x38, 0x83, 0x90, 0x4e, 0x74, 0xc0, 0xae, 0x33, 0xb3, 0x8c,
+  0xc3, 0x5d, 0x36, 0x9b, 0x99, 0x4a, 0x0f, 0x70, 0xf5, 0x90, 0x0a, 0x53, 0xba, 0x60, 0xbb, 0x6c,
+  0x0c, 0xfa, 0xd3, 0x30, 0x0b, 0x77, 0x18, 0xd9, 0x86, 0x15, 0x6e, 0x18, 0xd0, 0xad, 0x64, 0x12,
+  0x2b, 0x2a, 0x08, 0xea, 0x74, 0x8e, 0x77, 0xac, 0xac, 0x67, 0xd0, 0xef, 0xec, 0x7f, 0xa8, 0x8d,
+  0x8f, 0x4a, 0xae, 0xa9, 0x44, 0x69, 0xb4, 0x9b, 0x41, 0x11, 0xbb, 0x3e, 0x14, 0x01, 0x52, 0x45,
+  0x2f, 0xb4, 0x54, 0xa8, 0xe1, 0x84, 0x1f, 0xb2, 0x22, 0x14, 0x37, 0x9c, 0x04, 0xa0, 0x53, 0xd0,
+  0xd3, 0x8f, 0x82, 0x70, 0xfd, 0x11, 0x9f, 0x3e, 0xbd, 0xfe, 0x8c, 0xf9, 0xfc, 0x6f, 0x1c, 0x02,
+  0xe6, 0xe4, 0x66, 0xe0, 0x7a, 0xf6, 0x2f, 0x68, 0x51, 0x34, 0x5a, 0x13, 0x0f, 0x34, 0x83, 0x9a,
+  0xeb, 0x4f, 0xa2, 0x18, 0xd2, 0x3a, 0x94, 0x33, 0x75, 0x07, 0xd2, 0xd5, 0x14, 0xf1, 0xa6, 0x89,
+  0xb3, 0xbb, 0x02, 0x1f, 0x54, 0x33, 0x8b, 0x2a, 0x2b, 0x9e, 0xc1, 0x99, 0x75, 0xe1, 0x73, 0x4e,
+  0x21, 0x0c, 0xe2, 0x33, 0x71, 0x53, 0x88, 0x8c, 0x9c, 0xe0, 0xd7, 0x30, 0x86, 0x64, 0x9a, 0xaa,
+  0x74, 0x07, 0x81, 0xd2, 0xcb, 0xcb, 0x8f, 0x2c, 0x82, 0xf6, 0xbf, 0x52, 0xd6, 0x22, 0x26, 0x3e,
+  0x5f, 0xc9, 0x1a, 0x97, 0xd8, 0x4e, 0xe8, 0xf6, 0x98, 0x4c, 0xee, 0x6e, 0x9b, 0xe0, 0x03, 0xd7,
+  0x45, 0x43, 0x5b, 0xd5, 0xdb, 0xbd, 0x6e, 0xb7, 0xdb, 0xea, 0xaa, 0xda, 0x0d, 0xba, 0x76, 0xd9,
+  0x4f, 0x4b, 0x6e, 0xac, 0xbc, 0x8d, 0x97, 0x6c, 0x5e, 0xc6, 0x0e, 0x44, 0x20, 0xce, 0x22, 0x1e,
+  0xa7, 0x8a, 0xcf, 0xff, 0x85, 0x1e, 0x8b, 0x13, 0x5f, 0x70, 0xc5, 0x6c, 0xca, 0x16, 0x59, 0x00,
+  0x7d, 0x6d, 0xb4, 0x90, 0x0c, 0x62, 0x7a, 0xc6, 0xe2, 0x76, 0x04, 0x1b, 0xd4, 0x85, 0x55, 0x4e,
+  0x16, 0x31, 0x11, 0x5e, 0x1a, 0x67, 0x0b, 0xe0, 0xde, 0x03, 0xdb, 0xc4, 0x6a, 0x53, 0x07, 0x33,
+  0xca, 0x55, 0x25, 0x9c, 0x57, 0x57, 0x8a, 0x9f, 0x3b, 0x50, 0x62, 0x8d, 0x9b, 0x29, 0x26, 0xa6,
+  0xa8, 0xe2, 0xc6, 0x68, 0xbe, 0xc3, 0xb5, 0x6e, 0x2f, 0xee, 0xf6, 0x57, 0xc4, 0xfe, 0x3c, 0x3c,
+  0x6d, 0xed, 0x70, 0xaf, 0x8f, 0x5f, 0xce, 0x87, 0x87, 0xfd, 0xdd, 0x60, 0x10, 0xcc, 0xcf, 0x2e,
+  0xee, 0x86, 0x43, 0xd2, 0x23, 0x27, 0x5f, 0x86, 0xfb, 0xfd, 0x61, 0x13, 0xe0, 0x81, 0x04, 0x1c,
+  0x0c, 0x9a, 0xbc, 0xf5, 0x3f, 0x32, 0xff, 0xf4, 0x27, 0x21, 0xf5, 0xa3, 0x3a, 0xcf, 0x54, 0x02,
+  0x3f, 0xcb, 0x80, 0xbf, 0xcb, 0x96, 0xf3, 0x26, 0xff, 0xec, 0x04, 0x58, 0x82, 0x13, 0x89, 0x4b,
+  0x05, 0xdd, 0x59, 0xa8, 0x68, 0xd2, 0xdc, 0xa5, 0xbb, 0x29, 0xff, 0x9a, 0x93, 0x3e, 0xbd, 0x2c,
+  0xe9, 0xb5, 0x09, 0x68, 0xa7, 0x29, 0x03, 0xe5, 0x94, 0x9d, 0xe0, 0x75, 0x94, 0x91, 0x14, 0xce,
+  0x3a, 0x18, 0xe7, 0xa8, 0x0a, 0x97, 0xcd, 0x69, 0x16, 0x80, 0x91, 0xb2, 0xee, 0xa2, 0x4b, 0xfa,
+  0xab, 0x83, 0xf7, 0xcd, 0x67, 0x6c, 0x8d, 0x48, 0x0e, 0x0a, 0x8f, 0xa6, 0x6e, 0xa5, 0xb9, 0x1b,
+  0x36, 0x06, 0x3f, 0x45, 0x29, 0x4f, 0xb5, 0x8d, 0x61, 0x63, 0xb8, 0x1d, 0x36, 0xa4, 0x7b, 0x9c,
+  0xf9, 0x74, 0x11, 0x41, 0xc3, 0x5e, 0xb4, 0x2f, 0x97, 0xf1, 0x02, 0x4a, 0x98, 0x25, 0x0b, 0x6a,
+  0x0c, 0x38, 0x88, 0x17, 0x53, 0xb9, 0x57, 0x6b, 0xbe, 0xe7, 0x37, 0x37, 0xd7, 0x37, 0x3b, 0xec,
+  0xf7, 0x8f, 0x93, 0x9b, 0xab, 0x1d, 0x86, 0xfb, 0xf9, 0xea, 0xd3, 0xf5, 0x2e, 0x83, 0x3d, 0xff,
+  0xf8, 0xfb, 0x6f, 0x8d, 0x65, 0x07, 0x64, 0x4f, 0x19, 0x5d, 0xd1, 0x7b, 0x77, 0xb7, 0xc3, 0x98,
+  0x68, 0x7f, 0x18, 0x5c, 0x0f, 0x3f, 0x1c, 0x14, 0x6a, 0x92, 0xb4, 0xd5, 0x54, 0xae, 0x46, 0x25,
+  0x92, 0x1c, 0xec, 0x6e, 0x6b, 0x04, 0x24, 0xbe, 0x61, 0x10, 0xa9, 0x52, 0x15, 0x4f, 0x76, 0x48,
+  0xae, 0xda, 0x4a, 0xa2, 0xa6, 0x96, 0x8d, 0x22, 0x42, 0x13, 0x1e, 0x83, 0x3d, 0x60, 0x96, 0xff,
+  0x61, 0x4a, 0xf4, 0x14, 0xf0, 0xff, 0x2b, 0x1b, 0xfe, 0xed, 0x0e, 0x78, 0xdc, 0xc3, 0x79, 0xa6,
+  0xb4, 0xa7, 0x54, 0xcd, 0x2b, 0xff, 0x95, 0xf9, 0xce, 0x23, 0x71, 0xcc, 0xd6, 0xc3, 0x98, 0x79,
+  0x8a, 0xa0, 0x71, 0xe6, 0xa9, 0x51, 0x2c, 0x15, 0x59, 0x8e, 0x48, 0x55, 0xd7, 0x32, 0x8e, 0x1c,
+  0x6f, 0x1b, 0x1e, 0x46, 0x9f, 0x52, 0xbd, 0x15, 0xad, 0xe9, 0xee, 0x90, 0x66, 0x22, 0x0e, 0xa9,
+  0xbc, 0xc2, 0x0d, 0x9a, 0x3a, 0xc3, 0x58, 0x35, 0xf6, 0x7a, 0xdd, 0x68, 0xad, 0x70, 0x26, 0xa4,
+  0xf3, 0x86, 0x23, 0xef, 0x68, 0xba, 0x80, 0x56, 0xaf, 0xe8, 0xb7, 0x1b, 0x7a, 0x99, 0x3c, 0x9b,
+  0xed, 0xbe, 0x9f, 0xc3, 0xfe, 0x76, 0x87, 0xd3, 0x78, 0x4f, 0x27, 0x49, 0x12, 0xac, 0x7f, 0x74,
+  0x37, 0x38, 0xc3, 0xcd, 0xb8, 0x39, 0xcb, 0x71, 0x8b, 0x69, 0x38, 0x9f, 0x96, 0xea, 0xc0, 0x69,
+  0x78, 0x51, 0x5c, 0x18, 0x10, 0x32, 0x97, 0x6f, 0xee, 0x93, 0x8c, 0x43, 0x59, 0x68, 0x40, 0xc9,
+  0x67, 0x03, 0x6a, 0x43, 0x29, 0x06, 0x64, 0xa1, 0x87, 0x12, 0xf8, 0x34, 0x4b, 0x53, 0x16, 0xd5,
+  0x42, 0xe7, 0x4b, 0x06, 0xf4, 0x25, 0xe5, 0x86, 0xb6, 0x39, 0x63, 0x91, 0x01, 0x5f, 0xe5, 0xe2,
+  0x56, 0x57, 0xc0, 0xc6, 0xe9, 0x7a, 0x88, 0x61, 0x90, 0x33, 0xea, 0x85, 0x0a, 0x9b, 0xb8, 0x50,
+  0x91, 0x9b, 0xf2, 0x38, 0xaa, 0x28, 0x06, 0x17, 0x4c, 0x88, 0x38, 0x0e, 0x65, 0x1b, 0x1a, 0x18,
+  0x50, 0xf2, 0xd9, 0x00, 0x42, 0x3b, 0x37, 0x19, 0x2a, 0x2a, 0x18, 0xbd, 0x2f, 0x5f, 0x59, 0x7c,
+  0xfe, 0x6a, 0x40, 0xf8, 0x89, 0xb1, 0x8d, 0x91, 0xc5, 0xa4, 0xfe, 0x97, 0x30, 0x15, 0x09, 0x96,
+  0x22, 0xb5, 0x33, 0x3c, 0x20, 0x1e, 0xb1, 0x65, 0xb5, 0x33, 0x4f, 0x81, 0xa9, 0x8a, 0x7f, 0xb6,
+  0x8e, 0x0a, 0xed, 0x41, 0x65, 0x95, 0x0f, 0x66, 0x6c, 0x97, 0x72, 0x8f, 0xb9, 0xad, 0xb6, 0x2a,
+  0xde, 0xb0, 0x42, 0xb6, 0xb9, 0x47, 0x5d, 0x58, 0x52, 0x86, 0xc5, 0x97, 0x0b, 0xe5, 0xce, 0xf8,
+  0x96, 0xc7, 0x22, 0xf8, 0xf2, 0xea, 0x63, 0x0c, 0x16, 0xdb, 0x27, 0x7d, 0x32, 0x3c, 0x3c, 0xc4,
+  0xaa, 0xd3, 0xc2, 0xb1, 0x1e, 0x87, 0xbc, 0xc4, 0x4e, 0x78, 0x02, 0xfe, 0x71, 0x83, 0x1e, 0x38,
+  0x51, 0xfd, 0x1f, 0x3a, 0xcd, 0x72, 0x81, 0x86, 0x89, 0xf3, 0x95, 0x44, 0x1c, 0xef, 0x2d, 0x69,
+  0x4a, 0x7e, 0x26, 0x13, 0x32, 0xcf, 0x22, 0x19, 0x0e, 0x88, 0xed, 0xbb, 0x2d, 0xf2, 0x1d, 0xce,
+  0x17, 0x59, 0x1a, 0x11, 0x37, 0x76, 0xb2, 0x10, 0xac, 0xa2, 0x0b, 0x76, 0x74, 0x8e, 0x13, 0xcd,
+  0x48, 0x7c, 0x5c, 0x7f, 0x76, 0x11, 0x68, 0x44, 0x5e, 0x46, 0x7b, 0x05, 0x1a, 0xec, 0xdb, 0x99,
+  0x81, 0x38, 0x67, 0xd0, 0x9e, 0xdb, 0x59, 0x9b, 0x7c, 0x77, 0xa0, 0x40, 0x05, 0x23, 0x05, 0x06,
+  0x3a, 0x18, 0x1e, 0x99, 0xf5, 0xd2, 0xea, 0x42, 0x41, 0x17, 0xd9, 0xe5, 0x91, 0xa9, 0x81, 0x98,
+  0x76, 0x71, 0x2e, 0x6b, 0x23, 0x79, 0xfc, 0x2b, 0x4f, 0x80, 0xda, 0x2f, 0xb0, 0xd1, 0xaf, 0xda,
+  0xb2, 0x4e, 0x01, 0x94, 0x3d, 0x42, 0xe0, 0x99, 0xd8, 0x28, 0xc3, 0x23, 0x4e, 0x22, 0xcb, 0x75,
+  0x42, 0x70, 0x91, 0x05, 0x28, 0x19, 0xa0, 0x74, 0x99, 0xe2, 0x9d, 0x7f, 0x7b, 0x7c, 0x18, 0xc9,
+  0x6d, 0x7f, 0x4e, 0xec, 0x37, 0x2c, 0x68, 0xc9, 0xfb, 0xf0, 0xa3, 0x8c, 0x95, 0xcb, 0x2c, 0xe8,
+  0xca, 0x17, 0x8a, 0x93, 0xc9, 0x84, 0x94, 0x43, 0xd5, 0x16, 0x50, 0xeb, 0xca, 0x27, 0xe8, 0xc8,
+  0x26, 0xe4, 0xcd, 0x1b, 0x3c, 0x0c, 0xc9, 0xc1, 0x3a, 0x67, 0xb8, 0x29, 0xc3, 0x14, 0x6c, 0xe5,
+  0x1b, 0x40, 0xf0, 0x65, 0xef, 0x45, 0x6a, 0x18, 0x8d, 0xe0, 0x56, 0x8e, 0xab, 0x27, 0xe4, 0x3b,
+  0xa8, 0xcd, 0x90, 0x5d, 0xf1, 0x8b, 0x40, 0x1e, 0x6c, 0x5a, 0xd6, 0xc8, 0x94, 0xca, 0x87, 0xa5,
+  0xc1, 0x08, 0x3e, 0xc6, 0x13, 0xb2, 0x0f, 0x9f, 0xef, 0xde, 0x99, 0xe2, 0x3d, 0x23, 0xc2, 0xb3,
+  0x45, 0xde, 0x01, 0xc0, 0x3b, 0x62, 0x4d, 0x2d, 0x25, 0x83, 0x47, 0xde, 0xc1, 0xfa, 0x78, 0xee,
+  0xb3, 0xc0, 0x05, 0xcb, 0x3a, 0x1e, 0x07, 0x6c, 0xc1, 0x22, 0xf7, 0x58, 0x96, 0x8d, 0x05, 0xf4,
+  0xb8, 0xa7, 0x97, 0x61, 0x45, 0xa2, 0x11, 0x62, 0x5d, 0xd5, 0xbd, 0x58, 0xb9, 0xb7, 0x10, 0xe7,
+  0x19, 0x71, 0xf0, 0xf9, 0xde, 0x2c, 0x9d, 0xee, 0xad, 0xe1, 0xc1, 0xbd, 0x0a, 0x90, 0x06, 0x99,
+  0x8d, 0x81, 0x57, 0x9b, 0x74, 0x06, 0x13, 0xe9, 0x06, 0xb5, 0xb5, 0x81, 0x41, 0x1f, 0x50, 0xee,
+  0x75, 0x64, 0xbe, 0xd7, 0xa1, 0xf9, 0x5e, 0xc5, 0xe6, 0x7b, 0xab, 0x33, 0x50, 0x27, 0xc3, 0xd7,
+  0xfd, 0xfd, 0xa6, 0x33, 0x5f, 0x3b, 0x13, 0x33, 0xce, 0x04, 0x94, 0x0d, 0x91, 0xde, 0x6f, 0x53,
+  0xff, 0xe1, 0x90, 0xcc, 0x20, 0x88, 0xa3, 0xac, 0x1a, 0x29, 0x64, 0x3e, 0xb9, 0xc7, 0x84, 0x52,
+  0x43, 0xfe, 0xf5, 0x63, 0x67, 0xf3, 0xa0, 0x2c, 0xdc, 0xe0, 0x7c, 0x30, 0x3c, 0xd4, 0xc4, 0x21,
+  0x03, 0xe5, 0xd7, 0x6f, 0x29, 0x43, 0x24, 0xe4, 0x67, 0x5b, 0x77, 0x6a, 0xad, 0xae, 0x1f, 0x45,
+  0x2c, 0xbd, 0xb8, 0xfb, 0x72, 0x09, 0x16, 0xe4, 0x8d, 0xf6, 0x5e, 0x5a, 0xe0, 0x6f, 0x86, 0xa7,
+  0x85, 0xc2, 0x5e, 0x82, 0x97, 0x19, 0x5e, 0xb9, 0x94, 0xde, 0x10, 0x65, 0x41, 0x40, 0xfe, 0xfb,
+  0x5f, 0xfd, 0x84, 0xcd, 0xe4, 0xdc, 0xc7, 0xa1, 0xdb, 0x3f, 0xc0, 0x74, 0x7a, 0x27, 0x16, 0x39,
+  0x22, 0x57, 0x52, 0x5c, 0x7b, 0x09, 0x2e, 0x1e, 0x7f, 0xf2, 0x57, 0xcc, 0xb5, 0xdd, 0xaa, 0x17,
+  0xcb, 0x26, 0xd2, 0x9e, 0xfb, 0x29, 0x17, 0xca, 0x94, 0xf5, 0x01, 0x18, 0x3f, 0xac, 0x1e, 0x4d,
+  0x7c, 0xf5, 0x02, 0xc7, 0xda, 0x8a, 0x11, 0x3c, 0xb7, 0x7c, 0x10, 0x43, 0xbf, 0x69, 0x06, 0x18,
+  0xb6, 0x12, 0xa7, 0xea, 0xb5, 0x3d, 0x48, 0xc2, 0xbb, 0x6a, 0x63, 0x94, 0xc3, 0x95, 0xef, 0x99,
+  0xb7, 0x41, 0x8b, 0xbd, 0x02, 0xba, 0xcc, 0xc3, 0xdb, 0xd0, 0x7a, 0x07, 0x25, 0xfd, 0xf7, 0xf9,
+  0x2d, 0x4a, 0x6a, 0x5d, 0x5d, 0x5b, 0x06, 0xaa, 0x4a, 0xd0, 0x9b, 0x88, 0x36, 0xef, 0xaa, 0x40,
+  0x0e, 0x78, 0xd7, 0x57, 0x12, 0x0d, 0x4a, 0x18, 0x88, 0x25, 0xef, 0x8a, 0xad, 0xe9, 0x13, 0x8d,
+  0xd0, 0x62, 0x51, 0xa3, 0x06, 0xb4, 0x84, 0x25, 0xb6, 0xde, 0xb4, 0x6a, 0x10, 0xb6, 0x49, 0x5a,
+  0x2d, 0xab, 0x65, 0xb0, 0xa4, 0xaa, 0x81, 0x6d, 0x59, 0x14, 0x15, 0x35, 0x40, 0x65, 0x1c, 0xf1,
+  0x48, 0xfe, 0xd0, 0x96, 0x27, 0x7d, 0xa1, 0xc2, 0xeb, 0x42, 0xe7, 0x1d, 0xb9, 0xc5, 0x99, 0x6a,
+  0xfe, 0x02, 0x6d, 0xa2, 0x2c, 0x7d, 0xa5, 0xf5, 0x41, 0x27, 0x27, 0xc1, 0xb5, 0x11, 0xd7, 0x23,
+  0x05, 0x90, 0x08, 0xa7, 0x38, 0x10, 0xd1, 0xe8, 0x1f, 0x14, 0xb2, 0x1e, 0x54, 0xca, 0xc6, 0x3e,
+  0x90, 0x95, 0x04, 0x80, 0x98, 0xea, 0x2c, 0xea, 0x93, 0x4d, 0xf6, 0xd1, 0x36, 0x79, 0xb7, 0x1c,
+  0x4a, 0x0c, 0x4c, 0x89, 0x8b, 0x3a, 0xa5, 0x1e, 0xab, 0x4c, 0xb8, 0x15, 0xac, 0x7a, 0x2d, 0xe5,
+  0xc0, 0xb8, 0x3d, 0x0d, 0x79, 0x69, 0xff, 0xa5, 0xb1, 0x57, 0x44, 0xde, 0x84, 0xef, 0x61, 0x2e,
+  0x56, 0xd2, 0x72, 0x42, 0x17, 0x71, 0xd5, 0x58, 0x64, 0xd1, 0x52, 0x77, 0x35, 0xb8, 0x61, 0x40,
+  0xaa, 0xc2, 0x65, 0x1b, 0xd0, 0x1c, 0xa8, 0xe3, 0x11, 0x47, 0x24, 0xf5, 0xb9, 0x8a, 0xee, 0x4a,
+  0x56, 0x89, 0xd8, 0xc5, 0x45, 0x39, 0xb5, 0x84, 0x5e, 0x56, 0xb2, 0xa2, 0xc6, 0x9c, 0x2e, 0x73,
+  0xc0, 0xca, 0xca, 0xbb, 0x33, 0x51, 0xe4, 0x5e, 0x0d, 0x4e, 0x31, 0x58, 0xdf, 0x3a, 0xa4, 0xd8,
+  0xc9, 0x11, 0xda, 0x6a, 0xce, 0x54, 0x0f, 0x5d, 0x6e, 0x21, 0xb8, 0x79, 0xe5, 0xba, 0x28, 0xac,
+  0xf1, 0x21, 0xbd, 0x85, 0xa1, 0xe7, 0xdb, 0x43, 0xab, 0x1b, 0xd2, 0xc4, 0x08, 0x0c, 0xab, 0x3c,
+  0x30, 0x14, 0xb1, 0x64, 0xd5, 0x55, 0x71, 0x14, 0x58, 0x99, 0xe4, 0xc7, 0xaf, 0x2a, 0xb7, 0x8f,
+  0xee, 0xb4, 0xea, 0xd6, 0xdc, 0xac, 0x76, 0xbb, 0x0d, 0x2f, 0x28, 0x40, 0xcd, 0x4b, 0x2d, 0x9c,
+  0x0d, 0xea, 0x99, 0x3f, 0xc1, 0x18, 0x6d, 0x90, 0x1b, 0xdc, 0x10, 0x78, 0x94, 0xf6, 0x31, 0x2a,
+  0xd2, 0x34, 0x8f, 0xe4, 0x95, 0xa9, 0x5a, 0xb6, 0x62, 0xe3, 0xb2, 0xb8, 0xdd, 0xba, 0xdc, 0x08,
+  0x18, 0xe1, 0x91, 0xaa, 0x41, 0xd0, 0x57, 0x54, 0x09, 0x89, 0x2c, 0xc1, 0xaa, 0xfc, 0x8e, 0xae,
+  0x7e, 0x54, 0x6a, 0x36, 0xda, 0x94, 0xcd, 0xfa, 0xa5, 0x6d, 0xee, 0x0a, 0x16, 0x26, 0x0c, 0x6e,
+  0x34, 0x4b, 0x99, 0x02, 0xc8, 0xf3, 0xce, 0x7d, 0xd6, 0xef, 0xcf, 0xfa, 0xa7, 0x2a, 0xba, 0x44,
+  0xdd, 0xf8, 0xd1, 0x50, 0x41, 0x04, 0x77, 0x07, 0x19, 0x2f, 0x89, 0x23, 0x1c, 0xc7, 0xb5, 0x2c,
+  0x7d, 0xb3, 0x9a, 0x0d, 0x96, 0xa6, 0x71, 0xaa, 0x62, 0x87, 0xfa, 0x2a, 0xb1, 0x64, 0x8d, 0x69,
+  0x48, 0x98, 0xa7, 0x9b, 0xad, 0x0b, 0x95, 0x1b, 0xf5, 0xd7, 0xf9, 0xbc, 0x75, 0x9d, 0xcf, 0x5d,
+  0xf9, 0xa6, 0x59, 0x5a, 0x79, 0x2e, 0xd5, 0xf3, 0x96, 0xc8, 0xbd, 0x72, 0xcb, 0x8c, 0x0e, 0x92,
+  0x45, 0x15, 0x55, 0xa5, 0x98, 0xcf, 0x4d, 0x01, 0x59, 0x9f, 0x49, 0x10, 0xc4, 0x88, 0xf6, 0x5a,
+  0x1b, 0x58, 0xb9, 0x98, 0x2a, 0x78, 0xae, 0xb8, 0x6a, 0x61, 0x01, 0xa3, 0xdc, 0x02, 0x36, 0x35,
+  0x01, 0xed, 0xc3, 0xb6, 0x13, 0xfb, 0x89, 0xe9, 0xe9, 0xd8, 0x44, 0x6c, 0xc3, 0xe0, 0x32, 0xf2,
+  0x01, 0x0e, 0x1f, 0x41, 0x31, 0x0f, 0xc9, 0x09, 0x19, 0xc2, 0xf7, 0xfa, 0xc5, 0x82, 0x22, 0x52,
+  0x29, 0x31, 0xfb, 0x47, 0x84, 0xbf, 0xa8, 0xf5, 0x4d, 0x6d, 0x43, 0x6d, 0x89, 0x23, 0xe3, 0x0d,
+  0x8d, 0x97, 0xe8, 0xdf, 0x9e, 0x25, 0xfc, 0x03, 0x90, 0x79, 0x96, 0x35, 0x78, 0x51, 0x17, 0x1b,
+  0x49, 0xbb, 0x30, 0x6d, 0x59, 0x61, 0x03, 0xff, 0x38, 0x5e, 0x68, 0x15, 0x55, 0xb6, 0xa4, 0x30,
+  0xd2, 0x70, 0xaf, 0x63, 0xa0, 0x50, 0x3f, 0x92, 0x8d, 0xb1, 0x8a, 0xce, 0x3b, 0x0f, 0x07, 0x34,
+  0x2d, 0x98, 0x6e, 0x3e, 0x6c, 0x4b, 0x75, 0xff, 0xb9, 0xef, 0xe1, 0x7f, 0x71, 0x51, 0x79, 0x3f,
+  0x57, 0x0e, 0xc6, 0x9d, 0xaa, 0x3a, 0x95, 0x25, 0x95, 0xfb, 0xc0, 0x7e, 0x97, 0x26, 0x09, 0x54,
+  0xc1, 0xa7, 0x9e, 0x1f, 0xb8, 0x76, 0x5c, 0x50, 0x7d, 0x29, 0xbe, 0x61, 0xdb, 0xa1, 0xdf, 0x6e,
+  0xda, 0xb9, 0xc3, 0xef, 0x29, 0x80, 0x8d, 0xe6, 0xa4, 0x80, 0x2a, 0x2a, 0x7a, 0x2c, 0xd0, 0x4b,
+  0xc5, 0xd6, 0xab, 0x49, 0x31, 0x2f, 0xbb, 0x05, 0x54, 0x32, 0xe8, 0x42, 0x36, 0x3a, 0x39, 0x30,
+  0x34, 0x50, 0x2c, 0x9f, 0x17, 0x54, 0x0c, 0x73, 0x20, 0x0d, 0xa1, 0x6f, 0x95, 0xdd, 0x23, 0x02,
+  0xe4, 0xdf, 0x15, 0x7b, 0x0d, 0x27, 0x52, 0xd7, 0x3d, 0x5f, 0xc2, 0xe3, 0xa5, 0x0f, 0x45, 0x29,
+  0x14, 0x82, 0xb6, 0xa5, 0x5e, 0x84, 0x01, 0xad, 0x4a, 0x5f, 0xb2, 0x21, 0x3b, 0x71, 0x53, 0xfa,
+  0xa4, 0x07, 0x62, 0xba, 0x3f, 0x2b, 0x15, 0x50, 0xd9, 0xab, 0x2f, 0xec, 0xf4, 0x78, 0xec, 0x1f,
+  0xc8, 0x83, 0x8c, 0xcb, 0xbb, 0x14, 0x82, 0xae, 0xf6, 0x16, 0xdb, 0xe6, 0x89, 0x9c, 0x0a, 0xbe,
+  0x95, 0xe5, 0xf3, 0x3e, 0x74, 0xb7, 0x5b, 0x85, 0xa1, 0x67, 0xb6, 0x44, 0xf8, 0xab, 0x08, 0xac,
+  0x69, 0xbb, 0xc5, 0xab, 0x49, 0x0c, 0xbe, 0xb8, 0xda, 0x55, 0x55, 0x72, 0x9b, 0x04, 0x68, 0x5d,
+  0x10, 0xc6, 0xdb, 0xc4, 0xc3, 0xf6, 0x0a, 0x3e, 0xb1, 0xa9, 0xce, 0x5b, 0x2f, 0xdd, 0x19, 0x46,
+  0x28, 0xfe, 0xcf, 0xb6, 0xee, 0xb3, 0xab, 0x05, 0x33, 0x00, 0x6a, 0xe1, 0x46, 0xd2, 0x14, 0x88,
+  0xa2, 0xbf, 0x6d, 0xd7, 0x69, 0x69, 0xd7, 0xdf, 0xd2, 0x6f, 0xfd, 0x07, 0xe8, 0xea, 0xbf, 0x0d,
+  0x1e, 0x1e, 0x6a, 0x20, 0x97, 0x78, 0x1c, 0x1e, 0xbc, 0x24, 0x6f, 0x74, 0x36, 0xc2, 0x15, 0xc9,
+  0xaa, 0xcc, 0x43, 0x90, 0x82, 0xed, 0x20, 0x6e, 0x93, 0x25, 0xe8, 0x5d, 0xb2, 0xad, 0x56, 0xe9,
+  0xca, 0xf6, 0x7c, 0xb5, 0xfa, 0x52, 0xd8, 0x6c, 0xfe, 0x59, 0x62, 0xcf, 0x83, 0x38, 0x4e, 0x01,
+  0x9f, 0x74, 0xb0, 0xf2, 0x31, 0x08, 0x38, 0xcc, 0x0f, 0x80, 0x02, 0x28, 0x3b, 0xaf, 0x88, 0x50,
+  0x89, 0xab, 0xea, 0x3c, 0xc0, 0x68, 0x03, 0x70, 0xc4, 0xd0, 0x81, 0xdc, 0x80, 0x84, 0xe0, 0x0f,
+  0xb6, 0x3a, 0xd8, 0x9f, 0xbe, 0x94, 0xb8, 0xeb, 0x0a, 0xee, 0xd2, 0xc0, 0xb5, 0x41, 0xe7, 0xe4,
+  0x7f, 0x08, 0x1e, 0xd7, 0x01, 0x8e, 0x21, 0x97, 0xaa, 0xaf, 0x41, 0xdc, 0x2a, 0xbb, 0x85, 0x41,
+  0xab, 0x42, 0x0d, 0x82, 0xbc, 0x54, 0xb8, 0x34, 0x72, 0xe3, 0x8e, 0x9a, 0x14, 0xde, 0x46, 0x96,
+  0x72, 0x9d, 0xa3, 0x3e, 0xd3, 0x6f, 0xc3, 0x07, 0x72, 0x4c, 0x20, 0x65, 0xe3, 0x25, 0xcb, 0xbe,
+  0x38, 0xc5, 0x31, 0xe4, 0x4a, 0x37, 0x52, 0x2b, 0x14, 0x0f, 0x4c, 0x0d, 0x1a, 0xa9, 0x35, 0x76,
+  0x67, 0xf0, 0xa9, 0x7e, 0xfd, 0x0b, 0xcd, 0x14, 0x7c, 0x57, 0xbf, 0x9d, 0xc5, 0x87, 0x3e, 0x6e,
+  0xa1, 0x3f, 0xc0, 0xc3, 0x4f, 0x73, 0xe7, 0x57, 0x78, 0x8a, 0x13, 0xea, 0x40, 0x02, 0xd2, 0x94,
+  0xe4, 0x49, 0x92, 0x52, 0xef, 0xd8, 0x1a, 0x55, 0x58, 0xe8, 0x3f, 0x18, 0xb7, 0x8a, 0x22, 0x01,
+  0x1f, 0xf9, 0xc1, 0x6d, 0xc4, 0x5d, 0x4b, 0x20, 0x95, 0xab, 0x0a, 0x5c, 0x94, 0xb8, 0x0e, 0x70,
+  0x50, 0x05, 0xcc, 0x6f, 0xbb, 0x90, 0x2f, 0x89, 0x83, 0x35, 0xfe, 0x98, 0x88, 0xc8, 0x40, 0xc0,
+  0x35, 0x7b, 0x92, 0x9a, 0x94, 0x53, 0x0b, 0x81, 0x19, 0x4a, 0xb6, 0xa5, 0x69, 0xfc, 0x88, 0x6d,
+  0xe5, 0x4f, 0x87, 0x87, 0x87, 0xc5, 0x73, 0x07, 0xe7, 0x50, 0x34, 0x4d, 0x29, 0x4a, 0x07, 0xdd,
+  0x36, 0x59, 0x82, 0xd2, 0xe2, 0xb4, 0xc3, 0xe6, 0x73, 0xf8, 0xa2, 0xb0, 0xe5, 0x6f, 0xa1, 0xa1,
+  0x34, 0xe8, 0x28, 0x14, 0x43, 0xee, 0x1f, 0xb0, 0x22, 0x35, 0xb0, 0x93, 0x95, 0xfe, 0x07, 0xe7,
+  0x6f, 0x9f, 0x89, 0x11, 0x5f, 0x5e, 0xef, 0x50, 0xdf, 0xe9, 0x40, 0xde, 0x1c, 0xfe, 0x50, 0x9a,
+  0xfb, 0xcf, 0x48, 0x1e, 0x7b, 0x64, 0xc9, 0x87, 0x9e, 0x83, 0x20, 0xc6, 0xf1, 0x36, 0xde, 0xaf,
+  0x87, 0x0d, 0x78, 0xe0, 0x47, 0x25, 0x5e, 0x99, 0xe4, 0xeb, 0x42, 0x05, 0x70, 0x35, 0xda, 0x4e,
+  0x16, 0x49, 0xcc, 0x85, 0x9c, 0x64, 0x15, 0x33, 0xac, 0xb0, 0x26, 0x26, 0xeb, 0xf9, 0xb2, 0x19,
+  0x93, 0x59, 0x6e, 0xdc, 0xac, 0x9b, 0xa4, 0x0c, 0xc1, 0xcf, 0xd4, 0x7b, 0xaf, 0x3c, 0x33, 0xa9,
+  0xa9, 0x9b, 0x22, 0x28, 0x71, 0x20, 0x7d, 0xa8, 0xa1, 0x3f, 0xe4, 0x0a, 0x39, 0xf5, 0x6f, 0x13,
+  0xfc, 0x69, 0xf7, 0x91, 0xfc, 0x95, 0xea, 0xef, 0x37, 0x97, 0xb7, 0x8c, 0xa6, 0x8e, 0xf7, 0x95,
+  0xa6, 0x34, 0xe4, 0x36, 0xae, 0x7d, 0x02, 0xdc, 0x33, 0x2a, 0xa8, 0xe2, 0xaf, 0xf5, 0xd2, 0xd2,
+  0xd6, 0xb8, 0x7b, 0x64, 0x87, 0xaa, 0x50, 0x29, 0xa1, 0x01, 0x5c, 0xe8, 0x78, 0x8a, 0xbf, 0xc7,
+  0xde, 0x2c, 0x72, 0x44, 0x1e, 0x4e, 0xf3, 0xe1, 0x00, 0x0d, 0x38, 0xab, 0x10, 0x73, 0xa8, 0xa8,
+  0xf8, 0xf9, 0x0e, 0x62, 0xd6, 0x0d, 0xfb, 0x2b, 0x63, 0xd0, 0x51, 0xce, 0xa9, 0x0f, 0x99, 0xb2,
+  0x6b, 0xe5, 0x35, 0x8c, 0xba, 0x83, 0x32, 0x1b, 0x39, 0xf8, 0x73, 0xdd, 0xc5, 0x76, 0x3a, 0x71,
+  0xf2, 0xc4, 0x27, 0x53, 0xf0, 0x7c, 0x81, 0x29, 0xd8, 0xd1, 0xd9, 0x4e, 0xf1, 0x27, 0xd2, 0x8c,
+  0x69, 0x34, 0x23, 0xeb, 0xc1, 0xb6, 0xbc, 0xd7, 0x1c, 0xcb, 0x7c, 0xc6, 0x24, 0x87, 0xe8, 0x4c,
+  0x7c, 0xd6, 0x6f, 0x0c, 0x37, 0x84, 0xd9, 0x10, 0xbc, 0x4d, 0xde, 0x63, 0x9b, 0x51, 0xc5, 0x30,
+  0xce, 0x6a, 0x43, 0x1f, 0xad, 0x00, 0xc6, 0xbd, 0x7c, 0x90, 0x3b, 0xee, 0xe9, 0xdf, 0xec, 0xf7,
+  0xd4, 0xff, 0x01, 0xf1, 0x7f, 0xdc, 0x81, 0x15, 0xf1, 0x19, 0x31, 0x00, 0x00,
+};
@@ -0,0 +1,679 @@
+// Unit tests for lib/humidity_control, run on the host: pio test -e native
+
+#include <unity.h>
+
+#include <math.h>
+#include <string.h>
+
+#include "humidity_control.h"
+
+void setUp() {}
+void tearDown() {}
+
+static bool jsonField(const char *json, const char *key, char *out, size_t size) {
+  return jsonStringFieldRaw((const uint8_t *)json, strlen(json), key, out, size);
+}
+
+static bool fleet(const char *json, FleetAnnouncement &out) {
+  return parseFleetAnnouncement((const uint8_t *)json, strlen(json), out);
+}
+
+// ---- HumidityFilter ----
+
+static HumidityFilter filter(HumidityFilterMode mode, uint8_t window, float alpha, float maxRate) {
+  HumidityFilter f;
+  f.configure({mode, window, alpha, maxRate});
+  return f;
+}
+
+static void test_filter_median_drops_spike() {
+  HumidityFilter f = filter(FILTER_MEDIAN, 5, 0.3f, 0.0f);
+  TEST_ASSERT_FLOAT_IS_NAN(f.value());
+  const float samples[] = {50.0f, 51.0f, 90.0f, 52.0f, 53.0f};
+  for (uint8_t i = 0; i < 5; i++) TEST_ASSERT_TRUE(f.push(i * 10000U, samples[i]));
+  TEST_ASSERT_EQUAL(5, f.size());
+  TEST_ASSERT_EQUAL_FLOAT(52.0f, f.value());
+  // Even count: mean of the middle two.
+  f.reset();
+  f.push(0, 40.0f);
+  f.push(1000, 42.0f);
+  TEST_ASSERT_EQUAL_FLOAT(41.0f, f.value());
+}
+
+static void test_filter_trimmed_mean() {
+  HumidityFilter f = filter(FILTER_TRIMMED_MEAN, 8, 0.3f, 0.0f);
+  const float samples[] = {10.0f, 50.0f, 51.0f, 52.0f, 53.0f, 54.0f, 55.0f, 99.0f};
+  for (uint8_t i = 0; i < 8; i++) f.push(i * 1000U, samples[i]);
+  // Two dropped at each end: 51..54.
+  TEST_ASSERT_EQUAL_FLOAT(52.5f, f.value());
+}
+
+static void test_filter_ema() {
+  HumidityFilter f = filter(FILTER_EMA, 5, 0.5f, 0.0f);
+  f.push(0, 50.0f);
+  TEST_ASSERT_EQUAL_FLOAT(50.0f, f.value());
+  f.push(1000, 60.0f);
+  TEST_ASSERT_EQUAL_FLOAT(55.0f, f.value());
+  f.push(2000, 60.0f);
+  TEST_ASSERT_EQUAL_FLOAT(57.5f, f.value());
+}
+
+static void test_filter_rate_limit_then_step() {
+  HumidityFilter f = filter(FILTER_MEDIAN, 5, 0.3f, 1.0f);
+  TEST_ASSERT_TRUE(f.push(0, 50.0f));
+  TEST_ASSERT_TRUE(f.push(60000, 51.0f)); // exactly the allowed 1 %RH per minute
+  TEST_ASSERT_FALSE(f.push(120000, 80.0f));
+  TEST_ASSERT_FALSE(f.push(180000, 80.0f));
+  TEST_ASSERT_EQUAL_FLOAT(50.5f, f.value());
+  // The third rejection in a row is a real step: the filter restarts from it.
+  TEST_ASSERT_TRUE(f.push(240000, 80.0f));
+  TEST_ASSERT_EQUAL(1, f.size());
+  TEST_ASSERT_EQUAL_FLOAT(80.0f, f.value());
+  TEST_ASSERT_FALSE(f.push(250000, NAN));
+}
+
+static void test_filter_configure_clamps() {
+  HumidityFilter f = filter(FILTER_MEDIAN, 0, 0.0f, -1.0f);
+  f.push(0, 40.0f);
+  f.push(1000, 90.0f); // window 1, no rate limit
+  TEST_ASSERT_EQUAL(1, f.size());
+  TEST_ASSERT_EQUAL_FLOAT(90.0f, f.value());
+}
+
+// ---- fuseHumidity ----
+
+static void test_fuse_modes_and_staleness() {
+  const HumidityReading r[] = {
+      {40.0f, 90000, 1.0f},
+      {50.0f, 90000, 3.0f},
+      {NAN, 90000, 1.0f},  // nothing yet
+      {70.0f, 0, 1.0f},    // stale at now = 100000
+  };
+  uint8_t fresh = 0;
+  TEST_ASSERT_EQUAL_FLOAT(47.5f, fuseHumidity(r, 4, 100000, 60000, FUSION_AVERAGE, &fresh));
+  TEST_ASSERT_EQUAL(2, fresh);
+  TEST_ASSERT_EQUAL_FLOAT(40.0f, fuseHumidity(r, 4, 100000, 60000, FUSION_MIN));
+  TEST_ASSERT_EQUAL_FLOAT(45.0f, fuseHumidity(r, 4, 100000, 60000, FUSION_MEDIAN));
+  // A longer stale timeout lets the old source back in.
+  TEST_ASSERT_EQUAL_FLOAT(50.0f, fuseHumidity(r, 4, 100000, 200000, FUSION_MEDIAN, &fresh));
+  TEST_ASSERT_EQUAL(3, fresh);
+}
+
+static void test_fuse_weight_zero_and_none_fresh() {
+  const HumidityReading r[] = {{40.0f, 0, 0.0f}, {60.0f, 0, 1.0f}};
+  TEST_ASSERT_EQUAL_FLOAT(60.0f, fuseHumidity(r, 2, 1000, 60000, FUSION_MIN));
+  uint8_t fresh = 9;
+  TEST_ASSERT_FLOAT_IS_NAN(fuseHumidity(r, 2, 120000, 60000, FUSION_AVERAGE, &fresh));
+  TEST_ASSERT_EQUAL(0, fresh);
+}
+
+// ---- RelayGuard ----
+
+static void test_guard_min_on_off() {
+  RelayGuard g;
+  g.configure({60000, 30000, 0});
+  g.reset(0, false);
+  TEST_ASSERT_EQUAL(GATE_MIN_OFF, g.gate(1000, true)); // a reboot counts as a switch
+  TEST_ASSERT_EQUAL(29000, g.nextWakeMs(1000, 600000));
+  TEST_ASSERT_EQUAL(GATE_PASS, g.gate(30000, true));
+  TEST_ASSERT_EQUAL(GATE_PASS, g.gate(1000, false));
+
+  g.switched(30000, true);
+  TEST_ASSERT_EQUAL(1, g.switches());
+  TEST_ASSERT_EQUAL(GATE_MIN_ON, g.gate(40000, false));
+  TEST_ASSERT_EQUAL(GATE_PASS, g.gate(40000, true));
+  TEST_ASSERT_EQUAL(50000, g.nextWakeMs(40000, 600000));
+  TEST_ASSERT_EQUAL(5000, g.nextWakeMs(40000, 5000));
+  TEST_ASSERT_EQUAL(GATE_PASS, g.gate(90000, false));
+
+  g.switched(90000, true); // no change: not counted
+  TEST_ASSERT_EQUAL(1, g.switches());
+}
+
+static void test_guard_duty_budget() {
+  RelayGuard g;
+  g.configure({0, 0, 10}); // 6 minutes per hour
+  g.reset(0, true);
+  g.update(300000);
+  TEST_ASSERT_EQUAL(GATE_PASS, g.gate(300000, true));
+  TEST_ASSERT_EQUAL(60000, g.nextWakeMs(300000, 600000));
+  g.update(360000);
+  TEST_ASSERT_EQUAL(360000, g.onMsLastHour());
+  TEST_ASSERT_EQUAL(GATE_DUTY, g.gate(360000, true));
+
+  g.switched(360000, false);
+  TEST_ASSERT_EQUAL(360, g.onSeconds());
+  // The budget comes back when the first bucket drops out of the hour.
+  TEST_ASSERT_EQUAL(240000, g.nextWakeMs(360000, 600000));
+  g.update(DUTY_WINDOW_MS - 1);
+  TEST_ASSERT_EQUAL(GATE_DUTY, g.gate(DUTY_WINDOW_MS - 1, true));
+  g.update(DUTY_WINDOW_MS);
+  TEST_ASSERT_EQUAL(60000, g.onMsLastHour());
+  TEST_ASSERT_EQUAL(GATE_PASS, g.gate(DUTY_WINDOW_MS, true));
+}
+
+static void test_guard_wake_duty_spent_during_min_on() {
+  RelayGuard g;
+  g.configure({60000, 0, 1}); // 36 s of on-time per hour
+  g.reset(0, false);
+  g.switched(0, true);
+  // Wants OFF from 30 s on; the budget runs out at 36 s, the minimum run time at 60 s.
+  for (uint32_t now = 30000; now < 60000; now += 1000) {
+    g.update(now);
+    TEST_ASSERT_EQUAL(GATE_MIN_ON, g.gate(now, false));
+    const uint32_t wake = g.nextWakeMs(now, 600000);
+    TEST_ASSERT_TRUE(wake > 0);
+    TEST_ASSERT_TRUE(wake <= 60000 - now);
+    if (now >= 36000) TEST_ASSERT_EQUAL(60000 - now, wake);
+  }
+  g.update(60000);
+  TEST_ASSERT_EQUAL(GATE_PASS, g.gate(60000, false));
+  TEST_ASSERT_EQUAL(1, g.nextWakeMs(60000, 600000)); // goes OFF at the next evaluation
+}
+
+static void test_guard_long_gap_and_totals() {
+  RelayGuard g;
+  g.configure({0, 0, 50});
+  g.restoreTotals(7, 100);
+  g.reset(0, true);
+  g.update(3 * DUTY_WINDOW_MS); // not called for hours: all of it was on
+  // Every bucket full but the current one, which just started.
+  TEST_ASSERT_EQUAL(DUTY_WINDOW_MS - DUTY_BUCKET_MS, g.onMsLastHour());
+  TEST_ASSERT_EQUAL(100 + 3 * DUTY_WINDOW_MS / 1000, g.onSeconds());
+  TEST_ASSERT_EQUAL(7, g.switches());
+}
+
+// ---- HumidityPredictor ----
+
+static void test_predictor_learns_coasting() {
+  HumidityPredictor p;
+  TEST_ASSERT_FLOAT_IS_NAN(p.model().overshoot);
+
+  p.switched(0, false, 50.0f);
+  p.observe(60000, 51.0f);   // still rising after OFF
+  p.observe(90000, 50.9f);   // noise, not a turn yet
+  TEST_ASSERT_FLOAT_IS_NAN(p.model().overshoot);
+  p.observe(120000, 50.6f);  // turned
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 1.0f, p.model().overshoot);
+
+  // Peak 51.0 at 1 min to 48.0 at 5 min: 0.75 %RH/min decay.
+  p.switched(300000, true, 48.0f);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.75f, p.model().decayRate);
+  p.observe(360000, 47.2f);
+  p.observe(420000, 47.6f);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.8f, p.model().undershoot);
+
+  // A second cycle moves the value by PREDICTOR_ALPHA towards the new sample.
+  p.switched(600000, false, 52.0f);
+  p.observe(660000, 54.0f);
+  p.observe(720000, 53.0f);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 1.0f + PREDICTOR_ALPHA * (2.0f - 1.0f), p.model().overshoot);
+}
+
+static void test_predictive_shift_capped() {
+  const HumidityModel m = {NAN, NAN, 1.0f, 0.8f};
+  float on, off;
+  predictiveShift(m, 0.5f, on, off);
+  TEST_ASSERT_EQUAL_FLOAT(0.5f, on);
+  TEST_ASSERT_EQUAL_FLOAT(0.5f, off);
+  predictiveShift(m, 2.0f, on, off);
+  TEST_ASSERT_EQUAL_FLOAT(0.8f, on);
+  TEST_ASSERT_EQUAL_FLOAT(1.0f, off);
+  const HumidityModel empty = {NAN, NAN, NAN, NAN};
+  predictiveShift(empty, 2.0f, on, off);
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, on);
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, off);
+}
+
+// ---- HistoryRing ----
+
+static void test_history_varint_sizes_and_roundtrip() {
+  uint8_t buf[64];
+  HistoryRing ring;
+  ring.begin(buf, sizeof(buf));
+
+  ring.append({45.0f, 50.0f, false, true});
+  // Full record: 2-byte humidity varint, flags, 2-byte setpoint varint.
+  TEST_ASSERT_EQUAL(5, ring.bytesUsed());
+  for (int i = 0; i < 10; i++) ring.append({45.0f, 50.0f, false, true});
+  TEST_ASSERT_EQUAL(15, ring.bytesUsed()); // a steady room costs one byte per sample
+  ring.append({NAN, 50.0f, false, true});  // missing: flags change
+  ring.append({44.2f, 50.0f, false, true});
+  ring.append({44.2f, 55.5f, true, true});
+  ring.append({-3.0f, 55.5f, true, false});
+  TEST_ASSERT_EQUAL(15, ring.count());
+
+  HistoryRing::Reader r(ring);
+  HistorySample s;
+  for (int i = 0; i < 11; i++) {
+    TEST_ASSERT_TRUE(r.next(s));
+    TEST_ASSERT_EQUAL_FLOAT(45.0f, s.humidity);
+    TEST_ASSERT_EQUAL_FLOAT(50.0f, s.setpoint);
+    TEST_ASSERT_FALSE(s.relay);
+    TEST_ASSERT_TRUE(s.enabled);
+  }
+  TEST_ASSERT_TRUE(r.next(s));
+  TEST_ASSERT_FLOAT_IS_NAN(s.humidity);
+  TEST_ASSERT_TRUE(r.next(s));
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 44.2f, s.humidity);
+  TEST_ASSERT_TRUE(r.next(s));
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 55.5f, s.setpoint);
+  TEST_ASSERT_TRUE(s.relay);
+  TEST_ASSERT_TRUE(r.next(s));
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, -3.0f, s.humidity);
+  TEST_ASSERT_FALSE(s.enabled);
+  TEST_ASSERT_FALSE(r.next(s));
+}
+
+static void test_history_evicts_oldest() {
+  uint8_t buf[16];
+  HistoryRing ring;
+  ring.begin(buf, sizeof(buf));
+  const int total = 40;
+  for (int i = 0; i < total; i++) ring.append({40.0f + (i % 7) * 0.1f, 50.0f, (i & 4) != 0, true});
+  TEST_ASSERT_TRUE(ring.bytesUsed() <= ring.capacity());
+  TEST_ASSERT_TRUE(ring.count() > 0 && ring.count() < (uint32_t)total);
+
+  // Whatever is left reads back as the newest samples, in order.
+  HistoryRing::Reader r(ring);
+  HistorySample s;
+  for (int i = total - (int)ring.count(); i < total; i++) {
+    TEST_ASSERT_TRUE(r.next(s));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 40.0f + (i % 7) * 0.1f, s.humidity);
+    TEST_ASSERT_EQUAL((i & 4) != 0, s.relay);
+  }
+  TEST_ASSERT_FALSE(r.next(s));
+
+  ring.clear();
+  TEST_ASSERT_EQUAL(0, ring.count());
+  TEST_ASSERT_EQUAL(0, ring.bytesUsed());
+}
+
+static void test_history_gap() {
+  uint8_t buf[64];
+  HistoryRing ring;
+  ring.begin(buf, sizeof(buf));
+  ring.append({45.0f, 50.0f, true, true});
+  HistorySample gap;
+  gap.gap = true;
+  ring.append(gap);
+  ring.append(gap);
+  ring.append({46.0f, 50.0f, true, true});
+
+  HistoryRing::Reader r(ring);
+  HistorySample s;
+  TEST_ASSERT_TRUE(r.next(s));
+  TEST_ASSERT_FALSE(s.gap);
+  for (int i = 0; i < 2; i++) {
+    TEST_ASSERT_TRUE(r.next(s));
+    TEST_ASSERT_TRUE(s.gap);
+    TEST_ASSERT_FLOAT_IS_NAN(s.humidity);
+    TEST_ASSERT_EQUAL_FLOAT(50.0f, s.setpoint); // the last known setpoint
+    TEST_ASSERT_FALSE(s.relay);
+  }
+  TEST_ASSERT_TRUE(r.next(s));
+  TEST_ASSERT_FALSE(s.gap);
+  TEST_ASSERT_EQUAL_FLOAT(46.0f, s.humidity);
+  TEST_ASSERT_TRUE(s.relay);
+  TEST_ASSERT_FALSE(r.next(s));
+}
+
+// ---- Sensor decoders ----
+
+static void test_sht3x_decode() {
+  const uint8_t word[] = {0xBE, 0xEF};
+  TEST_ASSERT_EQUAL_HEX8(0x92, sht3xCrc8(word, 2)); // datasheet example
+
+  uint8_t frame[6] = {0x66, 0x66, 0, 0x80, 0x00, 0};
+  frame[2] = sht3xCrc8(frame, 2);
+  frame[5] = sht3xCrc8(frame + 3, 2);
+  float h = 0, t = 0;
+  TEST_ASSERT_TRUE(sht3xDecode(frame, h, t));
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 25.0f, t);
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 50.0f, h);
+  frame[4] ^= 1;
+  TEST_ASSERT_FALSE(sht3xDecode(frame, h, t));
+}
+
+// Datasheet floating-point compensation, as an independent reference.
+static double bme280RefHumidity(const Bme280Calib &c, double tFine, int32_t adcH) {
+  double v = tFine - 76800.0;
+  v = (adcH - (c.h4 * 64.0 + c.h5 / 16384.0 * v)) *
+      (c.h2 / 65536.0 * (1.0 + c.h6 / 67108864.0 * v * (1.0 + c.h3 / 67108864.0 * v)));
+  v = v * (1.0 - c.h1 * v / 524288.0);
+  return v < 0 ? 0 : (v > 100 ? 100 : v);
+}
+
+static void test_bme280_decode() {
+  const uint16_t t1 = 27504;
+  const int16_t t2 = 26435, t3 = -1000, h2 = 362, h4 = 313, h5 = 50;
+  const uint8_t h1 = 75, h3 = 0;
+  const int8_t h6 = 30;
+
+  uint8_t r88[26] = {0};
+  r88[0] = t1 & 0xFF;
+  r88[1] = t1 >> 8;
+  r88[2] = (uint8_t)(t2 & 0xFF);
+  r88[3] = (uint8_t)((uint16_t)t2 >> 8);
+  r88[4] = (uint8_t)(t3 & 0xFF);
+  r88[5] = (uint8_t)((uint16_t)t3 >> 8);
+  r88[25] = h1;
+  const uint8_t rE1[7] = {(uint8_t)(h2 & 0xFF), (uint8_t)(h2 >> 8), h3, (uint8_t)(h4 >> 4),
+                          (uint8_t)((h4 & 0x0F) | ((h5 & 0x0F) << 4)), (uint8_t)(h5 >> 4), (uint8_t)h6};
+  Bme280Calib cal;
+  bme280ParseCalib(r88, rE1, cal);
+  TEST_ASSERT_EQUAL(t1, cal.t1);
+  TEST_ASSERT_EQUAL(t3, cal.t3);
+  TEST_ASSERT_EQUAL(h4, cal.h4);
+  TEST_ASSERT_EQUAL(h5, cal.h5);
+  TEST_ASSERT_EQUAL(h6, cal.h6);
+
+  // Datasheet temperature example: adc_T 519888 -> 25.08 degC (t_fine 128422).
+  const int32_t adcT = 519888, adcH = 30000;
+  const uint8_t frame[8] = {0x80, 0, 0, (uint8_t)(adcT >> 12), (uint8_t)(adcT >> 4), (uint8_t)((adcT & 0x0F) << 4),
+                            (uint8_t)(adcH >> 8), (uint8_t)(adcH & 0xFF)};
+  float h = 0, t = 0;
+  TEST_ASSERT_TRUE(bme280Decode(cal, frame, h, t));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 25.08f, t);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, (float)bme280RefHumidity(cal, 128422.0, adcH), h);
+
+  uint8_t skipped[8];
+  memcpy(skipped, frame, sizeof(skipped));
+  skipped[6] = 0x80; // humidity oversampling off
+  skipped[7] = 0x00;
+  TEST_ASSERT_FALSE(bme280Decode(cal, skipped, h, t));
+}
+
+static void test_dht_decode() {
+  float h = 0, t = 0;
+  const uint8_t dht22[5] = {0x02, 0x8C, 0x01, 0x5F, 0xEE};
+  TEST_ASSERT_TRUE(dhtDecode(dht22, false, h, t));
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 65.2f, h);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 35.1f, t);
+
+  const uint8_t negative[5] = {0x02, 0x8C, 0x80, 0x65, (uint8_t)(0x02 + 0x8C + 0x80 + 0x65)};
+  TEST_ASSERT_TRUE(dhtDecode(negative, false, h, t));
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, -10.1f, t);
+
+  const uint8_t dht11[5] = {55, 0, 23, 4, 82};
+  TEST_ASSERT_TRUE(dhtDecode(dht11, true, h, t));
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 55.0f, h);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 23.4f, t);
+
+  const uint8_t corrupt[5] = {0x02, 0x8C, 0x01, 0x5F, 0xEF};
+  TEST_ASSERT_FALSE(dhtDecode(corrupt, false, h, t));
+  const uint8_t tooWet[5] = {0x03, 0xE9, 0x00, 0x00, 0xEC}; // 100.1 %RH
+  TEST_ASSERT_FALSE(dhtDecode(tooWet, false, h, t));
+}
+
+static void test_dht_frame_from_pulses() {
+  const uint8_t want[5] = {0x02, 0x8C, 0x01, 0x5F, 0xEE};
+  uint16_t pulses[42];
+  pulses[0] = 30; // line released by the host
+  pulses[1] = 80; // sensor response
+  for (int i = 0; i < 40; i++) pulses[2 + i] = (want[i / 8] >> (7 - i % 8)) & 1 ? 70 : 27;
+  uint8_t frame[5];
+  TEST_ASSERT_TRUE(dhtFrameFromPulses(pulses, 42, frame));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(want, frame, 5);
+  TEST_ASSERT_TRUE(dhtFrameFromPulses(pulses + 2, 40, frame)); // response not captured
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(want, frame, 5);
+
+  TEST_ASSERT_FALSE(dhtFrameFromPulses(pulses + 3, 39, frame)); // a bit missing
+  pulses[20] = 200;                                              // stuck line
+  TEST_ASSERT_FALSE(dhtFrameFromPulses(pulses, 42, frame));
+}
+
+// ---- MQTT handshake ----
+
+static void test_mqtt_encode_connect() {
+  MqttConnectOptions opt = {"dev", nullptr, nullptr, "t/s", "0", 0, true, 15};
+  uint8_t buf[300];
+  static const uint8_t plain[] = {0x10, 23,  0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04, 0x26, 0x00, 15, 0x00,
+                                  3,    'd', 'e',  'v',  0,   3,   't', '/', 's',  0,    1,    '0'};
+  TEST_ASSERT_EQUAL(sizeof(plain), mqttEncodeConnect(opt, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(plain, buf, sizeof(plain));
+
+  opt.user = "u";
+  opt.pass = "p";
+  TEST_ASSERT_EQUAL(sizeof(plain) + 6, mqttEncodeConnect(opt, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_HEX8(29, buf[1]);
+  TEST_ASSERT_EQUAL_HEX8(0xE6, buf[9]);
+  static const uint8_t creds[] = {0, 1, 'u', 0, 1, 'p'};
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(creds, buf + sizeof(plain), sizeof(creds));
+
+  // Remaining length over 127 takes two bytes; a short buffer is refused.
+  char id[201];
+  memset(id, 'x', 200);
+  id[200] = '\0';
+  MqttConnectOptions bare = {id, nullptr, nullptr, nullptr, nullptr, 0, false, 60};
+  TEST_ASSERT_EQUAL(3 + 212, mqttEncodeConnect(bare, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_HEX8(0xD4, buf[1]);
+  TEST_ASSERT_EQUAL_HEX8(0x01, buf[2]);
+  TEST_ASSERT_EQUAL_HEX8(0x02, buf[10]);
+  TEST_ASSERT_EQUAL(0, mqttEncodeConnect(bare, buf, 100));
+
+  static const uint8_t accepted[] = {0x20, 0x02, 0x00, 0x00};
+  static const uint8_t refused[] = {0x20, 0x02, 0x00, 0x05};
+  static const uint8_t other[] = {0x30, 0x02, 0x00, 0x00};
+  TEST_ASSERT_EQUAL(0, mqttConnackCode(accepted));
+  TEST_ASSERT_EQUAL(5, mqttConnackCode(refused));
+  TEST_ASSERT_EQUAL(-1, mqttConnackCode(other));
+}
+
+// ---- JSON / fleet announcement ----
+
+static void test_json_string_field() {
+  char out[32];
+  TEST_ASSERT_TRUE(jsonField("{\"name\": \"x\", \"v\" : \"a\\\"b\\\\c\\/d\"}", "v", out, sizeof(out)));
+  TEST_ASSERT_EQUAL_STRING("a\"b\\c/d", out);
+  // The key also appears as a value before the real field.
+  TEST_ASSERT_TRUE(jsonField("{\"a\":\"url\",\"url\":\"http://x\"}", "url", out, sizeof(out)));
+  TEST_ASSERT_EQUAL_STRING("http://x", out);
+  TEST_ASSERT_TRUE(jsonField("{\"e\":\"\"}", "e", out, sizeof(out)));
+  TEST_ASSERT_EQUAL_STRING("", out);
+
+  TEST_ASSERT_FALSE(jsonField("{\"n\":5}", "n", out, sizeof(out)));
+  TEST_ASSERT_FALSE(jsonField("{\"n\":\"5\"}", "m", out, sizeof(out)));
+  TEST_ASSERT_FALSE(jsonField("{\"n\":\"a\\nb\"}", "n", out, sizeof(out)));
+  TEST_ASSERT_FALSE(jsonField("{\"n\":\"unterminated", "n", out, sizeof(out)));
+  TEST_ASSERT_FALSE(jsonField("{\"n\":\"abcd\"}", "n", out, 4));
+  TEST_ASSERT_TRUE(jsonField("{\"n\":\"abc\"}", "n", out, 4));
+}
+
+static void test_fleet_announcement() {
+  FleetAnnouncement a;
+  TEST_ASSERT_TRUE(fleet("{\"version\":\"1.4.0\",\"url\":\"https://h/fw.bin\","
+                         "\"sha256\":\"0123456789ABCDEF0123456789abcdef0123456789ABCDEF0123456789abcdef\"}",
+                         a));
+  TEST_ASSERT_EQUAL_STRING("1.4.0", a.version);
+  TEST_ASSERT_EQUAL_STRING("https://h/fw.bin", a.url);
+  TEST_ASSERT_EQUAL_STRING("0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef", a.sha256);
+
+  const char *sha = "\"sha256\":\"0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef\"}";
+  char doc[256];
+  snprintf(doc, sizeof(doc), "{\"version\":\"\",\"url\":\"http://h/fw\",%s", sha);
+  TEST_ASSERT_FALSE(fleet(doc, a));
+  snprintf(doc, sizeof(doc), "{\"version\":\"2\",\"url\":\"ftp://h/fw\",%s", sha);
+  TEST_ASSERT_FALSE(fleet(doc, a));
+  snprintf(doc, sizeof(doc), "{\"version\":\"2\",\"url\":\"http://h/fw\",%s", sha);
+  TEST_ASSERT_TRUE(fleet(doc, a));
+  TEST_ASSERT_FALSE(fleet("{\"version\":\"2\",\"url\":\"http://h/fw\",\"sha256\":\"0123\"}", a));
+  TEST_ASSERT_FALSE(fleet("{\"version\":\"2\",\"url\":\"http://h/fw\","
+                          "\"sha256\":\"g123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef\"}",
+                          a));
+  TEST_ASSERT_FALSE(fleet("{\"version\":\"2\",\"sha256\":\"0123\"}", a));
+}
+
+static void test_http_request_line() {
+  char line[] = "GET /api/history%3Fx?since=5&n=a%20b HTTP/1.1";
+  HttpRequestLine r;
+  TEST_ASSERT_TRUE(httpParseRequestLine(line, r));
+  TEST_ASSERT_EQUAL(HTTP_REQ_GET, r.method);
+  TEST_ASSERT_EQUAL_STRING("/api/history?x", r.path);
+  TEST_ASSERT_EQUAL_STRING("since=5&n=a%20b", r.query);
+  TEST_ASSERT_FALSE(r.http10);
+
+  char post[] = "POST /save HTTP/1.0";
+  TEST_ASSERT_TRUE(httpParseRequestLine(post, r));
+  TEST_ASSERT_EQUAL(HTTP_REQ_POST, r.method);
+  TEST_ASSERT_EQUAL_STRING("/save", r.path);
+  TEST_ASSERT_EQUAL_STRING("", r.query);
+  TEST_ASSERT_TRUE(r.http10);
+
+  char put[] = "PUT / HTTP/1.1";
+  TEST_ASSERT_TRUE(httpParseRequestLine(put, r));
+  TEST_ASSERT_EQUAL(HTTP_REQ_OTHER, r.method);
+
+  char noVersion[] = "GET /";
+  char absolute[] = "GET http://h/ HTTP/1.1";
+  char http2[] = "GET / HTTP/2";
+  TEST_ASSERT_FALSE(httpParseRequestLine(noVersion, r));
+  TEST_ASSERT_FALSE(httpParseRequestLine(absolute, r));
+  TEST_ASSERT_FALSE(httpParseRequestLine(http2, r));
+}
+
+static void test_http_args() {
+  char query[] = "a=1&&b=x+y%2Bz&flag&c=%zz&d=";
+  HttpArg args[4];
+  TEST_ASSERT_EQUAL(4, httpParseArgs(query, args, 0, 4));
+  TEST_ASSERT_EQUAL_STRING("a", args[0].name);
+  TEST_ASSERT_EQUAL_STRING("1", args[0].value);
+  TEST_ASSERT_EQUAL_STRING("x y+z", args[1].value);
+  TEST_ASSERT_EQUAL_STRING("flag", args[2].name);
+  TEST_ASSERT_EQUAL_STRING("", args[2].value);
+  TEST_ASSERT_EQUAL_STRING("%zz", args[3].value); // not an escape: kept as is
+
+  // A form body appends to the query fields.
+  char body[] = "e=5";
+  TEST_ASSERT_EQUAL(2, httpParseArgs(body, args, 1, 4));
+  TEST_ASSERT_EQUAL_STRING("e", args[1].name);
+}
+
+static void test_http_header_param() {
+  char out[16];
+  TEST_ASSERT_TRUE(httpHeaderParam("multipart/form-data; boundary=----abc", "boundary", out, sizeof(out)));
+  TEST_ASSERT_EQUAL_STRING("----abc", out);
+  const char *disposition = "form-data; name=\"a;filename=x\"; filename=\"fw \\\"1\\\".bin\"";
+  TEST_ASSERT_TRUE(httpHeaderParam(disposition, "name", out, sizeof(out)));
+  TEST_ASSERT_EQUAL_STRING("a;filename=x", out);
+  TEST_ASSERT_TRUE(httpHeaderParam(disposition, "FILENAME", out, sizeof(out)));
+  TEST_ASSERT_EQUAL_STRING("fw \"1\".bin", out);
+  TEST_ASSERT_FALSE(httpHeaderParam("form-data; name=\"file\"", "filename", out, sizeof(out)));
+
+  TEST_ASSERT_TRUE(httpHeaderHasToken("keep-alive, Upgrade", "keep-alive"));
+  TEST_ASSERT_TRUE(httpHeaderHasToken("Upgrade ,  Close ", "close"));
+  TEST_ASSERT_FALSE(httpHeaderHasToken("keep-alive-ish", "keep-alive"));
+  TEST_ASSERT_FALSE(httpHeaderHasToken("", "close"));
+
+  TEST_ASSERT_TRUE(httpAcceptsEncoding("gzip, deflate, br", "gzip"));
+  TEST_ASSERT_TRUE(httpAcceptsEncoding("br;q=1.0, GZIP ; q=0.5", "gzip"));
+  TEST_ASSERT_FALSE(httpAcceptsEncoding("gzip;q=0", "gzip"));
+  TEST_ASSERT_FALSE(httpAcceptsEncoding("deflate, gzip; q=0.000", "gzip"));
+  TEST_ASSERT_TRUE(httpAcceptsEncoding("gzip;q=0.001", "gzip"));
+  TEST_ASSERT_FALSE(httpAcceptsEncoding("x-gzip-foo, identity", "gzip"));
+  TEST_ASSERT_TRUE(httpAcceptsEncoding("identity, *", "gzip"));
+  TEST_ASSERT_FALSE(httpAcceptsEncoding("*;q=0", "gzip"));
+  TEST_ASSERT_FALSE(httpAcceptsEncoding("*, gzip;q=0", "gzip")); // the explicit entry wins
+  TEST_ASSERT_FALSE(httpAcceptsEncoding("", "gzip"));
+  TEST_ASSERT_FALSE(httpHeaderParam("form-data; filename=\"0123456789abcdef\"", "filename", out, sizeof(out)));
+}
+
+struct MultipartLog {
+  char text[256];
+  size_t len;
+};
+
+static void multipartLog(void *ctx, MultipartEvent event, const uint8_t *data, size_t n) {
+  MultipartLog &log = *static_cast<MultipartLog *>(ctx);
+  const char *mark = event == MULTIPART_PART_BEGIN ? "[" : event == MULTIPART_PART_END ? "]" : "";
+  for (const char *m = mark; *m; m++) log.text[log.len++] = *m;
+  memcpy(log.text + log.len, data, n);
+  log.len += n;
+  log.text[log.len] = '\0';
+}
+
+static void test_multipart_any_split() {
+  const char body[] =
+      "preamble\r\n"
+      "--XyZ\r\n"
+      "Content-Disposition: form-data; name=\"file\"; filename=\"fw.bin\"\r\n"
+      "Content-Type: application/octet-stream\r\n"
+      "\r\n"
+      "a\r\nb\r\n--X\r\r\n--XyQ\r\n"
+      "--XyZ\r\n"
+      "Content-Disposition: form-data; name=\"n\"\r\n"
+      "\r\n"
+      "v\r\n"
+      "--XyZ--\r\n"
+      "epilogue";
+  const size_t total = sizeof(body) - 1;
+  for (size_t step = 1; step <= total; step++) {
+    MultipartParser mp;
+    MultipartLog log = {};
+    TEST_ASSERT_TRUE(mp.begin("XyZ", multipartLog, &log));
+    for (size_t i = 0; i < total; i += step) {
+      const size_t n = total - i < step ? total - i : step;
+      TEST_ASSERT_TRUE(mp.feed(reinterpret_cast<const uint8_t *>(body) + i, n));
+    }
+    TEST_ASSERT_TRUE(mp.done());
+    TEST_ASSERT_EQUAL_STRING("[a\r\nb\r\n--X\r\r\n--XyQ][v]", log.text);
+    TEST_ASSERT_EQUAL_STRING("n", mp.name());
+    TEST_ASSERT_EQUAL_STRING("", mp.filename());
+  }
+}
+
+static void test_multipart_filename_and_failures() {
+  MultipartParser mp;
+  MultipartLog log = {};
+  const char head[] = "--b\r\nContent-Disposition: form-data; name=\"file\"; filename=\"x.bin\"\r\n\r\nda";
+  TEST_ASSERT_TRUE(mp.begin("b", multipartLog, &log));
+  TEST_ASSERT_TRUE(mp.feed(reinterpret_cast<const uint8_t *>(head), sizeof(head) - 1));
+  TEST_ASSERT_EQUAL_STRING("file", mp.name());
+  TEST_ASSERT_EQUAL_STRING("x.bin", mp.filename());
+  TEST_ASSERT_EQUAL_STRING("[da", log.text);
+  TEST_ASSERT_FALSE(mp.done()); // truncated body
+
+  const char bad[] = "--b junk\r\n";
+  TEST_ASSERT_TRUE(mp.begin("b", multipartLog, &log));
+  TEST_ASSERT_FALSE(mp.feed(reinterpret_cast<const uint8_t *>(bad), sizeof(bad) - 1));
+  TEST_ASSERT_FALSE(mp.feed(reinterpret_cast<const uint8_t *>(bad), 1));
+
+  char longBoundary[MULTIPART_BOUNDARY_MAX + 2];
+  memset(longBoundary, 'x', sizeof(longBoundary) - 1);
+  longBoundary[sizeof(longBoundary) - 1] = '\0';
+  TEST_ASSERT_FALSE(mp.begin(longBoundary, multipartLog, &log));
+  TEST_ASSERT_FALSE(mp.begin("", multipartLog, &log));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_filter_median_drops_spike);
+  RUN_TEST(test_filter_trimmed_mean);
+  RUN_TEST(test_filter_ema);
+  RUN_TEST(test_filter_rate_limit_then_step);
+  RUN_TEST(test_filter_configure_clamps);
+  RUN_TEST(test_fuse_modes_and_staleness);
+  RUN_TEST(test_fuse_weight_zero_and_none_fresh);
+  RUN_TEST(test_guard_min_on_off);
+  RUN_TEST(test_guard_duty_budget);
+  RUN_TEST(test_guard_wake_duty_spent_during_min_on);
+  RUN_TEST(test_guard_long_gap_and_totals);
+  RUN_TEST(test_predictor_learns_coasting);
+  RUN_TEST(test_predictive_shift_capped);
+  RUN_TEST(test_history_varint_sizes_and_roundtrip);
+  RUN_TEST(test_history_evicts_oldest);
+  RUN_TEST(test_history_gap);
+  RUN_TEST(test_sht3x_decode);
+  RUN_TEST(test_bme280_decode);
+  RUN_TEST(test_dht_decode);
+  RUN_TEST(test_dht_frame_from_pulses);
+  RUN_TEST(test_json_string_field);
+  RUN_TEST(test_fleet_announcement);
+  RUN_TEST(test_mqtt_encode_connect);
+  RUN_TEST(test_http_request_line);
+  RUN_TEST(test_http_args);
+  RUN_TEST(test_http_header_param);
+  RUN_TEST(test_multipart_any_split);
+  RUN_TEST(test_multipart_filename_and_failures);
+  return UNITY_END();
+}